@@ -27,6 +27,7 @@
 #include "xsane-front-gtk.h"
 #include "xsane-preferences.h"
 #include "xsane-gamma.h"
+#include "xsane-job.h"
 
 /* ----------------------------------------------------------------------------------------------------------------- */
 
@@ -667,6 +668,12 @@ gint xsane_back_gtk_decision(gchar *title, gchar **xpm_d,  gchar *message, gchar
 
   DBG(DBG_proc, "xsane_back_gtk_decision\n");
 
+  if (xsane_job_worker_thread()) /* the job thread does not open dialogs, the main thread shows the message when the job is done */
+  {
+    xsane_job_message(message);
+   return TRUE;
+  }
+
   if (wait)
   {
     decision_flag_ptr = &decision_flag;
@@ -809,7 +816,7 @@ void xsane_back_gtk_error(gchar *error, int wait)
 {
   DBG(DBG_proc, "xsane_back_gtk_error: %s\n", error);
 
-  if (wait)
+  if ((wait) && (!xsane_job_worker_thread())) /* the job thread must not change the sensitivity */
   {
    SANE_Int old_sensitivity = xsane.sensitivity;
 
@@ -829,7 +836,7 @@ void xsane_back_gtk_warning(gchar *warning, int wait)
 {
   DBG(DBG_proc, "xsane_back_gtk_warning: %s\n", warning);
 
-  if (wait)
+  if ((wait) && (!xsane_job_worker_thread()))
   {
    SANE_Int old_sensitivity = xsane.sensitivity;
 
@@ -849,7 +856,7 @@ void xsane_back_gtk_info(gchar *info, int wait)
 {
   DBG(DBG_proc, "xsane_back_gtk_info: %s\n", info);
 
-  if (wait)
+  if ((wait) && (!xsane_job_worker_thread()))
   {
    SANE_Int old_sensitivity = xsane.sensitivity;
 
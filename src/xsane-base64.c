@@ -0,0 +1,117 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-base64.c
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */ 
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+#include "xsane-base64.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* character base of base64 coding */
+static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static char base64_pairs[4096][2]; /* characters of all 12 bit values, looked up for 12 bits at once */
+static int base64_pairs_initialized = 0;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+size_t xsane_base64_encode(unsigned char *in, size_t len, char *out)
+/* encodes len bytes including the padding of the last group, returns the number of characters */
+{
+ char *start = out;
+ unsigned int val;
+ size_t i;
+
+  if (!base64_pairs_initialized)
+  {
+    for (val = 0; val < 4096; val++)
+    {
+      base64_pairs[val][0] = base64[val >> 6];
+      base64_pairs[val][1] = base64[val & 0x3F];
+    }
+    base64_pairs_initialized = 1;
+  }
+
+  for (i = 0; i + 3 <= len; i += 3)
+  {
+    val = (in[i] << 16) | (in[i+1] << 8) | in[i+2];
+
+    memcpy(out,     base64_pairs[val >> 12], 2);
+    memcpy(out + 2, base64_pairs[val & 0xFFF], 2);
+    out += 4;
+  }
+
+  if (i < len) /* one or two bytes left */
+  {
+    val = (in[i] << 16);
+
+    if (i + 1 < len)
+    {
+      val |= (in[i+1] << 8);
+    }
+
+    memcpy(out, base64_pairs[val >> 12], 2);
+    out[2] = (i + 1 < len) ? base64[(val >> 6) & 0x3F] : '='; /* char not used */
+    out[3] = '='; /* char not used */
+    out += 4;
+  }
+
+ return out - start;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+size_t xsane_base64_read_block(FILE *infile, unsigned char *in)
+/* reads XSANE_BASE64_BLOCK_SIZE bytes, a block that is not full is the end of the file */
+{
+ size_t len = 0;
+ size_t bytes;
+
+  while ((len < XSANE_BASE64_BLOCK_SIZE) && (bytes = fread(in + len, 1, XSANE_BASE64_BLOCK_SIZE - len, infile)) > 0)
+  {
+    len += bytes;
+  }
+
+ return len;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+size_t xsane_base64_encode_block(unsigned char *in, size_t len, char *out)
+/* encodes up to XSANE_BASE64_BLOCK_SIZE bytes into lines that end with CRLF, */
+/* out must hold XSANE_BASE64_BLOCK_CHARS characters, returns the number of characters */
+{
+ char *outptr = out;
+ size_t line;
+
+  for (line = 0; line < len; line += XSANE_BASE64_LINE_BYTES)
+  {
+    outptr += xsane_base64_encode(in + line, MIN(len - line, XSANE_BASE64_LINE_BYTES), outptr);
+    *outptr++ = '\r';
+    *outptr++ = '\n';
+  }
+
+ return outptr - out;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
@@ -0,0 +1,53 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-base64.h
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */ 
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifndef HAVE_XSANE_BASE64_H
+#define HAVE_XSANE_BASE64_H
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* Email attachments are encoded in blocks: each line of XSANE_BASE64_LINE_BYTES input bytes
+ * gives the 76 characters that are allowed in a MIME line, a block of XSANE_BASE64_BLOCK_LINES
+ * lines is written to the socket with one write call. The block size is a multiple of 3,
+ * so only the last block of a file is padded.
+ */
+
+#define XSANE_BASE64_LINE_BYTES 57				/* 76 characters per line */
+#define XSANE_BASE64_BLOCK_LINES 256				/* lines that are written at once */
+#define XSANE_BASE64_BLOCK_SIZE (XSANE_BASE64_LINE_BYTES * XSANE_BASE64_BLOCK_LINES)
+#define XSANE_BASE64_BLOCK_CHARS ((XSANE_BASE64_BLOCK_SIZE / 3) * 4 + 2 * XSANE_BASE64_BLOCK_LINES)
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+extern size_t xsane_base64_encode(unsigned char *in, size_t len, char *out);
+extern size_t xsane_base64_read_block(FILE *infile, unsigned char *in);
+extern size_t xsane_base64_encode_block(unsigned char *in, size_t len, char *out);
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+#endif
+/* ---------------------------------------------------------------------------------------------------------------------- */
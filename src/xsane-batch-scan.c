@@ -741,6 +741,55 @@ void xsane_batch_scan_add()
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
+/* adds one area for each object that is found in the preview, the skew angle is shown in the area name */
+static void xsane_batch_scan_add_objects(void)
+{
+ XsaneDetectObject objects[XSANE_DETECT_MAX_OBJECTS];
+ Batch_Scan_Parameters *parameters;
+ float coordinate[4];
+ char buf[TEXTBUFSIZE];
+ int count, i;
+
+  DBG(DBG_proc, "xsane_batch_scan_add_objects\n");
+
+  count = preview_detect_objects(xsane.preview, objects, XSANE_DETECT_MAX_OBJECTS);
+
+  if (count <= 0)
+  {
+    xsane_back_gtk_error(ERR_NO_OBJECTS_FOUND, TRUE);
+   return;
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    parameters = calloc(1, sizeof(Batch_Scan_Parameters));
+
+    if (!parameters)
+    {
+      break;
+    }
+
+    xsane_batch_scan_get_parameters(parameters);
+
+    preview_get_object_device_coordinate(xsane.preview, &objects[i], coordinate);
+    parameters->tl_x = coordinate[0];
+    parameters->tl_y = coordinate[1];
+    parameters->br_x = coordinate[2];
+    parameters->br_y = coordinate[3];
+
+    snprintf(buf, sizeof(buf), TEXT_BATCH_AREA_OBJECT_NAME, i + 1, objects[i].angle);
+    parameters->name = strdup(buf);
+
+    xsane_batch_scan_create_list_entry(parameters);
+  }
+
+  /* scroll list to end */
+  gtk_adjustment_set_value(xsane.batch_scan_vadjustment, xsane.batch_scan_vadjustment->upper);
+  gtk_adjustment_value_changed(xsane.batch_scan_vadjustment);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
 void xsane_batch_scan_update_label_list(void)
 {
  GtkObject *list_item;
@@ -994,6 +1043,7 @@ void xsane_create_batch_scan_dialog(const char *devicetext)
   xsane_vseparator_new(xsane.batch_scan_button_box, 3);
 
   xsane_button_new_with_pixmap(xsane.batch_scan_dialog->window, xsane.batch_scan_button_box, add_batch_xpm,   DESC_BATCH_ADD, (GtkSignalFunc) xsane_batch_scan_add,    NULL);
+  xsane_button_new_with_pixmap(xsane.batch_scan_dialog->window, xsane.batch_scan_button_box, auto_select_preview_area_xpm, DESC_BATCH_ADD_OBJECTS, (GtkSignalFunc) xsane_batch_scan_add_objects, NULL);
 
   xsane_vseparator_new(xsane.batch_scan_button_box, 3);
 
@@ -0,0 +1,703 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-cms.c
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+#include "xsane-back-gtk.h"
+#include "xsane-text.h"
+#include "xsane-cms.h"
+
+#ifdef HAVE_LIBPTHREAD
+# include <pthread.h>
+#endif
+
+#ifdef HAVE_LIBLCMS
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#define XSANE_CMS_CACHE_SIZE 8
+
+/* fractions of the interpolation are 15 bit values, so the weighted sum of 4 grid points fits into 32 bits */
+#define XSANE_CMS_FRACTION_ONE 32768
+
+#define XSANE_CMS_16_TO_8(v) ((((v) + 128) - (((v) + 128) >> 8)) >> 8)
+
+enum
+{
+  XSANE_CMS_LUT_NONE = 0,	/* transformation is done by lcms */
+  XSANE_CMS_LUT_GRAY,		/* lut has one 16 bit gray value per input value */
+  XSANE_CMS_LUT_RGB		/* lut has XSANE_CMS_GRID^3 16 bit rgb values */
+};
+
+struct XsaneCmsTransform
+{
+  XsaneCmsTransform *next;	/* next cache entry, most recently used first */
+  int references;		/* number of users, +1 while the transformation is in the cache */
+
+  char *input_profile;
+  char *output_profile;		/* NULL = sRGB or gray with gamma 2.2 */
+  char *proof_profile;		/* NULL = no proofing */
+  DWORD input_format;
+  DWORD output_format;
+  int intent;
+  int proofing_intent;
+  DWORD flags;
+
+  int lut_type;
+  guint16 *lut;
+  cmsHTRANSFORM transform;	/* used for XSANE_CMS_LUT_NONE */
+};
+
+static XsaneCmsTransform *xsane_cms_cache = NULL;
+
+#ifdef HAVE_LIBPTHREAD
+/* the cache is used by the gtk main thread and the job thread (xsane-job.c) */
+static pthread_mutex_t xsane_cms_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+# define XSANE_CMS_CACHE_LOCK()   pthread_mutex_lock(&xsane_cms_cache_mutex)
+# define XSANE_CMS_CACHE_UNLOCK() pthread_mutex_unlock(&xsane_cms_cache_mutex)
+#else
+# define XSANE_CMS_CACHE_LOCK()
+# define XSANE_CMS_CACHE_UNLOCK()
+#endif
+
+/* grid index (upper 16 bits) and fraction (lower 16 bits) for each 16 bit input value */
+static guint32 *xsane_cms_grid_position = NULL;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_cms_string_equal(const char *a, const char *b)
+{
+  if ((!a) || (!b))
+  {
+   return (a == b);
+  }
+
+ return (!strcmp(a, b));
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_cms_free(XsaneCmsTransform *transform)
+{
+  DBG(DBG_proc, "xsane_cms_free\n");
+
+  if (transform->transform)
+  {
+    cmsDeleteTransform(transform->transform);
+  }
+
+  if (transform->lut)
+  {
+    free(transform->lut);
+  }
+
+  if (transform->input_profile)
+  {
+    free(transform->input_profile);
+  }
+
+  if (transform->output_profile)
+  {
+    free(transform->output_profile);
+  }
+
+  if (transform->proof_profile)
+  {
+    free(transform->proof_profile);
+  }
+
+  free(transform);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_cms_unref(XsaneCmsTransform *transform)
+/* called with locked cache */
+{
+  if (!transform)
+  {
+    return;
+  }
+
+  transform->references--;
+
+  if (transform->references <= 0)
+  {
+    xsane_cms_free(transform);
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_cms_error(const char *profile_name, const char *profile)
+{
+ char buf[TEXTBUFSIZE];
+
+  if (profile_name)
+  {
+    snprintf(buf, sizeof(buf), "%s\n%s %s: %s\n", ERR_CMS_CONVERSION, ERR_CMS_OPEN_ICM_FILE, profile_name, profile);
+  }
+  else
+  {
+    snprintf(buf, sizeof(buf), "%s\n%s\n", ERR_CMS_CONVERSION, ERR_CMS_CREATE_TRANSFORM);
+  }
+
+  xsane_back_gtk_error(buf, TRUE);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static cmsHPROFILE xsane_cms_open_output_profile(const char *output_profile, DWORD output_format)
+{
+  if (output_profile)
+  {
+   return cmsOpenProfileFromFile(output_profile, "r");
+  }
+
+  if ((output_format == TYPE_GRAY_8) || (output_format == TYPE_GRAY_16))
+  {
+   LPGAMMATABLE Gamma = cmsBuildGamma(256, 2.2);
+   cmsHPROFILE hProfile;
+
+    hProfile = cmsCreateGrayProfile(cmsD50_xyY(), Gamma);
+    cmsFreeGamma(Gamma);
+   return hProfile;
+  }
+
+ return cmsCreate_sRGBProfile();
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* creates the lcms transformation of the profiles of transform for the given formats, shows an error message on failure */
+static cmsHTRANSFORM xsane_cms_create_transform(XsaneCmsTransform *transform, DWORD input_format, DWORD output_format)
+{
+ cmsHPROFILE hInProfile = NULL;
+ cmsHPROFILE hOutProfile = NULL;
+ cmsHPROFILE hProofProfile = NULL;
+ cmsHTRANSFORM hTransform = NULL;
+
+  DBG(DBG_proc, "xsane_cms_create_transform\n");
+
+  cmsErrorAction(LCMS_ERROR_SHOW);
+
+  hInProfile = cmsOpenProfileFromFile(transform->input_profile, "r");
+  if (!hInProfile)
+  {
+    xsane_cms_error(CMS_SCANNER_ICM, transform->input_profile);
+   return NULL;
+  }
+
+  hOutProfile = xsane_cms_open_output_profile(transform->output_profile, output_format);
+  if (!hOutProfile)
+  {
+    cmsCloseProfile(hInProfile);
+    xsane_cms_error(CMS_DISPLAY_ICM, transform->output_profile);
+   return NULL;
+  }
+
+  if (transform->proof_profile)
+  {
+    hProofProfile = cmsOpenProfileFromFile(transform->proof_profile, "r");
+    if (!hProofProfile)
+    {
+      cmsCloseProfile(hInProfile);
+      cmsCloseProfile(hOutProfile);
+      xsane_cms_error(CMS_PROOF_ICM, transform->proof_profile);
+     return NULL;
+    }
+
+    hTransform = cmsCreateProofingTransform(hInProfile, input_format,
+                                            hOutProfile, output_format,
+                                            hProofProfile,
+                                            transform->intent, transform->proofing_intent, transform->flags);
+    cmsCloseProfile(hProofProfile);
+  }
+  else
+  {
+    hTransform = cmsCreateTransform(hInProfile, input_format,
+                                    hOutProfile, output_format,
+                                    transform->intent, transform->flags);
+  }
+
+  cmsCloseProfile(hInProfile);
+  cmsCloseProfile(hOutProfile);
+
+  if (!hTransform)
+  {
+    xsane_cms_error(NULL, NULL);
+  }
+
+ return hTransform;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_cms_create_grid_position(void)
+{
+ guint32 position, index, fraction;
+ int i;
+
+  if (xsane_cms_grid_position)
+  {
+   return 0;
+  }
+
+  xsane_cms_grid_position = malloc(65536 * sizeof(guint32));
+  if (!xsane_cms_grid_position)
+  {
+   return -1;
+  }
+
+  for (i = 0; i < 65536; i++)
+  {
+    position = (guint32) i * (XSANE_CMS_GRID - 1);
+    index    = position / 65535;
+    fraction = ((position % 65535) * XSANE_CMS_FRACTION_ONE + 32767) / 65535;
+
+    if (index == XSANE_CMS_GRID - 1) /* 65535 is the last grid point */
+    {
+      index    = XSANE_CMS_GRID - 2;
+      fraction = XSANE_CMS_FRACTION_ONE;
+    }
+
+    xsane_cms_grid_position[i] = (index << 16) | fraction;
+  }
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* samples the transformation into transform->lut, returns -1 if the lut can not be used */
+static int xsane_cms_create_lut(XsaneCmsTransform *transform)
+{
+ cmsHTRANSFORM hTransform;
+ guint16 *grid;
+ int r, g, b, i;
+ int points = XSANE_CMS_GRID * XSANE_CMS_GRID * XSANE_CMS_GRID;
+
+  DBG(DBG_proc, "xsane_cms_create_lut\n");
+
+  if (transform->flags & cmsFLAGS_GAMUTCHECK) /* gamut alarm colors can not be interpolated */
+  {
+   return -1;
+  }
+
+  if ( ((transform->input_format  == TYPE_RGB_8) || (transform->input_format  == TYPE_RGB_16)) &&
+       ((transform->output_format == TYPE_RGB_8) || (transform->output_format == TYPE_RGB_16)) )
+  {
+    if (xsane_cms_create_grid_position())
+    {
+     return -1;
+    }
+
+    grid           = malloc(3 * points * sizeof(guint16));
+    transform->lut = malloc(3 * points * sizeof(guint16));
+
+    if ((!grid) || (!transform->lut))
+    {
+      free(grid);
+     return -1;
+    }
+
+    i = 0;
+    for (r = 0; r < XSANE_CMS_GRID; r++)
+    {
+      for (g = 0; g < XSANE_CMS_GRID; g++)
+      {
+        for (b = 0; b < XSANE_CMS_GRID; b++)
+        {
+          grid[i++] = (r * 65535 + (XSANE_CMS_GRID - 1) / 2) / (XSANE_CMS_GRID - 1);
+          grid[i++] = (g * 65535 + (XSANE_CMS_GRID - 1) / 2) / (XSANE_CMS_GRID - 1);
+          grid[i++] = (b * 65535 + (XSANE_CMS_GRID - 1) / 2) / (XSANE_CMS_GRID - 1);
+        }
+      }
+    }
+
+    hTransform = xsane_cms_create_transform(transform, TYPE_RGB_16, TYPE_RGB_16);
+    if (!hTransform)
+    {
+      free(grid);
+     return -1;
+    }
+
+    cmsDoTransform(hTransform, grid, transform->lut, points);
+    cmsDeleteTransform(hTransform);
+    free(grid);
+
+    transform->lut_type = XSANE_CMS_LUT_RGB;
+   return 0;
+  }
+
+  if ( ((transform->input_format  == TYPE_GRAY_8) || (transform->input_format  == TYPE_GRAY_16)) &&
+       ((transform->output_format == TYPE_GRAY_8) || (transform->output_format == TYPE_GRAY_16)) )
+  {
+   int entries = (transform->input_format == TYPE_GRAY_8) ? 256 : 65536;
+
+    grid           = malloc(entries * sizeof(guint16));
+    transform->lut = malloc(entries * sizeof(guint16));
+
+    if ((!grid) || (!transform->lut))
+    {
+      free(grid);
+     return -1;
+    }
+
+    for (i = 0; i < entries; i++)
+    {
+      if (entries == 256)
+      {
+        ((u_char *) grid)[i] = i;
+      }
+      else
+      {
+        grid[i] = i;
+      }
+    }
+
+    hTransform = xsane_cms_create_transform(transform, transform->input_format, TYPE_GRAY_16);
+    if (!hTransform)
+    {
+      free(grid);
+     return -1;
+    }
+
+    cmsDoTransform(hTransform, grid, transform->lut, entries);
+    cmsDeleteTransform(hTransform);
+    free(grid);
+
+    transform->lut_type = XSANE_CMS_LUT_GRAY;
+   return 0;
+  }
+
+ return -1;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static XsaneCmsTransform *xsane_cms_cache_get(const char *input_profile, const char *output_profile, const char *proof_profile,
+                                              DWORD input_format, DWORD output_format,
+                                              int intent, int proofing_intent, DWORD flags)
+/* called with locked cache */
+{
+ XsaneCmsTransform *transform, **prev;
+ int entries;
+
+  DBG(DBG_proc, "xsane_cms_transform_get(%s, %s, %s)\n", input_profile, (output_profile) ? output_profile : "sRGB", (proof_profile) ? proof_profile : "-");
+
+  if (!proof_profile)
+  {
+    proofing_intent = 0;
+  }
+
+  entries = 0;
+  for (prev = &xsane_cms_cache; *prev; prev = &(*prev)->next)
+  {
+    transform = *prev;
+    entries++;
+
+    if ( (transform->input_format == input_format) && (transform->output_format == output_format) &&
+         (transform->intent == intent) && (transform->proofing_intent == proofing_intent) && (transform->flags == flags) &&
+         (xsane_cms_string_equal(transform->input_profile, input_profile)) &&
+         (xsane_cms_string_equal(transform->output_profile, output_profile)) &&
+         (xsane_cms_string_equal(transform->proof_profile, proof_profile)) )
+    {
+      DBG(DBG_info, "xsane_cms_transform_get: using cached transformation\n");
+
+      /* move to the front of the cache */
+      *prev = transform->next;
+      transform->next = xsane_cms_cache;
+      xsane_cms_cache = transform;
+
+      transform->references++;
+     return transform;
+    }
+  }
+
+  transform = calloc(1, sizeof(XsaneCmsTransform));
+  if (!transform)
+  {
+   return NULL;
+  }
+
+  transform->input_profile   = strdup(input_profile);
+  transform->output_profile  = (output_profile) ? strdup(output_profile) : NULL;
+  transform->proof_profile   = (proof_profile) ? strdup(proof_profile) : NULL;
+  transform->input_format    = input_format;
+  transform->output_format   = output_format;
+  transform->intent          = intent;
+  transform->proofing_intent = proofing_intent;
+  transform->flags           = flags;
+
+  if (xsane_cms_create_lut(transform))
+  {
+    if (transform->lut)
+    {
+      free(transform->lut);
+      transform->lut = NULL;
+    }
+
+    transform->lut_type  = XSANE_CMS_LUT_NONE;
+    transform->transform = xsane_cms_create_transform(transform, input_format, output_format);
+
+    if (!transform->transform)
+    {
+      xsane_cms_free(transform);
+     return NULL;
+    }
+  }
+
+  DBG(DBG_info, "xsane_cms_transform_get: created transformation with lut type %d\n", transform->lut_type);
+
+  /* the least recently used transformation leaves the cache, it is freed when its last user releases it */
+  if (entries >= XSANE_CMS_CACHE_SIZE)
+  {
+    for (prev = &xsane_cms_cache; (*prev)->next; prev = &(*prev)->next)
+    {
+    }
+
+    xsane_cms_unref(*prev);
+    *prev = NULL;
+  }
+
+  transform->references = 2; /* cache and caller */
+  transform->next = xsane_cms_cache;
+  xsane_cms_cache = transform;
+
+ return transform;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+XsaneCmsTransform *xsane_cms_transform_get(const char *input_profile, const char *output_profile, const char *proof_profile,
+                                           DWORD input_format, DWORD output_format,
+                                           int intent, int proofing_intent, DWORD flags)
+{
+ XsaneCmsTransform *transform;
+
+  XSANE_CMS_CACHE_LOCK();
+  transform = xsane_cms_cache_get(input_profile, output_profile, proof_profile, input_format, output_format, intent, proofing_intent, flags);
+  XSANE_CMS_CACHE_UNLOCK();
+
+ return transform;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_cms_transform_release(XsaneCmsTransform *transform)
+{
+  XSANE_CMS_CACHE_LOCK();
+  xsane_cms_unref(transform);
+  XSANE_CMS_CACHE_UNLOCK();
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_cms_apply_rgb_lut(XsaneCmsTransform *transform, void *in, void *out, unsigned int pixels)
+{
+ const int dr = 3 * XSANE_CMS_GRID * XSANE_CMS_GRID;
+ const int dg = 3 * XSANE_CMS_GRID;
+ const int db = 3;
+ u_char  *in8   = in;
+ guint16 *in16  = in;
+ u_char  *out8  = out;
+ guint16 *out16 = out;
+ int input_16  = (transform->input_format  == TYPE_RGB_16);
+ int output_16 = (transform->output_format == TYPE_RGB_16);
+ guint32 pr, pg, pb, fr, fg, fb;
+ guint32 w0, w1, w2, w3, value;
+ guint16 *c0, *c1, *c2, *c3;
+ unsigned int i;
+ int c;
+
+  for (i = 0; i < pixels; i++)
+  {
+    if (input_16)
+    {
+      pr = xsane_cms_grid_position[*in16++];
+      pg = xsane_cms_grid_position[*in16++];
+      pb = xsane_cms_grid_position[*in16++];
+    }
+    else
+    {
+      pr = xsane_cms_grid_position[(*in8++) * 257];
+      pg = xsane_cms_grid_position[(*in8++) * 257];
+      pb = xsane_cms_grid_position[(*in8++) * 257];
+    }
+
+    fr = pr & 0xffff;
+    fg = pg & 0xffff;
+    fb = pb & 0xffff;
+
+    c0 = transform->lut + (pr >> 16) * dr + (pg >> 16) * dg + (pb >> 16) * db;
+    c3 = c0 + dr + dg + db;
+
+    /* tetrahedral interpolation: the cube is split into 6 tetrahedrons along its diagonal */
+    if (fr >= fg)
+    {
+      if (fg >= fb) /* r >= g >= b */
+      {
+        c1 = c0 + dr;
+        c2 = c1 + dg;
+        w0 = XSANE_CMS_FRACTION_ONE - fr;
+        w1 = fr - fg;
+        w2 = fg - fb;
+        w3 = fb;
+      }
+      else if (fr >= fb) /* r >= b > g */
+      {
+        c1 = c0 + dr;
+        c2 = c1 + db;
+        w0 = XSANE_CMS_FRACTION_ONE - fr;
+        w1 = fr - fb;
+        w2 = fb - fg;
+        w3 = fg;
+      }
+      else /* b > r >= g */
+      {
+        c1 = c0 + db;
+        c2 = c1 + dr;
+        w0 = XSANE_CMS_FRACTION_ONE - fb;
+        w1 = fb - fr;
+        w2 = fr - fg;
+        w3 = fg;
+      }
+    }
+    else
+    {
+      if (fr >= fb) /* g > r >= b */
+      {
+        c1 = c0 + dg;
+        c2 = c1 + dr;
+        w0 = XSANE_CMS_FRACTION_ONE - fg;
+        w1 = fg - fr;
+        w2 = fr - fb;
+        w3 = fb;
+      }
+      else if (fg >= fb) /* g >= b > r */
+      {
+        c1 = c0 + dg;
+        c2 = c1 + db;
+        w0 = XSANE_CMS_FRACTION_ONE - fg;
+        w1 = fg - fb;
+        w2 = fb - fr;
+        w3 = fr;
+      }
+      else /* b > g > r */
+      {
+        c1 = c0 + db;
+        c2 = c1 + dg;
+        w0 = XSANE_CMS_FRACTION_ONE - fb;
+        w1 = fb - fg;
+        w2 = fg - fr;
+        w3 = fr;
+      }
+    }
+
+    for (c = 0; c < 3; c++)
+    {
+      value = (c0[c] * w0 + c1[c] * w1 + c2[c] * w2 + c3[c] * w3 + XSANE_CMS_FRACTION_ONE / 2) >> 15;
+
+      if (output_16)
+      {
+        *out16++ = value;
+      }
+      else
+      {
+        *out8++ = XSANE_CMS_16_TO_8(value);
+      }
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_cms_transform_apply(XsaneCmsTransform *transform, void *in, void *out, unsigned int pixels)
+{
+  switch (transform->lut_type)
+  {
+    case XSANE_CMS_LUT_RGB:
+      xsane_cms_apply_rgb_lut(transform, in, out, pixels);
+     break;
+
+    case XSANE_CMS_LUT_GRAY:
+    {
+     u_char  *in8   = in;
+     guint16 *in16  = in;
+     u_char  *out8  = out;
+     guint16 *out16 = out;
+     guint16 value;
+     unsigned int i;
+
+      for (i = 0; i < pixels; i++)
+      {
+        value = transform->lut[(transform->input_format == TYPE_GRAY_16) ? in16[i] : in8[i]];
+
+        if (transform->output_format == TYPE_GRAY_16)
+        {
+          out16[i] = value;
+        }
+        else
+        {
+          out8[i] = XSANE_CMS_16_TO_8(value);
+        }
+      }
+    }
+     break;
+
+    default:
+      cmsDoTransform(transform->transform, in, out, pixels);
+     break;
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_cms_cache_free(void)
+{
+ XsaneCmsTransform *transform;
+
+  DBG(DBG_proc, "xsane_cms_cache_free\n");
+
+  XSANE_CMS_CACHE_LOCK();
+
+  while (xsane_cms_cache)
+  {
+    transform = xsane_cms_cache;
+    xsane_cms_cache = transform->next;
+    xsane_cms_unref(transform);
+  }
+
+  if (xsane_cms_grid_position)
+  {
+    free(xsane_cms_grid_position);
+    xsane_cms_grid_position = NULL;
+  }
+
+  XSANE_CMS_CACHE_UNLOCK();
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#endif /* HAVE_LIBLCMS */
@@ -0,0 +1,61 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-cms.h
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifndef HAVE_XSANE_CMS_H
+#define HAVE_XSANE_CMS_H
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* Color transformations are created once per session for each combination of profiles, formats,
+ * intents and flags and are kept in a small cache, so preview, viewer and save do not read the
+ * icm files again for each correction. For rgb images the transformation is sampled into a
+ * 3D lut of XSANE_CMS_GRID^3 points that is applied with tetrahedral interpolation, for
+ * grayscale images into a table with one entry per input value. Transformations with gamut
+ * check and other formats are done by lcms.
+ * xsane_cms_transform_get returns a reference that has to be given back with xsane_cms_transform_release.
+ * The cache is locked, transformations can be used by the gtk main thread and the job thread.
+ */
+
+#define XSANE_CMS_GRID 33
+
+typedef struct XsaneCmsTransform XsaneCmsTransform;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifdef HAVE_LIBLCMS
+extern XsaneCmsTransform *xsane_cms_transform_get(const char *input_profile, const char *output_profile, const char *proof_profile,
+                                                  DWORD input_format, DWORD output_format,
+                                                  int intent, int proofing_intent, DWORD flags);
+extern void xsane_cms_transform_apply(XsaneCmsTransform *transform, void *in, void *out, unsigned int pixels);
+extern void xsane_cms_transform_release(XsaneCmsTransform *transform);
+extern void xsane_cms_cache_free(void);
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+#endif
+/* ---------------------------------------------------------------------------------------------------------------------- */
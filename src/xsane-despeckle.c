@@ -0,0 +1,423 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-despeckle.c
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */ 
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+#include "xsane-despeckle.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#define XSANE_DESPECKLE_COARSE_BITS_8 4
+#define XSANE_DESPECKLE_COARSE_BITS_16 8
+#define XSANE_DESPECKLE_SORT_RADIUS 1 /* smaller windows are sorted, the histograms only pay off for bigger ones */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+XsaneDespeckle *xsane_despeckle_new(Image_info *image_info, int radius, int bands)
+/* radius is the number of pixels on each side of the center, at most XSANE_DESPECKLE_MAX_RADIUS */
+{
+ XsaneDespeckle *despeckle;
+ int samples = image_info->image_width * image_info->channels;
+
+  DBG(DBG_proc, "xsane_despeckle_new(radius=%d, bands=%d)\n", radius, bands);
+
+  despeckle = calloc(1, sizeof(XsaneDespeckle));
+  if (!despeckle)
+  {
+   return NULL;
+  }
+
+  despeckle->image_info = image_info;
+  despeckle->radius     = radius;
+  despeckle->line_size  = samples;
+
+  if (image_info->depth > 8)
+  {
+    despeckle->line_size *= 2;
+  }
+
+  if (radius <= XSANE_DESPECKLE_SORT_RADIUS)
+  {
+   return despeckle; /* no histograms */
+  }
+
+  if (image_info->depth > 8)
+  {
+    despeckle->hist   = calloc((size_t) bands * 65536, sizeof(guint32));
+    despeckle->coarse = calloc((size_t) bands << (16 - XSANE_DESPECKLE_COARSE_BITS_16), sizeof(guint32));
+  }
+  else
+  {
+    despeckle->column_hist   = malloc((size_t) bands * samples * 256);
+    despeckle->column_coarse = malloc((size_t) bands * samples << (8 - XSANE_DESPECKLE_COARSE_BITS_8));
+    despeckle->hist          = malloc((size_t) bands * 256 * sizeof(guint32));
+    despeckle->coarse        = malloc(((size_t) bands << (8 - XSANE_DESPECKLE_COARSE_BITS_8)) * sizeof(guint32));
+  }
+
+  if (!despeckle->hist || !despeckle->coarse || ((image_info->depth <= 8) && (!despeckle->column_hist || !despeckle->column_coarse)))
+  {
+    DBG(DBG_error, "xsane_despeckle_new: out of memory\n");
+    xsane_despeckle_free(despeckle);
+   return NULL;
+  }
+
+ return despeckle;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_despeckle_free(XsaneDespeckle *despeckle)
+{
+  if (!despeckle)
+  {
+    return;
+  }
+
+  free(despeckle->column_hist);
+  free(despeckle->column_coarse);
+  free(despeckle->hist);
+  free(despeckle->coarse);
+  free(despeckle);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_despeckle_update_columns(XsaneDespeckle *despeckle, int band, unsigned char *line_ptr, int add)
+/* adds or subtracts line_ptr to/from the column histograms of band */
+{
+ int samples = despeckle->image_info->image_width * despeckle->image_info->channels;
+ guint8 *column_hist = despeckle->column_hist + (size_t) band * samples * 256;
+ guint8 *column_coarse = despeckle->column_coarse + ((size_t) band * samples << (8 - XSANE_DESPECKLE_COARSE_BITS_8));
+ int i;
+
+  for (i = 0; i < samples; i++)
+  {
+    if (add)
+    {
+      column_hist[(size_t) i * 256 + line_ptr[i]]++;
+      column_coarse[(i << (8 - XSANE_DESPECKLE_COARSE_BITS_8)) + (line_ptr[i] >> XSANE_DESPECKLE_COARSE_BITS_8)]++;
+    }
+    else
+    {
+      column_hist[(size_t) i * 256 + line_ptr[i]]--;
+      column_coarse[(i << (8 - XSANE_DESPECKLE_COARSE_BITS_8)) + (line_ptr[i] >> XSANE_DESPECKLE_COARSE_BITS_8)]--;
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_despeckle_median(guint32 *hist, guint32 *coarse, int fine_bits, int rank)
+/* returns the value with the given rank (0 = smallest) */
+{
+ int i, j;
+
+  for (i = 0; rank >= (int) coarse[i]; i++)
+  {
+    rank -= coarse[i];
+  }
+
+  hist += i << fine_bits;
+
+  for (j = 0; rank >= (int) hist[j]; j++)
+  {
+    rank -= hist[j];
+  }
+
+ return (i << fine_bits) + j;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_despeckle_line_8(XsaneDespeckle *despeckle, int band, int rows, unsigned char *out_line)
+{
+ int channels = despeckle->image_info->channels;
+ int width = despeckle->image_info->image_width;
+ int radius = despeckle->radius;
+ int coarse_bins = 1 << (8 - XSANE_DESPECKLE_COARSE_BITS_8);
+ guint8 *column_hist = despeckle->column_hist + (size_t) band * width * channels * 256;
+ guint8 *column_coarse = despeckle->column_coarse + (size_t) band * width * channels * coarse_bins;
+ guint32 *hist = despeckle->hist + band * 256;
+ guint32 *coarse = despeckle->coarse + band * coarse_bins;
+ guint8 *col, *col_coarse;
+ int x, c, b, count;
+
+  for (c = 0; c < channels; c++)
+  {
+    memset(hist, 0, 256 * sizeof(guint32));
+    memset(coarse, 0, coarse_bins * sizeof(guint32));
+
+    for (x = 0; (x <= radius) && (x < width); x++)
+    {
+      col = column_hist + (size_t) (x * channels + c) * 256;
+      col_coarse = column_coarse + (x * channels + c) * coarse_bins;
+
+      for (b = 0; b < 256; b++)
+      {
+        hist[b] += col[b];
+      }
+
+      for (b = 0; b < coarse_bins; b++)
+      {
+        coarse[b] += col_coarse[b];
+      }
+    }
+
+    for (x = 0; x < width; x++)
+    {
+      count = (MIN(x + radius, width - 1) - MAX(x - radius, 0) + 1) * rows;
+
+      out_line[x * channels + c] = xsane_despeckle_median(hist, coarse, XSANE_DESPECKLE_COARSE_BITS_8, count / 2);
+
+      if (x - radius >= 0) /* column leaves the window */
+      {
+        col = column_hist + (size_t) ((x - radius) * channels + c) * 256;
+        col_coarse = column_coarse + ((x - radius) * channels + c) * coarse_bins;
+
+        for (b = 0; b < 256; b++)
+        {
+          hist[b] -= col[b];
+        }
+
+        for (b = 0; b < coarse_bins; b++)
+        {
+          coarse[b] -= col_coarse[b];
+        }
+      }
+
+      if (x + radius + 1 < width) /* column enters the window */
+      {
+        col = column_hist + (size_t) ((x + radius + 1) * channels + c) * 256;
+        col_coarse = column_coarse + ((x + radius + 1) * channels + c) * coarse_bins;
+
+        for (b = 0; b < 256; b++)
+        {
+          hist[b] += col[b];
+        }
+
+        for (b = 0; b < coarse_bins; b++)
+        {
+          coarse[b] += col_coarse[b];
+        }
+      }
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_despeckle_line_sort(XsaneDespeckle *despeckle, unsigned char *in, int in_first_line, int ymin, int ymax, unsigned char *out_line)
+/* sorts the samples of the window by insertion, for radius <= XSANE_DESPECKLE_SORT_RADIUS */
+{
+ int channels = despeckle->image_info->channels;
+ int width = despeckle->image_info->image_width;
+ int radius = despeckle->radius;
+ int depth16 = (despeckle->image_info->depth > 8);
+ int window[(2 * XSANE_DESPECKLE_SORT_RADIUS + 1) * (2 * XSANE_DESPECKLE_SORT_RADIUS + 1)];
+ unsigned char *line_ptr;
+ int x, c, xx, xmin, xmax, line, count, val, i;
+
+  for (x = 0; x < width; x++)
+  {
+    xmin = MAX(x - radius, 0);
+    xmax = MIN(x + radius, width - 1);
+
+    for (c = 0; c < channels; c++)
+    {
+      count = 0;
+
+      for (line = ymin; line <= ymax; line++)
+      {
+        line_ptr = in + (size_t) (line - in_first_line) * despeckle->line_size;
+
+        for (xx = xmin; xx <= xmax; xx++)
+        {
+          if (depth16)
+          {
+            val = ((guint16 *) line_ptr)[xx * channels + c];
+          }
+          else
+          {
+            val = line_ptr[xx * channels + c];
+          }
+
+          for (i = count; (i > 0) && (window[i - 1] > val); i--)
+          {
+            window[i] = window[i - 1];
+          }
+          window[i] = val;
+          count++;
+        }
+      }
+
+      if (depth16)
+      {
+        ((guint16 *) out_line)[x * channels + c] = window[count / 2];
+      }
+      else
+      {
+        out_line[x * channels + c] = window[count / 2];
+      }
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_despeckle_column_16(XsaneDespeckle *despeckle, unsigned char *in, int in_first_line, int ymin, int ymax, int sample,
+                                           guint32 *hist, guint32 *coarse, int add)
+/* adds or subtracts the samples of lines ymin..ymax to/from the window histogram */
+{
+ guint16 val;
+ int line;
+
+  for (line = ymin; line <= ymax; line++)
+  {
+    val = ((guint16 *) (in + (size_t) (line - in_first_line) * despeckle->line_size))[sample];
+
+    if (add)
+    {
+      hist[val]++;
+      coarse[val >> XSANE_DESPECKLE_COARSE_BITS_16]++;
+    }
+    else
+    {
+      hist[val]--;
+      coarse[val >> XSANE_DESPECKLE_COARSE_BITS_16]--;
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_despeckle_line_16(XsaneDespeckle *despeckle, int band, unsigned char *in, int in_first_line, int ymin, int ymax, guint16 *out_line)
+/* the window histogram of band is empty before and after the call */
+{
+ int channels = despeckle->image_info->channels;
+ int width = despeckle->image_info->image_width;
+ int radius = despeckle->radius;
+ guint32 *hist = despeckle->hist + band * 65536;
+ guint32 *coarse = despeckle->coarse + band * (1 << (16 - XSANE_DESPECKLE_COARSE_BITS_16));
+ int x, c, count;
+
+  for (c = 0; c < channels; c++)
+  {
+    for (x = 0; (x <= radius) && (x < width); x++)
+    {
+      xsane_despeckle_column_16(despeckle, in, in_first_line, ymin, ymax, x * channels + c, hist, coarse, TRUE);
+    }
+
+    for (x = 0; x < width; x++)
+    {
+      count = (MIN(x + radius, width - 1) - MAX(x - radius, 0) + 1) * (ymax - ymin + 1);
+
+      out_line[x * channels + c] = xsane_despeckle_median(hist, coarse, 16 - XSANE_DESPECKLE_COARSE_BITS_16, count / 2);
+
+      if (x - radius >= 0) /* column leaves the window */
+      {
+        xsane_despeckle_column_16(despeckle, in, in_first_line, ymin, ymax, (x - radius) * channels + c, hist, coarse, FALSE);
+      }
+
+      if (x + radius + 1 < width) /* column enters the window */
+      {
+        xsane_despeckle_column_16(despeckle, in, in_first_line, ymin, ymax, (x + radius + 1) * channels + c, hist, coarse, TRUE);
+      }
+    }
+
+    for (x = MAX(width - radius, 0); x < width; x++) /* empty the histogram for the next channel */
+    {
+      xsane_despeckle_column_16(despeckle, in, in_first_line, ymin, ymax, x * channels + c, hist, coarse, FALSE);
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_despeckle_lines(XsaneDespeckle *despeckle, int band, unsigned char *in, int in_first_line, unsigned char *out, int first_line, int end_line)
+/* calculates the lines first_line .. end_line-1 into out, input line n is stored at */
+/* in + (n - in_first_line) * line_size and has to be available for n = first_line-radius .. end_line-1+radius */
+/* (clipped to the image). each band of lines that is calculated at the same time needs its own band number */
+{
+ int height = despeckle->image_info->image_height;
+ int radius = despeckle->radius;
+ size_t line_size = despeckle->line_size;
+ int y, ymin, ymax;
+
+  if (radius <= XSANE_DESPECKLE_SORT_RADIUS)
+  {
+    for (y = first_line; y < end_line; y++)
+    {
+      xsane_despeckle_line_sort(despeckle, in, in_first_line, MAX(y - radius, 0), MIN(y + radius, height - 1), out);
+      out += line_size;
+    }
+   return;
+  }
+
+  if (despeckle->column_hist) /* 8 bit: column histograms of the window of first_line */
+  {
+   int samples = despeckle->image_info->image_width * despeckle->image_info->channels;
+
+    memset(despeckle->column_hist + (size_t) band * samples * 256, 0, (size_t) samples * 256);
+    memset(despeckle->column_coarse + ((size_t) band * samples << (8 - XSANE_DESPECKLE_COARSE_BITS_8)), 0, (size_t) samples << (8 - XSANE_DESPECKLE_COARSE_BITS_8));
+
+    for (y = MAX(first_line - radius, 0); y <= MIN(first_line + radius, height - 1); y++)
+    {
+      xsane_despeckle_update_columns(despeckle, band, in + (size_t) (y - in_first_line) * line_size, TRUE);
+    }
+  }
+
+  for (y = first_line; y < end_line; y++)
+  {
+    ymin = MAX(y - radius, 0);
+    ymax = MIN(y + radius, height - 1);
+
+    if (despeckle->column_hist)
+    {
+      xsane_despeckle_line_8(despeckle, band, ymax - ymin + 1, out);
+
+      if (y + 1 < end_line) /* move the window to line y+1 */
+      {
+        if (y - radius >= 0)
+        {
+          xsane_despeckle_update_columns(despeckle, band, in + (size_t) (y - radius - in_first_line) * line_size, FALSE);
+        }
+
+        if (y + radius + 1 < height)
+        {
+          xsane_despeckle_update_columns(despeckle, band, in + (size_t) (y + radius + 1 - in_first_line) * line_size, TRUE);
+        }
+      }
+    }
+    else
+    {
+      xsane_despeckle_line_16(despeckle, band, in, in_first_line, ymin, ymax, (guint16 *) out); /* machine byte order */
+    }
+
+    out += line_size;
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
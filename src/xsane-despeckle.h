@@ -0,0 +1,66 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-despeckle.h
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */ 
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifndef HAVE_XSANE_DESPECKLE_H
+#define HAVE_XSANE_DESPECKLE_H
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* The despeckle filter replaces each sample by the median of the (2*radius+1)^2 window
+ * (clipped at the image borders, the upper median is used for even counts).
+ * The median is taken from a sliding histogram of the window instead of sorting it:
+ * 8 bit images keep one histogram per sample column of the vertical window, so moving
+ * the window one pixel to the right adds and subtracts two column histograms (constant time).
+ * Column histograms with 65536 bins would be too big for 16 bit images, here the samples
+ * of the entering and leaving columns are added to / subtracted from the window histogram.
+ * Both histograms have a coarse level for a fast median search.
+ * The 3x3 window of radius 1 is faster sorted directly, no histograms are allocated for it.
+ */
+
+#define XSANE_DESPECKLE_MAX_RADIUS 127 /* column histograms count up to 2*radius+1 lines in 8 bits */
+
+typedef struct XsaneDespeckle
+{
+  Image_info *image_info;
+  int radius;
+  size_t line_size;
+  guint8 *column_hist;		/* 8 bit: 256 bins per sample column, one set per band */
+  guint8 *column_coarse;
+  guint32 *hist;		/* window histogram, one per band */
+  guint32 *coarse;
+} XsaneDespeckle;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+extern XsaneDespeckle *xsane_despeckle_new(Image_info *image_info, int radius, int bands);
+extern void xsane_despeckle_free(XsaneDespeckle *despeckle);
+extern void xsane_despeckle_lines(XsaneDespeckle *despeckle, int band, unsigned char *in, int in_first_line, unsigned char *out, int first_line, int end_line);
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+#endif
+/* ---------------------------------------------------------------------------------------------------------------------- */
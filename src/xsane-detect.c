@@ -0,0 +1,684 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-detect.c
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+#include "xsane-detect.h"
+
+/* the avx2 kernel is compiled with a function attribute and selected at runtime, */
+/* so xsane still runs on cpus without avx2 */
+#if defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))) && (defined(__x86_64__) || defined(__i386__))
+# define XSANE_DETECT_AVX2
+# include <immintrin.h>
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* a pixel belongs to an object when its luminance is below 200 on a white background */
+/* or above 55 on a black background (the luminance is inverted for a black background) */
+#define XSANE_DETECT_LIMIT 200
+
+/* objects that are smaller than 1/XSANE_DETECT_MIN_AREA of the preview are dust */
+#define XSANE_DETECT_MIN_AREA 500
+#define XSANE_DETECT_MIN_PIXELS 16
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  int y;
+  int x0;			/* first pixel of the run */
+  int x1;			/* first pixel behind the run */
+  int parent;			/* union find: the run with the smallest index is the root of an object */
+} XsaneDetectRun;
+
+typedef struct
+{
+  XsaneDetectObject object;
+  int group;			/* component this one has been merged into, itself if not merged, -1 = dust */
+  int *row_left;		/* for each line of the bounding box: first object pixel, first pixel behind the object */
+  int *row_right;
+} XsaneDetectComponent;
+
+static void (*xsane_detect_mask_function)(u_char *luminance, int width, int flip, guint32 *mask) = NULL;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_detect_luminance(u_char *rgb, u_char *luminance, int pixels)
+/* converts 8 bit rgb pixels to luminance with the ITU-R 601 weights */
+{
+ int i;
+
+  for (i = 0; i < pixels; i++)
+  {
+    luminance[i] = (77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2] + 128) >> 8;
+    rgb += 3;
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* sets bit x of mask when pixel x is an object pixel, flip is 0x00 for a white and 0xff for a black background */
+static void xsane_detect_mask_scalar(u_char *luminance, int width, int flip, guint32 *mask)
+{
+ int x;
+
+  memset(mask, 0, ((width + 31) / 32) * sizeof(guint32));
+
+  for (x = 0; x < width; x++)
+  {
+    mask[x >> 5] |= ((guint32) ((luminance[x] ^ flip) < XSANE_DETECT_LIMIT)) << (x & 31);
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifdef XSANE_DETECT_AVX2
+__attribute__((target("avx2")))
+static void xsane_detect_mask_avx2(u_char *luminance, int width, int flip, guint32 *mask)
+{
+ /* the unsigned compare (value ^ flip) < limit is done as signed compare with flipped sign bits */
+ __m256i flip_sign = _mm256_set1_epi8((char) (flip ^ 0x80));
+ __m256i limit     = _mm256_set1_epi8((char) (XSANE_DETECT_LIMIT ^ 0x80));
+ __m256i value;
+ int x;
+
+  for (x = 0; x + 32 <= width; x += 32)
+  {
+    value = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (luminance + x)), flip_sign);
+    mask[x >> 5] = (guint32) _mm256_movemask_epi8(_mm256_cmpgt_epi8(limit, value));
+  }
+
+  if (x < width)
+  {
+    xsane_detect_mask_scalar(luminance + x, width - x, flip, mask + (x >> 5));
+  }
+}
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_detect_ctz(guint32 word)
+/* returns the number of trailing zero bits, word must not be 0 */
+{
+#ifdef __GNUC__
+ return __builtin_ctz(word);
+#else
+ int bit = 0;
+
+  while (!(word & 1))
+  {
+    word >>= 1;
+    bit++;
+  }
+
+ return bit;
+#endif
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* returns the first pixel >= x whose mask bit is set (set = TRUE) or not set (set = FALSE), width if there is none */
+static int xsane_detect_next(guint32 *mask, int width, int x, int set)
+{
+ guint32 word;
+
+  while (x < width)
+  {
+    word = mask[x >> 5];
+
+    if (!set)
+    {
+      word = ~word;
+    }
+
+    word &= 0xffffffffU << (x & 31);
+
+    if (word)
+    {
+      x = (x & ~31) + xsane_detect_ctz(word);
+     return (x < width) ? x : width;
+    }
+
+    x = (x & ~31) + 32;
+  }
+
+ return width;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_detect_find(XsaneDetectRun *run, int i)
+{
+  while (run[i].parent != i)
+  {
+    run[i].parent = run[run[i].parent].parent; /* path halving */
+    i = run[i].parent;
+  }
+
+ return i;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_detect_union(XsaneDetectRun *run, int a, int b)
+{
+  a = xsane_detect_find(run, a);
+  b = xsane_detect_find(run, b);
+
+  if (a < b)
+  {
+    run[b].parent = a;
+  }
+  else if (b < a)
+  {
+    run[a].parent = b;
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_detect_group(XsaneDetectComponent *component, int c)
+{
+  while ((c >= 0) && (component[c].group != c))
+  {
+    c = component[c].group;
+  }
+
+ return c;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* returns the skew angle of the minimum area rectangle around the points x[i], y[i] that are sorted by y and x, */
+/* hull must have space for 2 * points indices */
+static double xsane_detect_skew(int *x, int *y, int points, int *hull)
+{
+ double ux, uy, len, s, t, smin, smax, tmin, tmax, area;
+ double best_area = -1.0;
+ double angle = 0.0;
+ int i, k, h, lower;
+
+  /* convex hull with the monotone chain algorithm, y is the primary axis */
+  h = 0;
+  for (i = 0; i < points; i++)
+  {
+    while ((h >= 2) && ((double) (y[hull[h-1]] - y[hull[h-2]]) * (x[i] - x[hull[h-2]]) -
+                        (double) (x[hull[h-1]] - x[hull[h-2]]) * (y[i] - y[hull[h-2]]) <= 0))
+    {
+      h--;
+    }
+    hull[h++] = i;
+  }
+
+  lower = h + 1;
+  for (i = points - 2; i >= 0; i--)
+  {
+    while ((h >= lower) && ((double) (y[hull[h-1]] - y[hull[h-2]]) * (x[i] - x[hull[h-2]]) -
+                            (double) (x[hull[h-1]] - x[hull[h-2]]) * (y[i] - y[hull[h-2]]) <= 0))
+    {
+      h--;
+    }
+    hull[h++] = i;
+  }
+
+  h--; /* the first point has been added again at the end */
+
+  if (h < 3)
+  {
+   return 0.0;
+  }
+
+  /* one side of the minimum area rectangle lies on an edge of the hull */
+  for (i = 0; i < h; i++)
+  {
+    ux  = x[hull[i+1]] - x[hull[i]];
+    uy  = y[hull[i+1]] - y[hull[i]];
+    len = sqrt(ux * ux + uy * uy);
+
+    if (len == 0.0)
+    {
+      continue;
+    }
+
+    ux /= len;
+    uy /= len;
+
+    smin = smax = tmin = tmax = 0.0;
+
+    for (k = 0; k < h; k++)
+    {
+      s =  ux * (x[hull[k]] - x[hull[i]]) + uy * (y[hull[k]] - y[hull[i]]);
+      t = -uy * (x[hull[k]] - x[hull[i]]) + ux * (y[hull[k]] - y[hull[i]]);
+
+      if (s < smin) smin = s;
+      if (s > smax) smax = s;
+      if (t < tmin) tmin = t;
+      if (t > tmax) tmax = t;
+    }
+
+    area = (smax - smin) * (tmax - tmin);
+
+    if ((best_area < 0.0) || (area < best_area))
+    {
+      best_area = area;
+      angle     = atan2(uy, ux) * 180.0 / M_PI;
+    }
+  }
+
+  while (angle > 45.0)
+  {
+    angle -= 90.0;
+  }
+
+  while (angle <= -45.0)
+  {
+    angle += 90.0;
+  }
+
+ return 0.0 - angle; /* y points down in the image, positive angle = counterclockwise on the screen */
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_detect_compare_size(const void *a, const void *b)
+{
+ return ((XsaneDetectObject *) b)->pixels - ((XsaneDetectObject *) a)->pixels;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_detect_compare_position(const void *a, const void *b)
+{
+ const XsaneDetectObject *oa = a;
+ const XsaneDetectObject *ob = b;
+
+  if (oa->top != ob->top)
+  {
+   return oa->top - ob->top;
+  }
+
+ return oa->left - ob->left;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_detect_objects(u_char *luminance, int width, int height, XsaneDetectObject *objects, int max_objects)
+/* detects the objects on the luminance plane, up to max_objects of the largest objects are returned */
+/* sorted from top to bottom, the number of returned objects is returned */
+{
+ XsaneDetectRun *run = NULL;
+ XsaneDetectRun *new_run;
+ XsaneDetectComponent *component = NULL;
+ XsaneDetectObject *found = NULL;
+ XsaneDetectObject *o;
+ guint32 *mask;
+ int *run_component = NULL;
+ int *px = NULL;
+ int *py = NULL;
+ int *hull = NULL;
+ int runs = 0;
+ int runs_allocated = 0;
+ int components = 0;
+ int count = 0;
+ int prev_first = 0;
+ int prev_end = 0;
+ int first, x, y, i, j, c, g, flip, min_pixels, merged, points, line;
+ long brightness = 0;
+
+  DBG(DBG_proc, "xsane_detect_objects(%dx%d)\n", width, height);
+
+  if ((width < 1) || (height < 1) || (max_objects < 1))
+  {
+   return 0;
+  }
+
+  if (!xsane_detect_mask_function)
+  {
+    xsane_detect_mask_function = xsane_detect_mask_scalar;
+
+#ifdef XSANE_DETECT_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+      xsane_detect_mask_function = xsane_detect_mask_avx2;
+    }
+#endif
+
+    DBG(DBG_info, "xsane_detect_objects: using %s kernel\n", (xsane_detect_mask_function == xsane_detect_mask_scalar) ? "scalar" : "avx2");
+  }
+
+  /* the background color is taken from the margins of the image */
+  for (x = 0; x < width; x++)
+  {
+    brightness += luminance[x] + luminance[(size_t) (height - 1) * width + x];
+  }
+
+  for (y = 0; y < height; y++)
+  {
+    brightness += luminance[(size_t) y * width] + luminance[(size_t) y * width + width - 1];
+  }
+
+  brightness /= 2 * (width + height);
+  flip = (brightness > 128) ? 0x00 : 0xff;
+
+  DBG(DBG_info, "xsane_detect_objects: average margin brightness is %ld, background is %s\n", brightness, (flip) ? "black" : "white");
+
+  mask = malloc(((width + 31) / 32) * sizeof(guint32));
+  if (!mask)
+  {
+    DBG(DBG_error, "xsane_detect_objects: out of memory\n");
+   return 0;
+  }
+
+  /* classify each line and join its runs with the touching runs of the previous line (8 neighbourhood) */
+  for (y = 0; y < height; y++)
+  {
+    xsane_detect_mask_function(luminance + (size_t) y * width, width, flip, mask);
+
+    first = runs;
+    x = xsane_detect_next(mask, width, 0, TRUE);
+
+    while (x < width)
+    {
+      if (runs >= runs_allocated)
+      {
+        runs_allocated = (runs_allocated) ? 2 * runs_allocated : 1024;
+        new_run = realloc(run, runs_allocated * sizeof(XsaneDetectRun));
+
+        if (!new_run)
+        {
+          DBG(DBG_error, "xsane_detect_objects: out of memory\n");
+          free(run);
+          free(mask);
+         return 0;
+        }
+
+        run = new_run;
+      }
+
+      run[runs].y      = y;
+      run[runs].x0     = x;
+      run[runs].x1     = xsane_detect_next(mask, width, x, FALSE);
+      run[runs].parent = runs;
+
+      while ((prev_first < prev_end) && (run[prev_first].x1 < run[runs].x0))
+      {
+        prev_first++;
+      }
+
+      for (j = prev_first; (j < prev_end) && (run[j].x0 <= run[runs].x1); j++)
+      {
+        xsane_detect_union(run, runs, j);
+      }
+
+      x = xsane_detect_next(mask, width, run[runs].x1, TRUE);
+      runs++;
+    }
+
+    prev_first = first;
+    prev_end   = runs;
+  }
+
+  free(mask);
+
+  if (!runs)
+  {
+    DBG(DBG_info, "xsane_detect_objects: no object pixels\n");
+   return 0;
+  }
+
+  /* number the objects, the root of an object is its first run */
+  run_component = malloc(runs * sizeof(int));
+  if (!run_component)
+  {
+    goto out_of_memory;
+  }
+
+  for (i = 0; i < runs; i++)
+  {
+    j = xsane_detect_find(run, i);
+    run_component[i] = (j == i) ? components++ : run_component[j];
+  }
+
+  component = calloc(components, sizeof(XsaneDetectComponent));
+  if (!component)
+  {
+    goto out_of_memory;
+  }
+
+  for (c = 0; c < components; c++)
+  {
+    component[c].object.left   = width;
+    component[c].object.top    = height;
+    component[c].object.right  = -1;
+    component[c].object.bottom = -1;
+    component[c].group         = c;
+  }
+
+  for (i = 0; i < runs; i++)
+  {
+    o = &component[run_component[i]].object;
+
+    if (run[i].x0 < o->left)
+    {
+      o->left = run[i].x0;
+    }
+
+    if (run[i].x1 - 1 > o->right)
+    {
+      o->right = run[i].x1 - 1;
+    }
+
+    if (run[i].y < o->top)
+    {
+      o->top = run[i].y;
+    }
+
+    o->bottom  = run[i].y;
+    o->pixels += run[i].x1 - run[i].x0;
+  }
+
+  /* drop dust */
+  min_pixels = ((double) width * height) / XSANE_DETECT_MIN_AREA;
+  if (min_pixels < XSANE_DETECT_MIN_PIXELS)
+  {
+    min_pixels = XSANE_DETECT_MIN_PIXELS;
+  }
+
+  for (c = 0; c < components; c++)
+  {
+    if (component[c].object.pixels < min_pixels)
+    {
+      component[c].group = -1;
+    }
+  }
+
+  /* merge objects with overlapping bounding boxes, e.g. parts of a photo that are separated by bright areas */
+  do
+  {
+    merged = FALSE;
+
+    for (c = 0; c < components; c++)
+    {
+      if (component[c].group != c)
+      {
+        continue;
+      }
+
+      o = &component[c].object;
+
+      for (j = c + 1; j < components; j++)
+      {
+       XsaneDetectObject *oj = &component[j].object;
+
+        if ( (component[j].group != j) ||
+             (oj->left > o->right) || (oj->right < o->left) || (oj->top > o->bottom) || (oj->bottom < o->top) )
+        {
+          continue;
+        }
+
+        o->left    = (oj->left   < o->left)   ? oj->left   : o->left;
+        o->right   = (oj->right  > o->right)  ? oj->right  : o->right;
+        o->top     = (oj->top    < o->top)    ? oj->top    : o->top;
+        o->bottom  = (oj->bottom > o->bottom) ? oj->bottom : o->bottom;
+        o->pixels += oj->pixels;
+
+        component[j].group = c;
+        merged = TRUE;
+      }
+    }
+  }
+  while (merged);
+
+  /* left and right border of each line of the objects */
+  for (c = 0; c < components; c++)
+  {
+    if (component[c].group == c)
+    {
+      line = component[c].object.bottom - component[c].object.top + 1;
+
+      component[c].row_left  = malloc(line * sizeof(int));
+      component[c].row_right = malloc(line * sizeof(int));
+
+      if ((!component[c].row_left) || (!component[c].row_right))
+      {
+        goto out_of_memory;
+      }
+
+      for (y = 0; y < line; y++)
+      {
+        component[c].row_left[y]  = width;
+        component[c].row_right[y] = 0;
+      }
+
+      count++;
+    }
+  }
+
+  for (i = 0; i < runs; i++)
+  {
+    g = xsane_detect_group(component, run_component[i]);
+
+    if (g < 0)
+    {
+      continue; /* dust */
+    }
+
+    line = run[i].y - component[g].object.top;
+
+    if (run[i].x0 < component[g].row_left[line])
+    {
+      component[g].row_left[line] = run[i].x0;
+    }
+
+    if (run[i].x1 > component[g].row_right[line])
+    {
+      component[g].row_right[line] = run[i].x1;
+    }
+  }
+
+  found = malloc((count + 1) * sizeof(XsaneDetectObject));
+  px    = malloc((2 * height + 1) * sizeof(int));
+  py    = malloc((2 * height + 1) * sizeof(int));
+  hull  = malloc((4 * height + 2) * sizeof(int));
+
+  if ((!found) || (!px) || (!py) || (!hull))
+  {
+    goto out_of_memory;
+  }
+
+  /* skew angle from the left and right border points of each line */
+  count = 0;
+  for (c = 0; c < components; c++)
+  {
+    if (component[c].group != c)
+    {
+      continue;
+    }
+
+    o = &component[c].object;
+    points = 0;
+
+    for (y = 0; y <= o->bottom - o->top; y++)
+    {
+      if (component[c].row_right[y] > component[c].row_left[y])
+      {
+        px[points] = component[c].row_left[y];
+        py[points] = o->top + y;
+        points++;
+
+        px[points] = component[c].row_right[y];
+        py[points] = o->top + y;
+        points++;
+      }
+    }
+
+    o->angle = xsane_detect_skew(px, py, points, hull);
+
+    DBG(DBG_info, "xsane_detect_objects: object %d,%d - %d,%d, %d pixels, angle %3.2f\n",
+                  o->left, o->top, o->right, o->bottom, o->pixels, o->angle);
+
+    found[count++] = *o;
+  }
+
+  qsort(found, count, sizeof(XsaneDetectObject), xsane_detect_compare_size);
+
+  if (count > max_objects)
+  {
+    count = max_objects;
+  }
+
+  qsort(found, count, sizeof(XsaneDetectObject), xsane_detect_compare_position);
+  memcpy(objects, found, count * sizeof(XsaneDetectObject));
+
+  DBG(DBG_info, "xsane_detect_objects: %d objects\n", count);
+
+  goto done;
+
+out_of_memory:
+  DBG(DBG_error, "xsane_detect_objects: out of memory\n");
+  count = 0;
+
+done:
+  if (component)
+  {
+    for (c = 0; c < components; c++)
+    {
+      free(component[c].row_left);
+      free(component[c].row_right);
+    }
+    free(component);
+  }
+
+  free(run_component);
+  free(run);
+  free(found);
+  free(px);
+  free(py);
+  free(hull);
+
+ return count;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
@@ -0,0 +1,61 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-detect.h
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifndef HAVE_XSANE_DETECT_H
+#define HAVE_XSANE_DETECT_H
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* Object detection finds the originals (photos, slides, ...) that lie on the scanner glass in a preview.
+ * The preview is reduced to an 8 bit luminance plane, each line is classified against the background
+ * color in one pass into a bit mask (32 pixels per word, with avx2 when the cpu supports it) and the
+ * runs of object pixels are joined to connected objects. Small objects (dust) are dropped and objects
+ * with overlapping bounding boxes are merged. The skew angle of an object is taken from the minimum
+ * area rectangle around the convex hull of its runs.
+ */
+
+#define XSANE_DETECT_MAX_OBJECTS 32
+
+typedef struct
+{
+  int left;			/* bounding box in pixels of the luminance plane, right and bottom included */
+  int top;
+  int right;
+  int bottom;
+  int pixels;			/* number of object pixels */
+  double angle;			/* skew angle in degree (-45..45], positive = object is rotated counterclockwise */
+} XsaneDetectObject;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+extern void xsane_detect_luminance(u_char *rgb, u_char *luminance, int pixels);
+extern int xsane_detect_objects(u_char *luminance, int width, int height, XsaneDetectObject *objects, int max_objects);
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+#endif
+/* ---------------------------------------------------------------------------------------------------------------------- */
@@ -27,6 +27,7 @@
 #include "xsane-front-gtk.h"
 #include "xsane-preview.h"
 #include "xsane-save.h"
+#include "xsane-smtp.h"
 #include "xsane-gamma.h"
 #include "xsane-setup.h"
 #include "xsane-scan.h"
@@ -62,6 +63,7 @@ void xsane_email_dialog(void);
 
 static gint xsane_email_dialog_delete();
 static void xsane_email_filetype_callback(GtkWidget *filetype_option_menu, char *filetype);
+static void xsane_email_pdf_compression_callback(GtkWidget *widget, gpointer data);
 static void xsane_email_receiver_changed_callback(GtkWidget *widget, gpointer data);
 static void xsane_email_subject_changed_callback(GtkWidget *widget, gpointer data);
 static void xsane_email_project_browse_filename_callback(GtkWidget *widget, gpointer data);
@@ -80,7 +82,6 @@ static void xsane_email_show_callback(GtkWidget *widget, gpointer data);
 #if 0
 static void xsane_email_edit_callback(GtkWidget *widget, gpointer data);
 #endif
-static void xsane_email_send_process(void);
 static void xsane_email_send(void);
 
 
@@ -106,6 +107,15 @@ static void xsane_email_filetype_callback(GtkWidget *filetype_option_menu, char
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
+static void xsane_email_pdf_compression_callback(GtkWidget *widget, gpointer data)
+{
+  DBG(DBG_proc, "xsane_email_pdf_compression_callback(%d)\n", (int) data);
+
+  preferences.email_pdf_compression = (int) data;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
 void xsane_email_dialog()
 {
  GtkWidget *email_dialog, *email_scan_vbox, *email_project_vbox;
@@ -117,6 +127,8 @@ void xsane_email_dialog()
  GtkWidget *label;
  GtkWidget *filetype_menu, *filetype_item;
  GtkWidget *filetype_option_menu;
+ GtkWidget *pdf_compression_menu, *pdf_compression_item;
+ GtkWidget *pdf_compression_option_menu;
  GdkPixmap *pixmap;
  GdkBitmap *mask;
  char buf[64];
@@ -375,6 +387,37 @@ void xsane_email_dialog()
   gtk_widget_show(filetype_option_menu);
 
 
+  /* PDF COMPRESSION MENU */
+  hbox = gtk_hbox_new(FALSE, 2);
+  gtk_container_set_border_width(GTK_CONTAINER(hbox), 2);
+  gtk_box_pack_start(GTK_BOX(email_project_vbox), hbox, FALSE, FALSE, 1);
+  gtk_widget_show(hbox);
+
+  pdf_compression_menu = gtk_menu_new();
+
+  pdf_compression_item = gtk_menu_item_new_with_label(MENU_ITEM_PDF_COMPRESSION_ZLIB);
+  gtk_container_add(GTK_CONTAINER(pdf_compression_menu), pdf_compression_item);
+  g_signal_connect(GTK_OBJECT(pdf_compression_item), "activate", (GtkSignalFunc) xsane_email_pdf_compression_callback, (void *) XSANE_PDF_COMPRESSION_ZLIB);
+  gtk_widget_show(pdf_compression_item);
+
+  pdf_compression_item = gtk_menu_item_new_with_label(MENU_ITEM_PDF_COMPRESSION_JPEG);
+  gtk_container_add(GTK_CONTAINER(pdf_compression_menu), pdf_compression_item);
+  g_signal_connect(GTK_OBJECT(pdf_compression_item), "activate", (GtkSignalFunc) xsane_email_pdf_compression_callback, (void *) XSANE_PDF_COMPRESSION_JPEG);
+  gtk_widget_show(pdf_compression_item);
+
+  label = gtk_label_new(TEXT_PDF_COMPRESSION);
+  gtk_box_pack_start(GTK_BOX(hbox), label, FALSE, FALSE, 2);
+  gtk_widget_show(label);
+
+  pdf_compression_option_menu = gtk_option_menu_new();
+  xsane_back_gtk_set_tooltip(xsane.tooltips, pdf_compression_option_menu, DESC_PDF_COMPRESSION);
+  gtk_option_menu_set_menu(GTK_OPTION_MENU(pdf_compression_option_menu), pdf_compression_menu);
+  gtk_option_menu_set_history(GTK_OPTION_MENU(pdf_compression_option_menu), preferences.email_pdf_compression);
+  gtk_box_pack_end(GTK_BOX(hbox), pdf_compression_option_menu, FALSE, FALSE, 2);
+  gtk_widget_show(pdf_compression_menu);
+  gtk_widget_show(pdf_compression_option_menu);
+
+
   /* attachment frame */
   attachment_frame = gtk_frame_new(TEXT_ATTACHMENTS);
   gtk_box_pack_start(GTK_BOX(email_project_vbox), attachment_frame, FALSE, FALSE, 2);
@@ -525,6 +568,7 @@ static void xsane_email_project_display_status()
          (!strcmp(buf, TEXT_EMAIL_STATUS_SMTP_ERR_FROM)) ||
          (!strcmp(buf, TEXT_EMAIL_STATUS_SMTP_ERR_RCPT)) ||
          (!strcmp(buf, TEXT_EMAIL_STATUS_SMTP_ERR_DATA)) ||
+         (!strcmp(buf, TEXT_EMAIL_STATUS_SENDER_FAILED)) ||
          (!strcmp(buf, TEXT_EMAIL_STATUS_SENT)) )
     {
       if (strcmp(xsane.email_status, buf))
@@ -1764,8 +1808,88 @@ static void xsane_create_email(int fd)
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-static void xsane_email_send_process()
+/* The projects that are sent are put into a queue. A sender process takes all queued projects */
+/* and sends them through one smtp connection, projects that are sent while the sender process */
+/* is running are taken by the next sender process. Each entry stores the project settings */
+/* because the user can load another project before the email is sent. */
+
+typedef struct XsaneEmailQueue
+{
+  char *project;		/* project directory */
+  char *receiver;
+  char *subject;
+  char *filetype;		/* type of the converted images */
+  int html_mode;
+  int progress_size;		/* size of all attachments */
+  struct XsaneEmailQueue *next;
+} XsaneEmailQueue;
+
+static XsaneEmailQueue *xsane_email_queue = NULL;	/* projects that wait for the sender process */
+static pid_t xsane_email_sender_pid = 0;		/* running sender process, 0 = none */
+static guint xsane_email_queue_timer = 0;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_email_queue_select(XsaneEmailQueue *entry)
+/* makes the queued project the current project of the sender process */
+{
+  preferences.email_project = entry->project;
+  xsane.email_receiver      = entry->receiver;
+  xsane.email_subject       = entry->subject;
+  preferences.email_filetype = entry->filetype;
+  xsane.email_html_mode     = entry->html_mode;
+  xsane.email_progress_size  = entry->progress_size;
+  xsane.email_progress_bytes = 0;
+  xsane.email_progress_val   = 0.0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_email_queue_set_status(XsaneEmailQueue *queue, char *status)
+/* sets the status of all projects in the queue */
+{
+  for (; queue; queue = queue->next)
+  {
+    xsane_email_queue_select(queue);
+
+    if (xsane.email_status)
+    {
+      free(xsane.email_status);
+    }
+    xsane.email_status = strdup(status);
+    xsane_front_gtk_email_project_update_lockfile_status();
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_email_queue_set_error(XsaneEmailQueue *queue, char *status)
+/* called by the xsane process when no sender process can be started, */
+/* writes the status to the lockfiles of the queued projects and keeps the current project */
 {
+ char *email_project = preferences.email_project;
+ char *email_status = xsane.email_status;
+ float email_progress_val = xsane.email_progress_val;
+
+  xsane.email_status = status;
+  xsane.email_progress_val = 0.0;
+
+  for (; queue; queue = queue->next)
+  {
+    preferences.email_project = queue->project;
+    xsane_front_gtk_email_project_update_lockfile_status();
+  }
+
+  preferences.email_project = email_project;
+  xsane.email_status        = email_status;
+  xsane.email_progress_val  = email_progress_val;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_email_send_process(XsaneEmailQueue *queue)
+{
+ XsaneEmailQueue *entry;
  int fd_socket;
  int status;
  char *password;
@@ -1787,16 +1911,8 @@ static void xsane_email_send_process()
 
     if (fd_socket < 0) /* could not open socket */
     {
-      if (xsane.email_status)
-      {
-        free(xsane.email_status);
-      }
-      xsane.email_status = strdup(TEXT_EMAIL_STATUS_POP3_CONNECTION_FAILED);
-      xsane.email_progress_val = 0.0;
-      xsane_front_gtk_email_project_update_lockfile_status();
-
+      xsane_email_queue_set_status(queue, TEXT_EMAIL_STATUS_POP3_CONNECTION_FAILED);
       free(password);
-
      return;
     }
 
@@ -1806,75 +1922,201 @@ static void xsane_email_send_process()
 
     if (status == -1)
     {
-      if (xsane.email_status)
-      {
-        free(xsane.email_status);
-      }
-      xsane.email_status = strdup(TEXT_EMAIL_STATUS_POP3_LOGIN_FAILED);
-      xsane.email_progress_val = 0.0;
-      xsane_front_gtk_email_project_update_lockfile_status();
-
+      xsane_email_queue_set_status(queue, TEXT_EMAIL_STATUS_POP3_LOGIN_FAILED);
       free(password);
-
      return;
     }
 
     DBG(DBG_info, "POP3 authentication done\n");
   }
 
+  /* smtp email, the connection is used for all projects of the queue */
+  fd_socket = -1;
 
+  for (entry = queue; entry; entry = entry->next)
+  {
+    DBG(DBG_info, "sending email project %s\n", entry->project);
 
-  /* smtp email */
-  fd_socket = open_socket(preferences.email_smtp_server, preferences.email_smtp_port);
+    xsane_email_queue_select(entry);
+
+    if (fd_socket < 0)
+    {
+      fd_socket = smtp_open(preferences.email_smtp_server, preferences.email_smtp_port,
+                            preferences.email_authentication, preferences.email_auth_user, password);
+      if (fd_socket < 0) /* status is set by smtp_open */
+      {
+        continue;
+      }
+    }
+
+    if (write_smtp_header(fd_socket, preferences.email_from, xsane.email_receiver))
+    {
+      close(fd_socket); /* the server may wait for data, so the connection is not reused */
+      fd_socket = -1;
+      continue;
+    }
+
+    xsane_create_email(fd_socket); /* create email and write to socket */
+
+    if (write_smtp_footer(fd_socket))
+    {
+      close(fd_socket);
+      fd_socket = -1;
+      continue;
+    }
 
-  if (fd_socket < 0) /* could not open socket */
-  {
     if (xsane.email_status)
     {
       free(xsane.email_status);
     }
-    xsane.email_status = strdup(TEXT_EMAIL_STATUS_SMTP_CONNECTION_FAILED);
-    xsane.email_progress_val = 0.0;
+    xsane.email_status = strdup(TEXT_EMAIL_STATUS_SENT);
+    xsane.email_progress_val = 1.0;
     xsane_front_gtk_email_project_update_lockfile_status();
+  }
 
-    free(password);
+  if (fd_socket >= 0)
+  {
+    smtp_close(fd_socket);
+  }
 
-   return;
+  free(password);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_email_queue_free(XsaneEmailQueue *queue)
+{
+ XsaneEmailQueue *next;
+
+  while (queue)
+  {
+    next = queue->next;
+    free(queue->project);
+    free(queue->receiver);
+    free(queue->subject);
+    free(queue->filetype);
+    free(queue);
+    queue = next;
   }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
+static void xsane_email_queue_start(void)
+/* starts a sender process for all queued projects */
+{
+ XsaneEmailQueue *queue = xsane_email_queue;
+ pid_t pid;
+
+  xsane_email_queue = NULL;
 
-  status = write_smtp_header(fd_socket, preferences.email_from, xsane.email_receiver,
-                             preferences.email_authentication, preferences.email_auth_user, password);
-  if (status == -1)
+  pid = fork();
+ 
+  if (pid == 0) /* new process */
   {
-   return;
+   FILE *ipc_file = NULL;
+
+    if (xsane.ipc_pipefd[0])
+    {
+      close(xsane.ipc_pipefd[0]); /* close reading end of pipe */
+      ipc_file = fdopen(xsane.ipc_pipefd[1], "w");
+    }
+
+    DBG(DBG_info, "trying to change user id for new subprocess:\n");
+    DBG(DBG_info, "old effective uid = %d\n", (int) geteuid());
+    setuid(getuid());
+    DBG(DBG_info, "new effective uid = %d\n", (int) geteuid());
+
+    xsane_email_send_process(queue);
+
+    _exit(0); /* do not use exit() here! otherwise gtk gets in trouble */
+  }
+  else if (pid > 0) /* parent process */
+  {
+    xsane_front_gtk_add_process_to_list(pid); /* add pid to child process list */
+    xsane_email_sender_pid = pid;
+  }
+  else
+  {
+    DBG(DBG_error, "xsane_email_queue_start: could not create sender process\n");
+    xsane_email_queue_set_error(queue, TEXT_EMAIL_STATUS_SENDER_FAILED);
   }
 
+  xsane_email_queue_free(queue);
+}
 
-  xsane_create_email(fd_socket); /* create email and write to socket */
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-  write_smtp_footer(fd_socket);
+static gint xsane_email_queue_timer_callback(gpointer data)
+{
+ int status;
 
-  close(fd_socket);
+  if ((xsane_email_sender_pid) && (waitpid(xsane_email_sender_pid, &status, WNOHANG) != 0)) /* finished or already cleaned up by sigchld handler */
+  {
+    DBG(DBG_info, "email sender process %d has finished\n", xsane_email_sender_pid);
+    xsane_email_sender_pid = 0;
+  }
 
-  if (xsane.email_status)
+  if ((!xsane_email_sender_pid) && (xsane_email_queue))
   {
-    free(xsane.email_status);
+    xsane_email_queue_start();
   }
-  xsane.email_status = strdup(TEXT_EMAIL_STATUS_SENT);
-  xsane.email_progress_val = 1.0;
-  xsane_front_gtk_email_project_update_lockfile_status();
 
-  free(password);
+  if ((!xsane_email_sender_pid) && (!xsane_email_queue))
+  {
+    DBG(DBG_info, "disabling email queue timer\n");
+    xsane_email_queue_timer = 0;
+   return FALSE;
+  }
 
-  _exit(0);
+ return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_email_queue_add(void)
+/* appends the current project to the queue, it is sent when no sender process is running */
+{
+ XsaneEmailQueue **last = &xsane_email_queue;
+ XsaneEmailQueue *entry;
+
+  entry = calloc(1, sizeof(XsaneEmailQueue));
+  if (!entry)
+  {
+    DBG(DBG_error, "xsane_email_queue_add: out of memory\n");
+   return;
+  }
+
+  entry->project       = strdup(preferences.email_project);
+  entry->receiver      = strdup(xsane.email_receiver);
+  entry->subject       = strdup(xsane.email_subject);
+  entry->filetype      = strdup(preferences.email_filetype);
+  entry->html_mode     = xsane.email_html_mode;
+  entry->progress_size = xsane.email_progress_size;
+
+  while (*last)
+  {
+    last = &(*last)->next;
+  }
+  *last = entry;
+
+  DBG(DBG_info, "email project %s queued\n", entry->project);
+
+  if (!xsane_email_sender_pid)
+  {
+    xsane_email_queue_start();
+  }
+
+  if (!xsane_email_queue_timer)
+  {
+    xsane_email_queue_timer = gtk_timeout_add(500, (GtkFunction) xsane_email_queue_timer_callback, NULL);
+  }
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 static void xsane_email_send()
 {
- pid_t pid;
  char *image;
  char *type;
  GList *list = (GList *) GTK_LIST(xsane.project_list)->children;
@@ -1915,7 +2157,7 @@ static void xsane_email_send()
     free(type);
     DBG(DBG_info, "converting %s to %s\n", source_filename, email_filename);
     output_format = xsane_identify_output_format(email_filename, NULL, NULL);
-    xsane_save_image_as(email_filename, source_filename, output_format, xsane.enable_color_management, preferences.cms_function, preferences.cms_intent, preferences.cms_bpc, xsane.project_progress_bar, &cancel_save);
+    xsane_save_image_as(email_filename, source_filename, output_format, preferences.email_pdf_compression, xsane.enable_color_management, preferences.cms_function, preferences.cms_intent, preferences.cms_bpc, xsane.project_progress_bar, &cancel_save);
     list = list->next;
     xsane.email_progress_size += xsane_get_filesize(email_filename);
   }
@@ -1930,31 +2172,7 @@ static void xsane_email_send()
   xsane_email_project_display_status(); /* display status before creating lockfile! */
   xsane_front_gtk_email_project_update_lockfile_status(); /* create lockfile and update status */
 
-  pid = fork();
- 
-  if (pid == 0) /* new process */
-  {
-   FILE *ipc_file = NULL;
-
-    if (xsane.ipc_pipefd[0])
-    {
-      close(xsane.ipc_pipefd[0]); /* close reading end of pipe */
-      ipc_file = fdopen(xsane.ipc_pipefd[1], "w");
-    }
-
-    DBG(DBG_info, "trying to change user id for new subprocess:\n");
-    DBG(DBG_info, "old effective uid = %d\n", (int) geteuid());
-    setuid(getuid());
-    DBG(DBG_info, "new effective uid = %d\n", (int) geteuid());
-
-    xsane_email_send_process();
-
-    _exit(0); /* do not use exit() here! otherwise gtk gets in trouble */
-  }
-  else /* parent process */
-  {
-    xsane_front_gtk_add_process_to_list(pid); /* add pid to child process list */
-  }
+  xsane_email_queue_add(); /* send the project with the next sender process */
 
   xsane_email_send_timer = gtk_timeout_add(100, (GtkFunction) xsane_email_send_timer_callback, NULL);
   DBG(DBG_info, "enabling email send timer (%d)\n", xsane_email_send_timer);
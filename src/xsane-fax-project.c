@@ -49,6 +49,11 @@
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
+/* resolution of fax pages in fine and normal mode, images with a higher resolution are reduced */
+#define XSANE_FAX_RESOLUTION_X		204.0
+#define XSANE_FAX_RESOLUTION_Y_FINE	196.0
+#define XSANE_FAX_RESOLUTION_Y_NORMAL	98.0
+
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 /* forward declarations: */
@@ -1119,6 +1124,11 @@ static int xsane_fax_convert_pnm_to_ps(char *source_filename, char *fax_filename
   {
     xsane_read_pnm_header(infile, &image_info);
 
+    /* the fax only transmits the fax resolution, the original image is used when it can not be reduced */
+    xsane_save_reduce_resolution(&infile, &image_info, XSANE_FAX_RESOLUTION_X,
+                                 preferences.fax_fine_mode ? XSANE_FAX_RESOLUTION_Y_FINE : XSANE_FAX_RESOLUTION_Y_NORMAL,
+                                 xsane.project_progress_bar, &cancel_save);
+
     umask((mode_t) preferences.image_umask); /* define image file permissions */   
     outfile = fopen(fax_filename, "wb"); /* b = binary mode for win32 */
     umask(XSANE_DEFAULT_UMASK); /* define new file permissions */   
@@ -30,6 +30,7 @@
 #include "xsane-save.h"
 #include "xsane-gamma.h"
 #include "xsane-setup.h"
+#include "xsane-job.h"
 #include <md5.h>
 
 #ifdef HAVE_LIBPNG
@@ -59,6 +60,7 @@ void xsane_progress_new(char *bar_text, char *info, GtkSignalFunc callback, int
 void xsane_progress_update(gfloat newval);
 void xsane_progress_clear();
 void xsane_progress_bar_set_fraction(GtkProgressBar *progress_bar, gdouble fraction);
+void xsane_progress_bar_set_text(GtkProgressBar *progress_bar, gchar *text);
 GtkWidget *xsane_vendor_pixmap_new(GdkWindow *window, GtkWidget *parent);
 GtkWidget *xsane_toggle_button_new_with_pixmap(GdkWindow *window, GtkWidget *parent, const char *xpm_d[], const char *desc,
                                          int *state, void *xsane_toggle_button_callback);
@@ -747,6 +749,12 @@ void xsane_progress_bar_set_fraction(GtkProgressBar *progress_bar, gdouble fract
      fraction = 1.0; 
    }
 
+  if (xsane_job_worker_thread()) /* the job thread does not call gtk, the main thread shows its progress */
+  {
+    xsane_job_set_progress(fraction);
+    return;
+  }
+
 #ifdef HAVE_GTK2
   if ((fraction - gtk_progress_bar_get_fraction(progress_bar) > XSANE_PROGRESS_BAR_MIN_DELTA_PERCENT) || (fraction == 0.0) || (fraction > 0.99))
   {
@@ -778,6 +786,20 @@ void xsane_progress_bar_set_fraction(GtkProgressBar *progress_bar, gdouble fract
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
+void xsane_progress_bar_set_text(GtkProgressBar *progress_bar, gchar *text)
+{
+  if (xsane_job_worker_thread())
+  {
+    xsane_job_set_text(text);
+    return;
+  }
+
+  gtk_progress_bar_set_ellipsize(progress_bar, PANGO_ELLIPSIZE_START); /* this is new API, can be removed for old GTK versions */
+  gtk_progress_set_format_string(GTK_PROGRESS(progress_bar), text);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
 void xsane_progress_cancel(GtkWidget *widget, gpointer data)
 {
  void *cancel_data_pointer;
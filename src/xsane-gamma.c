@@ -918,10 +918,10 @@ static void xsane_calculate_auto_enhancement(SANE_Int *count_raw,
 
 void xsane_calculate_raw_histogram(void)
 {
- SANE_Int *count_raw;
- SANE_Int *count_raw_red;
- SANE_Int *count_raw_green;
- SANE_Int *count_raw_blue;
+ SANE_Int count_raw[256];
+ SANE_Int count_raw_red[256];
+ SANE_Int count_raw_green[256];
+ SANE_Int count_raw_blue[256];
  int i;
  int maxval_raw;
  double scale_raw;
@@ -948,10 +948,10 @@ void xsane_calculate_raw_histogram(void)
 
   if (xsane.preview) /* preview window exists? */
   {
-    count_raw       = calloc(256, sizeof(SANE_Int));
-    count_raw_red   = calloc(256, sizeof(SANE_Int));
-    count_raw_green = calloc(256, sizeof(SANE_Int));
-    count_raw_blue  = calloc(256, sizeof(SANE_Int));
+    memset(count_raw,       0, sizeof(count_raw));
+    memset(count_raw_red,   0, sizeof(count_raw_red));
+    memset(count_raw_green, 0, sizeof(count_raw_green));
+    memset(count_raw_blue,  0, sizeof(count_raw_blue));
 
     preview_calculate_raw_histogram(xsane.preview, count_raw, count_raw_red, count_raw_green, count_raw_blue);
 
@@ -997,11 +997,6 @@ void xsane_calculate_raw_histogram(void)
                                        xsane.histogram_red, xsane.histogram_green, xsane.histogram_blue,
                                        xsane.histogram_int, scale_raw);
     }
-
-    free(count_raw_blue);
-    free(count_raw_green);
-    free(count_raw_red);
-    free(count_raw);
   }
   else
   {
@@ -1013,10 +1008,10 @@ void xsane_calculate_raw_histogram(void)
 
 void xsane_calculate_enh_histogram(void)
 {
- SANE_Int *count_enh;
- SANE_Int *count_enh_red;
- SANE_Int *count_enh_green;
- SANE_Int *count_enh_blue;
+ SANE_Int count_enh[256];
+ SANE_Int count_enh_red[256];
+ SANE_Int count_enh_green[256];
+ SANE_Int count_enh_blue[256];
  int i;
  int maxval_enh;
  double scale_enh;
@@ -1025,10 +1020,10 @@ void xsane_calculate_enh_histogram(void)
 
   if (xsane.preview) /* preview window exists? */
   {
-    count_enh       = calloc(256, sizeof(SANE_Int));
-    count_enh_red   = calloc(256, sizeof(SANE_Int));
-    count_enh_green = calloc(256, sizeof(SANE_Int));
-    count_enh_blue  = calloc(256, sizeof(SANE_Int));
+    memset(count_enh,       0, sizeof(count_enh));
+    memset(count_enh_red,   0, sizeof(count_enh_red));
+    memset(count_enh_green, 0, sizeof(count_enh_green));
+    memset(count_enh_blue,  0, sizeof(count_enh_blue));
 
     preview_calculate_enh_histogram(xsane.preview, count_enh, count_enh_red, count_enh_green, count_enh_blue);
 
@@ -1067,11 +1062,6 @@ void xsane_calculate_enh_histogram(void)
                         count_enh, count_enh_red, count_enh_green, count_enh_blue,
                         xsane.histogram_red, xsane.histogram_green, xsane.histogram_blue, xsane.histogram_int, scale_enh);
     }
-
-    free(count_enh_blue);
-    free(count_enh_green);
-    free(count_enh_red);
-    free(count_enh);
   }
   else
   {
@@ -1319,12 +1309,190 @@ void xsane_create_preview_gamma_curve(u_char *gammadata, int negative, double ga
 
 #else
 
-void xsane_create_preview_gamma_curve(u_char *gammadata, int negative, double gamma,
-                                      double brightness, double contrast,
-                                      double medium_shadow, double medium_highlight, double medium_gamma, 
-                                      int numbers)
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* The gamma curves are recreated for all channels, the histograms and the medium on each slider event,
+ * most of them with unchanged parameters. Created curves are kept in a small cache that is searched
+ * with the complete parameter set. The medium part of a curve (that does not change while the user
+ * sliders are moved) is cached on its own, and the last step out = (int) (scale * pow(val/maxin, 1/gamma))
+ * is done by a binary search in the input values where the output changes: one pow call per output
+ * level instead of one per table entry.
+ */
+
+enum
+{
+  XSANE_GAMMA_CACHE_PREVIEW = 1,	/* u_char preview gamma curve */
+  XSANE_GAMMA_CACHE_SANE,		/* SANE_Int gamma curve */
+  XSANE_GAMMA_CACHE_MEDIUM		/* float medium curve */
+};
+
+#define XSANE_GAMMA_CACHE_SIZE 16
+
+typedef struct
+{
+  int type;			/* 0 = entry is empty */
+  unsigned int used;		/* value of xsane_gamma_cache_counter when the entry was used last time */
+  int negative;
+  double gamma;
+  double brightness;
+  double contrast;
+  double medium_shadow;
+  double medium_highlight;
+  double medium_gamma;
+  int numbers;
+  int maxout;
+  void *data;
+} XsaneGammaCacheEntry;
+
+static XsaneGammaCacheEntry xsane_gamma_cache[XSANE_GAMMA_CACHE_SIZE];
+static unsigned int xsane_gamma_cache_counter = 0;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static XsaneGammaCacheEntry *xsane_gamma_cache_find(int type, int negative, double gamma, double brightness, double contrast,
+                                                    double medium_shadow, double medium_highlight, double medium_gamma,
+                                                    int numbers, int maxout)
 {
  int i;
+
+  for (i = 0; i < XSANE_GAMMA_CACHE_SIZE; i++)
+  {
+   XsaneGammaCacheEntry *entry = &xsane_gamma_cache[i];
+
+    if ( (entry->type == type) && (entry->negative == negative) && (entry->numbers == numbers) && (entry->maxout == maxout) &&
+         (entry->gamma == gamma) && (entry->brightness == brightness) && (entry->contrast == contrast) &&
+         (entry->medium_shadow == medium_shadow) && (entry->medium_highlight == medium_highlight) &&
+         (entry->medium_gamma == medium_gamma) )
+    {
+      entry->used = ++xsane_gamma_cache_counter;
+     return entry;
+    }
+  }
+
+ return NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* stores a copy of data in the least recently used cache entry */
+static void xsane_gamma_cache_store(int type, int negative, double gamma, double brightness, double contrast,
+                                    double medium_shadow, double medium_highlight, double medium_gamma,
+                                    int numbers, int maxout, void *data, size_t size)
+{
+ XsaneGammaCacheEntry *entry = &xsane_gamma_cache[0];
+ int i;
+
+  for (i = 1; (i < XSANE_GAMMA_CACHE_SIZE) && (entry->type); i++)
+  {
+    if ((!xsane_gamma_cache[i].type) || (xsane_gamma_cache[i].used < entry->used))
+    {
+      entry = &xsane_gamma_cache[i];
+    }
+  }
+
+  if (entry->data)
+  {
+    free(entry->data);
+  }
+
+  entry->type = 0;
+  entry->data = malloc(size);
+
+  if (!entry->data)
+  {
+    return;
+  }
+
+  memcpy(entry->data, data, size);
+
+  entry->type             = type;
+  entry->used             = ++xsane_gamma_cache_counter;
+  entry->negative         = negative;
+  entry->gamma            = gamma;
+  entry->brightness       = brightness;
+  entry->contrast         = contrast;
+  entry->medium_shadow    = medium_shadow;
+  entry->medium_highlight = medium_highlight;
+  entry->medium_gamma     = medium_gamma;
+  entry->numbers          = numbers;
+  entry->maxout           = maxout;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static double xsane_gamma_medium_value(int i, int negative, double medium_m, double medium_mid, double medium_gamma, int maxin, double midin)
+{
+ double val = ((double) i);
+
+  val = (val - medium_mid) * medium_m + midin;
+  xsane_bound_double(&val, 0.0, maxin);
+
+  if (negative)
+  {
+    val = maxin - val; /* invert */
+  }
+
+  if (medium_gamma != 1.0)
+  {
+    val = maxin * pow( val/maxin, (1.0/medium_gamma) );
+  }
+
+ return val;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* returns the medium correction for all table entries, NULL if there is not enough memory */
+static float *xsane_gamma_get_medium_curve(int negative, double medium_shadow, double medium_highlight, double medium_gamma, int numbers)
+{
+ XsaneGammaCacheEntry *entry;
+ float *medium;
+ double medium_m, medium_mid, midin;
+ int maxin = numbers-1;
+ int i;
+
+  entry = xsane_gamma_cache_find(XSANE_GAMMA_CACHE_MEDIUM, negative, 0.0, 0.0, 0.0, medium_shadow, medium_highlight, medium_gamma, numbers, 0);
+
+  if (entry)
+  {
+   return entry->data;
+  }
+
+  medium = malloc(numbers * sizeof(float));
+
+  if (!medium)
+  {
+   return NULL;
+  }
+
+  medium_m   = 100.0/(medium_highlight - medium_shadow);
+  medium_mid = (medium_shadow + medium_highlight)/200.0 * maxin;
+  midin      = (int)(numbers / 2.0);
+
+  for (i=0; i <= maxin; i++)
+  {
+    medium[i] = xsane_gamma_medium_value(i, negative, medium_m, medium_mid, medium_gamma, maxin, midin);
+  }
+
+  xsane_gamma_cache_store(XSANE_GAMMA_CACHE_MEDIUM, negative, 0.0, 0.0, 0.0, medium_shadow, medium_highlight, medium_gamma, numbers, 0,
+                          medium, numbers * sizeof(float));
+  free(medium);
+
+  entry = xsane_gamma_cache_find(XSANE_GAMMA_CACHE_MEDIUM, negative, 0.0, 0.0, 0.0, medium_shadow, medium_highlight, medium_gamma, numbers, 0);
+
+ return (entry) ? entry->data : NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* creates the curve for xsane_create_preview_gamma_curve (output = u_char, scale = 255.99999, ceil for negative) */
+/* and xsane_create_gamma_curve (output = SANE_Int, scale = maxout) */
+static void xsane_gamma_create_curve(u_char *gammadata8, SANE_Int *gammadata,
+                                     int negative, double gamma, double brightness, double contrast,
+                                     double medium_shadow, double medium_highlight, double medium_gamma,
+                                     int numbers, int levels, double scale)
+{
+ int i, k, low, high;
  double midin;
  double val;
  double m;
@@ -1332,13 +1500,12 @@ void xsane_create_preview_gamma_curve(u_char *gammadata, int negative, double ga
  double medium_m;
  double medium_mid;
  int maxin = numbers-1;
+ float *medium;
+ double *threshold = NULL;
 
   medium_m   = 100.0/(medium_highlight - medium_shadow);
   medium_mid = (medium_shadow + medium_highlight)/200.0 * maxin;
 
-  DBG(DBG_proc, "xsane_create_preview_gamma_curve(neg=%d, gam=%3.2f, bri=%3.2f, ctr=%3.2f, nrs=%d)\n",
-                 negative, gamma, brightness, contrast, numbers);
-
   if (contrast < -100.0)
   {
     contrast = -100.0;
@@ -1349,47 +1516,112 @@ void xsane_create_preview_gamma_curve(u_char *gammadata, int negative, double ga
   m = 1.0 + contrast/100.0;
   b = (1.0 + brightness/100.0) * midin;
 
-  if (negative)
+  medium = xsane_gamma_get_medium_curve(negative, medium_shadow, medium_highlight, medium_gamma, numbers);
+
+  if (levels <= numbers)
   {
-    for (i=0; i <= maxin; i++)
+    threshold = malloc(levels * sizeof(double));
+  }
+
+  if (threshold)
+  {
+    /* threshold[k] is the smallest val for that the output is >= k */
+    for (k = 0; k < levels; k++)
     {
-      val = ((double) i);
+      threshold[k] = maxin * pow( k / scale, gamma );
+    }
+  }
 
-      /* medium correction */
-      val = (val - medium_mid) * medium_m + midin;
-      xsane_bound_double(&val, 0.0, maxin);
-      val = maxin - val; /* invert */
-      val = maxin * pow( val/maxin, (1.0/medium_gamma) );
+  for (i=0; i <= maxin; i++)
+  {
+    /* medium correction */
+    if (medium)
+    {
+      val = medium[i];
+    }
+    else
+    {
+      val = xsane_gamma_medium_value(i, negative, medium_m, medium_mid, medium_gamma, maxin, midin);
+    }
 
-      val = val - midin;
+    val = val - midin;
 
-      /* user correction */
-      val = val * m + b;
-      xsane_bound_double(&val, 0.0, maxin);
+    /* user correction */
+    val = val * m + b;
+    xsane_bound_double(&val, 0.0, maxin);
 
-      gammadata[i] = (u_char) (255.99999 * pow( ceil(val)/maxin, (1.0/gamma) ));
+    if ((negative) && (gammadata8))
+    {
+      val = ceil(val);
     }
-  }
-  else /* positive */
-  {
-    for (i=0; i <= maxin; i++)
+
+    if (threshold)
     {
-      val = ((double) i);
+      low  = 0;
+      high = levels - 1;
 
-      /* medium correction */
-      val = (val - medium_mid) * medium_m + midin;
-      xsane_bound_double(&val, 0.0, maxin);
-      val = maxin * pow( val/maxin, (1.0/medium_gamma) );
+      while (low < high)
+      {
+        k = (low + high + 1) / 2;
 
-      val = val - midin;
+        if (val >= threshold[k])
+        {
+          low = k;
+        }
+        else
+        {
+          high = k - 1;
+        }
+      }
 
-      /* user correction */
-      val = val * m + b;
-      xsane_bound_double(&val, 0.0, maxin);
+      k = low;
+    }
+    else
+    {
+      k = (int) (scale * pow( val/maxin, (1.0/gamma) ));
+    }
 
-      gammadata[i] = (u_char) (255.99999 * pow( val/maxin, (1.0/gamma) ));
+    if (gammadata8)
+    {
+      gammadata8[i] = (u_char) k;
+    }
+    else
+    {
+      gammadata[i] = k;
     }
   }
+
+  if (threshold)
+  {
+    free(threshold);
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_create_preview_gamma_curve(u_char *gammadata, int negative, double gamma,
+                                      double brightness, double contrast,
+                                      double medium_shadow, double medium_highlight, double medium_gamma,
+                                      int numbers)
+{
+ XsaneGammaCacheEntry *entry;
+
+  DBG(DBG_proc, "xsane_create_preview_gamma_curve(neg=%d, gam=%3.2f, bri=%3.2f, ctr=%3.2f, nrs=%d)\n",
+                 negative, gamma, brightness, contrast, numbers);
+
+  entry = xsane_gamma_cache_find(XSANE_GAMMA_CACHE_PREVIEW, negative, gamma, brightness, contrast,
+                                 medium_shadow, medium_highlight, medium_gamma, numbers, 255);
+  if (entry)
+  {
+    memcpy(gammadata, entry->data, numbers);
+    return;
+  }
+
+  xsane_gamma_create_curve(gammadata, NULL, negative, gamma, brightness, contrast,
+                           medium_shadow, medium_highlight, medium_gamma, numbers, 256, 255.99999);
+
+  xsane_gamma_cache_store(XSANE_GAMMA_CACHE_PREVIEW, negative, gamma, brightness, contrast,
+                          medium_shadow, medium_highlight, medium_gamma, numbers, 255, gammadata, numbers);
 }
 #endif
 
@@ -1397,17 +1629,10 @@ void xsane_create_preview_gamma_curve(u_char *gammadata, int negative, double ga
 
 void xsane_create_gamma_curve(SANE_Int *gammadata,
                               int negative, double gamma, double brightness, double contrast,
-                              double medium_shadow, double medium_highlight, double medium_gamma, 
+                              double medium_shadow, double medium_highlight, double medium_gamma,
                               int numbers, int maxout)
 {
- int i;
- double midin;
- double val;
- double m;
- double b;
- double medium_m;
- double medium_mid;
- int maxin = numbers-1;
+ XsaneGammaCacheEntry *entry;
 
   DBG(DBG_proc, "xsane_create_gamma_curve(neg=%d, gam=%3.2f, bri=%3.2f, ctr=%3.2f, "
                 "mshd=%3.2f, mhig=%3.2f, mgam=%3.2f, "
@@ -1416,58 +1641,19 @@ void xsane_create_gamma_curve(SANE_Int *gammadata,
                  medium_shadow, medium_highlight, medium_gamma,
                  numbers, maxout);
 
-  midin = (int)(numbers / 2.0);
-
-  if (contrast < -100.0)
+  entry = xsane_gamma_cache_find(XSANE_GAMMA_CACHE_SANE, negative, gamma, brightness, contrast,
+                                 medium_shadow, medium_highlight, medium_gamma, numbers, maxout);
+  if (entry)
   {
-    contrast = -100.0;
-  }
-
-  medium_m   = 100.0/(medium_highlight - medium_shadow);
-  medium_mid = (medium_shadow + medium_highlight)/200.0 * maxin;
-
-  m = 1.0 + contrast/100.0;
-  b = (1.0 + brightness/100.0) * midin;
-
-  if (negative)
-  {
-    for (i=0; i <= maxin; i++)
-    {
-      val = ((double) i);
-
-      /* medium correction */
-      val = (val - medium_mid) * medium_m + midin;
-      xsane_bound_double(&val, 0.0, maxin);
-      val = maxin - val; /* invert */
-      val = maxin * pow( val/maxin, (1.0/medium_gamma) );
-
-      val = val - midin;
-
-      /* user correction */
-      val = val * m + b;
-      xsane_bound_double(&val, 0.0, maxin);
-      gammadata[i] = (int) (maxout * pow( val/maxin, (1.0/gamma) ));
-    }
+    memcpy(gammadata, entry->data, numbers * sizeof(SANE_Int));
+    return;
   }
-  else /* positive */
-  {
-    for (i=0; i <= maxin; i++)
-    {
-      val = ((double) i);
 
-      /* medium correction */
-      val = (val - medium_mid) * medium_m + midin;
-      xsane_bound_double(&val, 0.0, maxin);
-      val = maxin * pow( val/maxin, (1.0/medium_gamma) );
+  xsane_gamma_create_curve(NULL, gammadata, negative, gamma, brightness, contrast,
+                           medium_shadow, medium_highlight, medium_gamma, numbers, maxout + 1, maxout);
 
-      val = val - midin;
-
-      /* user correction */
-      val = val * m + b;
-      xsane_bound_double(&val, 0.0, maxin);
-      gammadata[i] = (int) (maxout * pow( val/maxin, (1.0/gamma) ));
-    }
-  }
+  xsane_gamma_cache_store(XSANE_GAMMA_CACHE_SANE, negative, gamma, brightness, contrast,
+                          medium_shadow, medium_highlight, medium_gamma, numbers, maxout, gammadata, numbers * sizeof(SANE_Int));
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
@@ -0,0 +1,445 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-job.c
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+#include "xsane-back-gtk.h"
+#include "xsane-front-gtk.h"
+#include "xsane-save.h"
+#include "xsane-text.h"
+#include "xsane-job.h"
+
+#ifdef HAVE_LIBPTHREAD
+# include <pthread.h>
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#define XSANE_JOB_TIMER_INTERVAL 200 /* ms */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifdef HAVE_LIBPTHREAD
+
+/* The job thread is started with the first job and waits for the next job until xsane exits. */
+/* Finished jobs are moved to the done list, the timer of the main thread reports them and */
+/* removes the timer when no job is left. */
+
+typedef struct XsaneJob
+{
+  char *output_filename;
+  char *input_filename;		/* temporary file, it is removed when the job is done */
+  int output_format;
+  int pdf_compression;
+  int apply_ICM_profile;
+  int cms_function;
+  int cms_intent;
+  int cms_bpc;
+  int print_filename;
+  int cancel_save;		/* set by the cancel button while the job is converted */
+  int status;			/* return value of xsane_save_image_as */
+  char *message;		/* first message of the job thread, shown by the main thread */
+  struct XsaneJob *next;
+} XsaneJob;
+
+typedef struct
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;		/* signals a new job to the job thread */
+  pthread_t thread;
+  int thread_started;
+  XsaneJob *queue;		/* waiting jobs, the first job is converted next */
+  int waiting;			/* number of jobs in queue */
+  XsaneJob *current;		/* job that is converted by the job thread */
+  XsaneJob *done;		/* finished jobs that are not reported by the main thread */
+  gdouble fraction;		/* progress of the current job */
+  char text[TEXTBUFSIZE];	/* progress text of the current job */
+  guint timer;			/* only used by the main thread */
+} XsaneJobQueue;
+
+static XsaneJobQueue xsane_job_queue = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_job_append(XsaneJob **list, XsaneJob *job)
+{
+  while (*list)
+  {
+    list = &(*list)->next;
+  }
+
+  job->next = NULL;
+  *list = job;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void *xsane_job_thread(void *data)
+{
+ XsaneJobQueue *queue = &xsane_job_queue;
+ XsaneJob *job;
+
+  pthread_mutex_lock(&queue->mutex);
+
+  while (1)
+  {
+    while (!queue->queue)
+    {
+      pthread_cond_wait(&queue->cond, &queue->mutex);
+    }
+
+    job = queue->queue;
+    queue->queue = job->next;
+    queue->waiting--;
+    queue->current = job;
+    queue->fraction = 0.0;
+    snprintf(queue->text, sizeof(queue->text), "%s: %s", PROGRESS_CONVERTING_DATA, job->output_filename);
+
+    pthread_mutex_unlock(&queue->mutex);
+
+    DBG(DBG_info, "xsane_job_thread: converting %s to %s\n", job->input_filename, job->output_filename);
+
+    /* the job thread has no progress bar, progress and messages are passed to the job */
+    job->status = xsane_save_image_as(job->output_filename, job->input_filename, job->output_format, job->pdf_compression,
+                                      job->apply_ICM_profile, job->cms_function, job->cms_intent, job->cms_bpc,
+                                      NULL, &job->cancel_save);
+    remove(job->input_filename);
+
+    pthread_mutex_lock(&queue->mutex);
+
+    queue->current = NULL;
+    xsane_job_append(&queue->done, job);
+  }
+
+ return NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_job_free(XsaneJob *job)
+{
+  free(job->output_filename);
+  free(job->input_filename);
+
+  if (job->message)
+  {
+    free(job->message);
+  }
+
+  free(job);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_job_report(XsaneJob *job)
+/* called by the main thread when the job is done */
+{
+  DBG(DBG_proc, "xsane_job_report(%s, status=%d)\n", job->output_filename, job->status);
+
+  if (job->message)
+  {
+    xsane_back_gtk_error(job->message, FALSE);
+  }
+
+  if ((job->print_filename) && (!job->status)) /* print created filenames to stdout? */
+  {
+    if (job->output_filename[0] != '/') /* relative path */
+    {
+     char pathname[512];
+      getcwd(pathname, sizeof(pathname));
+      printf("XSANE_IMAGE_FILENAME: %s/%s\n", pathname, job->output_filename);
+      fflush(stdout);
+    }
+    else /* absolute path */
+    {
+      printf("XSANE_IMAGE_FILENAME: %s\n", job->output_filename);
+      fflush(stdout);
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static gint xsane_job_timer_callback(gpointer data)
+/* shows the progress of the job thread in the main window and reports finished jobs */
+{
+ XsaneJobQueue *queue = &xsane_job_queue;
+ XsaneJob *done, *job;
+ char text[TEXTBUFSIZE];
+ gdouble fraction;
+ int waiting;
+ int busy;
+
+  pthread_mutex_lock(&queue->mutex);
+
+  done = queue->done;
+  queue->done = NULL;
+  busy = (queue->current || queue->queue);
+  waiting = (queue->current) ? queue->waiting : queue->waiting - 1; /* the first job is about to start */
+  fraction = queue->fraction;
+
+  if (waiting > 0)
+  {
+    snprintf(text, sizeof(text), PROGRESS_JOBS_WAITING, queue->text, waiting);
+  }
+  else
+  {
+    snprintf(text, sizeof(text), "%s", queue->text);
+  }
+
+  pthread_mutex_unlock(&queue->mutex);
+
+  while (done)
+  {
+    job = done;
+    done = job->next;
+
+    xsane_job_report(job);
+    xsane_job_free(job);
+  }
+
+  if (!busy)
+  {
+    DBG(DBG_info, "xsane_job_timer_callback: all jobs done\n");
+
+    gtk_widget_hide(GTK_WIDGET(xsane.job_progress_bar));
+    gtk_widget_hide(xsane.job_cancel_button);
+    queue->timer = 0;
+
+   return FALSE; /* remove timer */
+  }
+
+  gtk_progress_set_format_string(GTK_PROGRESS(xsane.job_progress_bar), text);
+  gtk_progress_bar_set_fraction(xsane.job_progress_bar, fraction);
+  gtk_widget_show(GTK_WIDGET(xsane.job_progress_bar));
+  gtk_widget_show(xsane.job_cancel_button);
+
+ return TRUE; /* call timer again */
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_job_add_save(char *output_filename, char *input_filename, int output_format, int pdf_compression,
+                       int apply_ICM_profile, int cms_function, int cms_intent, int cms_bpc, int print_filename)
+/* the job removes input_filename when it is done, returns -1 if the image is not converted by the job thread */
+{
+ XsaneJobQueue *queue = &xsane_job_queue;
+ sigset_t all_signals, old_signals;
+ XsaneJob *job;
+
+  DBG(DBG_proc, "xsane_job_add_save(%s, %s)\n", output_filename, input_filename);
+
+  if (!queue->thread_started)
+  {
+    /* signals are handled by the main thread */
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals);
+
+    if (!pthread_create(&queue->thread, NULL, xsane_job_thread, NULL))
+    {
+      pthread_detach(queue->thread);
+      queue->thread_started = TRUE;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    if (!queue->thread_started)
+    {
+      DBG(DBG_error, "xsane_job_add_save: could not create job thread\n");
+     return -1;
+    }
+  }
+
+  job = calloc(1, sizeof(XsaneJob));
+  if (!job)
+  {
+   return -1;
+  }
+
+  job->output_filename   = strdup(output_filename);
+  job->input_filename    = strdup(input_filename);
+  job->output_format     = output_format;
+  job->pdf_compression   = pdf_compression;
+  job->apply_ICM_profile = apply_ICM_profile;
+  job->cms_function      = cms_function;
+  job->cms_intent        = cms_intent;
+  job->cms_bpc           = cms_bpc;
+  job->print_filename    = print_filename;
+
+  pthread_mutex_lock(&queue->mutex);
+
+  if ((!queue->current) && (!queue->queue)) /* job thread is idle */
+  {
+    queue->fraction = 0.0;
+    snprintf(queue->text, sizeof(queue->text), "%s: %s", PROGRESS_CONVERTING_DATA, output_filename);
+  }
+
+  xsane_job_append(&queue->queue, job);
+  queue->waiting++;
+  pthread_cond_signal(&queue->cond);
+  pthread_mutex_unlock(&queue->mutex);
+
+  if (!queue->timer)
+  {
+    queue->timer = gtk_timeout_add(XSANE_JOB_TIMER_INTERVAL, (GtkFunction) xsane_job_timer_callback, NULL);
+  }
+
+  xsane_job_timer_callback(NULL); /* show the job at once */
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_job_worker_thread(void)
+/* returns TRUE if the calling thread is the job thread */
+{
+ return ((xsane_job_queue.thread_started) && (pthread_equal(pthread_self(), xsane_job_queue.thread)));
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_job_set_progress(gdouble fraction)
+{
+  pthread_mutex_lock(&xsane_job_queue.mutex);
+  xsane_job_queue.fraction = fraction;
+  pthread_mutex_unlock(&xsane_job_queue.mutex);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_job_set_text(const char *text)
+{
+  if ((!text) || (!text[0])) /* the save functions clear the text when they are done, the job keeps its filename */
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&xsane_job_queue.mutex);
+  snprintf(xsane_job_queue.text, sizeof(xsane_job_queue.text), "%s", text);
+  pthread_mutex_unlock(&xsane_job_queue.mutex);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_job_message(const char *message)
+/* stores the first message of the current job */
+{
+ XsaneJob *job;
+
+  DBG(DBG_info, "xsane_job_message: %s\n", message);
+
+  pthread_mutex_lock(&xsane_job_queue.mutex);
+
+  job = xsane_job_queue.current;
+  if ((job) && (!job->message))
+  {
+    job->message = strdup(message);
+  }
+
+  pthread_mutex_unlock(&xsane_job_queue.mutex);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_job_cancel_callback(GtkWidget *widget, gpointer data)
+/* cancels the current job, the waiting jobs are converted */
+{
+  DBG(DBG_proc, "xsane_job_cancel_callback\n");
+
+  pthread_mutex_lock(&xsane_job_queue.mutex);
+
+  if (xsane_job_queue.current)
+  {
+    xsane_job_queue.current->cancel_save = TRUE;
+  }
+
+  pthread_mutex_unlock(&xsane_job_queue.mutex);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_job_finish(void)
+/* waits until all jobs are done and reported, the main window is updated while we wait */
+{
+  DBG(DBG_proc, "xsane_job_finish\n");
+
+  while (xsane_job_queue.timer)
+  {
+    gtk_main_iteration();
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#else /* HAVE_LIBPTHREAD */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_job_add_save(char *output_filename, char *input_filename, int output_format, int pdf_compression,
+                       int apply_ICM_profile, int cms_function, int cms_intent, int cms_bpc, int print_filename)
+{
+ return -1; /* the caller converts the image */
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_job_worker_thread(void)
+{
+ return FALSE;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_job_set_progress(gdouble fraction)
+{
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_job_set_text(const char *text)
+{
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_job_message(const char *message)
+{
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_job_cancel_callback(GtkWidget *widget, gpointer data)
+{
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_job_finish(void)
+{
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#endif /* HAVE_LIBPTHREAD */
@@ -0,0 +1,58 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-job.h
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifndef HAVE_XSANE_JOB_H
+#define HAVE_XSANE_JOB_H
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* Scans that have to be converted into the output format are put into a job queue. A job thread
+ * converts one image after the other while the next scan is already running. The job thread
+ * does not call gtk: xsane_progress_bar_set_fraction and the message dialogs of xsane-back-gtk.c
+ * pass progress and messages to the job, a timer of the main thread shows them in the main window.
+ * xsane_job_add_save returns -1 when the image has to be converted by the caller (no pthread support).
+ * Only save mode scans are queued: multipage pages are appended to the stream of the project
+ * when they are scanned (xsane_multipage_project_append_page), fax and email pages are
+ * converted when the project is sent.
+ */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+extern int xsane_job_add_save(char *output_filename, char *input_filename, int output_format, int pdf_compression,
+                              int apply_ICM_profile, int cms_function, int cms_intent, int cms_bpc, int print_filename);
+extern int xsane_job_worker_thread(void);
+extern void xsane_job_set_progress(gdouble fraction);
+extern void xsane_job_set_text(const char *text);
+extern void xsane_job_message(const char *message);
+extern void xsane_job_cancel_callback(GtkWidget *widget, gpointer data);
+extern void xsane_job_finish(void);
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+#endif
+/* ---------------------------------------------------------------------------------------------------------------------- */
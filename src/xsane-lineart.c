@@ -0,0 +1,204 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-lineart.c
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+#include "xsane-lineart.h"
+
+/* the avx2 kernels are compiled with a function attribute and selected at runtime, */
+/* so xsane still runs on cpus without avx2 */
+#if defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))) && (defined(__x86_64__) || defined(__i386__))
+# define XSANE_LINEART_AVX2
+# include <immintrin.h>
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void (*xsane_lineart_expand_function)(unsigned char *in, unsigned char *out, int pixels) = NULL;
+static void (*xsane_lineart_pack_function)(unsigned char *in, unsigned char *out, int pixels) = NULL;
+
+static unsigned char xsane_lineart_expand_table[256][8]; /* 8 grayscale pixels for each lineart byte */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_lineart_expand_scalar(unsigned char *in, unsigned char *out, int pixels)
+{
+ int i;
+
+  for (i = 0; i + 8 <= pixels; i += 8)
+  {
+    memcpy(out + i, xsane_lineart_expand_table[*in++], 8);
+  }
+
+  if (i < pixels) /* padding bits of the last byte are not expanded */
+  {
+    memcpy(out + i, xsane_lineart_expand_table[*in], pixels - i);
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_lineart_pack_scalar(unsigned char *in, unsigned char *out, int pixels)
+{
+ unsigned char packed;
+ int i, bit;
+
+  for (i = 0; i + 8 <= pixels; i += 8)
+  {
+    packed = 0;
+
+    for (bit = 0; bit < 8; bit++)
+    {
+      packed = (packed << 1) | (in[i + bit] == 0); /* white gets 0 bit, black gets 1 bit */
+    }
+
+    *out++ = packed;
+  }
+
+  if (i < pixels) /* the last byte is filled with white */
+  {
+    packed = 0;
+
+    for (bit = 0; bit < 8; bit++)
+    {
+      packed = (packed << 1) | ((i + bit < pixels) && (in[i + bit] == 0));
+    }
+
+    *out = packed;
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifdef XSANE_LINEART_AVX2
+__attribute__((target("avx2")))
+static void xsane_lineart_expand_avx2(unsigned char *in, unsigned char *out, int pixels)
+/* 4 input bytes are broadcast, each output byte gets the input byte of its pixel, */
+/* is masked with the bit of its pixel and compared with zero: a clear bit gets 0xff */
+{
+ const __m256i select = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                         2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+ const __m256i bits = _mm256_set1_epi64x((long long) 0x0102040810204080LL);
+ const __m256i zero = _mm256_setzero_si256();
+ __m256i v;
+ int packed;
+ int i;
+
+  for (i = 0; i + 32 <= pixels; i += 32)
+  {
+    memcpy(&packed, in, 4);
+    in += 4;
+
+    v = _mm256_shuffle_epi8(_mm256_set1_epi32(packed), select);
+    v = _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), zero);
+    _mm256_storeu_si256((__m256i *) (out + i), v);
+  }
+
+  xsane_lineart_expand_scalar(in, out + i, pixels - i);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static void xsane_lineart_pack_avx2(unsigned char *in, unsigned char *out, int pixels)
+/* the pixels of each output byte are reversed so that the movemask of the black */
+/* pixels has the first pixel in the highest bit of each byte */
+{
+ const __m256i reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                          7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+ const __m256i zero = _mm256_setzero_si256();
+ __m256i v;
+ int packed;
+ int i;
+
+  for (i = 0; i + 32 <= pixels; i += 32)
+  {
+    v = _mm256_loadu_si256((const __m256i *) (in + i));
+    v = _mm256_cmpeq_epi8(_mm256_shuffle_epi8(v, reverse), zero);
+    packed = _mm256_movemask_epi8(v);
+    memcpy(out, &packed, 4); /* x86 is little endian, the first byte of the mask is the first output byte */
+    out += 4;
+  }
+
+  xsane_lineart_pack_scalar(in + i, out, pixels - i);
+}
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_lineart_init(void)
+{
+ int val, bit;
+
+  for (val = 0; val < 256; val++)
+  {
+    for (bit = 0; bit < 8; bit++)
+    {
+      xsane_lineart_expand_table[val][bit] = (val & (0x80 >> bit)) ? 0x00 : 0xff; /* black bit gets 0, white bit gets 255 */
+    }
+  }
+
+  xsane_lineart_expand_function = xsane_lineart_expand_scalar;
+  xsane_lineart_pack_function   = xsane_lineart_pack_scalar;
+
+#ifdef XSANE_LINEART_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+  {
+    xsane_lineart_expand_function = xsane_lineart_expand_avx2;
+    xsane_lineart_pack_function   = xsane_lineart_pack_avx2;
+  }
+#endif
+
+  DBG(DBG_info, "xsane_lineart: using %s kernels\n", (xsane_lineart_expand_function == xsane_lineart_expand_scalar) ? "scalar" : "avx2");
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_lineart_expand(unsigned char *in, unsigned char *out, int pixels)
+/* expands (pixels + 7) / 8 bytes of lineart data to pixels bytes of grayscale data */
+{
+  if (!xsane_lineart_expand_function)
+  {
+    xsane_lineart_init();
+  }
+
+  xsane_lineart_expand_function(in, out, pixels);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_lineart_pack(unsigned char *in, unsigned char *out, int pixels)
+/* packs pixels bytes of grayscale data into (pixels + 7) / 8 bytes of lineart data, */
+/* only 0x00 is black */
+{
+  if (!xsane_lineart_pack_function)
+  {
+    xsane_lineart_init();
+  }
+
+  xsane_lineart_pack_function(in, out, pixels);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
@@ -0,0 +1,48 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-lineart.h
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifndef HAVE_XSANE_LINEART_H
+#define HAVE_XSANE_LINEART_H
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* Conversion between packed 1 bit lineart data (first pixel in the highest bit, set bit = black)
+ * and 8 bit grayscale data (black = 0x00, white = 0xff). Both kernels work on whole bytes:
+ * the expansion looks up 8 output pixels per input byte in a table, the packing compares
+ * 8 pixels at once. When the cpu supports AVX2, 32 pixels are converted per instruction sequence.
+ */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+extern void xsane_lineart_expand(unsigned char *in, unsigned char *out, int pixels);
+extern void xsane_lineart_pack(unsigned char *in, unsigned char *out, int pixels);
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+#endif
+/* ---------------------------------------------------------------------------------------------------------------------- */
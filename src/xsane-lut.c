@@ -0,0 +1,628 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-lut.c
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+#include "xsane-lut.h"
+
+/* the sse2 and avx2 kernels are compiled with a function attribute and selected at runtime, */
+/* so xsane still runs on cpus without sse2 / avx2 */
+#if defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))) && (defined(__x86_64__) || defined(__i386__))
+# define XSANE_LUT_SSE2
+# define XSANE_LUT_AVX2
+# include <immintrin.h>
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* gather instructions read 4 bytes for each value, the table is padded so the last entry can be read */
+#define XSANE_LUT_TABLE_PADDING 4
+
+static int (*xsane_lut_apply_function)(XsaneLut *lut, void *in, void *out, int samples, int channel) = NULL;
+static int xsane_lut_kernel = XSANE_LUT_KERNEL_AUTO;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+XsaneLut *xsane_lut_new(int channels, int input_depth, int input_bits, int output_depth)
+/* input_bits <= input_depth: only the upper input_bits of a sample are used as index (preview tables) */
+{
+ XsaneLut *lut;
+ int bytespe;
+ int c, i, k;
+
+  DBG(DBG_proc, "xsane_lut_new(channels=%d, input_depth=%d, input_bits=%d, output_depth=%d)\n", channels, input_depth, input_bits, output_depth);
+
+  if ( (channels < 1) || (channels > XSANE_LUT_MAX_CHANNELS) ||
+       ((input_depth != 8) && (input_depth != 16)) ||
+       ((output_depth != 8) && (output_depth != 16)) ||
+       (output_depth > input_depth) ||
+       (input_bits < 1) || (input_bits > input_depth) )
+  {
+    DBG(DBG_error, "xsane_lut_new: unsupported lut format\n");
+   return NULL;
+  }
+
+  lut = calloc(1, sizeof(XsaneLut));
+  if (!lut)
+  {
+   return NULL;
+  }
+
+  lut->channels     = channels;
+  lut->input_depth  = input_depth;
+  lut->input_shift  = input_depth - input_bits;
+  lut->output_depth = output_depth;
+  lut->entries      = 1 << input_bits;
+
+  bytespe = output_depth / 8;
+  lut->table = malloc(channels * lut->entries * bytespe + XSANE_LUT_TABLE_PADDING);
+  if (!lut->table)
+  {
+    free(lut);
+   return NULL;
+  }
+  memset(lut->table + channels * lut->entries * bytespe, 0, XSANE_LUT_TABLE_PADDING);
+
+  for (c = 0; c < channels; c++)
+  {
+    xsane_lut_set_table(lut, c, NULL); /* identity */
+  }
+
+  /* the channel of a sample repeats after lcm(8, channels) samples */
+  lut->period = 1;
+  while ((lut->period * 8) % channels)
+  {
+    lut->period++;
+  }
+
+  for (i = 0; i < lut->period; i++)
+  {
+    for (k = 0; k < 8; k++)
+    {
+      lut->offset[i][k] = ((i * 8 + k) % channels) * lut->entries;
+    }
+  }
+
+ return lut;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_lut_free(XsaneLut *lut)
+{
+  if (!lut)
+  {
+    return;
+  }
+
+  free(lut->table);
+  free(lut);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_lut_set_table(XsaneLut *lut, int channel, SANE_Int *table)
+/* table has lut->entries entries with values in the range of the input bits, NULL = identity */
+{
+ int input_bits = lut->input_depth - lut->input_shift;
+ int i, val;
+
+  for (i = 0; i < lut->entries; i++)
+  {
+    val = table ? table[i] : i;
+
+    if (input_bits > lut->output_depth)
+    {
+      val >>= input_bits - lut->output_depth;
+    }
+    else if (input_bits < lut->output_depth) /* identity of a reduced index */
+    {
+      val <<= lut->output_depth - input_bits;
+    }
+
+    if (val < 0)
+    {
+      val = 0;
+    }
+    else if (val >= (1 << lut->output_depth))
+    {
+      val = (1 << lut->output_depth) - 1;
+    }
+
+    if (lut->output_depth == 8)
+    {
+      lut->table[channel * lut->entries + i] = val;
+    }
+    else
+    {
+      ((guint16 *) lut->table)[channel * lut->entries + i] = val;
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_lut_set_table_8(XsaneLut *lut, int channel, u_char *table)
+/* table has lut->entries entries with 8 bit values (preview gamma tables) */
+{
+ int i;
+
+  for (i = 0; i < lut->entries; i++)
+  {
+    if (lut->output_depth == 8)
+    {
+      lut->table[channel * lut->entries + i] = table[i];
+    }
+    else
+    {
+      ((guint16 *) lut->table)[channel * lut->entries + i] = table[i] * 257;
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* scalar kernel: the loop for 3 channels is unrolled so the table of a sample is known */
+/* without looking at the channel counter. in and out may be the same buffer, so the */
+/* compiler can not reorder loads and stores, we do it by hand */
+#define XSANE_LUT_APPLY_SCALAR(in_type, out_type)							\
+{													\
+ const in_type *src = (const in_type *) in;								\
+ out_type *dst = (out_type *) out;									\
+ const out_type *table = (const out_type *) lut->table;						\
+ const out_type *table1 = table + lut->entries;								\
+ const out_type *table2 = table1 + lut->entries;							\
+ int shift = lut->input_shift;										\
+ int i = 0;												\
+													\
+  if (lut->channels == 1)										\
+  {													\
+    for (; i < samples; i++)										\
+    {													\
+      dst[i] = table[src[i] >> shift];									\
+    }													\
+   return 0;												\
+  }													\
+													\
+  while ((i < samples) && (channel)) /* complete the pixel of the last call */				\
+  {													\
+    dst[i] = table[channel * lut->entries + (src[i] >> shift)];					\
+    i++;												\
+    if (++channel == lut->channels)									\
+    {													\
+      channel = 0;											\
+    }													\
+  }													\
+													\
+  if (lut->channels == 3) /* all samples of a pixel are read before the first one is written */	\
+  {													\
+    if (!shift)												\
+    {													\
+      for (; i + 3 <= samples; i += 3)									\
+      {													\
+       out_type r = table[src[i]], g = table1[src[i + 1]], b = table2[src[i + 2]];			\
+													\
+        dst[i]     = r;										\
+        dst[i + 1] = g;										\
+        dst[i + 2] = b;										\
+      }													\
+    }													\
+    else												\
+    {													\
+      for (; i + 3 <= samples; i += 3)									\
+      {													\
+       out_type r = table[src[i] >> shift], g = table1[src[i + 1] >> shift], b = table2[src[i + 2] >> shift]; \
+													\
+        dst[i]     = r;										\
+        dst[i + 1] = g;										\
+        dst[i + 2] = b;										\
+      }													\
+    }													\
+  }													\
+													\
+  for (; i < samples; i++)										\
+  {													\
+    dst[i] = table[channel * lut->entries + (src[i] >> shift)];					\
+    if (++channel == lut->channels)									\
+    {													\
+      channel = 0;											\
+    }													\
+  }													\
+													\
+ return channel;											\
+}
+
+static int xsane_lut_apply_scalar(XsaneLut *lut, void *in, void *out, int samples, int channel)
+{
+  if (lut->input_depth == 8)
+  {
+    XSANE_LUT_APPLY_SCALAR(guint8, guint8);
+  }
+  else if (lut->output_depth == 8)
+  {
+    XSANE_LUT_APPLY_SCALAR(guint16, guint8);
+  }
+  else
+  {
+    XSANE_LUT_APPLY_SCALAR(guint16, guint16);
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifdef XSANE_LUT_SSE2
+/* sse2 has no gather instruction: the table values are loaded one by one and inserted */
+/* into a register with pinsrw, 16 bytes are written with one store. all samples of a */
+/* block are read before it is written, so in and out may be the same buffer. */
+/* for 1, 2 and 4 channels a sample position of a block always uses the same table, */
+/* the block functions are inlined with a constant channel number so the table pointers */
+/* stay in registers. for 3 channels the unrolled scalar loop is faster (tests/xsane-lut-bench) */
+
+#define XSANE_LUT_SSE2_PAIR(k)											\
+  v = _mm_insert_epi16(v, table[(2 * (k)) % channels][src[2 * (k)] >> shift] |					\
+                          (table[(2 * (k) + 1) % channels][src[2 * (k) + 1] >> shift] << 8), k)
+
+#define XSANE_LUT_SSE2_BLOCK_8(name, in_type)									\
+__attribute__((target("sse2"), always_inline))									\
+static inline void name(const in_type *src, guint8 *dst, const guint8 **table, int channels, int shift)	\
+{														\
+ __m128i v = _mm_setzero_si128();										\
+														\
+  XSANE_LUT_SSE2_PAIR(0);											\
+  XSANE_LUT_SSE2_PAIR(1);											\
+  XSANE_LUT_SSE2_PAIR(2);											\
+  XSANE_LUT_SSE2_PAIR(3);											\
+  XSANE_LUT_SSE2_PAIR(4);											\
+  XSANE_LUT_SSE2_PAIR(5);											\
+  XSANE_LUT_SSE2_PAIR(6);											\
+  XSANE_LUT_SSE2_PAIR(7);											\
+  _mm_storeu_si128((__m128i *) dst, v);										\
+}
+
+XSANE_LUT_SSE2_BLOCK_8(xsane_lut_sse2_block_8_8, guint8)
+XSANE_LUT_SSE2_BLOCK_8(xsane_lut_sse2_block_16_8, guint16)
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+__attribute__((target("sse2"), always_inline))
+static inline void xsane_lut_sse2_block_16_16(const guint16 *src, guint16 *dst, const guint16 **table, int channels, int shift)
+{
+ __m128i v = _mm_setzero_si128();
+
+  v = _mm_insert_epi16(v, table[0][src[0] >> shift], 0);
+  v = _mm_insert_epi16(v, table[1 % channels][src[1] >> shift], 1);
+  v = _mm_insert_epi16(v, table[2 % channels][src[2] >> shift], 2);
+  v = _mm_insert_epi16(v, table[3 % channels][src[3] >> shift], 3);
+  v = _mm_insert_epi16(v, table[4 % channels][src[4] >> shift], 4);
+  v = _mm_insert_epi16(v, table[5 % channels][src[5] >> shift], 5);
+  v = _mm_insert_epi16(v, table[6 % channels][src[6] >> shift], 6);
+  v = _mm_insert_epi16(v, table[7 % channels][src[7] >> shift], 7);
+  _mm_storeu_si128((__m128i *) dst, v);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+__attribute__((target("sse2"), always_inline))
+static inline int xsane_lut_sse2_blocks(XsaneLut *lut, void *in, void *out, int samples, int channels)
+/* the first sample is channel 0, returns the number of samples that have been done */
+{
+ int shift = lut->input_shift;
+ int i = 0;
+ int c;
+
+  if (lut->output_depth == 16)
+  {
+   const guint16 *table[XSANE_LUT_MAX_CHANNELS];
+
+    for (c = 0; c < XSANE_LUT_MAX_CHANNELS; c++)
+    {
+      table[c] = (const guint16 *) lut->table + (c % channels) * lut->entries;
+    }
+
+    for (; i + 8 <= samples; i += 8)
+    {
+      xsane_lut_sse2_block_16_16((const guint16 *) in + i, (guint16 *) out + i, table, channels, shift);
+    }
+  }
+  else
+  {
+   const guint8 *table[XSANE_LUT_MAX_CHANNELS];
+
+    for (c = 0; c < XSANE_LUT_MAX_CHANNELS; c++)
+    {
+      table[c] = lut->table + (c % channels) * lut->entries;
+    }
+
+    if (lut->input_depth == 8)
+    {
+      for (; i + 16 <= samples; i += 16)
+      {
+        xsane_lut_sse2_block_8_8((const guint8 *) in + i, (guint8 *) out + i, table, channels, shift);
+      }
+    }
+    else
+    {
+      for (; i + 16 <= samples; i += 16)
+      {
+        xsane_lut_sse2_block_16_8((const guint16 *) in + i, (guint8 *) out + i, table, channels, shift);
+      }
+    }
+  }
+
+ return i;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+__attribute__((target("sse2")))
+static int xsane_lut_apply_sse2(XsaneLut *lut, void *in, void *out, int samples, int channel)
+{
+ int in_bytes  = lut->input_depth / 8;
+ int out_bytes = lut->output_depth / 8;
+ int head, done, i;
+
+  if (lut->channels == 3)
+  {
+   return xsane_lut_apply_scalar(lut, in, out, samples, channel);
+  }
+
+  /* the scalar kernel completes the pixel of the last call, the sse2 loop then */
+  /* always starts with channel 0 */
+  head = (lut->channels - channel) % lut->channels;
+  if (head > samples)
+  {
+    head = samples;
+  }
+  if (head)
+  {
+    channel = xsane_lut_apply_scalar(lut, in, out, head, channel);
+  }
+
+  in  = (guint8 *) in + head * in_bytes;
+  out = (guint8 *) out + head * out_bytes;
+
+  switch (lut->channels)
+  {
+    case 1:
+      done = xsane_lut_sse2_blocks(lut, in, out, samples - head, 1);
+     break;
+
+    case 2:
+      done = xsane_lut_sse2_blocks(lut, in, out, samples - head, 2);
+     break;
+
+    default:
+      done = xsane_lut_sse2_blocks(lut, in, out, samples - head, 4);
+     break;
+  }
+
+  /* a block has a multiple of channels samples */
+  i = head + done;
+  if (i < samples)
+  {
+    channel = xsane_lut_apply_scalar(lut, (guint8 *) in + done * in_bytes, (guint8 *) out + done * out_bytes, samples - i, 0);
+  }
+  else if (done)
+  {
+    channel = 0;
+  }
+
+ return channel;
+}
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifdef XSANE_LUT_AVX2
+__attribute__((target("avx2")))
+static int xsane_lut_apply_avx2(XsaneLut *lut, void *in, void *out, int samples, int channel)
+{
+ __m128i shift = _mm_cvtsi32_si128(lut->input_shift);
+ __m256i mask;
+ __m256i offset[XSANE_LUT_MAX_CHANNELS];
+ __m256i idx0, idx1, val0, val1;
+ __m128i src;
+ int head, blocks, phase, i;
+
+  /* the scalar kernel completes the pixel of the last call, the avx2 loop then */
+  /* always starts with channel 0 */
+  head = (lut->channels - channel) % lut->channels;
+  if (head > samples)
+  {
+    head = samples;
+  }
+  if (head)
+  {
+    channel = xsane_lut_apply_scalar(lut, in, out, head, channel);
+  }
+
+  for (i = 0; i < lut->period; i++)
+  {
+    offset[i] = _mm256_loadu_si256((const __m256i *) lut->offset[i]);
+  }
+
+  mask   = _mm256_set1_epi32((lut->output_depth == 8) ? 0xff : 0xffff);
+  blocks = (samples - head) / 16;
+  phase  = 0;
+
+  for (i = 0; i < blocks; i++)
+  {
+   int pos = head + i * 16;
+
+    if (lut->input_depth == 8)
+    {
+      src  = _mm_loadu_si128((const __m128i *) ((const guint8 *) in + pos));
+      idx0 = _mm256_cvtepu8_epi32(src);
+      idx1 = _mm256_cvtepu8_epi32(_mm_srli_si128(src, 8));
+    }
+    else
+    {
+     __m256i src16 = _mm256_loadu_si256((const __m256i *) ((const guint16 *) in + pos));
+
+      idx0 = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(src16));
+      idx1 = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(src16, 1));
+    }
+
+    idx0 = _mm256_add_epi32(_mm256_srl_epi32(idx0, shift), offset[phase]);
+    if (++phase == lut->period)
+    {
+      phase = 0;
+    }
+    idx1 = _mm256_add_epi32(_mm256_srl_epi32(idx1, shift), offset[phase]);
+    if (++phase == lut->period)
+    {
+      phase = 0;
+    }
+
+    if (lut->output_depth == 8)
+    {
+      val0 = _mm256_and_si256(_mm256_i32gather_epi32((const int *) lut->table, idx0, 1), mask);
+      val1 = _mm256_and_si256(_mm256_i32gather_epi32((const int *) lut->table, idx1, 1), mask);
+    }
+    else
+    {
+      val0 = _mm256_and_si256(_mm256_i32gather_epi32((const int *) lut->table, idx0, 2), mask);
+      val1 = _mm256_and_si256(_mm256_i32gather_epi32((const int *) lut->table, idx1, 2), mask);
+    }
+
+    /* 16 values of 32 bit -> 16 values of 16 bit in the right order */
+    val0 = _mm256_permute4x64_epi64(_mm256_packus_epi32(val0, val1), 0xd8);
+
+    if (lut->output_depth == 8)
+    {
+      _mm_storeu_si128((__m128i *) ((guint8 *) out + pos),
+                       _mm_packus_epi16(_mm256_castsi256_si128(val0), _mm256_extracti128_si256(val0, 1)));
+    }
+    else
+    {
+      _mm256_storeu_si256((__m256i *) ((guint16 *) out + pos), val0);
+    }
+  }
+
+  i = head + blocks * 16;
+  if (i < samples)
+  {
+   int in_bytes  = lut->input_depth / 8;
+   int out_bytes = lut->output_depth / 8;
+
+    channel = xsane_lut_apply_scalar(lut, (guint8 *) in + i * in_bytes, (guint8 *) out + i * out_bytes, samples - i,
+                                     (blocks * 16) % lut->channels);
+  }
+  else if (blocks)
+  {
+    channel = (blocks * 16) % lut->channels;
+  }
+
+ return channel;
+}
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_lut_set_kernel(int kernel)
+/* selects the kernel that is used by xsane_lut_apply (test programs), XSANE_LUT_KERNEL_AUTO */
+/* selects the fastest kernel the cpu supports. returns -1 if the kernel is not available */
+{
+ int (*function)(XsaneLut *lut, void *in, void *out, int samples, int channel) = xsane_lut_apply_scalar;
+ const char *name = "scalar";
+
+#if defined(XSANE_LUT_SSE2) || defined(XSANE_LUT_AVX2)
+  __builtin_cpu_init();
+#endif
+
+  switch (kernel)
+  {
+    case XSANE_LUT_KERNEL_AUTO:
+#ifdef XSANE_LUT_SSE2
+      if (__builtin_cpu_supports("sse2"))
+      {
+        function = xsane_lut_apply_sse2;
+        name = "sse2";
+      }
+#endif
+#ifdef XSANE_LUT_AVX2
+      if (__builtin_cpu_supports("avx2"))
+      {
+        function = xsane_lut_apply_avx2;
+        name = "avx2";
+      }
+#endif
+     break;
+
+    case XSANE_LUT_KERNEL_SCALAR:
+     break;
+
+    case XSANE_LUT_KERNEL_SSE2:
+#ifdef XSANE_LUT_SSE2
+      if (__builtin_cpu_supports("sse2"))
+      {
+        function = xsane_lut_apply_sse2;
+        name = "sse2";
+       break;
+      }
+#endif
+     return -1;
+
+    case XSANE_LUT_KERNEL_AVX2:
+#ifdef XSANE_LUT_AVX2
+      if (__builtin_cpu_supports("avx2"))
+      {
+        function = xsane_lut_apply_avx2;
+        name = "avx2";
+       break;
+      }
+#endif
+     return -1;
+
+    default:
+     return -1;
+  }
+
+  DBG(DBG_info, "xsane_lut_set_kernel: using %s kernel\n", name);
+
+  xsane_lut_apply_function = function;
+  xsane_lut_kernel = kernel;
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_lut_apply(XsaneLut *lut, void *in, void *out, int samples, int channel)
+/* applies the lut to samples values, in and out may be the same buffer. */
+/* channel is the channel of the first sample, the channel of the next sample is returned */
+{
+  if (!xsane_lut_apply_function)
+  {
+    xsane_lut_set_kernel(XSANE_LUT_KERNEL_AUTO);
+  }
+
+  if (samples <= 0)
+  {
+   return channel;
+  }
+
+ return xsane_lut_apply_function(lut, in, out, samples, channel);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
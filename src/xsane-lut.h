@@ -0,0 +1,74 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-lut.h
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifndef HAVE_XSANE_LUT_H
+#define HAVE_XSANE_LUT_H
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* A lut applies one lookup table per channel to interleaved image data.
+ * The SANE_Int gamma tables are converted to compact 8 or 16 bit tables that
+ * are stored one after the other (de-interleaved), so the lookup for a sample
+ * only depends on its position in the pixel and no per sample branches are needed.
+ * xsane_lut_apply uses AVX2 gather instructions or SSE2 stores when the cpu supports them.
+ */
+
+#define XSANE_LUT_MAX_CHANNELS 4
+
+enum
+{
+  XSANE_LUT_KERNEL_AUTO = 0,
+  XSANE_LUT_KERNEL_SCALAR,
+  XSANE_LUT_KERNEL_SSE2,
+  XSANE_LUT_KERNEL_AVX2
+};
+
+typedef struct XsaneLut
+{
+  int channels;			/* samples per pixel */
+  int input_depth;		/* 8 or 16 bits per input sample */
+  int input_shift;		/* input sample is shifted right by input_shift before the lookup */
+  int output_depth;		/* 8 or 16 bits per output sample */
+  int entries;			/* entries per channel table */
+  unsigned char *table;		/* channels * entries values of output_depth bits */
+  int period;			/* number of 8 sample blocks until the channel pattern repeats */
+  int offset[XSANE_LUT_MAX_CHANNELS][8];	/* table offsets for the 8 sample blocks */
+} XsaneLut;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+extern XsaneLut *xsane_lut_new(int channels, int input_depth, int input_bits, int output_depth);
+extern void xsane_lut_free(XsaneLut *lut);
+extern void xsane_lut_set_table(XsaneLut *lut, int channel, SANE_Int *table);
+extern void xsane_lut_set_table_8(XsaneLut *lut, int channel, u_char *table);
+extern int xsane_lut_set_kernel(int kernel);
+extern int xsane_lut_apply(XsaneLut *lut, void *in, void *out, int samples, int channel);
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+#endif
+/* ---------------------------------------------------------------------------------------------------------------------- */
@@ -55,6 +55,7 @@ void xsane_multipage_dialog_close(void);
 void xsane_multipage_project_save(void);
 static gint xsane_multipage_dialog_delete();
 static void xsane_multipage_filetype_callback(GtkWidget *filetype_option_menu, char *filetype);
+static void xsane_multipage_pdf_compression_callback(GtkWidget *widget, gpointer data);
 static void xsane_multipage_project_browse_filename_callback(GtkWidget *widget, gpointer data);
 static void xsane_multipage_project_changed_callback(GtkWidget *widget, gpointer data);
 static void xsane_multipage_project_load(void);
@@ -65,6 +66,14 @@ static void xsane_multipage_entry_move_down_callback(GtkWidget *widget, gpointer
 static void xsane_multipage_entry_delete_callback(GtkWidget *widget, gpointer list);
 static void xsane_multipage_show_callback(GtkWidget *widget, gpointer data);
 static void xsane_multipage_edit_callback(GtkWidget *widget, gpointer data);
+static void xsane_multipage_stream_filenames(char *stream_filename, char *list_filename);
+static void xsane_multipage_stream_remove(void);
+static int xsane_multipage_stream_settings(char *settings, size_t size);
+static int xsane_multipage_stream_load(struct pdf_xref *xref);
+static FILE *xsane_multipage_open_page(char *source_filename, size_t size, Image_info *image_info, int *remove_lineart_file, int *cancel_save);
+void xsane_multipage_project_append_page(void);
+static int xsane_multipage_save_stream(char *multipage_filename, int output_format, int pages, int *cancel_save);
+static void xsane_multipage_save_file_done(int cancel_save);
 static void xsane_multipage_save_file(void);
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
@@ -89,6 +98,15 @@ static void xsane_multipage_filetype_callback(GtkWidget *filetype_option_menu, c
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
+static void xsane_multipage_pdf_compression_callback(GtkWidget *widget, gpointer data)
+{
+  DBG(DBG_proc, "xsane_multipage_pdf_compression_callback(%d)\n", (int) data);
+
+  preferences.multipage_pdf_compression = (int) data;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
 void xsane_multipage_dialog()
 {
  GtkWidget *multipage_dialog, *multipage_scan_vbox, *multipage_project_vbox;
@@ -100,6 +118,8 @@ void xsane_multipage_dialog()
  GtkWidget *label;
  GtkWidget *filetype_menu, *filetype_item;
  GtkWidget *filetype_option_menu;
+ GtkWidget *pdf_compression_menu, *pdf_compression_item;
+ GtkWidget *pdf_compression_option_menu;
  char buf[64];
  int filetype_nr;
  int select_item;
@@ -216,6 +236,37 @@ void xsane_multipage_dialog()
   gtk_widget_show(filetype_option_menu);
 
 
+  /* PDF COMPRESSION MENU */
+  hbox = gtk_hbox_new(FALSE, 2);
+  gtk_container_set_border_width(GTK_CONTAINER(hbox), 2);
+  gtk_box_pack_start(GTK_BOX(multipage_project_vbox), hbox, FALSE, FALSE, 1);
+  gtk_widget_show(hbox);
+
+  pdf_compression_menu = gtk_menu_new();
+
+  pdf_compression_item = gtk_menu_item_new_with_label(MENU_ITEM_PDF_COMPRESSION_ZLIB);
+  gtk_container_add(GTK_CONTAINER(pdf_compression_menu), pdf_compression_item);
+  g_signal_connect(GTK_OBJECT(pdf_compression_item), "activate", (GtkSignalFunc) xsane_multipage_pdf_compression_callback, (void *) XSANE_PDF_COMPRESSION_ZLIB);
+  gtk_widget_show(pdf_compression_item);
+
+  pdf_compression_item = gtk_menu_item_new_with_label(MENU_ITEM_PDF_COMPRESSION_JPEG);
+  gtk_container_add(GTK_CONTAINER(pdf_compression_menu), pdf_compression_item);
+  g_signal_connect(GTK_OBJECT(pdf_compression_item), "activate", (GtkSignalFunc) xsane_multipage_pdf_compression_callback, (void *) XSANE_PDF_COMPRESSION_JPEG);
+  gtk_widget_show(pdf_compression_item);
+
+  label = gtk_label_new(TEXT_PDF_COMPRESSION);
+  gtk_box_pack_start(GTK_BOX(hbox), label, FALSE, FALSE, 2);
+  gtk_widget_show(label);
+
+  pdf_compression_option_menu = gtk_option_menu_new();
+  xsane_back_gtk_set_tooltip(xsane.tooltips, pdf_compression_option_menu, DESC_PDF_COMPRESSION);
+  gtk_option_menu_set_menu(GTK_OPTION_MENU(pdf_compression_option_menu), pdf_compression_menu);
+  gtk_option_menu_set_history(GTK_OPTION_MENU(pdf_compression_option_menu), preferences.multipage_pdf_compression);
+  gtk_box_pack_end(GTK_BOX(hbox), pdf_compression_option_menu, FALSE, FALSE, 2);
+  gtk_widget_show(pdf_compression_menu);
+  gtk_widget_show(pdf_compression_option_menu);
+
+
   /* pages frame */
   pages_frame = gtk_frame_new(TEXT_PAGES);
   gtk_box_pack_start(GTK_BOX(multipage_project_vbox), pages_frame, TRUE, TRUE, 2);
@@ -483,6 +534,7 @@ static void xsane_multipage_project_delete()
   }
   snprintf(file, sizeof(file), "%s/xsane-multipage-list", preferences.multipage_project);
   remove(file);
+  xsane_multipage_stream_remove();
   snprintf(file, sizeof(file), "%s", preferences.multipage_project);
   rmdir(file);
 
@@ -682,6 +734,7 @@ static void xsane_multipage_entry_move_up_callback(GtkWidget *widget, gpointer l
       {
         xsane_front_gtk_list_entries_swap(list_item_1, list_item_2);
         gtk_list_select_item(GTK_LIST(list), newpos);
+        xsane_multipage_stream_remove(); /* page list changed */
 
         if (xsane.multipage_status)
         {
@@ -729,6 +782,7 @@ static void xsane_multipage_entry_move_down_callback(GtkWidget *widget, gpointer
       {
         xsane_front_gtk_list_entries_swap(list_item_1, list_item_2);
         gtk_list_select_item(GTK_LIST(list), newpos);
+        xsane_multipage_stream_remove(); /* page list changed */
 
         if (xsane.multipage_status)
         {
@@ -765,6 +819,7 @@ static void xsane_multipage_entry_delete_callback(GtkWidget *widget, gpointer li
     free(type);
     remove(file);
     gtk_widget_destroy(GTK_WIDGET(list_item));
+    xsane_multipage_stream_remove(); /* page list changed */
 
     if (xsane.multipage_status)
     {
@@ -829,6 +884,7 @@ static void xsane_multipage_edit_callback(GtkWidget *widget, gpointer list)
 
     xsane_back_gtk_make_path(sizeof(outfilename), outfilename, 0, 0, "xsane-viewer-", xsane.dev_name, ".pnm", XSANE_PATH_TMP);
     xsane_copy_file_by_name(outfilename, filename, xsane.project_progress_bar, &cancel_save);
+    xsane_multipage_stream_remove(); /* the page may be modified by the viewer */
 
     xsane.multipage_status = strdup(TEXT_PROJECT_STATUS_CHANGED);
     xsane_multipage_project_save();
@@ -842,6 +898,484 @@ static void xsane_multipage_edit_callback(GtkWidget *widget, gpointer list)
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
+/* Pdf and tiff files are written while the pages are scanned: each page is appended to
+ * xsane-multipage-stream in the project directory, xsane-multipage-stream-list holds the
+ * settings, the offsets of the pdf objects and the names of the pages in the stream.
+ * Saving the project copies the stream and writes the pdf trailer. When the page list is
+ * changed or the settings do not fit any more the stream is removed and the pages are
+ * converted again when the project is saved. A page is added to the stream list after it
+ * has been written completely, so the stream of an interrupted project can be used.
+ */
+
+#define XSANE_MULTIPAGE_SETTINGS_SIZE (2 * PATH_MAX + TEXTBUFSIZE) /* the settings contain the icm profile names */
+
+static void xsane_multipage_stream_filenames(char *stream_filename, char *list_filename)
+{
+  snprintf(stream_filename, PATH_MAX, "%s/xsane-multipage-stream", preferences.multipage_project);
+  snprintf(list_filename, PATH_MAX, "%s/xsane-multipage-stream-list", preferences.multipage_project);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_multipage_stream_remove(void)
+{
+ char stream_filename[PATH_MAX];
+ char list_filename[PATH_MAX];
+
+  DBG(DBG_proc, "xsane_multipage_stream_remove\n");
+
+  xsane_multipage_stream_filenames(stream_filename, list_filename);
+  remove(list_filename);
+  remove(stream_filename);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* returns the output format of the multipage file, settings is filled with all values that must not */
+/* change while pages are appended to the stream */
+static int xsane_multipage_stream_settings(char *settings, size_t size)
+{
+ char multipage_filename[PATH_MAX];
+
+  snprintf(multipage_filename, sizeof(multipage_filename), "%s%s", preferences.multipage_project, preferences.multipage_filetype);
+  snprintf(settings, size, "%s %d %d %d %d %d %d %d %d %d %d %s %s", preferences.multipage_filetype,
+           preferences.save_pdf_flatedecoded, preferences.multipage_pdf_compression, (int) preferences.jpeg_quality,
+           preferences.tiff_compression1_nr, preferences.tiff_compression8_nr, preferences.tiff_compression16_nr,
+           xsane.enable_color_management, preferences.cms_function, preferences.cms_intent, preferences.cms_bpc,
+           (xsane.scanner_default_color_icm_profile) ? xsane.scanner_default_color_icm_profile : "-",
+           (xsane.scanner_default_gray_icm_profile) ? xsane.scanner_default_gray_icm_profile : "-");
+
+ return xsane_identify_output_format(multipage_filename, NULL, NULL);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* returns the number of pages in the stream, these are the first pages of the project list, */
+/* -1 if there is no stream or it has been written with other settings */
+static int xsane_multipage_stream_load(struct pdf_xref *xref)
+{
+ FILE *listfile;
+ GList *list = (GList *) GTK_LIST(xsane.project_list)->children;
+ GtkObject *list_item;
+ char stream_filename[PATH_MAX];
+ char list_filename[PATH_MAX];
+ char settings[XSANE_MULTIPAGE_SETTINGS_SIZE];
+ char line[XSANE_MULTIPAGE_SETTINGS_SIZE];
+ char name[PATH_MAX];
+ char page_name[PATH_MAX];
+ unsigned long obj_page, obj_contents, obj_image;
+ int pages = 0;
+
+  DBG(DBG_proc, "xsane_multipage_stream_load\n");
+
+  xsane_multipage_stream_settings(settings, sizeof(settings));
+  xsane_multipage_stream_filenames(stream_filename, list_filename);
+
+  listfile = fopen(list_filename, "rb"); /* read binary (b for win32) */
+  if (!listfile)
+  {
+   return -1;
+  }
+
+  /* first line is the settings, second line the offsets of the pdf catalog and outlines objects */
+  if ( (!fgets(line, sizeof(line), listfile)) || (strncmp(line, settings, strlen(settings))) || (line[strlen(settings)] != '\n') ||
+       (!fgets(line, sizeof(line), listfile)) || (sscanf(line, "%lu %lu", &xref->obj[1], &xref->obj[2]) != 2) )
+  {
+    DBG(DBG_info, "xsane_multipage_stream_load: stream has been written with other settings\n");
+    fclose(listfile);
+   return -1;
+  }
+
+  xref->obj[3] = 0; /* pages object is written by the trailer */
+  xref->obj[4] = 0;
+  xref->obj[5] = 0;
+
+  /* one line for each page: offsets of the page, contents and image objects, page name */
+  while (fgets(line, sizeof(line), listfile))
+  {
+    if ( (!list) || (pages >= PDF_PAGES_MAX) || (sscanf(line, "%lu %lu %lu %[^\n]", &obj_page, &obj_contents, &obj_image, name) != 4) )
+    {
+      pages = -1;
+     break;
+    }
+
+    list_item = GTK_OBJECT(list->data);
+    snprintf(page_name, sizeof(page_name), "%s%s", (char *) gtk_object_get_data(list_item, "list_item_data"),
+                                                   (char *) gtk_object_get_data(list_item, "list_item_type"));
+    if (strcmp(page_name, name))
+    {
+      pages = -1;
+     break;
+    }
+
+    pages++;
+    xref->obj[PDF_PAGE_OBJECT(pages)]     = obj_page;
+    xref->obj[PDF_CONTENTS_OBJECT(pages)] = obj_contents;
+    xref->obj[PDF_IMAGE_OBJECT(pages)]    = obj_image;
+    list = list->next;
+  }
+
+  fclose(listfile);
+
+  DBG(DBG_info, "xsane_multipage_stream_load: %d pages\n", pages);
+
+ return pages;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* opens the image file of a page, lineart images are reduced to lineart before conversion, */
+/* then source_filename is the temporary pbm file and remove_lineart_file is set */
+static FILE *xsane_multipage_open_page(char *source_filename, size_t size, Image_info *image_info, int *remove_lineart_file, int *cancel_save)
+{
+ FILE *imagefile;
+ char buf[TEXTBUFSIZE];
+
+  *remove_lineart_file = FALSE;
+
+  imagefile = fopen(source_filename, "rb"); /* read binary (b for win32) */
+  if (!imagefile)
+  {
+    DBG(DBG_error, "could not read imagefile %s\n", source_filename);
+   return NULL;
+  }
+
+  xsane_read_pnm_header(imagefile, image_info);
+
+  /* reduce lineart images to lineart before conversion */
+  if (image_info->reduce_to_lineart)
+  {
+   char lineart_filename[PATH_MAX];
+
+    DBG(DBG_info, "original image is a lineart => reduce to lineart\n");
+    fclose(imagefile);
+    xsane_back_gtk_make_path(sizeof(lineart_filename), lineart_filename, 0, 0, "xsane-conversion-", xsane.dev_name, ".pbm", XSANE_PATH_TMP);
+
+    snprintf(buf, sizeof(buf), "%s", PROGRESS_PACKING_DATA);
+
+    gtk_progress_set_format_string(GTK_PROGRESS(xsane.project_progress_bar), buf);
+    xsane_progress_bar_set_fraction(GTK_PROGRESS_BAR(xsane.project_progress_bar), 0.0);
+
+    while (gtk_events_pending())
+    {
+      gtk_main_iteration();
+    }
+
+    xsane_save_image_as_lineart(lineart_filename, source_filename, xsane.project_progress_bar, cancel_save);
+
+    strncpy(source_filename, lineart_filename, size);
+    *remove_lineart_file = TRUE;
+
+    imagefile = fopen(source_filename, "rb"); /* read binary (b for win32) */
+    if (imagefile == 0)
+    {
+      snprintf(buf, sizeof(buf), "%s `%s': %s", ERR_OPEN_FAILED, source_filename, strerror(errno));
+      xsane_back_gtk_error(buf, TRUE);
+     return NULL;
+    }
+
+    xsane_read_pnm_header(imagefile, image_info);
+  }
+
+ return imagefile;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* appends the last page of the project list to the stream, the stream is removed if this is not possible */
+void xsane_multipage_project_append_page(void)
+{
+ GList *list = g_list_last((GList *) GTK_LIST(xsane.project_list)->children);
+ GtkObject *list_item;
+ FILE *listfile;
+ FILE *outfile = NULL;
+ FILE *imagefile;
+#ifdef HAVE_LIBTIFF
+ TIFF *tiffile = NULL;
+#endif
+ Image_info image_info;
+ struct pdf_xref xref;
+ char stream_filename[PATH_MAX];
+ char list_filename[PATH_MAX];
+ char source_filename[PATH_MAX];
+ char settings[XSANE_MULTIPAGE_SETTINGS_SIZE];
+ char buf[TEXTBUFSIZE];
+ char *image;
+ char *type;
+ float imagewidth, imageheight;
+ int output_format;
+ int remove_lineart_file = FALSE;
+ int cancel_save = 0;
+ int pages;
+
+  DBG(DBG_proc, "xsane_multipage_project_append_page\n");
+
+  if (!list)
+  {
+    return;
+  }
+
+  output_format = xsane_multipage_stream_settings(settings, sizeof(settings));
+  pages = xsane_multipage_stream_load(&xref);
+
+  if (pages < 0)
+  {
+    xsane_multipage_stream_remove();
+    pages = 0;
+  }
+
+  /* the stream must hold all pages but the new one */
+  if ( (pages + 1 != (int) g_list_length((GList *) GTK_LIST(xsane.project_list)->children)) || (pages >= PDF_PAGES_MAX) ||
+#ifdef HAVE_LIBTIFF
+       ((output_format != XSANE_PDF) && (output_format != XSANE_TIFF)) )
+#else
+       (output_format != XSANE_PDF) )
+#endif
+  {
+    DBG(DBG_info, "xsane_multipage_project_append_page: page can not be appended to the stream\n");
+    xsane_multipage_stream_remove();
+   return;
+  }
+
+  xsane_multipage_stream_filenames(stream_filename, list_filename);
+
+  if ((!pages) && (xsane_create_secure_file(stream_filename))) /* remove possibly existing symbolic links for security */
+  {
+    DBG(DBG_error, "xsane_multipage_project_append_page: could not create %s\n", stream_filename);
+   return;
+  }
+
+  list_item = GTK_OBJECT(list->data);
+  image = strdup((char *) gtk_object_get_data(list_item, "list_item_data"));
+  type  = strdup((char *) gtk_object_get_data(list_item, "list_item_type"));
+  xsane_convert_text_to_filename(&image);
+  snprintf(source_filename, sizeof(source_filename), "%s/%s%s", preferences.multipage_project, image, type);
+  free(image);
+  free(type);
+
+  imagefile = xsane_multipage_open_page(source_filename, sizeof(source_filename), &image_info, &remove_lineart_file, &cancel_save);
+  if (!imagefile)
+  {
+    xsane_multipage_stream_remove();
+   return;
+  }
+
+  snprintf(buf, sizeof(buf), "%s %s %d", PROGRESS_CONVERTING_DATA, PROGRESS_PAGE, pages + 1);
+  gtk_progress_set_format_string(GTK_PROGRESS(xsane.project_progress_bar), buf);
+
+  if (output_format == XSANE_PDF)
+  {
+    outfile = fopen(stream_filename, (pages) ? "r+b" : "wb"); /* b = binary mode for win32 */
+    if (outfile)
+    {
+      if (pages)
+      {
+        fseek(outfile, 0L, SEEK_END);
+      }
+      else
+      {
+        xsane_save_pdf_create_document_header(outfile, &xref, 0 /* pages are counted by the trailer */, preferences.save_pdf_flatedecoded);
+      }
+
+      imagewidth  = 72.0 * image_info.image_width/image_info.resolution_x; /* width in 1/72 inch */
+      imageheight = 72.0 * image_info.image_height/image_info.resolution_y; /* height in 1/72 inch */
+
+      xsane_save_pdf_page(outfile, &xref, pages + 1,
+                          imagefile, &image_info, imagewidth, imageheight,
+                          0, 0, imagewidth, imageheight, 0 /* portrait top left */,
+                          preferences.save_pdf_flatedecoded, preferences.multipage_pdf_compression,
+                          NULL /* hTransform */, 0 /* embed_scanner_icm_profile */, 0 /* icc_object */,
+                          xsane.project_progress_bar, &cancel_save);
+      fclose(outfile);
+    }
+    else
+    {
+      cancel_save = 1;
+    }
+  }
+#ifdef HAVE_LIBTIFF
+  else if (output_format == XSANE_TIFF)
+  {
+    tiffile = TIFFOpen(stream_filename, (pages) ? "a" : "w");
+    if (tiffile)
+    {
+     XsaneCmsTransform *hTransform = NULL;
+
+#ifdef HAVE_LIBLCMS
+      if ( (preferences.cms_function != XSANE_CMS_FUNCTION_EMBED_SCANNER_ICM_PROFILE)  && xsane.enable_color_management )
+      {
+        hTransform = xsane_create_cms_transform(&image_info, preferences.cms_function, preferences.cms_intent, preferences.cms_bpc);
+      }
+#endif
+
+      xsane_save_tiff_page(tiffile, pages + 1, -1 /* number of pages is not known */, preferences.jpeg_quality, imagefile, &image_info,
+                           hTransform, xsane.enable_color_management, preferences.cms_function,
+                           xsane.project_progress_bar, &cancel_save);
+#ifdef HAVE_LIBLCMS
+      if (hTransform != NULL)
+      {
+        xsane_cms_transform_release(hTransform);
+      }
+#endif
+      TIFFClose(tiffile);
+    }
+    else
+    {
+      cancel_save = 1;
+    }
+
+    xref.obj[1] = 0;
+    xref.obj[2] = 0;
+    xref.obj[PDF_PAGE_OBJECT(pages + 1)]     = 0;
+    xref.obj[PDF_CONTENTS_OBJECT(pages + 1)] = 0;
+    xref.obj[PDF_IMAGE_OBJECT(pages + 1)]    = 0;
+  }
+#endif
+
+  fclose(imagefile);
+
+  if (remove_lineart_file)
+  {
+    remove(source_filename); /* remove lineart pbm file  */
+  }
+
+  xsane_progress_bar_set_fraction(GTK_PROGRESS_BAR(xsane.project_progress_bar), 0.0);
+
+  if (cancel_save)
+  {
+    DBG(DBG_info, "xsane_multipage_project_append_page: could not append page, stream removed\n");
+    xsane_multipage_stream_remove();
+   return;
+  }
+
+  /* the page is complete, now add it to the stream list */
+  if (!pages)
+  {
+    listfile = fopen(list_filename, "wb"); /* write binary (b for win32) */
+    if (listfile)
+    {
+      fprintf(listfile, "%s\n", settings);
+      fprintf(listfile, "%lu %lu\n", xref.obj[1], xref.obj[2]);
+    }
+  }
+  else
+  {
+    listfile = fopen(list_filename, "ab"); /* append binary (b for win32) */
+  }
+
+  if (!listfile)
+  {
+    xsane_multipage_stream_remove();
+   return;
+  }
+
+  fprintf(listfile, "%lu %lu %lu %s%s\n", xref.obj[PDF_PAGE_OBJECT(pages + 1)], xref.obj[PDF_CONTENTS_OBJECT(pages + 1)],
+          xref.obj[PDF_IMAGE_OBJECT(pages + 1)],
+          (char *) gtk_object_get_data(list_item, "list_item_data"), (char *) gtk_object_get_data(list_item, "list_item_type"));
+
+  if (ferror(listfile))
+  {
+    fclose(listfile);
+    xsane_multipage_stream_remove();
+   return;
+  }
+
+  fclose(listfile);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* writes the multipage file from the stream, returns FALSE if the stream does not hold the pages of the project */
+static int xsane_multipage_save_stream(char *multipage_filename, int output_format, int pages, int *cancel_save)
+{
+ FILE *outfile;
+ struct pdf_xref xref;
+ char stream_filename[PATH_MAX];
+ char list_filename[PATH_MAX];
+
+  DBG(DBG_proc, "xsane_multipage_save_stream\n");
+
+  if ( (output_format != XSANE_PDF) && (output_format != XSANE_TIFF) )
+  {
+   return FALSE;
+  }
+
+  if ((pages < 1) || (xsane_multipage_stream_load(&xref) != pages))
+  {
+   return FALSE;
+  }
+
+  xsane_multipage_stream_filenames(stream_filename, list_filename);
+
+  DBG(DBG_info, "xsane_multipage_save_stream: copying %d pages from %s\n", pages, stream_filename);
+
+  if (xsane_copy_file_by_name(multipage_filename, stream_filename, xsane.project_progress_bar, cancel_save))
+  {
+    *cancel_save = 1;
+   return TRUE;
+  }
+
+  if (output_format == XSANE_PDF)
+  {
+    outfile = fopen(multipage_filename, "r+b"); /* b = binary mode for win32 */
+    if (!outfile)
+    {
+     char buf[TEXTBUFSIZE];
+
+      snprintf(buf, sizeof(buf), "%s `%s': %s", ERR_OPEN_FAILED, multipage_filename, strerror(errno));
+      xsane_back_gtk_error(buf, TRUE);
+      *cancel_save = 1;
+     return TRUE;
+    }
+
+    fseek(outfile, 0L, SEEK_END);
+    xsane_save_pdf_create_document_trailer(outfile, &xref, pages);
+
+    if (ferror(outfile))
+    {
+     char buf[TEXTBUFSIZE];
+
+      snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
+      DBG(DBG_error, "%s\n", buf);
+      xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
+      *cancel_save = 1;
+    }
+
+    fclose(outfile);
+  }
+
+ return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_multipage_save_file_done(int cancel_save)
+{
+  if (xsane.multipage_status)
+  {
+    free(xsane.multipage_status);
+    xsane.multipage_status = NULL;
+  }
+
+  if (cancel_save)
+  {
+    xsane.multipage_status = strdup(ERR_DURING_SAVE);
+  }
+  else
+  {
+    xsane.multipage_status = strdup(TEXT_PROJECT_STATUS_FILE_SAVED);
+  }
+  xsane_multipage_project_save();
+
+  gtk_progress_set_format_string(GTK_PROGRESS(xsane.project_progress_bar), _(xsane.multipage_status));
+  xsane_progress_bar_set_fraction(GTK_PROGRESS_BAR(xsane.project_progress_bar), 0.0);
+
+  xsane_multipage_project_set_sensitive(TRUE);
+  xsane_set_sensitivity(TRUE); /* allow changing xsane mode */
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
 static void xsane_multipage_save_file()
 {
  char *image;
@@ -944,6 +1478,12 @@ static void xsane_multipage_save_file()
 
   DBG(DBG_info, "xsane_multipage_save_file: created %s\n", multipage_filename);
 
+  if (xsane_multipage_save_stream(multipage_filename, output_format, pages, &cancel_save)) /* pages have been converted while scanning */
+  {
+    xsane_multipage_save_file_done(cancel_save);
+   return;
+  }
+
 
   if ((output_format == XSANE_PS) || (output_format == XSANE_PDF))
   {
@@ -1028,52 +1568,12 @@ static void xsane_multipage_save_file()
     xsane_convert_text_to_filename(&image);
     snprintf(source_filename, sizeof(source_filename), "%s/%s%s", preferences.multipage_project, image, type);
 
-    imagefile = fopen(source_filename, "rb"); /* read binary (b for win32) */
+    imagefile = xsane_multipage_open_page(source_filename, sizeof(source_filename), &image_info, &remove_lineart_file, &cancel_save);
     if (!imagefile)
     {
-      DBG(DBG_error, "could not read imagefile %s\n", source_filename);
      return;
     }
 
-    xsane_read_pnm_header(imagefile, &image_info);
-
-    /* reduce lineart images to lineart before conversion */
-    if (image_info.reduce_to_lineart)
-    {
-     char lineart_filename[PATH_MAX];
-
-      DBG(DBG_info, "original image is a lineart => reduce to lineart\n");
-      fclose(imagefile);
-      xsane_back_gtk_make_path(sizeof(lineart_filename), lineart_filename, 0, 0, "xsane-conversion-", xsane.dev_name, ".pbm", XSANE_PATH_TMP);
-
-      snprintf(buf, sizeof(buf), "%s", PROGRESS_PACKING_DATA);
-                                                                                                                         
-      gtk_progress_set_format_string(GTK_PROGRESS(xsane.project_progress_bar), buf);
-      xsane_progress_bar_set_fraction(GTK_PROGRESS_BAR(xsane.project_progress_bar), 0.0);
-                                                                                                                         
-      while (gtk_events_pending())
-      {
-        gtk_main_iteration();
-      }
-                                                                                                                         
-      xsane_save_image_as_lineart(lineart_filename, source_filename, xsane.project_progress_bar, &cancel_save);
-                                                                                                                         
-      strncpy(source_filename, lineart_filename, sizeof(source_filename));
-      remove_lineart_file = TRUE;
-                                                                                                                         
-      imagefile = fopen(source_filename, "rb"); /* read binary (b for win32) */
-      if (imagefile == 0)
-      {
-       char buf[TEXTBUFSIZE];
-        snprintf(buf, sizeof(buf), "%s `%s': %s", ERR_OPEN_FAILED, source_filename, strerror(errno));
-        xsane_back_gtk_error(buf, TRUE);
-                                                                                                                          
-       return;
-      }
-                                                                                                                         
-      xsane_read_pnm_header(imagefile, &image_info);
-    }
-
 
     snprintf(buf, sizeof(buf), "%s %s %d/%d", _(xsane.multipage_status), PROGRESS_PAGE, page, pages);
     gtk_progress_set_format_string(GTK_PROGRESS(xsane.project_progress_bar), buf);
@@ -1099,14 +1599,14 @@ static void xsane_multipage_save_file()
       xsane_save_pdf_page(outfile, &xref, page,
                          imagefile, &image_info, imagewidth, imageheight,
                          0, 0, imagewidth, imageheight, 0 /* portrait top left */,
-                         preferences.save_pdf_flatedecoded,
+                         preferences.save_pdf_flatedecoded, preferences.multipage_pdf_compression,
                          NULL /* hTransform */, 0 /* embed_scanner_icm_profile */, 0 /* icc_object */,
                          xsane.project_progress_bar, &cancel_save);
     }
 #ifdef HAVE_LIBTIFF
     else if (output_format == XSANE_TIFF)
     {
-     cmsHTRANSFORM hTransform = NULL;
+     XsaneCmsTransform *hTransform = NULL;
 
 #ifdef HAVE_LIBLCMS
       if ( (preferences.cms_function != XSANE_CMS_FUNCTION_EMBED_SCANNER_ICM_PROFILE)  && xsane.enable_color_management )
@@ -1121,12 +1621,14 @@ static void xsane_multipage_save_file()
 #ifdef HAVE_LIBLCMS
       if (hTransform != NULL)
       {
-        cmsDeleteTransform(hTransform);
+        xsane_cms_transform_release(hTransform);
       }
 #endif
     }
 #endif
 
+    fclose(imagefile);
+
     if (remove_lineart_file)
     {
       remove(source_filename); /* remove lineart pbm file  */
@@ -1178,27 +1680,7 @@ static void xsane_multipage_save_file()
   }
 #endif
 
-  if (xsane.multipage_status)
-  {
-    free(xsane.multipage_status);
-    xsane.multipage_status = NULL;
-  }
-
-  if (cancel_save)
-  {
-    xsane.multipage_status = strdup(ERR_DURING_SAVE);
-  }
-  else
-  {
-    xsane.multipage_status = strdup(TEXT_PROJECT_STATUS_FILE_SAVED);
-  }
-  xsane_multipage_project_save();
-
-  gtk_progress_set_format_string(GTK_PROGRESS(xsane.project_progress_bar), _(xsane.multipage_status));
-  xsane_progress_bar_set_fraction(GTK_PROGRESS_BAR(xsane.project_progress_bar), 0.0);
-
-  xsane_multipage_project_set_sensitive(TRUE);
-  xsane_set_sensitivity(TRUE); /* allow changing xsane mode */
+  xsane_multipage_save_file_done(cancel_save);
 }
 
 
@@ -54,5 +54,6 @@
 
 extern void xsane_multipage_dialog(void);
 extern void xsane_multipage_project_save(void);
+extern void xsane_multipage_project_append_page(void);
 
 #endif
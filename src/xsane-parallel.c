@@ -0,0 +1,257 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-parallel.c
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+#include "xsane-parallel.h"
+
+#ifdef HAVE_LIBPTHREAD
+# include <pthread.h>
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_parallel_threads(void)
+/* number of threads that are used for the filters, preferences.filter_threads = 0 means one per cpu */
+{
+ int threads = preferences.filter_threads;
+
+  if (threads <= 0)
+  {
+#ifdef _SC_NPROCESSORS_ONLN
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    threads = 1;
+#endif
+  }
+
+  if (threads < 1)
+  {
+    threads = 1;
+  }
+
+  if (threads > XSANE_PARALLEL_MAX_THREADS)
+  {
+    threads = XSANE_PARALLEL_MAX_THREADS;
+  }
+
+#ifndef HAVE_LIBPTHREAD
+  threads = 1;
+#endif
+
+ return threads;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_parallel_split(int band, int bands, int total, int *first, int *end)
+/* splits 0..total-1 into bands of nearly the same size, band gets first..end-1 */
+{
+  *first = (int) (((long long) total * band) / bands);
+  *end   = (int) (((long long) total * (band + 1)) / bands);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifdef HAVE_LIBPTHREAD
+
+/* The worker threads are started when they are needed first and wait for the next job */
+/* until xsane exits. A job is announced by incrementing generation, the bands are taken */
+/* from next_band by the workers and the calling thread. */
+
+typedef struct
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t start_cond;
+  pthread_cond_t done_cond;
+  int threads_started;		/* number of worker threads */
+  int threads_active;		/* workers with index < threads_active take part in the job */
+  int busy;			/* a job is running */
+  unsigned int generation;	/* incremented for each job */
+  XsaneParallelFunc func;
+  void *data;
+  int bands;
+  int next_band;
+  int bands_done;
+} XsaneParallelPool;
+
+static XsaneParallelPool xsane_parallel_pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_parallel_do_bands(XsaneParallelPool *pool)
+/* called with locked mutex, returns with locked mutex */
+{
+ int band;
+
+  while (pool->next_band < pool->bands)
+  {
+    band = pool->next_band++;
+    pthread_mutex_unlock(&pool->mutex);
+
+    pool->func(pool->data, band, pool->bands);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->bands_done++;
+
+    if (pool->bands_done == pool->bands)
+    {
+      pthread_cond_signal(&pool->done_cond);
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void *xsane_parallel_worker(void *data)
+{
+ XsaneParallelPool *pool = &xsane_parallel_pool;
+ int index = (int) (long) data;
+ unsigned int generation = 0; /* a job that is already done has no bands left */
+
+  pthread_mutex_lock(&pool->mutex);
+
+  while (1)
+  {
+    while (pool->generation == generation)
+    {
+      pthread_cond_wait(&pool->start_cond, &pool->mutex);
+    }
+
+    generation = pool->generation;
+
+    if (index < pool->threads_active)
+    {
+      xsane_parallel_do_bands(pool);
+    }
+  }
+
+ return NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_parallel_run(XsaneParallelFunc func, void *data, int bands)
+{
+ XsaneParallelPool *pool = &xsane_parallel_pool;
+ int workers = xsane_parallel_threads() - 1; /* the calling thread works, too */
+ sigset_t all_signals, old_signals;
+ pthread_t thread;
+ int band;
+
+  if (workers > bands - 1)
+  {
+    workers = bands - 1;
+  }
+
+  if (workers > pool->threads_started) /* start missing workers */
+  {
+    /* signals are handled by the main thread */
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->threads_started < workers)
+    {
+      if (pthread_create(&thread, NULL, xsane_parallel_worker, (void *) (long) pool->threads_started))
+      {
+        DBG(DBG_error, "xsane_parallel_run: could not create worker thread\n");
+       break;
+      }
+      pthread_detach(thread);
+      pool->threads_started++;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    DBG(DBG_info, "xsane_parallel_run: %d worker threads started\n", pool->threads_started);
+  }
+
+  if (workers > pool->threads_started)
+  {
+    workers = pool->threads_started;
+  }
+
+  if (workers < 1)
+  {
+    for (band = 0; band < bands; band++)
+    {
+      func(data, band, bands);
+    }
+   return;
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+
+  if (pool->busy) /* the pool works for another thread */
+  {
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (band = 0; band < bands; band++)
+    {
+      func(data, band, bands);
+    }
+   return;
+  }
+
+  pool->busy           = TRUE;
+  pool->func           = func;
+  pool->data           = data;
+  pool->bands          = bands;
+  pool->next_band      = 0;
+  pool->bands_done     = 0;
+  pool->threads_active = workers;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start_cond);
+
+  xsane_parallel_do_bands(pool);
+
+  while (pool->bands_done < pool->bands)
+  {
+    pthread_cond_wait(&pool->done_cond, &pool->mutex);
+  }
+
+  pool->busy = FALSE;
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#else /* HAVE_LIBPTHREAD */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_parallel_run(XsaneParallelFunc func, void *data, int bands)
+{
+ int band;
+
+  for (band = 0; band < bands; band++)
+  {
+    func(data, band, bands);
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#endif /* HAVE_LIBPTHREAD */
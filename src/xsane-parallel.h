@@ -0,0 +1,56 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-parallel.h
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifndef HAVE_XSANE_PARALLEL_H
+#define HAVE_XSANE_PARALLEL_H
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* The filters of xsane-save.c split their work into bands (ranges of lines or columns)
+ * that do not depend on each other. xsane_parallel_run calls func for each band, the
+ * bands are distributed to a pool of worker threads and the calling thread. It returns
+ * when all bands are done. The result must not depend on the number of bands, so the
+ * output is the same as with one thread. func must not call gtk functions.
+ * xsane_parallel_run can be called from the gtk main thread and the job thread (xsane-job.c),
+ * while the pool works for one of them the other one processes its bands alone.
+ * Without pthread support all bands are processed by the calling thread.
+ */
+
+#define XSANE_PARALLEL_MAX_THREADS 64
+
+typedef void (*XsaneParallelFunc)(void *data, int band, int bands);
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+extern int xsane_parallel_threads(void);
+extern void xsane_parallel_split(int band, int bands, int total, int *first, int *end);
+extern void xsane_parallel_run(XsaneParallelFunc func, void *data, int bands);
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+#endif
+/* ---------------------------------------------------------------------------------------------------------------------- */
@@ -0,0 +1,827 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-pipeline.c
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+#include "xsane-back-gtk.h"
+#include "xsane-save.h"
+#include "xsane-pipeline.h"
+#include "xsane-lut.h"
+#include "xsane-rotate.h"
+#include "xsane-lineart.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  XsaneLut *lut;
+  int reduce_16bit_to_8bit;
+  unsigned char *out_line;
+} XsanePipelineGamma;
+
+typedef struct
+{
+  int rotation;
+  int bytespp;
+  unsigned char *image;		/* collected lines */
+  size_t image_size;
+  unsigned char *out_line;	/* XSANE_PIPELINE_ROTATION_LINES lines for rotation != 4 */
+} XsanePipelineRotation;
+
+#define XSANE_PIPELINE_ROTATION_LINES 64
+
+typedef struct
+{
+  unsigned char *out_line;
+} XsanePipelineLineart;
+
+typedef struct
+{
+  FILE *outfile;
+} XsanePipelineSink;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_pipeline_bytes_per_line(Image_info *image_info)
+{
+  if (image_info->depth == 1)
+  {
+    return (image_info->image_width * image_info->channels + 7) / 8;
+  }
+
+ return image_info->image_width * image_info->channels * ((image_info->depth + 7) / 8);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_pipeline_emit(XsanePipelineStage *stage, unsigned char *line)
+{
+  if (!stage->next)
+  {
+    return 0; /* no following stage, line is dropped */
+  }
+
+  stage->next->lines++;
+
+ return stage->next->put_line(stage->next, line);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_pipeline_output_changed(XsanePipelineStage *stage)
+/* tells the following stage that the output format of stage has been changed */
+/* before the first line is emitted (a rotation only knows its size when the image is complete) */
+{
+ XsanePipelineStage *next = stage->next;
+
+  if (!next)
+  {
+   return 0;
+  }
+
+  next->input_bytes_per_line = stage->bytes_per_line;
+
+  if (next->input_changed)
+  {
+   return next->input_changed(next);
+  }
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static XsanePipelineStage *xsane_pipeline_append_stage(XsanePipeline *pipeline, void *data)
+{
+ XsanePipelineStage *stage;
+
+  stage = calloc(1, sizeof(XsanePipelineStage));
+  if (!stage)
+  {
+    DBG(DBG_error, "xsane_pipeline_append_stage: out of memory\n");
+   return NULL;
+  }
+
+  if (pipeline->last_stage)
+  {
+    stage->input_info           = &pipeline->last_stage->image_info;
+    stage->input_bytes_per_line = pipeline->last_stage->bytes_per_line;
+    pipeline->last_stage->next  = stage;
+  }
+  else
+  {
+    stage->input_info           = &pipeline->image_info;
+    stage->input_bytes_per_line = pipeline->bytes_per_line;
+    pipeline->first_stage       = stage;
+  }
+
+  pipeline->last_stage = stage;
+
+  /* by default a stage does not change the format of the lines */
+  memcpy(&stage->image_info, stage->input_info, sizeof(Image_info));
+  stage->bytes_per_line = stage->input_bytes_per_line;
+  stage->data = data;
+
+ return stage;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+XsanePipeline *xsane_pipeline_new(Image_info *image_info, int bytes_per_line)
+{
+ XsanePipeline *pipeline;
+
+  DBG(DBG_proc, "xsane_pipeline_new(width=%d, height=%d, depth=%d, channels=%d)\n",
+      image_info->image_width, image_info->image_height, image_info->depth, image_info->channels);
+
+  pipeline = calloc(1, sizeof(XsanePipeline));
+  if (!pipeline)
+  {
+    DBG(DBG_error, "xsane_pipeline_new: out of memory\n");
+   return NULL;
+  }
+
+  memcpy(&pipeline->image_info, image_info, sizeof(Image_info));
+  pipeline->bytes_per_line = bytes_per_line;
+
+  pipeline->line_buffer = malloc(bytes_per_line);
+  if (!pipeline->line_buffer)
+  {
+    DBG(DBG_error, "xsane_pipeline_new: out of memory\n");
+    free(pipeline);
+   return NULL;
+  }
+
+ return pipeline;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_pipeline_free(XsanePipeline *pipeline)
+{
+ XsanePipelineStage *stage;
+ XsanePipelineStage *next_stage;
+
+  DBG(DBG_proc, "xsane_pipeline_free\n");
+
+  if (!pipeline)
+  {
+    return;
+  }
+
+  for (stage = pipeline->first_stage; stage; stage = next_stage)
+  {
+    next_stage = stage->next;
+
+    if (stage->free_data)
+    {
+      stage->free_data(stage);
+    }
+
+    free(stage->data);
+    free(stage);
+  }
+
+  free(pipeline->line_buffer);
+  free(pipeline);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_pipeline_gamma_put_line(XsanePipelineStage *stage, unsigned char *line)
+{
+ XsanePipelineGamma *gamma = stage->data;
+ int samples = stage->input_info->image_width * stage->input_info->channels;
+
+  if (gamma->reduce_16bit_to_8bit)
+  {
+    xsane_lut_apply(gamma->lut, line, gamma->out_line, samples, 0);
+   return xsane_pipeline_emit(stage, gamma->out_line);
+  }
+
+  xsane_lut_apply(gamma->lut, line, line, samples, 0);
+
+ return xsane_pipeline_emit(stage, line);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_pipeline_gamma_free(XsanePipelineStage *stage)
+{
+ XsanePipelineGamma *gamma = stage->data;
+
+  xsane_lut_free(gamma->lut);
+  free(gamma->out_line);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_pipeline_add_gamma(XsanePipeline *pipeline, SANE_Int *gamma_gray, SANE_Int *gamma_red, SANE_Int *gamma_green, SANE_Int *gamma_blue,
+                             int reduce_16bit_to_8bit)
+/* the gamma tables are converted to a lut, they may be freed after the stage has been added */
+/* when no gamma table is given the stage only reduces 16 bit data to 8 bit */
+{
+ XsanePipelineGamma *gamma;
+ XsanePipelineStage *stage;
+ Image_info *info = pipeline->last_stage ? &pipeline->last_stage->image_info : &pipeline->image_info;
+ SANE_Int *table[3];
+ int c;
+
+  DBG(DBG_proc, "xsane_pipeline_add_gamma\n");
+
+  if (info->depth < 8)
+  {
+    DBG(DBG_error, "xsane_pipeline_add_gamma: gamma correction not possible for depth %d\n", info->depth);
+   return -1;
+  }
+
+  if (info->depth == 8)
+  {
+    reduce_16bit_to_8bit = FALSE;
+  }
+
+  if (info->channels == 1)
+  {
+    table[0] = gamma_gray;
+  }
+  else
+  {
+    table[0] = gamma_red;
+    table[1] = gamma_green;
+    table[2] = gamma_blue;
+  }
+
+  if ((!table[0]) && (!reduce_16bit_to_8bit)) /* nothing to do */
+  {
+   return 0;
+  }
+
+  gamma = calloc(1, sizeof(XsanePipelineGamma));
+  if (!gamma)
+  {
+   return -1;
+  }
+
+  gamma->reduce_16bit_to_8bit = reduce_16bit_to_8bit;
+
+  stage = xsane_pipeline_append_stage(pipeline, gamma);
+  if (!stage)
+  {
+    free(gamma);
+   return -1;
+  }
+
+  stage->put_line  = xsane_pipeline_gamma_put_line;
+  stage->free_data = xsane_pipeline_gamma_free;
+
+  gamma->lut = xsane_lut_new(info->channels, info->depth, info->depth, reduce_16bit_to_8bit ? 8 : info->depth);
+  if (!gamma->lut)
+  {
+   return -1; /* stage is freed with the pipeline */
+  }
+
+  for (c = 0; (c < info->channels) && (c < 3); c++) /* a 4th channel (infrared) is not gamma corrected */
+  {
+    xsane_lut_set_table(gamma->lut, c, table[0] ? table[c] : NULL);
+  }
+
+  if (reduce_16bit_to_8bit)
+  {
+    stage->image_info.depth = 8;
+    stage->bytes_per_line = xsane_pipeline_bytes_per_line(&stage->image_info);
+
+    gamma->out_line = malloc(stage->bytes_per_line);
+    if (!gamma->out_line)
+    {
+     return -1; /* stage is freed with the pipeline */
+    }
+  }
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_pipeline_lineart_expand_put_line(XsanePipelineStage *stage, unsigned char *line)
+{
+ XsanePipelineLineart *lineart = stage->data;
+ unsigned char *out_line = lineart->out_line;
+
+  xsane_lineart_expand(line, out_line, stage->image_info.image_width); /* black bit gets 0, white bit gets 255 */
+
+ return xsane_pipeline_emit(stage, out_line);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_pipeline_lineart_free(XsanePipelineStage *stage)
+{
+ XsanePipelineLineart *lineart = stage->data;
+
+  free(lineart->out_line);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_pipeline_add_lineart_expand(XsanePipeline *pipeline)
+/* expand 1 bit lineart data to 8 bit grayscale */
+{
+ XsanePipelineLineart *lineart;
+ XsanePipelineStage *stage;
+
+  DBG(DBG_proc, "xsane_pipeline_add_lineart_expand\n");
+
+  lineart = calloc(1, sizeof(XsanePipelineLineart));
+  if (!lineart)
+  {
+   return -1;
+  }
+
+  stage = xsane_pipeline_append_stage(pipeline, lineart);
+  if (!stage)
+  {
+    free(lineart);
+   return -1;
+  }
+
+  stage->put_line  = xsane_pipeline_lineart_expand_put_line;
+  stage->free_data = xsane_pipeline_lineart_free;
+
+  stage->image_info.depth = 8;
+  stage->image_info.reduce_to_lineart = TRUE;
+  stage->bytes_per_line = xsane_pipeline_bytes_per_line(&stage->image_info);
+
+  lineart->out_line = malloc(stage->bytes_per_line);
+  if (!lineart->out_line)
+  {
+   return -1;
+  }
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_pipeline_lineart_pack_put_line(XsanePipelineStage *stage, unsigned char *line)
+{
+ XsanePipelineLineart *lineart = stage->data;
+ unsigned char *out_line = lineart->out_line;
+
+  xsane_lineart_pack(line, out_line, stage->image_info.image_width); /* white gets 0 bit, black gets 1 bit */
+
+ return xsane_pipeline_emit(stage, out_line);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_pipeline_lineart_pack_input_changed(XsanePipelineStage *stage)
+{
+ XsanePipelineLineart *lineart = stage->data;
+
+  stage->image_info.image_width  = stage->input_info->image_width;
+  stage->image_info.image_height = stage->input_info->image_height;
+  stage->image_info.resolution_x = stage->input_info->resolution_x;
+  stage->image_info.resolution_y = stage->input_info->resolution_y;
+  stage->bytes_per_line = xsane_pipeline_bytes_per_line(&stage->image_info);
+
+  free(lineart->out_line);
+  lineart->out_line = malloc(stage->bytes_per_line);
+  if (!lineart->out_line)
+  {
+    DBG(DBG_error, "xsane_pipeline_lineart_pack_input_changed: out of memory\n");
+   return -1;
+  }
+
+ return xsane_pipeline_output_changed(stage);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_pipeline_add_lineart_pack(XsanePipeline *pipeline)
+/* pack 8 bit grayscale data that has been expanded from lineart back to 1 bit */
+{
+ XsanePipelineLineart *lineart;
+ XsanePipelineStage *stage;
+
+  DBG(DBG_proc, "xsane_pipeline_add_lineart_pack\n");
+
+  lineart = calloc(1, sizeof(XsanePipelineLineart));
+  if (!lineart)
+  {
+   return -1;
+  }
+
+  stage = xsane_pipeline_append_stage(pipeline, lineart);
+  if (!stage)
+  {
+    free(lineart);
+   return -1;
+  }
+
+  stage->put_line      = xsane_pipeline_lineart_pack_put_line;
+  stage->input_changed = xsane_pipeline_lineart_pack_input_changed;
+  stage->free_data     = xsane_pipeline_lineart_free;
+
+  stage->image_info.depth = 1;
+  stage->image_info.reduce_to_lineart = FALSE;
+  stage->bytes_per_line = xsane_pipeline_bytes_per_line(&stage->image_info);
+
+  lineart->out_line = malloc(stage->bytes_per_line);
+  if (!lineart->out_line)
+  {
+   return -1;
+  }
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_pipeline_rotation_put_line(XsanePipelineStage *stage, unsigned char *line)
+{
+ XsanePipelineRotation *rotation = stage->data;
+ int bytes_per_line = stage->input_bytes_per_line;
+ size_t needed = (size_t) stage->lines * bytes_per_line;
+
+  if (rotation->rotation == 4) /* mirror x can be done line by line */
+  {
+   int width = stage->input_info->image_width;
+   int x;
+
+    for (x = 0; x < width; x++)
+    {
+      memcpy(rotation->out_line + x * rotation->bytespp, line + (width - 1 - x) * rotation->bytespp, rotation->bytespp);
+    }
+
+   return xsane_pipeline_emit(stage, rotation->out_line);
+  }
+
+  if (needed > rotation->image_size) /* more lines than announced, e.g. hand scanner */
+  {
+   unsigned char *image;
+   size_t image_size = rotation->image_size * 2;
+
+    if (image_size < needed)
+    {
+      image_size = needed + 64 * (size_t) bytes_per_line;
+    }
+
+    image = realloc(rotation->image, image_size);
+    if (!image)
+    {
+      DBG(DBG_error, "xsane_pipeline_rotation_put_line: out of memory\n");
+     return -1;
+    }
+
+    rotation->image = image;
+    rotation->image_size = image_size;
+  }
+
+  memcpy(rotation->image + (size_t) (stage->lines - 1) * bytes_per_line, line, bytes_per_line);
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_pipeline_rotation_finish(XsanePipelineStage *stage)
+{
+ XsanePipelineRotation *rotation = stage->data;
+ int width  = stage->input_info->image_width;
+ int height = stage->lines;
+ int bytespp = rotation->bytespp;
+ int line, lines, first_line, end_line;
+
+  if (rotation->rotation == 4) /* already done line by line */
+  {
+   return 0;
+  }
+
+  DBG(DBG_proc, "xsane_pipeline_rotation_finish(rotation=%d, %d x %d)\n", rotation->rotation, width, height);
+
+  if (rotation->rotation & 1)
+  {
+    stage->image_info.image_width  = height;
+    stage->image_info.image_height = width;
+    stage->image_info.resolution_x = stage->input_info->resolution_y;
+    stage->image_info.resolution_y = stage->input_info->resolution_x;
+  }
+  else
+  {
+    stage->image_info.image_height = height;
+  }
+
+  stage->bytes_per_line = stage->image_info.image_width * bytespp;
+  lines = stage->image_info.image_height;
+
+  /* the following stages have been created with the expected size */
+  if (xsane_pipeline_output_changed(stage))
+  {
+   return -1;
+  }
+
+  /* the lines are rotated in blocks, so a block of the image stays in the cache */
+  rotation->out_line = malloc(XSANE_PIPELINE_ROTATION_LINES * stage->bytes_per_line);
+  if (!rotation->out_line)
+  {
+    DBG(DBG_error, "xsane_pipeline_rotation_finish: out of memory\n");
+   return -1;
+  }
+
+  for (first_line = 0; first_line < lines; first_line += XSANE_PIPELINE_ROTATION_LINES)
+  {
+    end_line = MIN(first_line + XSANE_PIPELINE_ROTATION_LINES, lines);
+
+    xsane_rotate_lines(rotation->image, width, height, bytespp, rotation->rotation, rotation->out_line, first_line, end_line);
+
+    for (line = 0; line < end_line - first_line; line++)
+    {
+      if (xsane_pipeline_emit(stage, rotation->out_line + (size_t) line * stage->bytes_per_line))
+      {
+       return -1;
+      }
+    }
+  }
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_pipeline_rotation_free(XsanePipelineStage *stage)
+{
+ XsanePipelineRotation *rotation = stage->data;
+
+  free(rotation->image);
+  free(rotation->out_line);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_pipeline_add_rotation(XsanePipeline *pipeline, int rotation_nr)
+/* rotation_nr is defined as in xsane_save_rotate_image, the image is collected in memory */
+/* returns -1 if there is not enough memory for the image, the caller may use the file based rotation then */
+{
+ XsanePipelineRotation *rotation;
+ XsanePipelineStage *stage;
+ Image_info *info = pipeline->last_stage ? &pipeline->last_stage->image_info : &pipeline->image_info;
+
+  DBG(DBG_proc, "xsane_pipeline_add_rotation(%d)\n", rotation_nr);
+
+  if (rotation_nr == 0)
+  {
+    return 0;
+  }
+
+  if (info->depth < 8) /* lineart has to be expanded before */
+  {
+    DBG(DBG_error, "xsane_pipeline_add_rotation: rotation not possible for depth %d\n", info->depth);
+   return -1;
+  }
+
+  rotation = calloc(1, sizeof(XsanePipelineRotation));
+  if (!rotation)
+  {
+   return -1;
+  }
+
+  rotation->rotation = rotation_nr;
+  rotation->bytespp  = info->channels * ((info->depth + 7) / 8);
+
+  stage = xsane_pipeline_append_stage(pipeline, rotation);
+  if (!stage)
+  {
+    free(rotation);
+   return -1;
+  }
+
+  stage->put_line  = xsane_pipeline_rotation_put_line;
+  stage->finish    = xsane_pipeline_rotation_finish;
+  stage->free_data = xsane_pipeline_rotation_free;
+
+  if (rotation_nr & 1) /* expected size, corrected in xsane_pipeline_rotation_finish */
+  {
+    stage->image_info.image_width  = info->image_height;
+    stage->image_info.image_height = info->image_width;
+    stage->image_info.resolution_x = info->resolution_y;
+    stage->image_info.resolution_y = info->resolution_x;
+    stage->bytes_per_line = stage->image_info.image_width * rotation->bytespp;
+  }
+
+  if (rotation_nr == 4)
+  {
+    rotation->out_line = malloc(stage->bytes_per_line);
+    if (!rotation->out_line)
+    {
+     return -1;
+    }
+  }
+  else
+  {
+    rotation->image_size = (size_t) stage->input_bytes_per_line * ((info->image_height > 0) ? info->image_height : 256);
+    rotation->image = malloc(rotation->image_size);
+    if (!rotation->image)
+    {
+      DBG(DBG_info, "xsane_pipeline_add_rotation: not enough memory for %lu bytes\n", (unsigned long) rotation->image_size);
+     return -1;
+    }
+  }
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_pipeline_sink_put_line(XsanePipelineStage *stage, unsigned char *line)
+{
+ XsanePipelineSink *sink = stage->data;
+
+  fwrite(line, 1, stage->input_bytes_per_line, sink->outfile);
+
+  if (ferror(sink->outfile))
+  {
+    DBG(DBG_error, "xsane_pipeline_sink_put_line: %s\n", strerror(errno));
+   return -1;
+  }
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_pipeline_sink_finish(XsanePipelineStage *stage)
+{
+ XsanePipelineSink *sink = stage->data;
+
+  /* the header has been written with the expected image size, the image may be */
+  /* smaller (e.g. when scanning with hand scanner) or a rotation stage may only now know the size */
+  if ( (stage->lines != stage->image_info.image_height) ||
+       (stage->input_info->image_width != stage->image_info.image_width) )
+  {
+    DBG(DBG_info, "xsane_pipeline_sink_finish: correcting image size to %d x %d\n", stage->input_info->image_width, stage->lines);
+    memcpy(&stage->image_info, stage->input_info, sizeof(Image_info));
+    stage->image_info.image_height = stage->lines;
+    xsane_write_pnm_header(sink->outfile, &stage->image_info, 0); /* header has a fixed size */
+    fseek(sink->outfile, 0, SEEK_END);
+  }
+
+  fflush(sink->outfile);
+
+ return ferror(sink->outfile) ? -1 : 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_pipeline_add_pnm_sink(XsanePipeline *pipeline, FILE *outfile)
+/* the pnm header is written immediately with the expected image size and corrected when the pipeline is finished */
+{
+ XsanePipelineSink *sink;
+ XsanePipelineStage *stage;
+
+  DBG(DBG_proc, "xsane_pipeline_add_pnm_sink\n");
+
+  sink = calloc(1, sizeof(XsanePipelineSink));
+  if (!sink)
+  {
+   return -1;
+  }
+
+  sink->outfile = outfile;
+
+  stage = xsane_pipeline_append_stage(pipeline, sink);
+  if (!stage)
+  {
+    free(sink);
+   return -1;
+  }
+
+  stage->put_line = xsane_pipeline_sink_put_line;
+  stage->finish   = xsane_pipeline_sink_finish;
+
+  xsane_write_pnm_header(outfile, &stage->image_info, 0);
+
+ return ferror(outfile) ? -1 : 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_pipeline_put_line(XsanePipeline *pipeline, unsigned char *line)
+{
+  pipeline->first_stage->lines++;
+
+  if (pipeline->first_stage->put_line(pipeline->first_stage, line))
+  {
+    pipeline->error = TRUE;
+   return -1;
+  }
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_pipeline_write(XsanePipeline *pipeline, unsigned char *buf, int len)
+/* feed raw scan data, len does not have to be a multiple of the line size */
+/* returns 0 on success */
+{
+ int bytes;
+
+  if ((pipeline->error) || (!pipeline->first_stage))
+  {
+    return -1;
+  }
+
+  while (len > 0)
+  {
+    if ( (pipeline->line_buffer_fill == 0) && (len >= pipeline->bytes_per_line) &&
+         ( (pipeline->image_info.depth <= 8) || (!(((unsigned long) buf) & 1)) ) ) /* 16 bit lines must be aligned */
+    {
+      /* complete line in buffer, no need to copy it */
+      if (xsane_pipeline_put_line(pipeline, buf))
+      {
+        return -1;
+      }
+
+      buf += pipeline->bytes_per_line;
+      len -= pipeline->bytes_per_line;
+    }
+    else
+    {
+      bytes = pipeline->bytes_per_line - pipeline->line_buffer_fill;
+
+      if (bytes > len)
+      {
+        bytes = len;
+      }
+
+      memcpy(pipeline->line_buffer + pipeline->line_buffer_fill, buf, bytes);
+      pipeline->line_buffer_fill += bytes;
+      buf += bytes;
+      len -= bytes;
+
+      if (pipeline->line_buffer_fill == pipeline->bytes_per_line)
+      {
+        pipeline->line_buffer_fill = 0;
+
+        if (xsane_pipeline_put_line(pipeline, pipeline->line_buffer))
+        {
+          return -1;
+        }
+      }
+    }
+  }
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_pipeline_finish(XsanePipeline *pipeline)
+/* flush all stages, an incomplete last line is dropped */
+{
+ XsanePipelineStage *stage;
+
+  DBG(DBG_proc, "xsane_pipeline_finish\n");
+
+  if (pipeline->error)
+  {
+    return -1;
+  }
+
+  if (pipeline->line_buffer_fill)
+  {
+    DBG(DBG_info, "xsane_pipeline_finish: dropping incomplete line (%d bytes)\n", pipeline->line_buffer_fill);
+    pipeline->line_buffer_fill = 0;
+  }
+
+  for (stage = pipeline->first_stage; stage; stage = stage->next)
+  {
+    if ((stage->finish) && (stage->finish(stage)))
+    {
+      pipeline->error = TRUE;
+     return -1;
+    }
+  }
+
+ return 0;
+}
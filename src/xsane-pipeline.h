@@ -0,0 +1,87 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-pipeline.h
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifndef HAVE_XSANE_PIPELINE_H
+#define HAVE_XSANE_PIPELINE_H
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* A pipeline is a chain of line oriented stages. The raw data returned by sane_read
+ * is split into lines by xsane_pipeline_write and every complete line is passed
+ * through the stages. A stage may modify the line in place, emit a line of a new
+ * format or collect lines and emit them when the pipeline is finished (rotation).
+ * The last stage always is a sink that writes the lines to a pnm file.
+ */
+
+typedef struct XsanePipelineStage
+{
+  int (*put_line)(struct XsanePipelineStage *stage, unsigned char *line); /* returns 0 on success */
+  int (*finish)(struct XsanePipelineStage *stage); /* called after the last line, returns 0 on success */
+  int (*input_changed)(struct XsanePipelineStage *stage); /* the previous stage changed its output format, returns 0 on success */
+  void (*free_data)(struct XsanePipelineStage *stage);
+
+  Image_info *input_info;	/* format of the lines the stage gets (output format of the previous stage) */
+  Image_info image_info;	/* format of the lines the stage emits */
+  int input_bytes_per_line;
+  int bytes_per_line;
+  int lines;			/* number of lines the stage received */
+
+  struct XsanePipelineStage *next;
+  void *data;
+} XsanePipelineStage;
+
+typedef struct XsanePipeline
+{
+  Image_info image_info;	/* format of the data written into the pipeline */
+  int bytes_per_line;
+
+  unsigned char *line_buffer;	/* collects a line that is split over several writes */
+  int line_buffer_fill;
+
+  XsanePipelineStage *first_stage;
+  XsanePipelineStage *last_stage;
+
+  int error;
+} XsanePipeline;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+extern XsanePipeline *xsane_pipeline_new(Image_info *image_info, int bytes_per_line);
+extern void xsane_pipeline_free(XsanePipeline *pipeline);
+extern int xsane_pipeline_add_gamma(XsanePipeline *pipeline, SANE_Int *gamma_gray, SANE_Int *gamma_red, SANE_Int *gamma_green, SANE_Int *gamma_blue,
+                                    int reduce_16bit_to_8bit);
+extern int xsane_pipeline_add_lineart_expand(XsanePipeline *pipeline);
+extern int xsane_pipeline_add_rotation(XsanePipeline *pipeline, int rotation);
+extern int xsane_pipeline_add_lineart_pack(XsanePipeline *pipeline);
+extern int xsane_pipeline_add_pnm_sink(XsanePipeline *pipeline, FILE *outfile);
+extern int xsane_pipeline_write(XsanePipeline *pipeline, unsigned char *buf, int len);
+extern int xsane_pipeline_finish(XsanePipeline *pipeline);
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+#endif
+/* ---------------------------------------------------------------------------------------------------------------------- */
@@ -0,0 +1,251 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-planar.c
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+#include "xsane-planar.h"
+
+/* the ssse3 kernel is compiled with a function attribute and selected at runtime, */
+/* so xsane still runs on cpus without ssse3 */
+#if defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))) && (defined(__x86_64__) || defined(__i386__))
+# define XSANE_PLANAR_SSSE3
+# include <immintrin.h>
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void (*xsane_planar_interleave_8_function)(unsigned char *red, unsigned char *green, unsigned char *blue,
+                                                  unsigned char *rgb, int pixels) = NULL;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+XsanePlanar *xsane_planar_new(int bytes_per_line, int lines, int sample_size, size_t max_memory)
+/* returns NULL when the image size is not known or the planes need more than max_memory bytes */
+{
+ XsanePlanar *planar;
+ size_t plane_size;
+
+  DBG(DBG_proc, "xsane_planar_new(bytes_per_line=%d, lines=%d, sample_size=%d)\n", bytes_per_line, lines, sample_size);
+
+  if ( (bytes_per_line <= 0) || (lines <= 0) || ((sample_size != 1) && (sample_size != 2)) || (bytes_per_line % sample_size) )
+  {
+    DBG(DBG_info, "xsane_planar_new: unsupported image format or unknown image size\n");
+   return NULL;
+  }
+
+  plane_size = (size_t) bytes_per_line * lines;
+
+  if ((plane_size / lines != (size_t) bytes_per_line) || (plane_size > max_memory / 3))
+  {
+    DBG(DBG_info, "xsane_planar_new: planes need more than %lu bytes\n", (unsigned long) max_memory);
+   return NULL;
+  }
+
+  planar = calloc(1, sizeof(XsanePlanar));
+  if (!planar)
+  {
+   return NULL;
+  }
+
+  planar->data = calloc(3, plane_size); /* missing data of short frames is black */
+  if (!planar->data)
+  {
+    DBG(DBG_info, "xsane_planar_new: out of memory\n");
+    free(planar);
+   return NULL;
+  }
+
+  planar->plane_size     = plane_size;
+  planar->bytes_per_line = bytes_per_line;
+  planar->lines          = lines;
+  planar->sample_size    = sample_size;
+
+ return planar;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_planar_free(XsanePlanar *planar)
+{
+  if (planar)
+  {
+    free(planar->data);
+    free(planar);
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_planar_write(XsanePlanar *planar, int plane, void *data, size_t len)
+/* appends len bytes to plane 0 (red), 1 (green) or 2 (blue), data behind the end of the plane is dropped */
+{
+  if ((plane < 0) || (plane > 2))
+  {
+    return;
+  }
+
+  if (len > planar->plane_size - planar->fill[plane])
+  {
+    len = planar->plane_size - planar->fill[plane];
+  }
+
+  memcpy(planar->data + plane * planar->plane_size + planar->fill[plane], data, len);
+  planar->fill[plane] += len;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_planar_interleave_8_scalar(unsigned char *red, unsigned char *green, unsigned char *blue,
+                                             unsigned char *rgb, int pixels)
+{
+ int i;
+
+  for (i = 0; i < pixels; i++)
+  {
+    *rgb++ = red[i];
+    *rgb++ = green[i];
+    *rgb++ = blue[i];
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifdef XSANE_PLANAR_SSSE3
+/* shuffle masks that move the bytes of one plane to their place in the 3 output vectors of 16 pixels, */
+/* byte k of the output is sample k/3 of plane k%3, 0x80 clears the byte */
+static unsigned char xsane_planar_shuffle[3][3][16];
+
+__attribute__((target("ssse3")))
+static void xsane_planar_interleave_8_ssse3(unsigned char *red, unsigned char *green, unsigned char *blue,
+                                            unsigned char *rgb, int pixels)
+{
+ __m128i r, g, b, out;
+ int i, v;
+
+  for (i = 0; i + 16 <= pixels; i += 16)
+  {
+    r = _mm_loadu_si128((const __m128i *) (red   + i));
+    g = _mm_loadu_si128((const __m128i *) (green + i));
+    b = _mm_loadu_si128((const __m128i *) (blue  + i));
+
+    for (v = 0; v < 3; v++)
+    {
+      out = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, _mm_loadu_si128((const __m128i *) xsane_planar_shuffle[v][0])),
+                                      _mm_shuffle_epi8(g, _mm_loadu_si128((const __m128i *) xsane_planar_shuffle[v][1]))),
+                         _mm_shuffle_epi8(b, _mm_loadu_si128((const __m128i *) xsane_planar_shuffle[v][2])));
+      _mm_storeu_si128((__m128i *) (rgb + 3 * i + 16 * v), out);
+    }
+  }
+
+  xsane_planar_interleave_8_scalar(red + i, green + i, blue + i, rgb + 3 * i, pixels - i);
+}
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_planar_interleave_16(guint16 *red, guint16 *green, guint16 *blue, guint16 *rgb, int pixels)
+{
+ int i;
+
+  for (i = 0; i < pixels; i++)
+  {
+    *rgb++ = red[i];
+    *rgb++ = green[i];
+    *rgb++ = blue[i];
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_planar_write_interleaved(XsanePlanar *planar, FILE *out)
+/* writes the interleaved image line by line to out, returns 0 on success */
+{
+ unsigned char *line;
+ unsigned char *red, *green, *blue;
+ int pixels = planar->bytes_per_line / planar->sample_size;
+ int y;
+
+  DBG(DBG_proc, "xsane_planar_write_interleaved\n");
+
+  if (!xsane_planar_interleave_8_function)
+  {
+    xsane_planar_interleave_8_function = xsane_planar_interleave_8_scalar;
+
+#ifdef XSANE_PLANAR_SSSE3
+    {
+     int c, k;
+
+      for (k = 0; k < 48; k++)
+      {
+        for (c = 0; c < 3; c++)
+        {
+          xsane_planar_shuffle[k / 16][c][k % 16] = (k % 3 == c) ? (k / 3) : 0x80;
+        }
+      }
+    }
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3"))
+    {
+      xsane_planar_interleave_8_function = xsane_planar_interleave_8_ssse3;
+    }
+#endif
+
+    DBG(DBG_info, "xsane_planar_write_interleaved: using %s kernel\n",
+                  (xsane_planar_interleave_8_function == xsane_planar_interleave_8_scalar) ? "scalar" : "ssse3");
+  }
+
+  line = malloc(3 * planar->bytes_per_line);
+  if (!line)
+  {
+   return -1;
+  }
+
+  for (y = 0; y < planar->lines; y++)
+  {
+    red   = planar->data + (size_t) y * planar->bytes_per_line;
+    green = red   + planar->plane_size;
+    blue  = green + planar->plane_size;
+
+    if (planar->sample_size == 2)
+    {
+      xsane_planar_interleave_16((guint16 *) red, (guint16 *) green, (guint16 *) blue, (guint16 *) line, pixels);
+    }
+    else
+    {
+      xsane_planar_interleave_8_function(red, green, blue, line, pixels);
+    }
+
+    if (fwrite(line, 3 * planar->bytes_per_line, 1, out) != 1)
+    {
+      free(line);
+     return -1;
+    }
+  }
+
+  free(line);
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
@@ -0,0 +1,59 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-planar.h
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifndef HAVE_XSANE_PLANAR_H
+#define HAVE_XSANE_PLANAR_H
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* A 3 pass scanner sends the red, green and blue planes of the image one after the other.
+ * XsanePlanar keeps the planes in memory, each plane contiguous as it is received, and
+ * interleaves them to rgb pixels when all planes are complete. The file only is written once
+ * in sequential order. 8 bit planes are interleaved with ssse3 shuffles when the cpu supports it.
+ */
+
+typedef struct XsanePlanar
+{
+  size_t plane_size;		/* bytes per plane */
+  int bytes_per_line;		/* bytes per line of one plane */
+  int lines;
+  int sample_size;		/* bytes per sample: 1 or 2 */
+  unsigned char *data;		/* 3 planes of plane_size bytes */
+  size_t fill[3];		/* bytes received per plane */
+} XsanePlanar;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+extern XsanePlanar *xsane_planar_new(int bytes_per_line, int lines, int sample_size, size_t max_memory);
+extern void xsane_planar_free(XsanePlanar *planar);
+extern void xsane_planar_write(XsanePlanar *planar, int plane, void *data, size_t len);
+extern int xsane_planar_write_interleaved(XsanePlanar *planar, FILE *out);
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+#endif
+/* ---------------------------------------------------------------------------------------------------------------------- */
@@ -85,9 +85,11 @@ Preferences preferences =
        110,             /* default pop3 port */
        0,		/* no email project */
        0,		/* no email filetype */
+       0,		/* email_pdf_compression: zlib */
 #endif
        0,		/* no multipage project */
        0,		/* no multipage filetype */
+       0,		/* multipage_pdf_compression: zlib */
        0,		/* no default ocrcommand */
        0,		/* no default ocr input file option */
        0,		/* no default ocr output file option */
@@ -106,11 +108,16 @@ Preferences preferences =
        1,		/* skip_existing_numbers */
        1,               /* save_ps_flatedecoded */
        1,               /* save_pdf_flatedecoded */
+       0,		/* save_pdf_compression: zlib */
        0,		/* save_pnm16_as_ascii */
        0,		/* reduce_16bit_to_8bit */
        1,		/* filename_counter_step */
        4,		/* filename_counter_len */
        1,		/* adf_pages_max */
+    4096,		/* scan_buffer_size */
+       1,		/* adf_overlap */
+       0,		/* filter_threads */
+       0,		/* scale_filter: box */
        6,		/* show_range_mode */
        1,		/* tooltips enabled */
        1,		/* show histogram */
@@ -201,9 +208,11 @@ desc[] =
     {"e-mail-pop3-port",		xsane_rc_pref_int,	POFFSET(email_pop3_port)},
     {"e-mail-project",			xsane_rc_pref_string,	POFFSET(email_project)},
     {"e-mail-filetype",			xsane_rc_pref_string,	POFFSET(email_filetype)},
+    {"e-mail-pdf-compression",		xsane_rc_pref_int,	POFFSET(email_pdf_compression)},
 #endif
     {"multipage-project",		xsane_rc_pref_string,	POFFSET(multipage_project)},
     {"multipage-filetype",		xsane_rc_pref_string,	POFFSET(multipage_filetype)},
+    {"multipage-pdf-compression",	xsane_rc_pref_int,	POFFSET(multipage_pdf_compression)},
     {"ocr-command",			xsane_rc_pref_string,	POFFSET(ocr_command)},
     {"ocr-inputfile-option",		xsane_rc_pref_string,	POFFSET(ocr_inputfile_option)},
     {"ocr-outputfile-options",		xsane_rc_pref_string,	POFFSET(ocr_outputfile_option)},
@@ -222,11 +231,16 @@ desc[] =
     {"skip-existing-numbers",		xsane_rc_pref_int,	POFFSET(skip_existing_numbers)},
     {"save-ps-flatedecoded",		xsane_rc_pref_int,	POFFSET(save_ps_flatedecoded)},
     {"save-pdf-flatedecoded",		xsane_rc_pref_int,	POFFSET(save_pdf_flatedecoded)},
+    {"save-pdf-compression",		xsane_rc_pref_int,	POFFSET(save_pdf_compression)},
     {"save-pnm16-as-ascii",		xsane_rc_pref_int,	POFFSET( save_pnm16_as_ascii)},
     {"reduce-16bit-to8bit",		xsane_rc_pref_int,	POFFSET(reduce_16bit_to_8bit)},
     {"filename-counter-step",		xsane_rc_pref_int,	POFFSET(filename_counter_step)},
     {"filename-counter-len",		xsane_rc_pref_int,	POFFSET(filename_counter_len)},
     {"adf-pages-max",			xsane_rc_pref_int,	POFFSET(adf_pages_max)},
+    {"scan-buffer-size",		xsane_rc_pref_int,	POFFSET(scan_buffer_size)},
+    {"adf-overlap",			xsane_rc_pref_int,	POFFSET(adf_overlap)},
+    {"filter-threads",			xsane_rc_pref_int,	POFFSET(filter_threads)},
+    {"scale-filter",			xsane_rc_pref_int,	POFFSET(scale_filter)},
     {"show-range-mode",			xsane_rc_pref_int,	POFFSET(show_range_mode)},
     {"tool-tips",			xsane_rc_pref_int,	POFFSET(tooltips_enabled)},
     {"show-histogram",			xsane_rc_pref_int,	POFFSET(show_histogram)},
@@ -129,9 +129,11 @@ typedef struct
     int    email_pop3_port;		/* port to connect to pop3 server */
     char   *email_project;		/* mail project */
     char   *email_filetype;		/* mail filetype */
+    int    email_pdf_compression;	/* compression of pdf mail attachments */
 #endif
     char   *multipage_project;		/* multipage project */
     char   *multipage_filetype;		/* multipage filetype */
+    int    multipage_pdf_compression;	/* compression of multipage pdf files */
 
     char   *ocr_command;		/* ocrcommand */
     char   *ocr_inputfile_option;	/* option for input file */
@@ -153,11 +155,16 @@ typedef struct
     int    skip_existing_numbers;	/* skip used filenames when automatically increase counter */
     int    save_ps_flatedecoded;	/* use zlib to for postscript compression (flatedecode) */
     int    save_pdf_flatedecoded;	/* use zlib to for pdf compression (flatedecode) */
+    int    save_pdf_compression;	/* XSANE_PDF_COMPRESSION_ZLIB or _JPEG (jpeg / CCITT G4) */
     int    save_pnm16_as_ascii;		/* selection if pnm 16 bit is saved as ascii or binary file */
     int    reduce_16bit_to_8bit;	/* reduce images with 16 bits/color to 8 bits/color */
     int    filename_counter_step;	/* filename_counter += filename_counter_step; */
     int    filename_counter_len;	/* minimum length of filename_counter */
     int    adf_pages_max;		/* maximum pages to scan in adf mode */
+    int    scan_buffer_size;		/* size of reader thread buffer in KB, 0 = read in main loop */
+    int    adf_overlap;			/* reader thread starts the next adf page while the last one is saved */
+    int    filter_threads;		/* threads used by the image filters, 0 = one per cpu */
+    int    scale_filter;		/* XSANE_SCALE_FILTER_BOX, _BILINEAR or _LANCZOS3 */
 
     int    show_range_mode;		/* how to show a range */
     int    tooltips_enabled;		/* should tooltips be disabled? */
@@ -80,8 +80,14 @@
 #include "xsane-preview.h"
 #include "xsane-preferences.h"
 #include "xsane-gamma.h"
+#include "xsane-reader.h"
+#include "xsane-lut.h"
+#include "xsane-cms.h"
 #include <gdk/gdkkeysyms.h>
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
 #ifndef PATH_MAX
 # define PATH_MAX	1024
@@ -143,19 +149,50 @@ static void preview_establish_selection(Preview *p);
 static void preview_get_scale_device_to_image(Preview *p, float *xscalep, float *yscalep);
 static void preview_get_scale_device_to_window(Preview *p, float *xscalep, float *yscalep);
 static void preview_get_scale_window_to_image(Preview *p, float *xscalep, float *yscalep);
+static size_t preview_raw_size(Preview *p, int lines);
+static void preview_set_raw_format(Preview *p, int channels, int depth);
+static void preview_raw_get_line(Preview *p, int y, guint16 *line);
+static void preview_raw_get_pixel(Preview *p, int x, int y, guint16 *rgb);
+static void preview_enh_update(Preview *p, int first_line, int end_line, int stale_ok);
+static void preview_get_memory_usage(Preview *p, double *used, double *full);
+static void preview_free_raw(Preview *p);
+#ifdef HAVE_MMAP
+static int preview_map_raw(Preview *p, FILE *in, size_t image_offset);
+#endif
+static int preview_read_image_header(FILE *in, Preview_cache_header *header);
+static void preview_read_image_pixel(FILE *in, Preview_cache_header *header, int x, int y, guint16 *rgb);
+static void preview_correction_changed(Preview *p);
+static void preview_histogram_free(Preview *p);
+static void preview_histogram_invalidate_lines(Preview *p, int first_line, int end_line);
+static void preview_histogram_count_area(Preview *p, int x0, int y0, int x1, int y1, guint32 *count);
+static guint16 *preview_histogram_get_tile(Preview *p, int tile_x, int tile_y);
+static void preview_histogram_get(Preview *p, int x0, int y0, int x1, int y1, guint32 *count);
+static void preview_get_selection_image_area(Preview *p, int *min_x, int *min_y, int *max_x, int *max_y);
+static void preview_invalidate_lines(Preview *p, int first_line, int end_line);
+static void preview_invalidate_image(Preview *p);
+static void preview_mark_lines_dirty(Preview *p, int first_line, int end_line);
+static void preview_update_levels(Preview *p, int first_line, int end_line);
+static void preview_free_levels(Preview *p);
+static void preview_build_levels(Preview *p, int levels);
+static void preview_paint_axis(int *image_index, int *offset, int window_size, int used_size, int window_reversed,
+                               int image_size, int image_reversed, float scale, int level, int stride);
+static void preview_paint_image_area(Preview *p, int first_line, int end_line, GdkRectangle *area);
 static void preview_paint_image(Preview *p);
 static void preview_display_partial_image(Preview *p);
 static void preview_display_maybe(Preview *p);
 static void preview_display_image(Preview *p);
+static void preview_display_color_components(Preview *p, int x, int y);
 static void preview_save_option(Preview *p, int option, void *save_loc, int *valid);
 static void preview_restore_option(Preview *p, int option, void *saved_value, int valid);
 static void preview_set_option(Preview *p, int option, void *value);
 static void preview_set_option_float(Preview *p, int option, float value);
 static void preview_set_option_val(Preview *p, int option, SANE_Int value);
 static int  preview_increment_image_y(Preview *p);
+static SANE_Status preview_read(Preview *p, SANE_Byte *buf, SANE_Int max_len, SANE_Int *len);
 static void preview_read_image_data(gpointer data, gint source, GdkInputCondition cond);
 static void preview_scan_done(Preview *p, int save_image);
 static void preview_scan_start(Preview *p);
+static void preview_correction_cancel(Preview *p);
 static int preview_make_image_path(Preview *p, size_t filename_size, char *filename, int level);
 static void preview_restore_image(Preview *p);
 static gint preview_expose_event_handler_start(GtkWidget *window, GdkEvent *event, gpointer data);
@@ -927,377 +964,1011 @@ static void preview_get_scale_window_to_image(Preview *p, float *xscalep, float
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-static void preview_paint_image(Preview *p)
+/* image_data_raw holds the preview as it is sent by the scanner: one (gray, lineart) or three (color) */
+/* samples per pixel with 8 or 16 bits per sample. image_data_enh is created from it in tiles of */
+/* PREVIEW_TILE_LINES lines when the tile is needed the first time after the raw data has been changed. */
+/* When the correction has been changed the tiles are marked stale: they still show the image with */
+/* the previous correction and are created again by preview_correction_idle_handler. */
+
+static size_t preview_raw_size(Preview *p, int lines)
 {
- float xscale, yscale, src_x, src_y;
- int dst_x, dst_y, height, x, y, old_y, src_offset, x_direction;
- int rotation;
+ return (size_t) p->image_channels * p->image_sample_size * p->image_width * lines;
+}
 
-  DBG(DBG_proc, "preview_paint_image (rotation=%d)\n", p->rotation);
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-  if (!p->image_data_enh)
-  {
-    return; /* no image data */
-  }
+static void preview_set_raw_format(Preview *p, int channels, int depth)
+{
+  p->image_channels    = channels;
+  p->image_sample_size = (depth > 8) ? 2 : 1;
+}
 
-  memset(p->preview_row, 0x80, 3 * p->preview_window_width);
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-  old_y = -1;
-  height = 0;
+/* returns image line y of image_data_raw as 3 * image_width 16 bit samples */
+static void preview_raw_get_line(Preview *p, int y, guint16 *line)
+{
+ size_t offset = (size_t) y * p->image_width * p->image_channels;
+ int x;
 
-  rotation = p->rotation;
-  if (p->calibration) /* do not rotate calibration image */
+  if (p->image_sample_size == 2)
   {
-    p->rotation = 0;
-    xscale=1.0;
-    yscale=1.0;
+   guint16 *rawp = (guint16 *) p->image_data_raw + offset;
+
+    if (p->image_channels == 3)
+    {
+      memcpy(line, rawp, 6 * p->image_width);
+    }
+    else
+    {
+      for (x = 0; x < p->image_width; x++)
+      {
+        *line++ = *rawp;
+        *line++ = *rawp;
+        *line++ = *rawp++;
+      }
+    }
   }
   else
   {
-    preview_get_scale_window_to_image(p, &xscale, &yscale);
-  }
-
-
-  switch (p->rotation & 3)
-  {
-    case 0: /* do not rotate - 0 degree */
-    default:
-
-      /* don't draw last line unless it's complete: */
-      height = p->image_y; /* last line */
+   u_char *rawp = p->image_data_raw + offset;
 
-      if (p->image_x == 0 && height < p->image_height)
+    if (p->image_channels == 3)
+    {
+      for (x = 0; x < 3 * p->image_width; x++)
       {
-        ++height; /* use last line if it is complete */
+        *line++ = (*rawp++) * 256;
       }
-
-      src_y = 0.0; /* Source Y position index */
-
-      DBG(DBG_info, "preview_height=%d\n", p->preview_height);
-
-      for (dst_y = 0; dst_y < p->preview_height; ++dst_y)
+    }
+    else
+    {
+      for (x = 0; x < p->image_width; x++)
       {
-        y = (int) (src_y + 0.5);
-        if (y >= height)
-        {
-          break;
-        }
+        *line++ = (*rawp) * 256;
+        *line++ = (*rawp) * 256;
+        *line++ = (*rawp++) * 256;
+      }
+    }
+  }
+}
 
-        if (p->rotation & 4) /* mirror in x direction */
-        {
-          src_offset = (y+1) * 3 * p->image_width - 3;
-          x_direction = -1;
-        }
-        else /* not mirrored */
-        {
-          src_offset = y * 3 * p->image_width;
-          x_direction = 1;
-        }
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-        if (old_y != y) /* create new line ? - not necessary if the same line is used several times */
-        {
-          old_y = y;
-          src_x = 0.0; /* Source X position index */
+/* returns pixel x, y of image_data_raw as 3 16 bit samples */
+static void preview_raw_get_pixel(Preview *p, int x, int y, guint16 *rgb)
+{
+ size_t offset = ((size_t) y * p->image_width + x) * p->image_channels;
+ int c;
 
-          for (dst_x = 0; dst_x < p->preview_width; ++dst_x)
-          {
-            x = (int) (src_x + 0.5);
-            if (x >= p->image_width)
-            {
-              break;
-            }
+  for (c = 0; c < 3; c++)
+  {
+    if (p->image_sample_size == 2)
+    {
+      rgb[c] = ((guint16 *) p->image_data_raw)[offset];
+    }
+    else
+    {
+      rgb[c] = p->image_data_raw[offset] * 256;
+    }
 
-            p->preview_row[3*dst_x + 0] = p->image_data_enh[src_offset + x_direction * 3 * x + 0]; /* R */
-            p->preview_row[3*dst_x + 1] = p->image_data_enh[src_offset + x_direction * 3 * x + 1]; /* G */
-            p->preview_row[3*dst_x + 2] = p->image_data_enh[src_offset + x_direction * 3 * x + 2]; /* B */
-            src_x += xscale; /* calculate new source x position index */
-          }
-        }
+    if (p->image_channels == 3)
+    {
+      offset++;
+    }
+  }
+}
 
-        gtk_preview_draw_row(GTK_PREVIEW(p->window), p->preview_row, 0, dst_y, p->preview_window_width);
-        src_y += yscale; /* calculate new source y position index */
-      }
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-      memset(p->preview_row, 0x80, 3*p->preview_window_width);
-      for (; dst_y < p->preview_window_height; ++dst_y)
-      {
-        gtk_preview_draw_row(GTK_PREVIEW(p->window), p->preview_row, 0, dst_y, p->preview_window_width);
-      }
-     break;
+/* creates all tiles of image_data_enh that contain lines first_line .. end_line-1 and are not valid, */
+/* stale tiles are kept when stale_ok is set */
+static void preview_enh_update(Preview *p, int first_line, int end_line, int stale_ok)
+{
+ XsaneLut *lut = NULL;
+ guint16 *line, *linep;
+ u_char *enhp;
+ int tile, first_tile, end_tile;
+ int x, y, y_end, level;
+ int rotate = 16 - preview_gamma_input_bits;
+ int gamma, color;
 
+  if ((!p->image_data_raw) || (!p->image_data_enh) || (!p->image_enh_valid))
+  {
+    return;
+  }
 
-    case 1: /* 90 degree */ 
-      /* because we run in x direction we have to draw all rows all the time */
+  if (first_line < 0)
+  {
+    first_line = 0;
+  }
 
-      src_y = 0.0;
+  if (end_line > p->image_height)
+  {
+    end_line = p->image_height;
+  }
 
-      DBG(DBG_info, "height=%d\n", height);
-      DBG(DBG_info, "preview_height=%d\n", p->preview_height);
+  first_tile = first_line / PREVIEW_TILE_LINES;
+  end_tile   = (end_line + PREVIEW_TILE_LINES - 1) / PREVIEW_TILE_LINES;
 
-      for (dst_y = 0; dst_y < p->preview_height; ++dst_y)
-      {
-        y = (int) (src_y + 0.5);
-        if (y >= p->image_width)
-        {
-          break;
-        }
+  for (tile = first_tile; tile < end_tile; tile++)
+  {
+    if ( (p->image_enh_valid[tile] != TRUE) && ((!stale_ok) || (p->image_enh_valid[tile] != PREVIEW_TILE_STALE)) )
+    {
+      break;
+    }
+  }
 
-        if (p->rotation & 4) /* mirror in x direction */
-        {
-          src_offset = y * 3 + 3 * p->image_width * (p->image_height-1);
-          x_direction = -1;
-        }
-        else /* not mirrored */
-        {
-          src_offset = y * 3;
-          x_direction = 1;
-        }
+  if (tile >= end_tile)
+  {
+    return; /* all tiles are valid */
+  }
 
-        if (old_y != y) /* create new line ? - not necessary if the same line is used several times */
-        {
-          old_y = y;
-          src_x = p->image_height - 1;
+  DBG(DBG_proc, "preview_enh_update(lines %d..%d)\n", first_line, end_line);
 
-          for (dst_x = 0; dst_x < p->preview_width; ++dst_x)
-          {
-            x = (int) (src_x + 0.5);
-            if (x < 0)
-            {
-              break;
-            }
+  line = malloc(6 * p->image_width);
+  if (!line)
+  {
+    DBG(DBG_error, "preview_enh_update: out of memory\n");
+   return;
+  }
 
-            p->preview_row[3*dst_x + 0] = p->image_data_enh[src_offset + x_direction * 3 * x * p->image_width + 0]; /* R */
-            p->preview_row[3*dst_x + 1] = p->image_data_enh[src_offset + x_direction * 3 * x * p->image_width + 1]; /* G */
-            p->preview_row[3*dst_x + 2] = p->image_data_enh[src_offset + x_direction * 3 * x * p->image_width + 2]; /* B */
-            src_x -= xscale;
-          }
-        }
+  gamma = ((p->params.depth > 1) && (preview_gamma_data_red));
+  color = ( (xsane.param.format == SANE_FRAME_RGB) || /* color preview */
+            (xsane.param.format == SANE_FRAME_RED) ||
+            (xsane.param.format == SANE_FRAME_GREEN) ||
+            (xsane.param.format == SANE_FRAME_BLUE) );
 
-        gtk_preview_draw_row(GTK_PREVIEW(p->window), p->preview_row, 0, dst_y, p->preview_window_width);
-        src_y += yscale;
-      }
+  if ((gamma) && (color) && (!p->cms_transform))
+  {
+    lut = xsane_lut_new(3, 16, preview_gamma_input_bits, 8);
 
-      memset(p->preview_row, 0x80, 3*p->preview_window_width);
-      for (; dst_y < p->preview_window_height; ++dst_y)
-      {
-        gtk_preview_draw_row(GTK_PREVIEW(p->window), p->preview_row, 0, dst_y, p->preview_window_width);
-      }
-     break;
+    if (lut)
+    {
+      xsane_lut_set_table_8(lut, 0, preview_gamma_data_red);
+      xsane_lut_set_table_8(lut, 1, preview_gamma_data_green);
+      xsane_lut_set_table_8(lut, 2, preview_gamma_data_blue);
+    }
+  }
 
+  for (tile = first_tile; tile < end_tile; tile++)
+  {
+    if ( (p->image_enh_valid[tile] == TRUE) || ((stale_ok) && (p->image_enh_valid[tile] == PREVIEW_TILE_STALE)) )
+    {
+      continue;
+    }
 
-    case 2: /* 180 degree */ 
+    y_end = (tile + 1) * PREVIEW_TILE_LINES;
+    if (y_end > p->image_height)
+    {
+      y_end = p->image_height;
+    }
 
-      /* don't draw last line unless it's complete: */
-      height = p->image_y; /* last line */
+    for (y = tile * PREVIEW_TILE_LINES; y < y_end; y++)
+    {
+      preview_raw_get_line(p, y, line);
+      linep = line;
+      enhp  = p->image_data_enh + 3 * y * p->image_width;
 
-      if ( (p->image_x == 0) && (height < p->image_height) )
+#ifdef HAVE_LIBLCMS
+      if (p->cms_transform)
       {
-        ++height; /* use last line if it is complete */
+        xsane_cms_transform_apply(p->cms_transform, line, enhp, p->image_width);
       }
-
-      src_y = 0; /* Source Y position index */
-
-      DBG(DBG_info, "height=%d\n", height);
-      DBG(DBG_info, "preview_height=%d\n", p->preview_height);
-
-      /* it looks like it is necessary to write row 0 at first */
-      memset(p->preview_row, 0x80, 3*p->preview_window_width);
-      gtk_preview_draw_row(GTK_PREVIEW(p->window), p->preview_row, 0, 0, p->preview_window_width);
-      for (dst_y = p->preview_height-1; dst_y >=0; --dst_y)
+      else
+#endif
+      if ((gamma) && (color))
       {
-        y = (int) (src_y + 0.5);
-        if (y >= height)
-        {
-          break;
-        }
-
-        if (p->rotation & 4) /* mirror in x direction */
-        {
-          src_offset = (y+1) * 3 * p->image_width - 3;
-          x_direction = -1;
-        }
-        else /* not mirrored */
+        if (lut)
         {
-          src_offset = y * 3 * p->image_width;
-          x_direction = 1;
+          xsane_lut_apply(lut, line, enhp, 3 * p->image_width, 0);
         }
-
-        if (old_y != y) /* create new line ? - not necessary if the same line is used several times */
+        else
         {
-          old_y = y;
-          src_x = p->image_width - 1;
-
-          for (dst_x = 0; dst_x < p->preview_width; ++dst_x)
+          for (x = 0; x < p->image_width; x++)
           {
-            x = (int) (src_x + 0.5);
-            if (x < 0)
-            {
-              break;
-            }
-
-            p->preview_row[3*dst_x + 0] = p->image_data_enh[src_offset + x_direction * 3 * x + 0]; /* R */
-            p->preview_row[3*dst_x + 1] = p->image_data_enh[src_offset + x_direction * 3 * x + 1]; /* G */
-            p->preview_row[3*dst_x + 2] = p->image_data_enh[src_offset + x_direction * 3 * x + 2]; /* B */
-            src_x -= xscale;
+            *enhp++ = preview_gamma_data_red  [(*linep++) >> rotate];
+            *enhp++ = preview_gamma_data_green[(*linep++) >> rotate];
+            *enhp++ = preview_gamma_data_blue [(*linep++) >> rotate];
           }
         }
-
-        gtk_preview_draw_row(GTK_PREVIEW(p->window), p->preview_row, 0, dst_y, p->preview_window_width);
-        src_y += yscale;
       }
-      dst_y = p->preview_height;
-
-      memset(p->preview_row, 0x80, 3*p->preview_window_width);
-      for (; dst_y < p->preview_window_height; ++dst_y)
+      else if (gamma) /* grayscale preview */
       {
-        gtk_preview_draw_row(GTK_PREVIEW(p->window), p->preview_row, 0, dst_y, p->preview_window_width);
+        for (x = 0; x < p->image_width; x++)
+        {
+          level = (*linep++); /* red */
+          level += (*linep++); /* green */
+          level += (*linep++); /* blue */
+          level /= 3;
+          level >>= rotate;
+          *enhp++ = preview_gamma_data_red  [level]; /* use 12 bit gamma table */
+          *enhp++ = preview_gamma_data_green[level];
+          *enhp++ = preview_gamma_data_blue [level];
+        }
       }
-     break;
-
-
-    case 3: /* 270 degree */ 
-      /* because we run in x direction we have to draw all rows all the time */
-
-      src_y = 0.0;
-
-      DBG(DBG_info, "preview_height=%d\n", p->preview_height);
-
-      for (dst_y = 0; dst_y < p->preview_height; ++dst_y)
+      else /* lineart or no gamma table */
       {
-        y = (int) (src_y + 0.5);
-        if (y >= p->image_width)
+        for (x = 0; x < 3 * p->image_width; x++)
         {
-          break;
+          *enhp++ = (*linep++) >> 8;
         }
+      }
+    }
 
-        if (p->rotation & 4) /* mirror in x direction */
-        {
-          src_offset = (p->image_width - y - 1) * 3 + 3 * p->image_width * (p->image_height - 1);
-          x_direction = -1;
-        }
-        else /* not mirrored */
-        {
-          src_offset = (p->image_width - y - 1) * 3;
-          x_direction = 1;
-        }
+    p->image_enh_valid[tile] = TRUE;
+  }
 
-        if (old_y != y) /* create new line ? - not necessary if the same line is used several times */
-        {
-          old_y = y;
-          src_x = 0.0;
+  xsane_lut_free(lut);
+  free(line);
+}
 
-          for (dst_x = 0; dst_x < p->preview_width; ++dst_x)
-          {
-            x = (int) (src_x + 0.5);
-            if (x >= p->image_height)
-            {
-              break;
-            }
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-            p->preview_row[3*dst_x + 0] = p->image_data_enh[src_offset + x_direction * 3 * x * p->image_width + 0]; /* R */
-            p->preview_row[3*dst_x + 1] = p->image_data_enh[src_offset + x_direction * 3 * x * p->image_width + 1]; /* G */
-            p->preview_row[3*dst_x + 2] = p->image_data_enh[src_offset + x_direction * 3 * x * p->image_width + 2]; /* B */
-            src_x += xscale;
-          }
-        }
+/* memory that is used by the preview image and the memory the old layout */
+/* with 16 bit color samples for every preview would have needed */
+static void preview_get_memory_usage(Preview *p, double *used, double *full)
+{
+ int level;
 
-        gtk_preview_draw_row(GTK_PREVIEW(p->window), p->preview_row, 0, dst_y, p->preview_window_width);
-        src_y += yscale;
-      }
+  *used = 0.0;
+  *full = 0.0;
 
-      memset(p->preview_row, 0x80, 3*p->preview_window_width);
-      for (; dst_y < p->preview_window_height; ++dst_y)
-      {
-        gtk_preview_draw_row(GTK_PREVIEW(p->window), p->preview_row, 0, dst_y, p->preview_window_width);
-      }
-     break;
+  if ((!p->image_data_raw) || (!p->image_data_enh))
+  {
+    return;
   }
 
-  if (p->calibration) /* do not rotate calibration image */
+  *used = preview_raw_size(p, p->image_height) + 3.0 * p->image_width * p->image_height;
+  *full = 9.0 * p->image_width * p->image_height;
+
+  for (level = 1; level < p->image_levels; level++)
   {
-    p->rotation = rotation;
+    *used += 3.0 * p->image_level_width[level] * p->image_level_height[level];
   }
-
-  /* image is redrawn, we have no visible selections */
-  p->previous_selection.active = FALSE;
-  p->previous_selection_maximum.active = FALSE;
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-static void preview_display_partial_image(Preview *p)
+static void preview_free_raw(Preview *p)
 {
-  DBG(DBG_proc, "preview_display_partial_image\n");
-
-  preview_paint_image(p);
-
-  if (GTK_WIDGET_DRAWABLE(p->window))
+#ifdef HAVE_MMAP
+  if (p->image_data_raw_map)
   {
-    GtkPreview *preview = GTK_PREVIEW(p->window);
-    int src_x, src_y;
-
-    src_x = (p->window->allocation.width - preview->buffer_width)/2;
-    src_y = (p->window->allocation.height - preview->buffer_height)/2;
+    munmap(p->image_data_raw_map, p->image_data_raw_map_size);
+    p->image_data_raw_map = NULL;
+    p->image_data_raw_map_size = 0;
+    p->image_data_raw = 0;
+  }
+#endif
 
-    gtk_preview_put(preview, p->window->window, p->window->style->black_gc, src_x, src_y,
-                    0, 0, p->preview_window_width, p->preview_window_height);
+  if (p->image_data_raw)
+  {
+    free(p->image_data_raw);
+    p->image_data_raw = 0;
   }
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-static void preview_display_maybe(Preview *p)
+#ifdef HAVE_MMAP
+/* replaces the allocated image_data_raw by a private mapping of the preview cache file, */
+/* the preview files are removed before they are written again, so the mapping stays valid */
+static int preview_map_raw(Preview *p, FILE *in, size_t image_offset)
 {
- time_t now;
+ struct stat st;
+ size_t size = image_offset + preview_raw_size(p, p->image_height);
+ void *map;
 
-  DBG(DBG_proc, "preview_display_maybe\n");
+  DBG(DBG_proc, "preview_map_raw\n");
 
-  time(&now);
+  if ((fstat(fileno(in), &st)) || ((size_t) st.st_size < size))
+  {
+    DBG(DBG_info, "preview_map_raw: preview cache file is too short\n");
+   return -1;
+  }
 
-  if (now > p->image_last_time_updated) /* wait at least one secone */
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(in), 0);
+  if (map == MAP_FAILED)
   {
-    p->image_last_time_updated = now;
-    preview_display_partial_image(p);
+    DBG(DBG_info, "preview_map_raw: mmap failed: %s\n", strerror(errno));
+   return -1;
+  }
+
+  if (p->image_data_raw)
+  {
+    free(p->image_data_raw);
   }
+
+  p->image_data_raw          = (u_char *) map + image_offset;
+  p->image_data_raw_map      = map;
+  p->image_data_raw_map_size = size;
+
+ return 0;
 }
+#endif
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-static void preview_display_image(Preview *p)
+/* reads the header of a preview cache file, a P6 image (startimage, calibration image) is */
+/* accepted, too: its header is converted and it has no thumbnail */
+static int preview_read_image_header(FILE *in, Preview_cache_header *header)
 {
-  DBG(DBG_proc, "preview_display_image\n");
+ char buf[TEXTBUFSIZE];
+ int max_val;
 
-  /* if image height was unknown and got larger than expected get missing memory */
-  if (p->params.lines <= 0 && p->image_y < p->image_height)
+  if ( (fread(header, sizeof(Preview_cache_header), 1, in) == 1) &&
+       (!memcmp(header->magic, PREVIEW_CACHE_MAGIC, sizeof(header->magic))) )
   {
-    p->image_height   = p->image_y;
+    if ( (header->version != PREVIEW_CACHE_VERSION) || (header->byte_order != PREVIEW_CACHE_BYTE_ORDER) ||
+         ((header->channels != 1) && (header->channels != 3)) ||
+         ((header->sample_size != 1) && (header->sample_size != 2)) )
+    {
+      DBG(DBG_info, "preview cache file has wrong version or byte order\n");
+     return -1;
+    }
 
-    p->image_data_raw = realloc(p->image_data_raw, 6 * p->image_width * p->image_height);
-    p->image_data_enh = realloc(p->image_data_enh, 3 * p->image_width * p->image_height);
-    assert(p->image_data_raw);
-    assert(p->image_data_enh);
+   return 0;
   }
 
-  preview_display_with_correction(p);
+  rewind(in);
+  memset(header, 0, sizeof(Preview_cache_header));
+
+  if (fscanf(in, "P6\n"
+                 "# surface: %g %g %g %g %u %u\n"
+                 "# time: %d\n"
+                 "%u %u\n%d",
+	      header->surface + 0, header->surface + 1, header->surface + 2, header->surface + 3,
+	      &header->surface_type, &header->surface_unit,
+              &header->time,
+	      &header->image_width, &header->image_height,
+              &max_val) != 10)
+  {
+    DBG(DBG_info, "no preview image\n");
+   return -1;
+  }
+
+  fgets(buf, sizeof(buf), in); /* skip newline character. this made a lot of problems in the past, so I skip it this way */
+
+  header->channels     = 3;
+  header->sample_size  = (max_val == 65535) ? 2 : 1;
+  header->image_offset = ftell(in);
+
+ return 0;
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-static void preview_save_option(Preview *p, int option, void *save_loc, int *valid)
+/* reads pixel x, y of the image data of a preview file as 3 16 bit samples */
+static void preview_read_image_pixel(FILE *in, Preview_cache_header *header, int x, int y, guint16 *rgb)
 {
- SANE_Status status;
+ u_char sample[6];
+ guint16 sample16;
+ int pixel_size = header->channels * header->sample_size;
+ int c, index;
 
-  DBG(DBG_proc, "preview_save_option\n");
+  memset(sample, 0, sizeof(sample));
 
-  if (option <= 0)
+  fseek(in, header->image_offset + ((size_t) y * header->image_width + x) * pixel_size, SEEK_SET);
+  if (fread(sample, pixel_size, 1, in) != 1)
   {
-    *valid = 0;
-    return;
+    DBG(DBG_info, "preview_read_image_pixel: preview file is too short\n");
   }
 
-  status = xsane_control_option(xsane.dev, option, SANE_ACTION_GET_VALUE, save_loc, 0);
-  *valid = (status == SANE_STATUS_GOOD);
-}
+  for (c = 0; c < 3; c++)
+  {
+    index = (header->channels == 3) ? c : 0;
+
+    if (header->sample_size == 2)
+    {
+      memcpy(&sample16, sample + 2 * index, 2); /* 16 bit value in machines byte order */
+      rgb[c] = sample16;
+    }
+    else
+    {
+      rgb[c] = sample[index] * 256;
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* The painted image is taken from a pyramid of levels: level 0 is image_data_enh, each further
+ * level is a 2x2 box filtered copy of the previous one. The levels are built when the image is
+ * painted the first time after image_data_enh has been changed and are reused for all following
+ * resizes, zooms and rotations. The smallest level that still has at least one pixel per window
+ * pixel is painted, so large previews are not walked pixel by pixel in a small window.
+ * Image lines that change while scanning are marked dirty and only the window area that
+ * shows these lines is painted and put to the screen.
+ */
+
+static void preview_invalidate_lines(Preview *p, int first_line, int end_line)
+{
+ int tile;
+
+  p->image_levels = 1;
+
+  if (p->image_enh_valid) /* image_data_enh has to be created again for these lines */
+  {
+    for (tile = ((first_line > 0) ? first_line : 0) / PREVIEW_TILE_LINES;
+         (tile * PREVIEW_TILE_LINES < end_line) && (tile * PREVIEW_TILE_LINES < p->image_height); tile++)
+    {
+      p->image_enh_valid[tile] = FALSE;
+    }
+  }
+
+  preview_mark_lines_dirty(p, first_line, end_line);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void preview_mark_lines_dirty(Preview *p, int first_line, int end_line)
+{
+  if (p->dirty_line_first >= p->dirty_line_end) /* nothing is dirty */
+  {
+    p->dirty_line_first = first_line;
+    p->dirty_line_end   = end_line;
+  }
+  else
+  {
+    if (first_line < p->dirty_line_first)
+    {
+      p->dirty_line_first = first_line;
+    }
+
+    if (end_line > p->dirty_line_end)
+    {
+      p->dirty_line_end = end_line;
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void preview_invalidate_image(Preview *p)
+{
+  p->paint_valid = FALSE; /* the next display paints the whole window */
+  preview_invalidate_lines(p, 0, p->image_height);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void preview_free_levels(Preview *p)
+{
+ int level;
+
+  for (level = 1; level < PREVIEW_LEVELS; level++)
+  {
+    if (p->image_level_data[level])
+    {
+      free(p->image_level_data[level]);
+      p->image_level_data[level] = NULL;
+    }
+  }
+
+  p->image_levels = 1;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* creates lines first_line .. end_line-1 of level from the previous level */
+static void preview_build_level_lines(Preview *p, int level, int first_line, int end_line)
+{
+ u_char *src, *dst, *line0, *line1;
+ int width, src_width, src_height;
+ int x, y, x1, c;
+
+  src        = (level == 1) ? p->image_data_enh : p->image_level_data[level - 1];
+  src_width  = p->image_level_width[level - 1];
+  src_height = p->image_level_height[level - 1];
+  width      = p->image_level_width[level];
+
+  for (y = first_line; y < end_line; y++)
+  {
+    dst   = p->image_level_data[level] + 3 * width * y;
+    line0 = src + 3 * src_width * (2 * y);
+    line1 = (2 * y + 1 < src_height) ? line0 + 3 * src_width : line0; /* odd height: repeat last line */
+
+    for (x = 0; x < width; x++)
+    {
+      x1 = (2 * x + 1 < src_width) ? 2 * x + 1 : 2 * x; /* odd width: repeat last column */
+
+      for (c = 0; c < 3; c++)
+      {
+        *dst++ = (line0[6 * x + c] + line0[3 * x1 + c] + line1[6 * x + c] + line1[3 * x1 + c] + 2) >> 2;
+      }
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void preview_build_levels(Preview *p, int levels)
+{
+ u_char *dst;
+ int level, width, height;
+
+  if (p->image_levels < 1)
+  {
+    p->image_levels = 1;
+  }
+
+  p->image_level_width[0]  = p->image_width;
+  p->image_level_height[0] = p->image_height;
+
+  for (level = p->image_levels; level < levels; level++)
+  {
+    DBG(DBG_info, "preview_build_levels: building level %d\n", level);
+
+    width  = (p->image_level_width[level - 1]  + 1) / 2;
+    height = (p->image_level_height[level - 1] + 1) / 2;
+
+    dst = realloc(p->image_level_data[level], 3 * width * height);
+    if (!dst)
+    {
+      break; /* paint with the levels we have */
+    }
+
+    p->image_level_data[level]   = dst;
+    p->image_level_width[level]  = width;
+    p->image_level_height[level] = height;
+
+    preview_build_level_lines(p, level, 0, height);
+
+    p->image_levels = level + 1;
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* creates the lines of all built levels again that are taken from lines first_line .. end_line-1 of image_data_enh */
+static void preview_update_levels(Preview *p, int first_line, int end_line)
+{
+ int level;
+
+  for (level = 1; level < p->image_levels; level++)
+  {
+    first_line = first_line / 2;
+    end_line   = (end_line + 1) / 2;
+
+    if (end_line > p->image_level_height[level])
+    {
+      end_line = p->image_level_height[level];
+    }
+
+    preview_build_level_lines(p, level, first_line, end_line);
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* fills the lookup table of one window axis: image_index is the level 0 image index */
+/* that is shown at the window position (-1 = no image), offset the byte offset */
+/* of the pixel in the painted level */
+static void preview_paint_axis(int *image_index, int *offset, int window_size, int used_size, int window_reversed,
+                               int image_size, int image_reversed, float scale, int level, int stride)
+{
+ float pos;
+ int w, t;
+
+  for (w = 0; w < window_size; w++)
+  {
+    image_index[w] = -1;
+    offset[w]      = 0;
+
+    if (w >= used_size)
+    {
+      continue;
+    }
+
+    t = (window_reversed) ? used_size - 1 - w : w;
+
+    pos = t * scale + 0.5; /* position of the pixel center measured from the image border */
+
+    if (pos >= image_size)
+    {
+      continue;
+    }
+
+    if (image_reversed)
+    {
+      pos = image_size - pos;
+    }
+
+    image_index[w] = (int) pos;
+    offset[w]      = ((int) (pos / (1 << level))) * stride;
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* paints the whole preview buffer (first_line = -1) or only the window pixels that show */
+/* image lines first_line .. end_line-1, the painted window area is returned in area */
+static void preview_paint_image_area(Preview *p, int first_line, int end_line, GdkRectangle *area)
+{
+ float xscale, yscale;
+ int rotation, level, levels, height, lines_on_y;
+ int *x_index, *x_offset, *y_index, *y_offset, *line_index;
+ int x0, x1, y0, y1, w, x, y;
+ int level_width;
+ u_char *data, *src, *row;
+
+  DBG(DBG_proc, "preview_paint_image_area(rotation=%d, lines %d..%d)\n", p->rotation, first_line, end_line);
+
+  area->x = area->y = area->width = area->height = 0;
+
+  if ((!p->image_data_enh) || (!p->preview_row) || (p->preview_window_width <= 0) || (p->preview_window_height <= 0))
+  {
+    return; /* no image data */
+  }
+
+  if (p->calibration) /* do not rotate calibration image */
+  {
+    rotation = 0;
+    xscale = 1.0;
+    yscale = 1.0;
+  }
+  else
+  {
+    rotation = p->rotation;
+    preview_get_scale_window_to_image(p, &xscale, &yscale);
+  }
+
+  /* don't draw last line unless it's complete: */
+  height = p->image_y;
+  if ((p->image_x == 0) && (height < p->image_height))
+  {
+    ++height; /* use last line if it is complete */
+  }
+
+  if (!p->scanning)
+  {
+    height = p->image_height;
+  }
+
+  /* while the correction is applied in the background the stale tiles are painted as they are */
+  if (first_line < 0)
+  {
+    preview_enh_update(p, 0, p->image_height, (p->correction_idle != 0));
+  }
+  else
+  {
+    preview_enh_update(p, first_line, end_line, (p->correction_idle != 0));
+  }
+
+  /* use the smallest level that has at least one pixel per window pixel, */
+  /* while scanning the image data changes all the time, so levels are not used */
+  level  = 0;
+  levels = 1;
+  if (!p->scanning)
+  {
+    while ((level + 1 < PREVIEW_LEVELS) && ((1 << (level + 1)) <= xscale) && ((1 << (level + 1)) <= yscale) &&
+           (p->image_width >> (level + 1)) && (p->image_height >> (level + 1)))
+    {
+      level++;
+    }
+
+    levels = level + 1;
+
+    if (p->image_levels < levels)
+    {
+      preview_build_levels(p, levels);
+    }
+
+    if (level >= p->image_levels)
+    {
+      level = p->image_levels - 1;
+    }
+  }
+
+  if (level)
+  {
+    data        = p->image_level_data[level];
+    level_width = p->image_level_width[level];
+  }
+  else
+  {
+    data        = p->image_data_enh;
+    level_width = p->image_width;
+  }
+
+  x_index  = malloc(sizeof(int) * p->preview_window_width);
+  x_offset = malloc(sizeof(int) * p->preview_window_width);
+  y_index  = malloc(sizeof(int) * p->preview_window_height);
+  y_offset = malloc(sizeof(int) * p->preview_window_height);
+
+  if ((!x_index) || (!x_offset) || (!y_index) || (!y_offset))
+  {
+    DBG(DBG_error, "preview_paint_image_area: out of memory\n");
+    free(x_index);
+    free(x_offset);
+    free(y_index);
+    free(y_offset);
+   return;
+  }
+
+  /* image columns and lines for each window column and row */
+  switch (rotation & 3)
+  {
+    case 0: /* do not rotate - 0 degree */
+    default:
+      preview_paint_axis(x_index, x_offset, p->preview_window_width, p->preview_width, FALSE,
+                         p->image_width, (rotation & 4), xscale, level, 3);
+      preview_paint_axis(y_index, y_offset, p->preview_window_height, p->preview_height, FALSE,
+                         p->image_height, FALSE, yscale, level, 3 * level_width);
+     break;
+
+    case 1: /* 90 degree */
+      preview_paint_axis(x_index, x_offset, p->preview_window_width, p->preview_width, FALSE,
+                         p->image_height, !(rotation & 4), xscale, level, 3 * level_width);
+      preview_paint_axis(y_index, y_offset, p->preview_window_height, p->preview_height, FALSE,
+                         p->image_width, FALSE, yscale, level, 3);
+     break;
+
+    case 2: /* 180 degree */
+      preview_paint_axis(x_index, x_offset, p->preview_window_width, p->preview_width, FALSE,
+                         p->image_width, !(rotation & 4), xscale, level, 3);
+      preview_paint_axis(y_index, y_offset, p->preview_window_height, p->preview_height, TRUE,
+                         p->image_height, FALSE, yscale, level, 3 * level_width);
+     break;
+
+    case 3: /* 270 degree */
+      preview_paint_axis(x_index, x_offset, p->preview_window_width, p->preview_width, FALSE,
+                         p->image_height, (rotation & 4), xscale, level, 3 * level_width);
+      preview_paint_axis(y_index, y_offset, p->preview_window_height, p->preview_height, FALSE,
+                         p->image_width, TRUE, yscale, level, 3);
+     break;
+  }
+
+  lines_on_y = ((rotation & 1) == 0);
+  line_index = (lines_on_y) ? y_index : x_index;
+
+  if (lines_on_y) /* image lines that are not scanned yet are not painted */
+  {
+    for (y = 0; y < p->preview_window_height; y++)
+    {
+      if (y_index[y] >= height)
+      {
+        y_index[y] = -1;
+      }
+    }
+  }
+
+  x0 = 0;
+  y0 = 0;
+  x1 = p->preview_window_width;
+  y1 = p->preview_window_height;
+
+  if (first_line >= 0) /* only paint the window area that shows the dirty lines */
+  {
+   int *start = (lines_on_y) ? &y0 : &x0;
+   int *end   = (lines_on_y) ? &y1 : &x1;
+   int size   = *end;
+
+    *start = size;
+    *end   = 0;
+
+    for (w = 0; w < size; w++)
+    {
+      if ((line_index[w] >= first_line) && (line_index[w] < end_line))
+      {
+        if (w < *start)
+        {
+          *start = w;
+        }
+        *end = w + 1;
+      }
+    }
+  }
+
+  for (y = y0; y < y1; y++)
+  {
+    row = p->preview_row + 3 * x0;
+
+    if (y_index[y] < 0)
+    {
+      memset(row, 0x80, 3 * (x1 - x0));
+    }
+    else
+    {
+      src = data + y_offset[y];
+
+      for (x = x0; x < x1; x++)
+      {
+        if (x_index[x] < 0)
+        {
+          *row++ = 0x80;
+          *row++ = 0x80;
+          *row++ = 0x80;
+        }
+        else
+        {
+          *row++ = src[x_offset[x] + 0]; /* R */
+          *row++ = src[x_offset[x] + 1]; /* G */
+          *row++ = src[x_offset[x] + 2]; /* B */
+        }
+      }
+    }
+
+    gtk_preview_draw_row(GTK_PREVIEW(p->window), p->preview_row + 3 * x0, x0, y, x1 - x0);
+  }
+
+  free(x_index);
+  free(x_offset);
+  free(y_index);
+  free(y_offset);
+
+  if ((x1 > x0) && (y1 > y0))
+  {
+    area->x      = x0;
+    area->y      = y0;
+    area->width  = x1 - x0;
+    area->height = y1 - y0;
+  }
+
+  if (first_line < 0)
+  {
+    p->paint_valid          = TRUE;
+    p->paint_image_width    = p->image_width;
+    p->paint_image_height   = p->image_height;
+    p->paint_preview_width  = p->preview_width;
+    p->paint_preview_height = p->preview_height;
+    p->paint_window_width   = p->preview_window_width;
+    p->paint_window_height  = p->preview_window_height;
+    p->paint_rotation       = rotation;
+  }
+
+  /* the line that is not complete yet stays dirty */
+  p->dirty_line_first = (p->dirty_line_end > height) ? height : p->dirty_line_end;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void preview_paint_image(Preview *p)
+{
+ GdkRectangle area;
+
+  DBG(DBG_proc, "preview_paint_image (rotation=%d)\n", p->rotation);
+
+  preview_paint_image_area(p, -1, 0, &area);
+
+  /* image is redrawn, we have no visible selections */
+  p->previous_selection.active = FALSE;
+  p->previous_selection_maximum.active = FALSE;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void preview_display_partial_image(Preview *p)
+{
+ GdkRectangle area;
+ int full;
+
+  DBG(DBG_proc, "preview_display_partial_image\n");
+
+  full = ( (!p->paint_valid) ||
+           (p->paint_image_width    != p->image_width)          || (p->paint_image_height   != p->image_height) ||
+           (p->paint_preview_width  != p->preview_width)        || (p->paint_preview_height != p->preview_height) ||
+           (p->paint_window_width   != p->preview_window_width) || (p->paint_window_height  != p->preview_window_height) ||
+           (p->paint_rotation != ((p->calibration) ? 0 : p->rotation)) ||
+           ((p->dirty_line_first <= 0) && (p->dirty_line_end >= p->image_height)) );
+
+  if (full)
+  {
+    preview_paint_image(p);
+    area.x      = 0;
+    area.y      = 0;
+    area.width  = p->preview_window_width;
+    area.height = p->preview_window_height;
+  }
+  else if (p->dirty_line_first < p->dirty_line_end)
+  {
+    preview_paint_image_area(p, p->dirty_line_first, p->dirty_line_end, &area);
+  }
+  else
+  {
+    return; /* nothing has changed */
+  }
+
+  if ((GTK_WIDGET_DRAWABLE(p->window)) && (area.width > 0) && (area.height > 0))
+  {
+    GtkPreview *preview = GTK_PREVIEW(p->window);
+    int src_x, src_y;
+
+    src_x = (p->window->allocation.width - preview->buffer_width)/2;
+    src_y = (p->window->allocation.height - preview->buffer_height)/2;
+
+    if (full)
+    {
+      gtk_preview_put(preview, p->window->window, p->window->style->black_gc, src_x, src_y,
+                      0, 0, p->preview_window_width, p->preview_window_height);
+    }
+    else
+    {
+     Tselection selection         = p->selection;
+     Tselection selection_maximum = p->selection_maximum;
+     Tselection visible_selection         = p->previous_selection;
+     Tselection visible_selection_maximum = p->previous_selection_maximum;
+
+      /* the selection frames are drawn with xor, remove them before the area is overwritten */
+      p->selection.active = FALSE;
+      p->selection_maximum.active = FALSE;
+      preview_draw_selection(p);
+
+      gtk_preview_put(preview, p->window->window, p->window->style->black_gc, src_x + area.x, src_y + area.y,
+                      area.x, area.y, area.width, area.height);
+
+      /* and draw the frames again that have been visible */
+      p->selection         = visible_selection;
+      p->selection_maximum = visible_selection_maximum;
+      preview_draw_selection(p);
+
+      p->selection         = selection;
+      p->selection_maximum = selection_maximum;
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void preview_display_maybe(Preview *p)
+{
+ time_t now;
+
+  DBG(DBG_proc, "preview_display_maybe\n");
+
+  time(&now);
+
+  if (now > p->image_last_time_updated) /* wait at least one secone */
+  {
+    p->image_last_time_updated = now;
+    preview_display_partial_image(p);
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void preview_display_image(Preview *p)
+{
+  DBG(DBG_proc, "preview_display_image\n");
+
+  /* if image height was unknown and got larger than expected get missing memory */
+  if (p->params.lines <= 0 && p->image_y < p->image_height)
+  {
+    p->image_height   = p->image_y;
+
+    p->image_data_raw = realloc(p->image_data_raw, preview_raw_size(p, p->image_height));
+    p->image_data_enh = realloc(p->image_data_enh, 3 * p->image_width * p->image_height);
+    assert(p->image_data_raw);
+    assert(p->image_data_enh);
+    preview_histogram_free(p);
+    preview_invalidate_image(p);
+  }
+
+  preview_display_with_correction(p);
+
+  if (p->rgb_label)
+  {
+    preview_display_color_components(p, -1, -1); /* update memory usage */
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void preview_save_option(Preview *p, int option, void *save_loc, int *valid)
+{
+ SANE_Status status;
+
+  DBG(DBG_proc, "preview_save_option\n");
+
+  if (option <= 0)
+  {
+    *valid = 0;
+    return;
+  }
+
+  status = xsane_control_option(xsane.dev, option, SANE_ACTION_GET_VALUE, save_loc, 0);
+  *valid = (status == SANE_STATUS_GOOD);
+}
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
@@ -1419,6 +2090,7 @@ static int preview_test_image_y(Preview *p)
 static int preview_increment_image_y(Preview *p)
 {
  size_t extra_size, offset;
+ int tile;
  char buf[TEXTBUFSIZE];
 
   DBG(DBG_proc, "preview_increment_image_y\n");
@@ -1428,21 +2100,27 @@ static int preview_increment_image_y(Preview *p)
 
   if (p->params.lines <= 0 && p->image_y >= p->image_height) /* backend said it does not know image height */
   {
-    offset = 3 * p->image_width*p->image_height;
-    extra_size = 3 * 32 * p->image_width;
+    offset = preview_raw_size(p, p->image_height);
+    extra_size = preview_raw_size(p, 32);
     p->image_height += 32;
 
-    p->image_data_raw = realloc(p->image_data_raw, (offset + extra_size) * 2);
-    p->image_data_enh = realloc(p->image_data_enh, offset + extra_size);
+    p->image_data_raw  = realloc(p->image_data_raw, offset + extra_size);
+    p->image_data_enh  = realloc(p->image_data_enh, 3 * p->image_width * p->image_height);
+    p->image_enh_valid = realloc(p->image_enh_valid, (p->image_height + PREVIEW_TILE_LINES - 1) / PREVIEW_TILE_LINES);
 
-    if ( (!p->image_data_enh) || (!p->image_data_raw) )
+    if ( (!p->image_data_enh) || (!p->image_data_raw) || (!p->image_enh_valid) )
     {
       snprintf(buf, sizeof(buf), "%s %s.", ERR_FAILED_ALLOCATE_IMAGE, strerror(errno));
       preview_scan_done(p, 0);
       xsane_back_gtk_error(buf, TRUE);
      return -1;
     }
-    memset(p->image_data_enh + offset, 0xff, extra_size);
+    memset(p->image_data_raw + offset, 0xff, extra_size);
+
+    for (tile = (p->image_height - 32) / PREVIEW_TILE_LINES; tile * PREVIEW_TILE_LINES < p->image_height; tile++)
+    {
+      p->image_enh_valid[tile] = FALSE;
+    }
   }
 
   return 0;
@@ -1450,44 +2128,55 @@ static int preview_increment_image_y(Preview *p)
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
+/* reads from the reader thread when it is active, otherwise directly from the backend */
+static SANE_Status preview_read(Preview *p, SANE_Byte *buf, SANE_Int max_len, SANE_Int *len)
+{
+  if (p->reader)
+  {
+   return xsane_reader_read(p->reader, buf, max_len, len);
+  }
+
+ return sane_read(xsane.dev, buf, max_len, len);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
 static void preview_read_image_data(gpointer data, gint source, GdkInputCondition cond)
 {
  SANE_Status status;
  Preview *p = data;
  char buf[TEXTBUFSIZE];
- u_char imagebuf8[8192];
- guint16 *imagebuf16 = (guint16 *) imagebuf8;
- SANE_Handle dev;
+ guint16 imagebuf16[16384];
+ u_char *imagebuf8 = (u_char *) imagebuf16; /* aligned for 16 bit data */
  SANE_Int len;
  int i, j;
+ int first_line = p->image_y; /* first image line that is changed by this call */
 
   DBG(DBG_proc, "preview_read_image_data\n");
 
-  dev = xsane.dev;
   while (1)
   {
     if ((p->params.depth == 1) || (p->params.depth == 8))
     {
-      status = sane_read(dev, imagebuf8, sizeof(imagebuf8), &len);
+      status = preview_read(p, imagebuf8, sizeof(imagebuf16), &len);
     }
     else if (p->params.depth == 16)
     {
       if (p->read_offset_16)
       {
         imagebuf8[0] = p->last_offset_16_byte; 
-        /* use imagebuf8 and sizeof(imagebuf8) here because sizeof(imagebuf16) returns the size of a pointer */
-        status = sane_read(dev, imagebuf8+1, sizeof(imagebuf8) - 1, &len);
+        status = preview_read(p, imagebuf8+1, sizeof(imagebuf16) - 1, &len);
         len++;
       }
       else
       {
-        status = sane_read(dev, (SANE_Byte *) imagebuf16, sizeof(imagebuf8), &len);
+        status = preview_read(p, (SANE_Byte *) imagebuf16, sizeof(imagebuf16), &len);
       }
 
       if (len % 2) /* odd number of bytes */
       {
         len--;
-        p->last_offset_16_byte = imagebuf16[len];
+        p->last_offset_16_byte = imagebuf8[len];
         p->read_offset_16 = 1;
       }
       else /* even number of bytes */
@@ -1579,8 +2268,7 @@ static void preview_read_image_data(gpointer data, gint source, GdkInputConditio
                   return; /* backend sends too much image data */
                 }
 
-                p->image_data_raw[p->image_offset]   = imagebuf8[i] * 256;
-                p->image_data_enh[p->image_offset++] = imagebuf8[i];
+                p->image_data_raw[p->image_offset++] = imagebuf8[i];
 
                 if (p->image_offset%3 == 0)
                 {
@@ -1602,8 +2290,7 @@ static void preview_read_image_data(gpointer data, gint source, GdkInputConditio
                   return; /* backend sends too much image data */
                 }
   
-                p->image_data_raw[p->image_offset]   = imagebuf16[i];
-                p->image_data_enh[p->image_offset++] = (u_char) (imagebuf16[i]/256);
+                ((guint16 *) p->image_data_raw)[p->image_offset++] = imagebuf16[i];
   
                 if (p->image_offset%3 == 0)
                 {
@@ -1641,14 +2328,7 @@ static void preview_read_image_data(gpointer data, gint source, GdkInputConditio
               {
                 u_char gl = (mask & (1 << j)) ? 0x00 : 0xff;
 
-                p->image_data_raw[p->image_offset]   = gl * 256;
-                p->image_data_enh[p->image_offset++] = gl;
-
-                p->image_data_raw[p->image_offset]   = gl * 256;
-                p->image_data_enh[p->image_offset++] = gl;
-
-                p->image_data_raw[p->image_offset]   = gl * 256;
-                p->image_data_enh[p->image_offset++] = gl;
+                p->image_data_raw[p->image_offset++] = gl;
 
                 if (++p->image_x >= p->image_width)
                 {
@@ -1672,14 +2352,7 @@ static void preview_read_image_data(gpointer data, gint source, GdkInputConditio
                 return; /* backend sends too much image data */
               }
 
-              p->image_data_raw[p->image_offset]   = gray * 256;
-              p->image_data_enh[p->image_offset++] = gray;
-
-              p->image_data_raw[p->image_offset]   = gray * 256;
-              p->image_data_enh[p->image_offset++] = gray;
-
-              p->image_data_raw[p->image_offset]   = gray * 256;
-              p->image_data_enh[p->image_offset++] = gray;
+              p->image_data_raw[p->image_offset++] = gray;
               if (++p->image_x >= p->image_width && preview_increment_image_y(p) < 0)
 	      {
                 return;
@@ -1690,21 +2363,12 @@ static void preview_read_image_data(gpointer data, gint source, GdkInputConditio
           case 16:
             for (i = 0; i < len/2; ++i)
             {
-             u_char gray = imagebuf16[i]/256;
-
               if (preview_test_image_y(p))
               {
                 return; /* backend sends too much image data */
               }
 
-              p->image_data_raw[p->image_offset]   = imagebuf16[i];
-              p->image_data_enh[p->image_offset++] = gray;
-
-              p->image_data_raw[p->image_offset]   = imagebuf16[i];
-              p->image_data_enh[p->image_offset++] = gray;
-
-              p->image_data_raw[p->image_offset]   = imagebuf16[i];
-              p->image_data_enh[p->image_offset++] = gray;
+              ((guint16 *) p->image_data_raw)[p->image_offset++] = imagebuf16[i];
 
               if (++p->image_x >= p->image_width && preview_increment_image_y(p) < 0)
 	      {
@@ -1741,8 +2405,7 @@ static void preview_read_image_data(gpointer data, gint source, GdkInputConditio
                     u_char gl = (mask & 1) ? 0xff : 0x00;
                     mask >>= 1;
 
-                    p->image_data_raw[p->image_offset] = gl * 256;
-                    p->image_data_enh[p->image_offset] = gl;
+                    p->image_data_raw[p->image_offset] = gl;
 
                     p->image_offset += 3;
                     if (++p->image_x >= p->image_width && preview_increment_image_y(p) < 0)
@@ -1761,8 +2424,7 @@ static void preview_read_image_data(gpointer data, gint source, GdkInputConditio
                     return; /* backend sends too much image data */
                   }
 
-                  p->image_data_raw[p->image_offset] = imagebuf8[i] * 256;
-                  p->image_data_enh[p->image_offset] = imagebuf8[i];
+                  p->image_data_raw[p->image_offset] = imagebuf8[i];
 
                   p->image_offset += 3;
                   if (++p->image_x >= p->image_width && preview_increment_image_y(p) < 0)
@@ -1780,8 +2442,7 @@ static void preview_read_image_data(gpointer data, gint source, GdkInputConditio
                     return; /* backend sends too much image data */
                   }
 
-                  p->image_data_raw[p->image_offset] = imagebuf16[i];
-                  p->image_data_enh[p->image_offset] = (u_char) (imagebuf16[i]/256);
+                  ((guint16 *) p->image_data_raw)[p->image_offset] = imagebuf16[i];
 
                   p->image_offset += 3;
                   if (++p->image_x >= p->image_width && preview_increment_image_y(p) < 0)
@@ -1808,6 +2469,9 @@ static void preview_read_image_data(gpointer data, gint source, GdkInputConditio
 
     if (p->input_tag < 0)
     {
+      preview_invalidate_lines(p, (first_line < p->image_y) ? first_line : p->image_y, p->image_y + 1);
+      preview_histogram_invalidate_lines(p, (first_line < p->image_y) ? first_line : p->image_y, p->image_y + 1);
+      first_line = p->image_y;
       preview_display_maybe(p);
       while (gtk_events_pending())
       {
@@ -1816,6 +2480,8 @@ static void preview_read_image_data(gpointer data, gint source, GdkInputConditio
       }
     }
   }
+  preview_invalidate_lines(p, (first_line < p->image_y) ? first_line : p->image_y, p->image_y + 1);
+  preview_histogram_invalidate_lines(p, (first_line < p->image_y) ? first_line : p->image_y, p->image_y + 1);
   preview_display_maybe(p);
 
  return;
@@ -1837,6 +2503,12 @@ static void preview_scan_done(Preview *p, int save_image)
     p->input_tag = -1;
   }
 
+  if (p->reader)
+  {
+    xsane_reader_free(p->reader); /* cancels the scan if the reader thread is still running */
+    p->reader = NULL;
+  }
+
   sane_cancel(xsane.dev);
 
   xsane.block_update_param = TRUE; /* do not change parameters each time */
@@ -1901,17 +2573,17 @@ static int preview_get_memory(Preview *p)
 
   DBG(DBG_proc, "preview_get_memory\n");
 
+  preview_free_levels(p);
+  preview_histogram_free(p);
+  preview_invalidate_image(p);
+
   if (p->image_data_enh)
   {
     free(p->image_data_enh);
     p->image_data_enh = 0;
   }
 
-  if (p->image_data_raw)
-  {
-    free(p->image_data_raw);
-    p->image_data_raw = 0;
-  }
+  preview_free_raw(p);
 
   if (p->preview_row)
   {
@@ -1919,11 +2591,20 @@ static int preview_get_memory(Preview *p)
     p->preview_row = 0;
   }
 
-  p->image_data_raw = malloc(6 * p->image_width * p->image_height);
-  p->image_data_enh = malloc(3 * p->image_width * p->image_height);
-  p->preview_row    = malloc(3 * p->preview_window_width);
+  if (p->image_enh_valid)
+  {
+    free(p->image_enh_valid);
+    p->image_enh_valid = 0;
+  }
+
+  DBG(DBG_info, "preview_get_memory: %d channels with %d bytes per sample\n", p->image_channels, p->image_sample_size);
 
-  if ( (!p->image_data_raw) || (!p->image_data_enh) || (!p->preview_row) )
+  p->image_data_raw  = malloc(preview_raw_size(p, p->image_height));
+  p->image_data_enh  = malloc(3 * p->image_width * p->image_height);
+  p->image_enh_valid = calloc((p->image_height + PREVIEW_TILE_LINES - 1) / PREVIEW_TILE_LINES, 1);
+  p->preview_row     = malloc(3 * p->preview_window_width);
+
+  if ( (!p->image_data_raw) || (!p->image_data_enh) || (!p->image_enh_valid) || (!p->preview_row) )
   {
     if (p->image_data_enh)
     {
@@ -1931,12 +2612,14 @@ static int preview_get_memory(Preview *p)
       p->image_data_enh = 0;
     }
 
-    if (p->image_data_raw)
+    if (p->image_enh_valid)
     {
-      free(p->image_data_raw);
-      p->image_data_raw = 0;
+      free(p->image_enh_valid);
+      p->image_enh_valid = 0;
     }
 
+    preview_free_raw(p);
+
     if (p->preview_row)
     {
       free(p->preview_row);
@@ -1950,9 +2633,6 @@ static int preview_get_memory(Preview *p)
     return -1; /* error */
   }
 
-  memset(p->image_data_raw, 0x80, 6*p->image_width*p->image_height); /* clean memory */
-  memset(p->image_data_enh, 0x80, 3*p->image_width*p->image_height); /* clean memory */
-
   return 0; /* ok */
 }
 
@@ -1968,6 +2648,8 @@ static void preview_scan_start(Preview *p)
 
   DBG(DBG_proc, "preview_scan_start\n");
 
+  preview_correction_cancel(p); /* stale tiles are created when they are painted */
+
   p->read_offset_16 = 0;
 
   xsane.medium_changed = FALSE;
@@ -2024,8 +2706,12 @@ static void preview_scan_start(Preview *p)
   }
 
   if ( (!p->image_data_enh)  || (p->params.pixels_per_line != p->image_width)
-      || ( (p->params.lines >= 0) && (p->params.lines != p->image_height) ) )
+      || ( (p->params.lines >= 0) && (p->params.lines != p->image_height) )
+      || (p->image_channels != ((p->params.format == SANE_FRAME_GRAY) ? 1 : 3))
+      || (p->image_sample_size != ((p->params.depth > 8) ? 2 : 1))
+      || (p->image_data_raw_map) ) /* do not scan into a mapped preview cache file */
   {
+    preview_set_raw_format(p, (p->params.format == SANE_FRAME_GRAY) ? 1 : 3, p->params.depth);
     p->image_width  = p->params.pixels_per_line;
     p->image_height = p->params.lines;
 
@@ -2041,17 +2727,34 @@ static void preview_scan_start(Preview *p)
       xsane_back_gtk_error(buf, TRUE);
      return;
     }
+
+    memset(p->image_data_raw, 0x80, preview_raw_size(p, p->image_height)); /* clean memory */
   }
   else if (p->scanning == FALSE) /* single pass scan or first run in 3 pass mode */
   {
-    memset(p->image_data_raw, 0x80, 6*p->image_width*p->image_height); /* clean memory */
-    memset(p->image_data_enh, 0x80, 3*p->image_width*p->image_height); /* clean memory */
+    memset(p->image_data_raw, 0x80, preview_raw_size(p, p->image_height)); /* clean memory */
   }
 
+  preview_invalidate_image(p); /* also the next frame in 3 pass mode starts at line 0 */
+  preview_histogram_invalidate_lines(p, 0, p->image_height);
+
   /* we do not have any active selection (image is redrawn while scanning) */
   p->selection.active = FALSE;
   p->previous_selection_maximum.active = FALSE;
 
+  if (p->reader) /* reader thread of the previous frame in 3 pass mode, it already got EOF */
+  {
+    xsane_reader_free(p->reader);
+    p->reader = NULL;
+  }
+
+  /* read the scanner in its own thread, so redrawing the preview does not stall the scanner */
+  p->reader = xsane_reader_new(dev, (size_t) preferences.scan_buffer_size * 1024, FALSE);
+  if (p->reader)
+  {
+    p->input_tag = gdk_input_add(xsane_reader_get_fd(p->reader), GDK_INPUT_READ, preview_read_image_data, p);
+  }
+  else
 #ifndef BUGGY_GDK_INPUT_EXCEPTION
   if ((sane_set_io_mode(dev, SANE_TRUE) == SANE_STATUS_GOOD) && (sane_get_select_fd(dev, &fd) == SANE_STATUS_GOOD))
   {
@@ -2073,34 +2776,32 @@ static int preview_make_image_path(Preview *p, size_t filename_size, char *filen
   DBG(DBG_proc, "preview_make_image_path\n");
 
   snprintf(buf, sizeof(buf), "xsane-preview-level-%d-", level);
-  return xsane_back_gtk_make_path(filename_size, filename, 0, 0, buf, xsane.dev_name, ".ppm", XSANE_PATH_TMP);
+  return xsane_back_gtk_make_path(filename_size, filename, 0, 0, buf, xsane.dev_name, ".cache", XSANE_PATH_TMP);
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 int preview_create_batch_icon_from_file(Preview *p, FILE *in, Batch_Scan_Parameters *parameters, int min_quality, int *min_time)
 {
+ Preview_cache_header header;
  u_int psurface_type, psurface_unit;
  int image_width, image_height;
  int xoffset, yoffset, width, height;
- int max_val;
  int x, y, dx, dy;
  int time;
- float psurface[4];
+ float *psurface;
  float dsurface[4];
- char buf[TEXTBUFSIZE];
  float scale;
- int header = 0;
  int rotate16 = 16 - preview_gamma_input_bits;
- int rotate8 = preview_gamma_input_bits - 8;
- guint16 r,g,b;
- int c;
+ guint16 rgb[3];
+ u_char r, g, b;
  int maximum_size;
  int quality = 0;
  int xx, yy;
  int offset = 0;
  guchar *data;
- size_t bytes_read;
+ u_char *thumbnail = NULL;
+ int image_x, image_y, thumbnail_x, thumbnail_y;
 
   DBG(DBG_proc, "preview_create_batch_icon_from_file\n");
 
@@ -2110,23 +2811,17 @@ int preview_create_batch_icon_from_file(Preview *p, FILE *in, Batch_Scan_Paramet
   }
 
   /* See whether there is a saved preview and load it if present: */
-  if (fscanf(in, "P6\n"
-                 "# surface: %g %g %g %g %u %u\n"
-                 "# time: %d\n"
-                 "%d %d\n%d",
-	      psurface + 0, psurface + 1, psurface + 2, psurface + 3,
-	      &psurface_type, &psurface_unit,
-              &time,
-	      &image_width, &image_height,
-              &max_val) != 10)
+  if (preview_read_image_header(in, &header))
   {
-    DBG(DBG_info, "no preview image\n");
    return min_quality;
   }
 
-  fgets(buf, sizeof(buf), in); /* skip newline character. this made a lot of problems in the past, so I skip it this way */
-
-  header = ftell(in);
+  psurface      = header.surface;
+  psurface_type = header.surface_type;
+  psurface_unit = header.surface_unit;
+  time          = header.time;
+  image_width   = header.image_width;
+  image_height  = header.image_height;
 
   if (min_quality >= 0) /* read real preview */
   {
@@ -2238,173 +2933,127 @@ int preview_create_batch_icon_from_file(Preview *p, FILE *in, Batch_Scan_Paramet
     data[x] = 0xF0;
   }
 
-  if (max_val == 65535)
+  /* the thumbnail of the preview cache file is used when it has at least one pixel per icon pixel, */
+  /* otherwise the pixels are read from the image data */
+  if ( (header.thumbnail_width) && (header.thumbnail_height) &&
+       (scale * header.thumbnail_width >= image_width) && (scale * header.thumbnail_height >= image_height) )
   {
-    for (y=0; y < height; y++)
-    { 
-      for (x=0; x < width; x++)
-      {
-        fseek(in, header + (xoffset + (int)(x * scale) + (yoffset + (int)(y * scale)) * image_width) * 6, SEEK_SET);
-
-        bytes_read = fread(&r, 2, 1, in); /* read 16 bit value in machines byte order */
-        r = preview_gamma_data_red[r >> rotate16];
-
-        bytes_read = fread(&g, 2, 1, in);
-        g = preview_gamma_data_green[g >> rotate16];
-
-        bytes_read = fread(&b, 2, 1, in);
-        b = preview_gamma_data_blue[b >> rotate16];
-
-        c = r * 65536 + g * 256 + b;
-
-        switch (parameters->rotation)
-        {
-          case 0: /* 0 degree */
-            xx = x + dx;
-            yy = y + dy;
-            offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
-          break;
-
-          case 1: /* 90 degree */
-            xx = maximum_size - y;
-            yy = x + dx;
-            offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
-          break;
+    thumbnail = malloc(3 * header.thumbnail_width * header.thumbnail_height);
 
-          case 2: /* 180 degree */
-            xx = maximum_size - x - dx;
-            yy = maximum_size - y - dy;
-            offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
-          break;
-
-          case 3: /* 270 degree */
-            xx = y + dy;
-            yy = maximum_size - x - dx;
-            offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
-          break;
-
-          case 4: /* 0 degree, x-mirror */
-            xx = maximum_size - x - dx;
-            yy = y + dy;
-            offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
-          break;
-
-          case 5: /* 90 degree, x-mirror */
-            xx = y + dy;
-            yy = x + dx;
-            offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
-          break;
-
-          case 6: /* 180 degree, x-mirror */
-            xx = x + dx;
-            yy = maximum_size - y - dy;
-            offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
-          break;
-
-          case 7: /* 270 degree, x-mirror */
-            xx = maximum_size - y - dy;
-            yy = maximum_size - x - dx;
-            offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
-          break;
-        }
+    if (thumbnail)
+    {
+      fseek(in, header.thumbnail_offset, SEEK_SET);
 
-        data[offset + 0] = r;
-        data[offset + 1] = g;
-        data[offset + 2] = b;
+      if (fread(thumbnail, 3 * header.thumbnail_width, header.thumbnail_height, in) != header.thumbnail_height)
+      {
+        free(thumbnail);
+        thumbnail = NULL;
       }
     }
-
-    for (y = 0; y < parameters->gtk_preview_size; y++)
-    {
-      gtk_preview_draw_row(GTK_PREVIEW(parameters->gtk_preview), data + 3 * parameters->gtk_preview_size * y,
-                           0, y, parameters->gtk_preview_size);
-    }
   }
-  else /* depth = 8 */
-  {
-    for (y=0; y < height; y++)
-    { 
-      for (x=0; x < width; x++)
-      {
-        fseek(in, header + (xoffset + (int)(x * scale) + (yoffset + (int)(y * scale)) * image_width) * 3, SEEK_SET);
 
-        r = fgetc(in);
-        r = preview_gamma_data_red[r << rotate8];
+  DBG(DBG_info, "creating batch icon from %s\n", (thumbnail) ? "thumbnail" : "image data");
 
-        g = fgetc(in);
-        g = preview_gamma_data_green[g << rotate8];
+  for (y=0; y < height; y++)
+  { 
+    for (x=0; x < width; x++)
+    {
+      image_x = xoffset + (int)(x * scale);
+      image_y = yoffset + (int)(y * scale);
 
-        b = fgetc(in);
-        b = preview_gamma_data_blue[b << rotate8];
-        switch (parameters->rotation)
-        {
-          case 0: /* 0 degree */
-            xx = x + dx;
-            yy = y + dy;
-            offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
-          break;
+      if (thumbnail)
+      {
+        thumbnail_x = (int) ((float) image_x * header.thumbnail_width / image_width);
+        thumbnail_y = (int) ((float) image_y * header.thumbnail_height / image_height);
+        xsane_bound_int(&thumbnail_x, 0, header.thumbnail_width - 1);
+        xsane_bound_int(&thumbnail_y, 0, header.thumbnail_height - 1);
+
+        offset = 3 * (thumbnail_y * header.thumbnail_width + thumbnail_x);
+        rgb[0] = thumbnail[offset + 0] * 256;
+        rgb[1] = thumbnail[offset + 1] * 256;
+        rgb[2] = thumbnail[offset + 2] * 256;
+      }
+      else
+      {
+        preview_read_image_pixel(in, &header, image_x, image_y, rgb);
+      }
 
-          case 1: /* 90 degree */
-            xx = maximum_size - y;
-            yy = x + dx;
-            offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
-          break;
+      r = preview_gamma_data_red  [rgb[0] >> rotate16];
+      g = preview_gamma_data_green[rgb[1] >> rotate16];
+      b = preview_gamma_data_blue [rgb[2] >> rotate16];
 
-          case 2: /* 180 degree */
-            xx = maximum_size - x - dx;
-            yy = maximum_size - y - dy;
-            offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
-          break;
+      switch (parameters->rotation)
+      {
+        case 0: /* 0 degree */
+          xx = x + dx;
+          yy = y + dy;
+          offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
+        break;
 
-          case 3: /* 270 degree */
-            xx = y + dy;
-            yy = maximum_size - x - dx;
-            offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
-          break;
+        case 1: /* 90 degree */
+          xx = maximum_size - y;
+          yy = x + dx;
+          offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
+        break;
 
-          case 4: /* 0 degree, x-mirror */
-            xx = maximum_size - x - dx;
-            yy = y + dy;
-            offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
-          break;
+        case 2: /* 180 degree */
+          xx = maximum_size - x - dx;
+          yy = maximum_size - y - dy;
+          offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
+        break;
 
-          case 5: /* 90 degree, x-mirror */
-            xx = y + dy;
-            yy = x + dx;
-            offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
-          break;
+        case 3: /* 270 degree */
+          xx = y + dy;
+          yy = maximum_size - x - dx;
+          offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
+        break;
 
-          case 6: /* 180 degree, x-mirror */
-            xx = x + dx;
-            yy = maximum_size - y - dy;
-            offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
-          break;
+        case 4: /* 0 degree, x-mirror */
+          xx = maximum_size - x - dx;
+          yy = y + dy;
+          offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
+        break;
 
-          case 7: /* 270 degree, x-mirror */
-            xx = maximum_size - y - dy;
-            yy = maximum_size - x - dx;
-            offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
-          break;
-        }
+        case 5: /* 90 degree, x-mirror */
+          xx = y + dy;
+          yy = x + dx;
+          offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
+        break;
+
+        case 6: /* 180 degree, x-mirror */
+          xx = x + dx;
+          yy = maximum_size - y - dy;
+          offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
+        break;
 
-        data[offset + 0] = r;
-        data[offset + 1] = g;
-        data[offset + 2] = b;
+        case 7: /* 270 degree, x-mirror */
+          xx = maximum_size - y - dy;
+          yy = maximum_size - x - dx;
+          offset = parameters->gtk_preview_size * 3 * yy + 3*(xx);
+        break;
       }
-    }
 
-    for (y = 0; y < parameters->gtk_preview_size; y++)
-    {
-      gtk_preview_draw_row(GTK_PREVIEW(parameters->gtk_preview), data + 3 * parameters->gtk_preview_size * y,
-                           0, y, parameters->gtk_preview_size);
+      data[offset + 0] = r;
+      data[offset + 1] = g;
+      data[offset + 2] = b;
     }
   }
 
+  for (y = 0; y < parameters->gtk_preview_size; y++)
+  {
+    gtk_preview_draw_row(GTK_PREVIEW(parameters->gtk_preview), data + 3 * parameters->gtk_preview_size * y,
+                         0, y, parameters->gtk_preview_size);
+  }
+
+  if (thumbnail)
+  {
+    free(thumbnail);
+  }
+
   free(data);
 
  return quality;
 }
-
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 void preview_create_batch_icon(Preview *p, Batch_Scan_Parameters *parameters)
@@ -2444,19 +3093,18 @@ void preview_create_batch_icon(Preview *p, Batch_Scan_Parameters *parameters)
 
 static int preview_restore_image_from_file(Preview *p, FILE *in, int min_quality, int *min_time)
 {
+ Preview_cache_header header;
  u_int psurface_type, psurface_unit;
  int image_width, image_height;
  int xoffset, yoffset, width, height;
- int max_val;
  int quality = 0;
- int x, y;
+ int y;
+ int pixel_size;
  int time;
- float psurface[4];
+ float *psurface;
  float dsurface[4];
  size_t nread;
- guint16 *imagep;
- guint16 *imagepx;
- char buf[TEXTBUFSIZE];
+ u_char *imagep;
 
   DBG(DBG_proc, "preview_restore_image_from_file\n");
 
@@ -2466,22 +3114,17 @@ static int preview_restore_image_from_file(Preview *p, FILE *in, int min_quality
   }
 
   /* See whether there is a saved preview and load it if present: */
-  if (fscanf(in, "P6\n"
-                 "# surface: %g %g %g %g %u %u\n"
-                 "# time: %d\n"
-                 "%d %d\n%d",
-	      psurface + 0, psurface + 1, psurface + 2, psurface + 3,
-	      &psurface_type, &psurface_unit,
-              &time,
-	      &image_width, &image_height,
-              &max_val) != 10)
+  if (preview_read_image_header(in, &header))
   {
-    DBG(DBG_info, "no preview image\n");
     return min_quality;
   }
 
-  fgets(buf, sizeof(buf), in); /* skip newline character. this made a lot of problems in the past, so I skip it this way */
-
+  psurface      = header.surface;
+  psurface_type = header.surface_type;
+  psurface_unit = header.surface_unit;
+  time          = header.time;
+  image_width   = header.image_width;
+  image_height  = header.image_height;
 
   if (min_quality >= 0) /* read real preview */
   {
@@ -2546,59 +3189,36 @@ static int preview_restore_image_from_file(Preview *p, FILE *in, int min_quality
     height  = image_height;
   }
 
-  if (max_val == 65535)
-  {
-    p->params.depth = 16;
-  }
-  else
-  {
-    p->params.depth = 8;
-  }
-
+  p->params.depth = (header.sample_size == 2) ? 16 : 8;
+
   p->image_width  = width;
   p->image_height = height;
+  preview_set_raw_format(p, header.channels, p->params.depth); /* the image is stored in image_data_raw as it is in the file */
 
   if (preview_get_memory(p))
   {
     return min_quality; /* error allocating memory */
   }
 
-  if (p->params.depth == 16)
-  {
-    fseek(in, yoffset * image_width * 6, SEEK_CUR); /* skip unused lines */
-
-    imagep = p->image_data_raw;
-
-    for (y = yoffset; y < yoffset + height; y++)
-    {
-      fseek(in, xoffset * 6, SEEK_CUR); /* skip unused pixel left of area */
-
-      nread = fread(imagep, 6, width, in);
-      imagep += width * 3; /* imagep is a pointer to a 2 byte value, so we use 3 instead 6 here */
+  pixel_size = header.channels * header.sample_size;
 
-      fseek(in, (image_width - width - xoffset) * 6, SEEK_CUR); /* skip unused pixel right of area */
-    }
+#ifdef HAVE_MMAP
+  if ( (!memcmp(header.magic, PREVIEW_CACHE_MAGIC, sizeof(header.magic))) && /* preview cache file that contains the whole wanted area: map it */
+       (xoffset == 0) && (yoffset == 0) && (width == image_width) && (height == image_height) &&
+       (!preview_map_raw(p, in, header.image_offset)) )
+  {
+    DBG(DBG_info, "preview cache file is mapped\n");
   }
-  else /* depth = 8 */
+  else
+#endif
   {
-    fseek(in, yoffset * image_width * 3, SEEK_CUR); /* skip unused lines */
-
     imagep = p->image_data_raw;
 
     for (y = yoffset; y < yoffset + height; y++)
     {
-      fseek(in, xoffset * 3, SEEK_CUR); /* skip unused pixel left of area */
-
-      imagepx = imagep;
-      for (x = 0; x < width; x++)
-      {
-        *imagepx++ = ((guint16) fgetc(in)) * 256; /* transfrom to 16 bit image with correct byte order */
-        *imagepx++ = ((guint16) fgetc(in)) * 256;
-        *imagepx++ = ((guint16) fgetc(in)) * 256;
-      }
-      imagep += width * 3; /* imagep is a pointer to a 2 byte value, so we use 3 instead 6 here */
-
-      fseek(in, (image_width - width - xoffset) * 3, SEEK_CUR); /* skip unused pixel right of area */
+      fseek(in, header.image_offset + ((size_t) y * image_width + xoffset) * pixel_size, SEEK_SET);
+      nread = fread(imagep, pixel_size, width, in);
+      imagep += width * pixel_size;
     }
   }
 
@@ -2678,10 +3298,11 @@ static void preview_restore_image(Preview *p)
         p->image_width  = 1;
         p->image_height = 1;
         p->params.depth = 16;
+        preview_set_raw_format(p, 3, p->params.depth);
 
         preview_get_memory(p);
 
-        imagep = p->image_data_raw;
+        imagep = (guint16 *) p->image_data_raw;
         *imagep++ = 65535;
         *imagep++ = 00000;
         *imagep++ = 00000;
@@ -2705,7 +3326,7 @@ static int preview_get_pixel_color(Preview *p, int x, int y, int *raw_red, int *
                                                               int *enh_red, int *enh_green, int *enh_blue)
 {
  int image_x, image_y;
- int offset;
+ guint16 rgb[3];
  int rotate = 16 - preview_gamma_input_bits;
 
   DBG(DBG_proc, "preview_get_pixel_color\n");
@@ -2716,26 +3337,26 @@ static int preview_get_pixel_color(Preview *p, int x, int y, int *raw_red, int *
 
     if ( (image_x >= 0) && (image_x < p->image_width) && (image_y >=0) && (image_y < p->image_height) )
     {
-      offset = 3 * (image_y * p->image_width + image_x);
+      preview_raw_get_pixel(p, image_x, image_y, rgb);
 
       if (!xsane.negative) /* positive */
       {
-        *raw_red   = (p->image_data_raw[offset    ]) >> 8;
-        *raw_green = (p->image_data_raw[offset + 1]) >> 8;
-        *raw_blue  = (p->image_data_raw[offset + 2]) >> 8;
+        *raw_red   = rgb[0] >> 8;
+        *raw_green = rgb[1] >> 8;
+        *raw_blue  = rgb[2] >> 8;
       }
       else /* negative */
       {
-        *raw_red   = 255 - ((p->image_data_raw[offset    ]) >> 8);
-        *raw_green = 255 - ((p->image_data_raw[offset + 1]) >> 8);
-        *raw_blue  = 255 - ((p->image_data_raw[offset + 2]) >> 8);
+        *raw_red   = 255 - (rgb[0] >> 8);
+        *raw_green = 255 - (rgb[1] >> 8);
+        *raw_blue  = 255 - (rgb[2] >> 8);
       }
 
       /* the enhanced pixels are already inverted when negative is selected */ 
       /* do not use image_data_enh because the preview gamma value is applied to this */
-      *enh_red   = histogram_gamma_data_red  [(p->image_data_raw[offset    ]) >> rotate];
-      *enh_green = histogram_gamma_data_green[(p->image_data_raw[offset + 1]) >> rotate];
-      *enh_blue  = histogram_gamma_data_blue [(p->image_data_raw[offset + 2]) >> rotate];
+      *enh_red   = histogram_gamma_data_red  [rgb[0] >> rotate];
+      *enh_green = histogram_gamma_data_green[rgb[1] >> rotate];
+      *enh_blue  = histogram_gamma_data_blue [rgb[2] >> rotate];
 
      return 0;
     }
@@ -2776,6 +3397,8 @@ static void preview_display_zoom(Preview *p, int x, int y, int zoom)
     return;
   }
 
+  preview_enh_update(p, 0, p->image_height, FALSE);
+
   row = calloc(XSANE_ZOOM_SIZE, 3);
 
   if (row)
@@ -2961,17 +3584,27 @@ static void preview_display_color_components(Preview *p, int x, int y)
 {
  char buffer[TEXTBUFSIZE];
  int raw_red, raw_green, raw_blue, enh_red, enh_green, enh_blue;
+ double used, full;
+ int len;
 
   if (! preview_get_pixel_color(p, x, y, &raw_red, &raw_green, &raw_blue, &enh_red, &enh_green, &enh_blue))
   {
-    snprintf(buffer, sizeof(buffer), " %03d, %03d, %03d \n" \
-                                     " %03d, %03d, %03d ",
+    len = snprintf(buffer, sizeof(buffer), " %03d, %03d, %03d \n" \
+                                           " %03d, %03d, %03d ",
     raw_red, raw_green, raw_blue, enh_red, enh_green, enh_blue);
   }
   else
   {
-    snprintf(buffer, sizeof(buffer), " ###, ###, ### \n" \
-                                     " ###, ###, ### ");
+    len = snprintf(buffer, sizeof(buffer), " ###, ###, ### \n" \
+                                           " ###, ###, ### ");
+  }
+
+  /* memory used by the preview image and the change against 16 bit rgb data */
+  preview_get_memory_usage(p, &used, &full);
+
+  if (full > 0.0)
+  {
+    snprintf(buffer + len, sizeof(buffer) - len, "\n %1.1f MB %+d%% ", used / (1024.0 * 1024.0), (int) (100.0 * (used - full) / full));
   }
 
   gtk_label_set_text(GTK_LABEL(p->rgb_label), buffer);
@@ -2986,9 +3619,7 @@ static gint preview_hold_event_handler(gpointer data)
   DBG(DBG_proc, "preview_hold_event_handler\n");
 
   preview_draw_selection(p);
-  p->gamma_functions_interruptable = TRUE;
   preview_establish_selection(p);
-  p->gamma_functions_interruptable = FALSE;
 
   gtk_timeout_remove(p->hold_timer);
   p->hold_timer = 0;
@@ -4205,7 +4836,6 @@ Preview *preview_new(void)
   p->calibration = 0; /* do not display calibration image */
   p->input_tag   = -1;
   p->rotation    = 0;
-  p->gamma_functions_interruptable = FALSE;
 
   p->index_xmin        = 0;
   p->index_xmax        = 2;
@@ -5139,25 +5769,73 @@ static void preview_save_image_file(Preview *p, FILE *out)
 
   if (out)
   {
-   float dsurface[4];
+   Preview_cache_header header;
+   guint16 rgb[3];
+   int x, y;
+   long pos;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PREVIEW_CACHE_MAGIC, sizeof(header.magic));
+    header.version      = PREVIEW_CACHE_VERSION;
+    header.byte_order   = PREVIEW_CACHE_BYTE_ORDER;
+    preview_rotate_previewsurface_to_devicesurface(p->rotation, p->surface, header.surface);
+    header.surface_type = p->surface_type;
+    header.surface_unit = p->surface_unit;
+    header.time         = (gint32) time(NULL);
+    header.image_width  = p->image_width;
+    header.image_height = p->image_height;
+    header.channels     = p->image_channels;
+    header.sample_size  = p->image_sample_size;
+
+    /* the thumbnail is used by the batch scan icons, so they do not have to read the whole image */
+    if ((p->image_width > PREVIEW_CACHE_THUMBNAIL_SIZE) || (p->image_height > PREVIEW_CACHE_THUMBNAIL_SIZE))
+    {
+      if (p->image_width > p->image_height)
+      {
+        header.thumbnail_width  = PREVIEW_CACHE_THUMBNAIL_SIZE;
+        header.thumbnail_height = MAX(1, (p->image_height * PREVIEW_CACHE_THUMBNAIL_SIZE) / p->image_width);
+      }
+      else
+      {
+        header.thumbnail_width  = MAX(1, (p->image_width * PREVIEW_CACHE_THUMBNAIL_SIZE) / p->image_height);
+        header.thumbnail_height = PREVIEW_CACHE_THUMBNAIL_SIZE;
+      }
+    }
+    else
+    {
+      header.thumbnail_width  = p->image_width;
+      header.thumbnail_height = p->image_height;
+    }
 
-    preview_rotate_previewsurface_to_devicesurface(p->rotation, p->surface, dsurface);
+    header.thumbnail_offset = sizeof(header);
+    header.image_offset     = (header.thumbnail_offset + 3 * header.thumbnail_width * header.thumbnail_height + 15) & ~15;
 
-    /* always save it as a 16 bit PPM image: */
-    fprintf(out, "P6\n"
-                 "# surface: %g %g %g %g %u %u\n"
-                 "# time: %d\n"
-                 "%d %d\n65535\n",
-                 dsurface[0], dsurface[1], dsurface[2], dsurface[3],
-                 p->surface_type, p->surface_unit,
-                 (int) time(NULL),
-                 p->image_width, p->image_height);
+    fwrite(&header, sizeof(header), 1, out);
+
+    for (y = 0; y < header.thumbnail_height; y++)
+    {
+      for (x = 0; x < header.thumbnail_width; x++)
+      {
+        preview_raw_get_pixel(p, (x * p->image_width) / header.thumbnail_width, (y * p->image_height) / header.thumbnail_height, rgb);
+        fputc(rgb[0] >> 8, out);
+        fputc(rgb[1] >> 8, out);
+        fputc(rgb[2] >> 8, out);
+      }
+    }
+
+    for (pos = ftell(out); pos < header.image_offset; pos++)
+    {
+      fputc(0, out);
+    }
+
+    if (fwrite(p->image_data_raw, 1, preview_raw_size(p, p->image_height), out) != preview_raw_size(p, p->image_height))
+    {
+      DBG(DBG_error, "preview_save_image_file: could not write preview cache file\n");
+    }
 
-    fwrite(p->image_data_raw, 6, p->image_width*p->image_height, out);
     fclose(out);
   }
 }
-
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 static void preview_save_image(Preview *p)
@@ -5193,7 +5871,8 @@ static void preview_save_image(Preview *p)
 
   if (p->filename[level])
   {
-    /* save preview image */
+    /* save preview image, the old file is removed first because it still may be mapped */
+    remove(p->filename[level]);
     out = fopen(p->filename[level], "wb"); /* b = binary mode for win32*/
 
     preview_save_image_file(p, out);
@@ -5211,6 +5890,7 @@ static void preview_delete_images(Preview *p)
 
   for (level = 0; level<3; level++)
   {
+    remove(p->filename[level]); /* the file still may be mapped */
     out = fopen(p->filename[level], "wb"); /* b = binary mode for win32*/
     if (out)
     fclose(out);
@@ -5233,6 +5913,8 @@ void preview_destroy(Preview *p)
     preview_scan_done(p, 0);		/* don't save partial window */
   }
 
+  preview_correction_cancel(p);
+
   for(level = 0; level <= 2; level++)
   {
     if (p->filename[level])
@@ -5241,17 +5923,30 @@ void preview_destroy(Preview *p)
     }
   }
 
+  preview_free_levels(p);
+
   if (p->image_data_enh)
   {
     free(p->image_data_enh);
     p->image_data_enh = 0;
   }
 
-  if (p->image_data_raw)
+  if (p->image_enh_valid)
   {
-    free(p->image_data_raw);
-    p->image_data_raw = 0;
+    free(p->image_enh_valid);
+    p->image_enh_valid = 0;
+  }
+
+  preview_free_raw(p);
+  preview_histogram_free(p);
+
+#ifdef HAVE_LIBLCMS
+  if (p->cms_transform)
+  {
+    xsane_cms_transform_release(p->cms_transform);
+    p->cms_transform = NULL;
   }
+#endif
 
   if (p->preview_row)
   {
@@ -5422,7 +6117,7 @@ static void preview_get_color(Preview *p, int x, int y, int range, int *red, int
  int image_x, image_y;
  int image_x_min, image_y_min;
  int image_x_max, image_y_max;
- int offset;
+ guint16 rgb[3];
  int count = 0;
 
   DBG(DBG_proc, "preview_get_color\n");
@@ -5453,19 +6148,19 @@ static void preview_get_color(Preview *p, int x, int y, int range, int *red, int
         {
           count++;
 
-          offset = 3 * (image_y * p->image_width + image_x);
+          preview_raw_get_pixel(p, image_x, image_y, rgb);
  
           if (!xsane.negative) /* positive */
           {
-            *red   += (p->image_data_raw[offset    ]) >> 8;
-            *green += (p->image_data_raw[offset + 1]) >> 8;
-            *blue  += (p->image_data_raw[offset + 2]) >> 8;
+            *red   += rgb[0] >> 8;
+            *green += rgb[1] >> 8;
+            *blue  += rgb[2] >> 8;
           }
           else /* negative */
           {
-            *red   += 255 - (p->image_data_raw[offset    ] >> 8);
-            *green += 255 - (p->image_data_raw[offset + 1] >> 8);
-            *blue  += 255 - (p->image_data_raw[offset + 2] >> 8);
+            *red   += 255 - (rgb[0] >> 8);
+            *green += 255 - (rgb[1] >> 8);
+            *blue  += 255 - (rgb[2] >> 8);
           }
         }
       }
@@ -6253,86 +6948,221 @@ void preview_display_with_correction(Preview *p)
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-void preview_do_gamma_correction(Preview *p)
+/* When the correction has been changed all tiles of image_data_enh are marked stale and are created
+ * again by an idle handler, one tile per call, so gtk events (e.g. the next slider value) are handled
+ * between the tiles. Tiles that are visible in the preview window are created first and painted at once,
+ * the other tiles are created afterwards. A new correction that arrives while the handler is running
+ * marks all tiles stale again and the handler continues with the new correction, so the tiles of an
+ * old correction are not created to the end. Until a tile has been created its stale data is painted.
+ */
+
+/* returns the image lines first_line .. end_line-1 that are shown in the preview window */
+static void preview_get_visible_lines(Preview *p, int *first_line, int *end_line)
 {
- int x,y;
- int offset;
- u_char *image_data_enhp = NULL;
- guint16 *image_data_rawp = NULL;
- int rotate = 16 - preview_gamma_input_bits;
+ float xscale, yscale, scale;
+ int rotation, window_size, used_size, image_reversed;
+ int *image_index, *offset;
+ int w;
 
-  DBG(DBG_proc, "preview_display_with_correction\n");
+  *first_line = 0;
+  *end_line   = 0;
 
-  if ((p->image_data_raw) && (p->params.depth > 1) && (preview_gamma_data_red))
+  if (p->calibration) /* do not rotate calibration image */
   {
-    if ( (xsane.param.format == SANE_FRAME_RGB) || /* color preview */
-         (xsane.param.format == SANE_FRAME_RED) ||
-         (xsane.param.format == SANE_FRAME_GREEN) ||
-         (xsane.param.format == SANE_FRAME_BLUE) )
-    {
-      for (y=0; y < p->image_height; y++)
-      {
-        offset = 3 * (y * p->image_width);
+    rotation = 0;
+    xscale = 1.0;
+    yscale = 1.0;
+  }
+  else
+  {
+    rotation = p->rotation;
+    preview_get_scale_window_to_image(p, &xscale, &yscale);
+  }
 
-        image_data_rawp = p->image_data_raw + offset;
-        image_data_enhp = p->image_data_enh + offset;
+  if (rotation & 1) /* image lines are shown as window columns */
+  {
+    window_size    = p->preview_window_width;
+    used_size      = p->preview_width;
+    scale          = xscale;
+    image_reversed = ((rotation & 3) == 1) ? !(rotation & 4) : (rotation & 4);
+  }
+  else
+  {
+    window_size    = p->preview_window_height;
+    used_size      = p->preview_height;
+    scale          = yscale;
+    image_reversed = FALSE;
+  }
 
-        for (x=0; x < p->image_width; x++)
-        {
-          *image_data_enhp++ = preview_gamma_data_red  [(*image_data_rawp++) >> rotate];
-          *image_data_enhp++ = preview_gamma_data_green[(*image_data_rawp++) >> rotate];
-          *image_data_enhp++ = preview_gamma_data_blue [(*image_data_rawp++) >> rotate];
-        }
+  if (window_size <= 0)
+  {
+    return;
+  }
 
-        if (p->gamma_functions_interruptable)
-        {
-          while (gtk_events_pending())
-          {
-            DBG(DBG_info, "preview_display_with_correction: calling gtk_main_iteration\n");
-            gtk_main_iteration();
-          }
-        }
+  image_index = malloc(sizeof(int) * window_size);
+  offset      = malloc(sizeof(int) * window_size);
+
+  if ((!image_index) || (!offset))
+  {
+    free(image_index);
+    free(offset);
+    *end_line = p->image_height; /* take all lines as visible */
+   return;
+  }
+
+  preview_paint_axis(image_index, offset, window_size, used_size, FALSE, p->image_height, image_reversed, scale, 0, 0);
+
+  *first_line = p->image_height;
+
+  for (w = 0; w < window_size; w++)
+  {
+    if (image_index[w] >= 0)
+    {
+      if (image_index[w] < *first_line)
+      {
+        *first_line = image_index[w];
+      }
+
+      if (image_index[w] >= *end_line)
+      {
+        *end_line = image_index[w] + 1;
       }
     }
-    else /* grayscale preview */
+  }
+
+  if (*first_line > *end_line)
+  {
+    *first_line = *end_line;
+  }
+
+  free(image_index);
+  free(offset);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* returns the first stale tile of tiles first_tile .. end_tile-1, -1 if there is none */
+static int preview_find_stale_tile(Preview *p, int first_tile, int end_tile)
+{
+ int tile;
+
+  for (tile = first_tile; tile < end_tile; tile++)
+  {
+    if (p->image_enh_valid[tile] == PREVIEW_TILE_STALE)
     {
-     int level;
+     return tile;
+    }
+  }
 
-      for (y=0; y < p->image_height; y++)
-      {
-        offset = 3 * (y * p->image_width);
+ return -1;
+}
 
-        image_data_rawp = p->image_data_raw + offset;
-        image_data_enhp = p->image_data_enh + offset;
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-        for (x=0; x < p->image_width; x++)
-        {
-          level = (*image_data_rawp++); /* red */
-          level += (*image_data_rawp++); /* green */
-          level += (*image_data_rawp++); /* blue */
-          level /= 3;
-          level >>= rotate;
-          *image_data_enhp++ = preview_gamma_data_red  [level]; /* use 12 bit gamma table */
-          *image_data_enhp++ = preview_gamma_data_green[level];
-          *image_data_enhp++ = preview_gamma_data_blue [level];
-        }
+static gint preview_correction_idle_handler(gpointer data)
+{
+ Preview *p = data;
+ int tile = -1;
+ int tiles, first_line, end_line;
+ int visible_first_line = 0;
+ int visible_end_line   = 0;
 
-        if (p->gamma_functions_interruptable)
-        {
-          while (gtk_events_pending())
-          {
-            DBG(DBG_info, "preview_read_image_data (raw): calling gtk_main_iteration\n");
-            gtk_main_iteration();
-          }
-        }
-      }
+  if ((p->image_data_enh) && (p->image_enh_valid) && (!p->scanning))
+  {
+    tiles = (p->image_height + PREVIEW_TILE_LINES - 1) / PREVIEW_TILE_LINES;
+
+    preview_get_visible_lines(p, &visible_first_line, &visible_end_line);
+
+    tile = preview_find_stale_tile(p, visible_first_line / PREVIEW_TILE_LINES,
+                                   (visible_end_line + PREVIEW_TILE_LINES - 1) / PREVIEW_TILE_LINES);
+
+    if (tile < 0) /* all visible tiles are done */
+    {
+      tile = preview_find_stale_tile(p, 0, tiles);
     }
   }
 
-  if (p->image_data_enh)
+  if (tile < 0)
+  {
+    DBG(DBG_info, "preview_correction_idle_handler: all tiles are done\n");
+    p->correction_idle = 0;
+   return FALSE;
+  }
+
+  first_line = tile * PREVIEW_TILE_LINES;
+  end_line   = first_line + PREVIEW_TILE_LINES;
+
+  if (end_line > p->image_height)
+  {
+    end_line = p->image_height;
+  }
+
+  preview_enh_update(p, first_line, end_line, FALSE);
+  preview_update_levels(p, first_line, end_line);
+
+  if ((first_line < visible_end_line) && (end_line > visible_first_line))
   {
+    preview_mark_lines_dirty(p, first_line, end_line);
     preview_display_partial_image(p);
   }
+
+ return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void preview_correction_cancel(Preview *p)
+{
+  if (p->correction_idle)
+  {
+    gtk_idle_remove(p->correction_idle);
+    p->correction_idle = 0;
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* image_data_enh has to be created with a new correction */
+static void preview_correction_changed(Preview *p)
+{
+ int tile;
+
+  if ((!p->image_data_enh) || (!p->image_enh_valid))
+  {
+    return;
+  }
+
+  for (tile = 0; tile * PREVIEW_TILE_LINES < p->image_height; tile++)
+  {
+    if (p->image_enh_valid[tile] == TRUE)
+    {
+      p->image_enh_valid[tile] = PREVIEW_TILE_STALE;
+    }
+  }
+
+  if ((!p->correction_idle) && (!p->scanning))
+  {
+    p->correction_idle = gtk_idle_add(preview_correction_idle_handler, p);
+  }
+
+  preview_display_partial_image(p); /* paints the window when it has not been painted yet */
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void preview_do_gamma_correction(Preview *p)
+{
+  DBG(DBG_proc, "preview_do_gamma_correction\n");
+
+#ifdef HAVE_LIBLCMS
+  if (p->cms_transform) /* use gamma tables instead of color management */
+  {
+    xsane_cms_transform_release(p->cms_transform);
+    p->cms_transform = NULL;
+  }
+#endif
+
+  preview_correction_changed(p);
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
@@ -6340,24 +7170,13 @@ void preview_do_gamma_correction(Preview *p)
 #ifdef HAVE_LIBLCMS
 int preview_do_color_correction(Preview *p)
 {
- int y;
- u_char *image_data_enhp = NULL;
- guint16 *image_data_rawp = NULL;
- cmsHPROFILE hInProfile = NULL;
- cmsHPROFILE hOutProfile = NULL;
- cmsHPROFILE hProofProfile = NULL;
- cmsHTRANSFORM hTransform = NULL;
- DWORD input_format, output_format;
+ XsaneCmsTransform *hTransform = NULL;
  DWORD cms_flags = 0;
- int proof = 0;
  char *cms_proof_icm_profile = NULL;
- int linesize = 0;
 
 
   DBG(DBG_proc, "preview_do_color_correction\n");
 
-  cmsErrorAction(LCMS_ERROR_SHOW);
-
   if (preferences.cms_bpc)
   {
     cms_flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
@@ -6367,147 +7186,234 @@ int preview_do_color_correction(Preview *p)
   {
     default:
     case 0: /* display */
-      proof = 0;
+      cms_proof_icm_profile = NULL;
      break;
 
     case 1: /* proof printer */
       cms_proof_icm_profile  = preferences.printer[preferences.printernr]->icm_profile;
-      proof = 1;
      break;
 
     case 2: /* proof custom proofing */
       cms_proof_icm_profile  = preferences.custom_proofing_icm_profile;
-      proof = 1;
      break;
   }
 
-  if ( (xsane.param.format == SANE_FRAME_RGB) || /* color preview */
-       (xsane.param.format == SANE_FRAME_RED) ||
-       (xsane.param.format == SANE_FRAME_GREEN) ||
-       (xsane.param.format == SANE_FRAME_BLUE) )
+  if (cms_proof_icm_profile)
   {
-    input_format = TYPE_RGB_16;
-    output_format = TYPE_RGB_8;
-    linesize = p->image_width * 3;
+    cms_flags |= cmsFLAGS_SOFTPROOFING;
+
+    if (p->cms_gamut_check)
+    {
+      cms_flags |= cmsFLAGS_GAMUTCHECK;
+    }
   }
-  else
+
+  /* preview_enh_update passes color and grayscale lines as 16 bit rgb data to the transformation */
+  hTransform = xsane_cms_transform_get(xsane.scanner_default_color_icm_profile, preferences.display_icm_profile, cms_proof_icm_profile,
+                                       TYPE_RGB_16, TYPE_RGB_8, preferences.cms_intent, p->cms_proofing_intent, cms_flags);
+
+  if (!hTransform) /* error message has been shown */
   {
-    input_format = TYPE_GRAY_16;
-    output_format = TYPE_GRAY_8;
-    linesize = p->image_width;
+   return -1;
   }
 
-  hInProfile  = cmsOpenProfileFromFile(xsane.scanner_default_color_icm_profile, "r");
-  if (!hInProfile)
+  if (p->cms_transform)
   {
-   char buf[TEXTBUFSIZE];
+    xsane_cms_transform_release(p->cms_transform);
+  }
+  p->cms_transform = hTransform;
 
-    snprintf(buf, sizeof(buf), "%s\n%s %s: %s\n", ERR_CMS_CONVERSION, ERR_CMS_OPEN_ICM_FILE, CMS_SCANNER_ICM, xsane.scanner_default_color_icm_profile);
-    xsane_back_gtk_error(buf, TRUE);
-   return -1;
+  preview_correction_changed(p);
+
+ return 0;
+}
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* The histograms of the selection are summed up from histograms of PREVIEW_HISTOGRAM_TILE_SIZE^2 pixel
+ * tiles of image_data_raw, only the pixels of the tiles that are cut by the selection border are counted
+ * again. A tile histogram is counted when it is needed the first time after the raw data has been changed.
+ * The tile histograms count the raw samples reduced to 8 bits, so the gamma tables are applied to the
+ * 256 bins of the summed histogram and not to each pixel. The intensity after the gamma tables is
+ * taken as the mean of the three gamma tables applied to the raw intensity.
+ */
+
+static void preview_histogram_free(Preview *p)
+{
+  if (p->histogram_tiles)
+  {
+    free(p->histogram_tiles);
+    p->histogram_tiles = 0;
   }
 
-  hOutProfile = cmsOpenProfileFromFile(preferences.display_icm_profile, "r");
-  if (!hOutProfile)
+  if (p->histogram_tile_valid)
   {
-   char buf[TEXTBUFSIZE];
+    free(p->histogram_tile_valid);
+    p->histogram_tile_valid = 0;
+  }
 
-    cmsCloseProfile(hInProfile);
+  p->histogram_tiles_x = 0;
+  p->histogram_tiles_y = 0;
+}
 
-    snprintf(buf, sizeof(buf), "%s\n%s %s: %s\n", ERR_CMS_CONVERSION, ERR_CMS_OPEN_ICM_FILE, CMS_DISPLAY_ICM, preferences.display_icm_profile);
-    xsane_back_gtk_error(buf, TRUE);
-   return -1;
-  }
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void preview_histogram_invalidate_lines(Preview *p, int first_line, int end_line)
+{
+ int tile_y;
 
-  if (proof == 0)
+  if (!p->histogram_tile_valid)
   {
-    hTransform = cmsCreateTransform(hInProfile, input_format,
-                                    hOutProfile, output_format,
-                                    preferences.cms_intent, cms_flags);
+    return;
   }
-  else /* proof */
+
+  for (tile_y = ((first_line > 0) ? first_line : 0) / PREVIEW_HISTOGRAM_TILE_SIZE;
+       (tile_y * PREVIEW_HISTOGRAM_TILE_SIZE < end_line) && (tile_y < p->histogram_tiles_y); tile_y++)
   {
-    cms_flags |= cmsFLAGS_SOFTPROOFING;
+    memset(p->histogram_tile_valid + tile_y * p->histogram_tiles_x, 0, p->histogram_tiles_x);
+  }
+}
 
-    if (p->cms_gamut_check)
-    {
-      cms_flags |= cmsFLAGS_GAMUTCHECK;
-    }
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* adds the pixels x0 .. x1-1, y0 .. y1-1 of image_data_raw to count (4 * 256 bins: intensity, red, green, blue) */
+static void preview_histogram_count_area(Preview *p, int x0, int y0, int x1, int y1, guint32 *count)
+{
+ guint16 rgb[3];
+ int red, green, blue;
+ int x, y;
 
-    hProofProfile = cmsOpenProfileFromFile(cms_proof_icm_profile, "r");
-    if (!hProofProfile)
+  for (y = y0; y < y1; y++)
+  {
+    for (x = x0; x < x1; x++)
     {
-     char buf[TEXTBUFSIZE];
+      preview_raw_get_pixel(p, x, y, rgb);
 
-      cmsCloseProfile(hInProfile);
-      cmsCloseProfile(hOutProfile);
+      red   = rgb[0] >> 8; /* reduce from 16 to 8 bits */
+      green = rgb[1] >> 8;
+      blue  = rgb[2] >> 8;
 
-      snprintf(buf, sizeof(buf), "%s\n%s %s: %s\n", ERR_CMS_CONVERSION, ERR_CMS_OPEN_ICM_FILE, CMS_PROOF_ICM, cms_proof_icm_profile);
-      xsane_back_gtk_error(buf, TRUE);
-     return -1;
+      count[(red + green + blue) / 3]++;
+      count[256 + red]++;
+      count[512 + green]++;
+      count[768 + blue]++;
     }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* returns the 4 * 256 bins of histogram tile tile_x, tile_y, NULL if there is no memory for the tiles */
+static guint16 *preview_histogram_get_tile(Preview *p, int tile_x, int tile_y)
+{
+ guint32 count[4 * 256];
+ guint16 *tile;
+ int index, i;
+
+  if (!p->histogram_tiles)
+  {
+    p->histogram_tiles_x = (p->image_width  + PREVIEW_HISTOGRAM_TILE_SIZE - 1) / PREVIEW_HISTOGRAM_TILE_SIZE;
+    p->histogram_tiles_y = (p->image_height + PREVIEW_HISTOGRAM_TILE_SIZE - 1) / PREVIEW_HISTOGRAM_TILE_SIZE;
 
-    hTransform = cmsCreateProofingTransform(hInProfile, input_format,
-                                              hOutProfile, output_format,
-                                              hProofProfile,
-                                              preferences.cms_intent, p->cms_proofing_intent, cms_flags);
+    p->histogram_tiles      = malloc((size_t) p->histogram_tiles_x * p->histogram_tiles_y * 4 * 256 * sizeof(guint16));
+    p->histogram_tile_valid = calloc((size_t) p->histogram_tiles_x * p->histogram_tiles_y, 1);
+
+    if ((!p->histogram_tiles) || (!p->histogram_tile_valid))
+    {
+      DBG(DBG_error, "preview_histogram_get_tile: out of memory\n");
+      preview_histogram_free(p);
+     return NULL;
+    }
   }
 
-  if (!hTransform)
+  index = tile_y * p->histogram_tiles_x + tile_x;
+  tile  = p->histogram_tiles + (size_t) index * 4 * 256;
+
+  if (!p->histogram_tile_valid[index])
   {
-   char buf[TEXTBUFSIZE];
+    memset(count, 0, sizeof(count));
+    preview_histogram_count_area(p, tile_x * PREVIEW_HISTOGRAM_TILE_SIZE, tile_y * PREVIEW_HISTOGRAM_TILE_SIZE,
+                                 MIN((tile_x + 1) * PREVIEW_HISTOGRAM_TILE_SIZE, p->image_width),
+                                 MIN((tile_y + 1) * PREVIEW_HISTOGRAM_TILE_SIZE, p->image_height), count);
 
-    cmsCloseProfile(hInProfile);
-    cmsCloseProfile(hOutProfile);
-    if (proof)
+    for (i = 0; i < 4 * 256; i++)
     {
-      cmsCloseProfile(hProofProfile);
+      tile[i] = count[i]; /* a tile has at most 64 * 64 pixels */
     }
 
-    snprintf(buf, sizeof(buf), "%s\n%s\n", ERR_CMS_CONVERSION, ERR_CMS_CREATE_TRANSFORM);
-    xsane_back_gtk_error(buf, TRUE);
-   return -1;
+    p->histogram_tile_valid[index] = TRUE;
+  }
+
+ return tile;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* returns the histogram of the pixels x0 .. x1-1, y0 .. y1-1 of image_data_raw in count (4 * 256 bins) */
+static void preview_histogram_get(Preview *p, int x0, int y0, int x1, int y1, guint32 *count)
+{
+ guint16 *tile;
+ int tile_x0, tile_y0, tile_x1, tile_y1;
+ int full_x0, full_y0, full_x1, full_y1;
+ int tile_x, tile_y, i;
+
+  memset(count, 0, 4 * 256 * sizeof(guint32));
+
+  if ((x1 <= x0) || (y1 <= y0))
+  {
+    return;
   }
 
+  /* tiles that are completely inside of the area, the tiles at the right and bottom border of the image may be smaller */
+  tile_x0 = (x0 + PREVIEW_HISTOGRAM_TILE_SIZE - 1) / PREVIEW_HISTOGRAM_TILE_SIZE;
+  tile_y0 = (y0 + PREVIEW_HISTOGRAM_TILE_SIZE - 1) / PREVIEW_HISTOGRAM_TILE_SIZE;
+  tile_x1 = (x1 >= p->image_width)  ? (p->image_width  + PREVIEW_HISTOGRAM_TILE_SIZE - 1) / PREVIEW_HISTOGRAM_TILE_SIZE : x1 / PREVIEW_HISTOGRAM_TILE_SIZE;
+  tile_y1 = (y1 >= p->image_height) ? (p->image_height + PREVIEW_HISTOGRAM_TILE_SIZE - 1) / PREVIEW_HISTOGRAM_TILE_SIZE : y1 / PREVIEW_HISTOGRAM_TILE_SIZE;
 
-  for (y=0; y < p->image_height; y++)
+  if ((tile_x0 >= tile_x1) || (tile_y0 >= tile_y1)) /* area does not contain a whole tile */
   {
-    image_data_rawp = p->image_data_raw + linesize * y;
-    image_data_enhp = p->image_data_enh + linesize * y;
-
-    cmsDoTransform(hTransform, image_data_rawp, image_data_enhp, p->image_width);
+    preview_histogram_count_area(p, x0, y0, x1, y1, count);
+    return;
+  }
 
-    if (p->gamma_functions_interruptable)
+  for (tile_y = tile_y0; tile_y < tile_y1; tile_y++)
+  {
+    for (tile_x = tile_x0; tile_x < tile_x1; tile_x++)
     {
-      while (gtk_events_pending())
+      tile = preview_histogram_get_tile(p, tile_x, tile_y);
+
+      if (!tile) /* no memory for the tiles, count all pixels */
       {
-        DBG(DBG_info, "preview_do_color_correction: calling gtk_main_iteration\n");
-        gtk_main_iteration();
+        memset(count, 0, 4 * 256 * sizeof(guint32));
+        preview_histogram_count_area(p, x0, y0, x1, y1, count);
+        return;
+      }
+
+      for (i = 0; i < 4 * 256; i++)
+      {
+        count[i] += tile[i];
       }
     }
   }
 
-  if (p->image_data_enh)
-  {
-    preview_display_partial_image(p);
-  }
+  full_x0 = tile_x0 * PREVIEW_HISTOGRAM_TILE_SIZE;
+  full_y0 = tile_y0 * PREVIEW_HISTOGRAM_TILE_SIZE;
+  full_x1 = MIN(tile_x1 * PREVIEW_HISTOGRAM_TILE_SIZE, x1);
+  full_y1 = MIN(tile_y1 * PREVIEW_HISTOGRAM_TILE_SIZE, y1);
 
- return 0;
+  preview_histogram_count_area(p, x0,      y0,      x1,      full_y0, count); /* top */
+  preview_histogram_count_area(p, x0,      full_y1, x1,      y1,      count); /* bottom */
+  preview_histogram_count_area(p, x0,      full_y0, full_x0, full_y1, count); /* left */
+  preview_histogram_count_area(p, full_x1, full_y0, x1,      full_y1, count); /* right */
 }
-#endif
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-void preview_calculate_raw_histogram(Preview *p, SANE_Int *count_raw, SANE_Int *count_raw_red, SANE_Int *count_raw_green, SANE_Int *count_raw_blue)
+/* returns the selection in image coordinates, clipped to the image */
+static void preview_get_selection_image_area(Preview *p, int *min_x, int *min_y, int *max_x, int *max_y)
 {
- int x, y;
- int offset;
- SANE_Int red_raw, green_raw, blue_raw;
- SANE_Int min_x, max_x, min_y, max_y;
  float xscale, yscale;
- guint16 *image_data_rawp;
- 
-  DBG(DBG_proc, "preview_calculate_raw_histogram\n");
 
   preview_get_scale_device_to_image(p, &xscale, &yscale);
 
@@ -6515,134 +7421,129 @@ void preview_calculate_raw_histogram(Preview *p, SANE_Int *count_raw, SANE_Int *
   {
     case 0: /* 0 degree */
     default:
-      min_x = (p->selection.coordinate[0] - p->surface[0]) * xscale;
-      min_y = (p->selection.coordinate[1] - p->surface[1]) * yscale;
-      max_x = (p->selection.coordinate[2] - p->surface[0]) * xscale;
-      max_y = (p->selection.coordinate[3] - p->surface[1]) * yscale;
+      *min_x = (p->selection.coordinate[0] - p->surface[0]) * xscale;
+      *min_y = (p->selection.coordinate[1] - p->surface[1]) * yscale;
+      *max_x = (p->selection.coordinate[2] - p->surface[0]) * xscale;
+      *max_y = (p->selection.coordinate[3] - p->surface[1]) * yscale;
      break;
 
     case 1: /* 90 degree */
-      min_x = (p->selection.coordinate[1] - p->surface[1]) * xscale;
-      min_y = (p->selection.coordinate[2] - p->surface[2]) * xscale;
-      max_x = (p->selection.coordinate[3] - p->surface[1]) * xscale;
-      max_y = (p->selection.coordinate[0] - p->surface[2]) * xscale;
+      *min_x = (p->selection.coordinate[1] - p->surface[1]) * xscale;
+      *min_y = (p->selection.coordinate[2] - p->surface[2]) * xscale;
+      *max_x = (p->selection.coordinate[3] - p->surface[1]) * xscale;
+      *max_y = (p->selection.coordinate[0] - p->surface[2]) * xscale;
      break;
 
     case 2: /* 180 degree */
-      min_x = (p->selection.coordinate[2] - p->surface[2]) * xscale;
-      min_y = (p->selection.coordinate[3] - p->surface[3]) * yscale;
-      max_x = (p->selection.coordinate[0] - p->surface[2]) * xscale;
-      max_y = (p->selection.coordinate[1] - p->surface[3]) * yscale;
+      *min_x = (p->selection.coordinate[2] - p->surface[2]) * xscale;
+      *min_y = (p->selection.coordinate[3] - p->surface[3]) * yscale;
+      *max_x = (p->selection.coordinate[0] - p->surface[2]) * xscale;
+      *max_y = (p->selection.coordinate[1] - p->surface[3]) * yscale;
      break;
 
     case 3: /* 270 degree */
-      min_x = (p->selection.coordinate[3] - p->surface[3]) * xscale;
-      min_y = (p->selection.coordinate[0] - p->surface[0]) * yscale;
-      max_x = (p->selection.coordinate[1] - p->surface[3]) * xscale;
-      max_y = (p->selection.coordinate[2] - p->surface[0]) * yscale;
+      *min_x = (p->selection.coordinate[3] - p->surface[3]) * xscale;
+      *min_y = (p->selection.coordinate[0] - p->surface[0]) * yscale;
+      *max_x = (p->selection.coordinate[1] - p->surface[3]) * xscale;
+      *max_y = (p->selection.coordinate[2] - p->surface[0]) * yscale;
      break;
 
     case 4: /* 0 degree, x mirror */
-      min_x = (p->selection.coordinate[2] - p->surface[2]) * xscale;
-      min_y = (p->selection.coordinate[1] - p->surface[1]) * yscale;
-      max_x = (p->selection.coordinate[0] - p->surface[2]) * xscale;
-      max_y = (p->selection.coordinate[3] - p->surface[1]) * yscale;
+      *min_x = (p->selection.coordinate[2] - p->surface[2]) * xscale;
+      *min_y = (p->selection.coordinate[1] - p->surface[1]) * yscale;
+      *max_x = (p->selection.coordinate[0] - p->surface[2]) * xscale;
+      *max_y = (p->selection.coordinate[3] - p->surface[1]) * yscale;
      break;
 
     case 5: /* 90 degree, x mirror */
-      min_x = (p->selection.coordinate[1] - p->surface[1]) * xscale;
-      min_y = (p->selection.coordinate[0] - p->surface[0]) * yscale;
-      max_x = (p->selection.coordinate[3] - p->surface[1]) * xscale;
-      max_y = (p->selection.coordinate[2] - p->surface[0]) * yscale;
+      *min_x = (p->selection.coordinate[1] - p->surface[1]) * xscale;
+      *min_y = (p->selection.coordinate[0] - p->surface[0]) * yscale;
+      *max_x = (p->selection.coordinate[3] - p->surface[1]) * xscale;
+      *max_y = (p->selection.coordinate[2] - p->surface[0]) * yscale;
      break;
 
     case 6: /* 180 degree, x mirror */
-      min_x = (p->selection.coordinate[0] - p->surface[0]) * xscale;
-      min_y = (p->selection.coordinate[3] - p->surface[3]) * yscale;
-      max_x = (p->selection.coordinate[2] - p->surface[0]) * xscale;
-      max_y = (p->selection.coordinate[1] - p->surface[3]) * yscale;
+      *min_x = (p->selection.coordinate[0] - p->surface[0]) * xscale;
+      *min_y = (p->selection.coordinate[3] - p->surface[3]) * yscale;
+      *max_x = (p->selection.coordinate[2] - p->surface[0]) * xscale;
+      *max_y = (p->selection.coordinate[1] - p->surface[3]) * yscale;
      break;
 
     case 7: /* 270 degree, x mirror */
-      min_x = (p->selection.coordinate[3] - p->surface[3]) * xscale;
-      min_y = (p->selection.coordinate[2] - p->surface[2]) * yscale;
-      max_x = (p->selection.coordinate[1] - p->surface[3]) * xscale;
-      max_y = (p->selection.coordinate[0] - p->surface[2]) * yscale;
+      *min_x = (p->selection.coordinate[3] - p->surface[3]) * xscale;
+      *min_y = (p->selection.coordinate[2] - p->surface[2]) * yscale;
+      *max_x = (p->selection.coordinate[1] - p->surface[3]) * xscale;
+      *max_y = (p->selection.coordinate[0] - p->surface[2]) * yscale;
      break;
   }
 
-  if (min_x < 0)
+  if (*min_x < 0)
   {
-    min_x = 0;
+    *min_x = 0;
   }
    
-  if (max_x >= p->image_width)
+  if (*max_x >= p->image_width)
   {
-    max_x = p->image_width-1;
+    *max_x = p->image_width-1;
   }
    
-  if (min_y < 0)
+  if (*min_y < 0)
   {
-    min_y = 0;
+    *min_y = 0;
   }
    
-  if (max_y >= p->image_height)
+  if (*max_y >= p->image_height)
   {
-    max_y = p->image_height-1;
+    *max_y = p->image_height-1;
   }
-   
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void preview_calculate_raw_histogram(Preview *p, SANE_Int *count_raw, SANE_Int *count_raw_red, SANE_Int *count_raw_green, SANE_Int *count_raw_blue)
+{
+ guint32 count[4 * 256];
+ int red_raw, green_raw, blue_raw;
+ int min_x, max_x, min_y, max_y;
+ int rotate = 16 - preview_gamma_input_bits;
+ int i, index;
+
+  DBG(DBG_proc, "preview_calculate_raw_histogram\n");
+
   if ((p->image_data_raw) && (p->params.depth > 1) && (preview_gamma_data_red))
   {
-    for (y = min_y; y <= max_y; y++)
-    {
-      offset = 3 * (y * p->image_width + min_x);
-      image_data_rawp = p->image_data_raw + offset;
+    preview_get_selection_image_area(p, &min_x, &min_y, &max_x, &max_y);
+    preview_histogram_get(p, min_x, min_y, max_x + 1, max_y + 1, count);
 
-      if (!histogram_medium_gamma_data_red) /* no medium gamma table for histogran */
+    if (!histogram_medium_gamma_data_red) /* no medium gamma table for histogran */
+    {
+      for (i = 0; i <= 255; i++)
       {
-        for (x = min_x; x <= max_x; x++)
-        {
-          red_raw   = (*image_data_rawp++) >> 8; /* reduce from 16 to 8 bits */
-          green_raw = (*image_data_rawp++) >> 8;
-          blue_raw  = (*image_data_rawp++) >> 8;
-
-          count_raw      [(u_char) ((red_raw + green_raw + blue_raw)/3)]++;
-          count_raw_red  [red_raw]++;
-          count_raw_green[green_raw]++;
-          count_raw_blue [blue_raw]++;
-        }
+        count_raw      [i] += count[i];
+        count_raw_red  [i] += count[256 + i];
+        count_raw_green[i] += count[512 + i];
+        count_raw_blue [i] += count[768 + i];
       }
-      else /* use medium gamma table for raw histogram */
+    }
+    else /* use medium gamma table for raw histogram */
+    {
+      for (i = 0; i <= 255; i++)
       {
-       int rotate = 16 - preview_gamma_input_bits;
+        index = (i << 8) >> rotate;
 
-        for (x = min_x; x <= max_x; x++)
-        {
-          red_raw   = histogram_medium_gamma_data_red  [(*image_data_rawp++) >> rotate];
-          green_raw = histogram_medium_gamma_data_green[(*image_data_rawp++) >> rotate];
-          blue_raw  = histogram_medium_gamma_data_blue [(*image_data_rawp++) >> rotate];
-
-          count_raw      [(u_char) ((red_raw + green_raw + blue_raw)/3)]++;
-          count_raw_red  [red_raw]++;
-          count_raw_green[green_raw]++;
-          count_raw_blue [blue_raw]++;
-        }
-      }
+        red_raw   = histogram_medium_gamma_data_red  [index];
+        green_raw = histogram_medium_gamma_data_green[index];
+        blue_raw  = histogram_medium_gamma_data_blue [index];
 
-      if (p->gamma_functions_interruptable)
-      {
-        while (gtk_events_pending())
-        {
-          DBG(DBG_info, "preview_calculate_raw_histogram: calling gtk_main_iteration\n");
-          gtk_main_iteration();
-        }
+        count_raw      [(u_char) ((red_raw + green_raw + blue_raw)/3)] += count[i];
+        count_raw_red  [red_raw]   += count[256 + i];
+        count_raw_green[green_raw] += count[512 + i];
+        count_raw_blue [blue_raw]  += count[768 + i];
       }
     }
   }
   else /* no preview image => all colors = 1 */
   {
-   int i;
-
     for (i = 1; i <= 254; i++)
     {
       count_raw      [i] = 0;
@@ -6667,131 +7568,35 @@ void preview_calculate_raw_histogram(Preview *p, SANE_Int *count_raw, SANE_Int *
 
 void preview_calculate_enh_histogram(Preview *p, SANE_Int *count, SANE_Int *count_red, SANE_Int *count_green, SANE_Int *count_blue)
 {
- int x, y;
- int offset;
+ guint32 count_raw[4 * 256];
  u_char red, green, blue;
- SANE_Int min_x, max_x, min_y, max_y;
- float xscale, yscale;
- guint16 *image_data_rawp;
+ int min_x, max_x, min_y, max_y;
  int rotate = 16 - preview_gamma_input_bits;
- 
-  DBG(DBG_proc, "preview_calculate_enh_histogram\n");
-
-  preview_get_scale_device_to_image(p, &xscale, &yscale);
-
-  switch (p->rotation)
-  {
-    case 0: /* 0 degree */
-    default:
-      min_x = (p->selection.coordinate[0] - p->surface[0]) * xscale;
-      min_y = (p->selection.coordinate[1] - p->surface[1]) * yscale;
-      max_x = (p->selection.coordinate[2] - p->surface[0]) * xscale;
-      max_y = (p->selection.coordinate[3] - p->surface[1]) * yscale;
-     break;
-
-    case 1: /* 90 degree */
-      min_x = (p->selection.coordinate[1] - p->surface[1]) * xscale;
-      min_y = (p->selection.coordinate[2] - p->surface[2]) * xscale;
-      max_x = (p->selection.coordinate[3] - p->surface[1]) * xscale;
-      max_y = (p->selection.coordinate[0] - p->surface[2]) * xscale;
-     break;
-
-    case 2: /* 180 degree */
-      min_x = (p->selection.coordinate[2] - p->surface[2]) * xscale;
-      min_y = (p->selection.coordinate[3] - p->surface[3]) * yscale;
-      max_x = (p->selection.coordinate[0] - p->surface[2]) * xscale;
-      max_y = (p->selection.coordinate[1] - p->surface[3]) * yscale;
-     break;
-
-    case 3: /* 270 degree */
-      min_x = (p->selection.coordinate[3] - p->surface[3]) * xscale;
-      min_y = (p->selection.coordinate[0] - p->surface[0]) * yscale;
-      max_x = (p->selection.coordinate[1] - p->surface[3]) * xscale;
-      max_y = (p->selection.coordinate[2] - p->surface[0]) * yscale;
-     break;
-
-    case 4: /* 0 degree, x mirror */
-      min_x = (p->selection.coordinate[2] - p->surface[2]) * xscale;
-      min_y = (p->selection.coordinate[1] - p->surface[1]) * yscale;
-      max_x = (p->selection.coordinate[0] - p->surface[2]) * xscale;
-      max_y = (p->selection.coordinate[3] - p->surface[1]) * yscale;
-     break;
-
-    case 5: /* 90 degree, x mirror */
-      min_x = (p->selection.coordinate[1] - p->surface[1]) * xscale;
-      min_y = (p->selection.coordinate[0] - p->surface[0]) * yscale;
-      max_x = (p->selection.coordinate[3] - p->surface[1]) * xscale;
-      max_y = (p->selection.coordinate[2] - p->surface[0]) * yscale;
-     break;
-
-    case 6: /* 180 degree, x mirror */
-      min_x = (p->selection.coordinate[0] - p->surface[0]) * xscale;
-      min_y = (p->selection.coordinate[3] - p->surface[3]) * yscale;
-      max_x = (p->selection.coordinate[2] - p->surface[0]) * xscale;
-      max_y = (p->selection.coordinate[1] - p->surface[3]) * yscale;
-     break;
+ int i, index;
 
-    case 7: /* 270 degree, x mirror */
-      min_x = (p->selection.coordinate[3] - p->surface[3]) * xscale;
-      min_y = (p->selection.coordinate[2] - p->surface[2]) * yscale;
-      max_x = (p->selection.coordinate[1] - p->surface[3]) * xscale;
-      max_y = (p->selection.coordinate[0] - p->surface[2]) * yscale;
-     break;
-  }
+  DBG(DBG_proc, "preview_calculate_enh_histogram\n");
 
-  if (min_x < 0)
-  {
-    min_x = 0;
-  }
-   
-  if (max_x >= p->image_width)
-  {
-    max_x = p->image_width-1;
-  }
-   
-  if (min_y < 0)
-  {
-    min_y = 0;
-  }
-   
-  if (max_y >= p->image_height)
-  {
-    max_y = p->image_height-1;
-  }
-   
   if ((p->image_data_raw) && (p->params.depth > 1) && (preview_gamma_data_red))
   {
-    for (y = min_y; y <= max_y; y++)
+    preview_get_selection_image_area(p, &min_x, &min_y, &max_x, &max_y);
+    preview_histogram_get(p, min_x, min_y, max_x + 1, max_y + 1, count_raw);
+
+    for (i = 0; i <= 255; i++)
     {
-      offset = 3 * (y * p->image_width + min_x);
-      image_data_rawp = p->image_data_raw + offset;
+      index = (i << 8) >> rotate;
 
-      for (x = min_x; x <= max_x; x++)
-      {
-        red   = histogram_gamma_data_red  [(*image_data_rawp++) >> rotate];
-        green = histogram_gamma_data_green[(*image_data_rawp++) >> rotate];
-        blue  = histogram_gamma_data_blue [(*image_data_rawp++) >> rotate];
-
-	count      [(u_char) ((red + green + blue)/3)]++;
-	count_red  [red]++;
-	count_green[green]++;
-	count_blue [blue]++;
-      }
+      red   = histogram_gamma_data_red  [index];
+      green = histogram_gamma_data_green[index];
+      blue  = histogram_gamma_data_blue [index];
 
-      if (p->gamma_functions_interruptable)
-      {
-        while (gtk_events_pending())
-        {
-          DBG(DBG_info, "preview_calculate_enh_histogram: calling gtk_main_iteration\n");
-          gtk_main_iteration();
-        }
-      }
+      count      [(u_char) ((red + green + blue)/3)] += count_raw[i];
+      count_red  [red]   += count_raw[256 + i];
+      count_green[green] += count_raw[512 + i];
+      count_blue [blue]  += count_raw[768 + i];
     }
   }
   else /* no preview image => all colors = 1 */
   {
-   int i;
-
     for (i = 1; i <= 254; i++)
     {
       count      [i] = 0;
@@ -7119,6 +7924,90 @@ void preview_set_maximum_output_size(Preview *p, float width, float height, int
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
+/* converts the image area left, top .. right, bottom (included) to preview surface coordinates */
+static void preview_image_area_to_coordinate(Preview *p, int left, int top, int right, int bottom, float *coordinate)
+{
+ float xscale, yscale;
+
+  preview_get_scale_device_to_image(p, &xscale, &yscale);
+
+  if (((p->rotation & 3) == 0) || ((p->rotation & 3) == 2)) /* 0 or 180 degree */
+  {
+    *(coordinate+0) = p->image_surface[0] + left / xscale;
+    *(coordinate+2) = p->image_surface[0] + right / xscale;
+    *(coordinate+1) = p->image_surface[1] + top / yscale;
+    *(coordinate+3) = p->image_surface[1] + bottom / yscale;
+  }
+  else /* 90 or 270 degree */
+  {
+    *(coordinate+1) = p->image_surface[1] + left / xscale;
+    *(coordinate+3) = p->image_surface[1] + right / xscale;
+    *(coordinate+0) = p->image_surface[0] + top / yscale;
+    *(coordinate+2) = p->image_surface[0] + bottom / yscale;
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* detects the originals on the preview image, returns the number of objects */
+int preview_detect_objects(Preview *p, XsaneDetectObject *objects, int max_objects)
+{
+ u_char *luminance;
+ int count;
+
+  DBG(DBG_proc, "preview_detect_objects\n");
+
+  if ((!p->image_data_enh) || (p->image_width < 1) || (p->image_height < 1))
+  {
+   return 0;
+  }
+
+  preview_enh_update(p, 0, p->image_height, FALSE);
+
+  luminance = malloc((size_t) p->image_width * p->image_height);
+  if (!luminance)
+  {
+    DBG(DBG_error, "preview_detect_objects: out of memory\n");
+   return 0;
+  }
+
+  xsane_detect_luminance(p->image_data_enh, luminance, p->image_width * p->image_height);
+  count = xsane_detect_objects(luminance, p->image_width, p->image_height, objects, max_objects);
+
+  free(luminance);
+
+ return count;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* returns the scan area coordinates of a detected object as they are used for the scanner options */
+void preview_get_object_device_coordinate(Preview *p, XsaneDetectObject *object, float *coordinate)
+{
+ float preview_coordinate[4];
+ float tmp_coordinate;
+
+  preview_image_area_to_coordinate(p, object->left, object->top, object->right, object->bottom, preview_coordinate);
+
+  if (preview_coordinate[p->index_xmin] > preview_coordinate[p->index_xmax])
+  {
+    tmp_coordinate = preview_coordinate[p->index_xmin];
+    preview_coordinate[p->index_xmin] = preview_coordinate[p->index_xmax];
+    preview_coordinate[p->index_xmax] = tmp_coordinate;
+  }
+
+  if (preview_coordinate[p->index_ymin] > preview_coordinate[p->index_ymax])
+  {
+    tmp_coordinate = preview_coordinate[p->index_ymin];
+    preview_coordinate[p->index_ymin] = preview_coordinate[p->index_ymax];
+    preview_coordinate[p->index_ymax] = tmp_coordinate;
+  }
+
+  preview_rotate_previewsurface_to_devicesurface(p->rotation, preview_coordinate, coordinate);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
 #define AUTORAISE_ERROR 30
 void preview_autoraise_scan_area(Preview *p, int preview_x, int preview_y, float *autoselect_coord)
 {
@@ -7130,12 +8019,29 @@ void preview_autoraise_scan_area(Preview *p, int preview_x, int preview_y, float
  float error;
  int top, bottom, left, right;
  int top_ok, bottom_ok, left_ok, right_ok;
- float xscale, yscale;
+ XsaneDetectObject objects[XSANE_DETECT_MAX_OBJECTS];
+ int i;
 
   DBG(DBG_proc, "preview_autoraise_scan_area\n");
 
   preview_transform_coordinate_window_to_image(p, preview_x, preview_y, &image_x, &image_y);
 
+  /* use the detected object under the pointer, when there is none search a frame of uniform color */
+  count = preview_detect_objects(p, objects, XSANE_DETECT_MAX_OBJECTS);
+
+  for (i = 0; i < count; i++)
+  {
+    if ( (image_x >= objects[i].left) && (image_x <= objects[i].right) &&
+         (image_y >= objects[i].top)  && (image_y <= objects[i].bottom) )
+    {
+      DBG(DBG_info, "preview_autoraise_scan_area: using detected object %d\n", i);
+      preview_image_area_to_coordinate(p, objects[i].left, objects[i].top, objects[i].right, objects[i].bottom, autoselect_coord);
+     return;
+    }
+  }
+
+  preview_enh_update(p, 0, p->image_height, FALSE);
+
   top_ok    = FALSE;
   bottom_ok = FALSE;
   left_ok   = FALSE;
@@ -7335,199 +8241,47 @@ void preview_autoraise_scan_area(Preview *p, int preview_x, int preview_y, float
   }
 
 
-  preview_get_scale_device_to_image(p, &xscale, &yscale);
-
-  if (((p->rotation & 3) == 0) || ((p->rotation & 3) == 2)) /* 0 or 180 degree */
-  {
-    *(autoselect_coord+0) = p->image_surface[0] + left / xscale;
-    *(autoselect_coord+2) = p->image_surface[0] + right / xscale;
-    *(autoselect_coord+1) = p->image_surface[1] + top / yscale;
-    *(autoselect_coord+3) = p->image_surface[1] + bottom / yscale;
-  }
-  else /* 90 or 270 degree */
-  {
-    *(autoselect_coord+1) = p->image_surface[1] + left / xscale;
-    *(autoselect_coord+3) = p->image_surface[1] + right / xscale;
-    *(autoselect_coord+0) = p->image_surface[0] + top / yscale;
-    *(autoselect_coord+2) = p->image_surface[0] + bottom / yscale;
-  }
+  preview_image_area_to_coordinate(p, left, top, right, bottom, autoselect_coord);
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 void preview_autoselect_scan_area(Preview *p, float *autoselect_coord)
 {
- int x, y;
- int offset;
- float color;
+ XsaneDetectObject objects[XSANE_DETECT_MAX_OBJECTS];
  int top, bottom, left, right;
- float xscale, yscale;
- long bright_sum = 0;
- int brightness;
- int background_white;
+ int count, i;
 
   DBG(DBG_proc, "preview_autoselect_scan_area\n");
 
-  /* try to find out background color */
-  /* add color values at the margins */
-  /* and see if it is more black or more white */
-
-  /* upper line */
-  for (x = 0; x < p->image_width; x++)
-  {
-    offset = 3 * x;
-    bright_sum += (p->image_data_enh[offset + 0] + p->image_data_enh[offset + 1] + p->image_data_enh[offset + 2]) / 3.0; 
-  }
-
-  /* lower line */
-  for (x = 0; x < p->image_width; x++)
-  {
-    offset = 3 * ( (p->image_height-1) * p->image_width + x);
-    bright_sum += (p->image_data_enh[offset + 0] + p->image_data_enh[offset + 1] + p->image_data_enh[offset + 2]) / 3.0; 
-  }
-
-  /* left line */
-  for (y = 0; y < p->image_height; y++)
-  {
-    offset = 3 * y * p->image_width;
-    bright_sum += (p->image_data_enh[offset + 0] + p->image_data_enh[offset + 1] + p->image_data_enh[offset + 2]) / 3.0; 
-  }
-
-  /* right line */
-  for (y = 0; y < p->image_height; y++)
-  {
-    offset = 3 * (y * p->image_width + p->image_width - 1);
-    bright_sum += (p->image_data_enh[offset + 0] + p->image_data_enh[offset + 1] + p->image_data_enh[offset + 2]) / 3.0; 
-  }
-
-  brightness = bright_sum / (2 * (p->image_width + p->image_height) );
-  DBG(DBG_info, "preview_autoselect_scan_area: average margin brightness is %d\n", brightness);
+  /* select the bounding box of all detected objects */
+  count = preview_detect_objects(p, objects, XSANE_DETECT_MAX_OBJECTS);
 
-  if ( brightness > 128 )
-  {
-    DBG(DBG_info, "preview_autoselect_scan_area: background is white\n");
-    background_white = 1;
-  }
-  else
-  {
-    DBG(DBG_info, "preview_autoselect_scan_area: background is black\n");
-    background_white = 0;
-  }
-  
+  top    = p->image_height - 1;
+  bottom = 0;
+  left   = p->image_width - 1;
+  right  = 0;
 
-  /* search top */
-  top = 0;
-  for (y = 0; y < p->image_height; y++)
+  for (i = 0; i < count; i++)
   {
-    for (x = 0; x < p->image_width; x++)
-    {
-      offset = 3 * (y * p->image_width + x);
-      color = (p->image_data_enh[offset + 0] + p->image_data_enh[offset + 1] + p->image_data_enh[offset + 2]) / 3.0; 
-      if (background_white)
-      {
-        if (color < 200)
-        {
-          top = y;
-          break;
-        }
-      }
-
-      else if (color > 55 )
-      {
-        top = y;
-        break;
-      }
-    }
-    if (top)
+    if (objects[i].top < top)
     {
-      break;
+      top = objects[i].top;
     }
-  }
 
-
-  /* search bottom */
-  bottom = 0;
-  for (y = p->image_height-1; y > top; y--)
-  {
-    for (x = 0; x < p->image_width; x++)
-    {
-      offset = 3 * (y * p->image_width + x);
-      color = (p->image_data_enh[offset + 0] + p->image_data_enh[offset + 1] + p->image_data_enh[offset + 2]) / 3.0; 
-      if (background_white)
-      {
-        if (color < 200)
-        {
-          bottom = y;
-          break;
-        }
-      }
-      else if (color > 55 )
-      {
-        bottom = y;
-        break;
-      }
-    }
-    if (bottom)
+    if (objects[i].bottom > bottom)
     {
-      break;
+      bottom = objects[i].bottom;
     }
-  }
-
 
-  /* search left */
-  left = 0;
-  for (x = 0; x < p->image_width; x++)
-  {
-    for (y = 0; y < p->image_height; y++)
-    {
-      offset = 3 * (y * p->image_width + x);
-      color = (p->image_data_enh[offset + 0] + p->image_data_enh[offset + 1] + p->image_data_enh[offset + 2]) / 3.0; 
-      if (background_white)
-      {
-        if (color < 200)
-        {
-          left = x;
-          break;
-        }
-      }
-      else if (color > 55 )
-      {
-        left = x;
-        break;
-      }
-    }
-    if (left)
+    if (objects[i].left < left)
     {
-      break;
+      left = objects[i].left;
     }
-  }
-
 
-  /* search right */
-  right = 0;
-  for (x = p->image_width-1; x > left; x--)
-  {
-    for (y = 0; y < p->image_height; y++)
-    {
-      offset = 3 * (y * p->image_width + x);
-      color = (p->image_data_enh[offset + 0] + p->image_data_enh[offset + 1] + p->image_data_enh[offset + 2]) / 3.0; 
-      if (background_white)
-      {
-        if (color < 200)
-        {
-          right = x;
-          break;
-        }
-      }
-      else if (color > 55 )
-      {
-        right = x;
-        break;
-      }
-    }
-    if (right)
+    if (objects[i].right > right)
     {
-      break;
+      right = objects[i].right;
     }
   }
 
@@ -7540,22 +8294,7 @@ void preview_autoselect_scan_area(Preview *p, float *autoselect_coord)
     right  = p->image_width -1;
   }
 
-  preview_get_scale_device_to_image(p, &xscale, &yscale);
-
-  if (((p->rotation & 3) == 0) || ((p->rotation & 3) == 2)) /* 0 or 180 degree */
-  {
-    *(autoselect_coord+0) = p->image_surface[0] + left / xscale;
-    *(autoselect_coord+2) = p->image_surface[0] + right / xscale;
-    *(autoselect_coord+1) = p->image_surface[1] + top / yscale;
-    *(autoselect_coord+3) = p->image_surface[1] + bottom / yscale;
-  }
-  else /* 90 or 270 degree */
-  {
-    *(autoselect_coord+1) = p->image_surface[1] + left / xscale;
-    *(autoselect_coord+3) = p->image_surface[1] + right / xscale;
-    *(autoselect_coord+0) = p->image_surface[0] + top / yscale;
-    *(autoselect_coord+2) = p->image_surface[0] + bottom / yscale;
-  }
+  preview_image_area_to_coordinate(p, left, top, right, bottom, autoselect_coord);
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
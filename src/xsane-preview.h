@@ -30,10 +30,20 @@
 #include <sys/types.h>
 #include <sane/sane.h>
 #include "xsane-batch-scan.h"
+#include "xsane-detect.h"
 
 #define SELECTION_RANGE_IN  4
 #define SELECTION_RANGE_OUT 8
 #define XSANE_CURSOR_PREVIEW GDK_LEFT_PTR
+#define PREVIEW_LEVELS 8
+#define PREVIEW_TILE_LINES 32
+#define PREVIEW_TILE_STALE 2	/* image_enh_valid: tile holds image_data_enh of a previous correction */
+#define PREVIEW_HISTOGRAM_TILE_SIZE 64
+
+#define PREVIEW_CACHE_MAGIC "XSANEPRV"
+#define PREVIEW_CACHE_VERSION 1
+#define PREVIEW_CACHE_BYTE_ORDER 0x01020304
+#define PREVIEW_CACHE_THUMBNAIL_SIZE 256
 
 /* ------------------------------------------------------------------------------------------------------ */
 
@@ -49,6 +59,32 @@ enum
 
 /* ------------------------------------------------------------------------------------------------------ */
 
+/* header of the preview cache files, all values are stored in the byte order of the machine.
+ * The header is followed by the thumbnail (8 bit rgb, thumbnail_width * thumbnail_height pixels)
+ * and at image_offset (aligned to 16 bytes, so the file can be mapped) by image_data_raw
+ * in the layout that is defined by channels and sample_size.
+ */
+typedef struct
+{
+  char magic[8];		/* PREVIEW_CACHE_MAGIC without trailing 0 */
+  guint32 version;		/* PREVIEW_CACHE_VERSION */
+  guint32 byte_order;		/* PREVIEW_CACHE_BYTE_ORDER */
+  float surface[4];		/* device surface of the image */
+  guint32 surface_type;
+  guint32 surface_unit;
+  gint32 time;
+  guint32 image_width;
+  guint32 image_height;
+  guint32 channels;		/* 1 or 3 */
+  guint32 sample_size;		/* 1 or 2 bytes */
+  guint32 thumbnail_width;	/* 0 = no thumbnail */
+  guint32 thumbnail_height;
+  guint32 thumbnail_offset;
+  guint32 image_offset;
+} Preview_cache_header;
+
+/* ------------------------------------------------------------------------------------------------------ */
+
 #if 0
 typedef struct Batch_selection
 {
@@ -74,6 +110,7 @@ typedef struct
   int cursornr;
 
   guint hold_timer;
+  guint correction_idle;		/* idle handler that creates the stale tiles of image_data_enh, 0 = not active */
 
   char *filename[3];		/* filenames for preview level 0,1,2 */
 
@@ -125,6 +162,7 @@ typedef struct
   int preview_channels;
   time_t image_last_time_updated;
   gint input_tag;
+  struct XsaneReader *reader;	/* thread that reads the scanner, NULL when sane_read is called in the main loop */
   SANE_Parameters params;
   int image_offset;
   int image_x;
@@ -132,9 +170,32 @@ typedef struct
   int image_width;		/* width of preview image in pixels */
   int image_height;		/* height of preview image in pixel lines */
   int rotation;			/* rotation: 0=0, 1=90, 2=180, 3=270 degree, 4-7= rotation + mirror in x direction */
-  int gamma_functions_interruptable; /* bit that defines if gamma function can be interrupted */
-  guint16 *image_data_raw;	/* 3 * image_width * image_height bytes * 2 */
+  u_char *image_data_raw;	/* image_channels * image_width * image_height samples of image_sample_size bytes */
+  void *image_data_raw_map;	/* mapped preview cache file that contains image_data_raw, NULL = image_data_raw is allocated */
+  size_t image_data_raw_map_size;
+  int image_channels;		/* samples per pixel in image_data_raw: 1 = gray/lineart, 3 = color */
+  int image_sample_size;	/* bytes per sample in image_data_raw: 1 or 2 (guint16) */
   u_char *image_data_enh;	/* 3 * image_width * image_height bytes */
+  u_char *image_enh_valid;	/* one flag per PREVIEW_TILE_LINES lines of image_data_enh, 0 = has to be created from image_data_raw, PREVIEW_TILE_STALE */
+  struct XsaneCmsTransform *cms_transform; /* color transformation used to create image_data_enh, NULL = gamma correction */
+  guint16 *histogram_tiles;	/* 4 * 256 bins (intensity, red, green, blue) per PREVIEW_HISTOGRAM_TILE_SIZE^2 pixels of image_data_raw */
+  u_char *histogram_tile_valid;	/* one flag per histogram tile, 0 = has to be counted again */
+  int histogram_tiles_x;
+  int histogram_tiles_y;
+  u_char *image_level_data[PREVIEW_LEVELS]; /* image_data_enh reduced by 2^level, [0] is not used */
+  int image_level_width[PREVIEW_LEVELS];
+  int image_level_height[PREVIEW_LEVELS];
+  int image_levels;		/* number of valid levels, image_data_enh included */
+  int dirty_line_first;		/* image lines dirty_line_first .. dirty_line_end-1 have not been painted */
+  int dirty_line_end;
+  int paint_valid;		/* preview buffer shows the image with the paint_ geometry */
+  int paint_image_width;
+  int paint_image_height;
+  int paint_preview_width;
+  int paint_preview_height;
+  int paint_window_width;
+  int paint_window_height;
+  int paint_rotation;
 
   GdkGC *gc_selection;
   GdkGC *gc_selection_maximum;
@@ -223,6 +284,8 @@ extern void preview_set_maximum_output_size(Preview *p, float width, float heigh
 extern void preview_select_full_preview_area(Preview *p);
 extern void preview_display_valid(Preview *p);
 extern void preview_create_batch_icon(Preview *p, Batch_Scan_Parameters *parameters);
+extern int preview_detect_objects(Preview *p, XsaneDetectObject *objects, int max_objects);
+extern void preview_get_object_device_coordinate(Preview *p, XsaneDetectObject *object, float *coordinate);
 
 /* ------------------------------------------------------------------------------------------------------ */
 
@@ -0,0 +1,452 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-reader.c
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+#include "xsane-reader.h"
+
+#ifdef HAVE_LIBPTHREAD
+# include <pthread.h>
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifdef HAVE_LIBPTHREAD
+
+/* The ring buffer has exactly one writer (the reader thread, moves head) and one reader */
+/* (the gtk main loop, moves tail). head and tail are never wrapped, the position in the */
+/* buffer is head & mask, the filled size is head - tail. The mutex is only used to let */
+/* the thread sleep while the buffer is full, it is never taken on the data path. */
+
+#if defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 1)))
+# define XSANE_READER_BARRIER() __sync_synchronize()
+#else
+static pthread_mutex_t xsane_reader_barrier_mutex = PTHREAD_MUTEX_INITIALIZER;
+# define XSANE_READER_BARRIER() do { pthread_mutex_lock(&xsane_reader_barrier_mutex); pthread_mutex_unlock(&xsane_reader_barrier_mutex); } while (0)
+#endif
+
+#define XSANE_READER_MIN_BUFFER_SIZE 65536
+
+struct XsaneReader
+{
+  SANE_Handle dev;
+  pthread_t thread;
+
+  SANE_Byte *buffer;
+  size_t size;				/* power of 2 */
+  size_t mask;
+  volatile size_t head;			/* written by the reader thread */
+  volatile size_t tail;			/* written by the gtk main loop */
+
+  volatile int finished;		/* thread has left its loop, status is valid */
+  volatile SANE_Status status;		/* status of the last sane_read call */
+  volatile int stop;			/* set by xsane_reader_free */
+
+  int start_next_page;			/* call sane_start for the next adf page after EOF */
+  volatile int next_page_started;	/* sane_start has been called, next_page_status is valid */
+  volatile SANE_Status next_page_status;
+  int joined;				/* pthread_join has been called */
+
+  volatile int notify_pending;		/* a byte has been written to the pipe and not consumed yet */
+  int notify_pipe[2];
+
+  pthread_mutex_t wait_mutex;
+  pthread_cond_t wait_cond;
+  volatile int thread_waiting;		/* thread sleeps because buffer is full */
+};
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_reader_notify(XsaneReader *reader)
+{
+ char c = 0;
+ ssize_t bytes_written;
+
+  if (reader->notify_pending)
+  {
+    return;
+  }
+
+  reader->notify_pending = TRUE;
+  XSANE_READER_BARRIER();
+
+  bytes_written = write(reader->notify_pipe[1], &c, 1);
+  if (bytes_written != 1)
+  {
+    DBG(DBG_error, "xsane_reader_notify: could not write to notify pipe: %s\n", strerror(errno));
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void *xsane_reader_thread(void *data)
+{
+ XsaneReader *reader = data;
+ SANE_Status status = SANE_STATUS_GOOD;
+ SANE_Int len;
+ size_t free_size, pos, chunk;
+
+  DBG(DBG_proc, "xsane_reader_thread\n");
+
+  while (!reader->stop)
+  {
+    free_size = reader->size - (reader->head - reader->tail);
+
+    if (!free_size) /* buffer full, wait until the main loop has taken some data */
+    {
+      pthread_mutex_lock(&reader->wait_mutex);
+      reader->thread_waiting = TRUE;
+      XSANE_READER_BARRIER();
+
+      while ((reader->head - reader->tail == reader->size) && (!reader->stop))
+      {
+        pthread_cond_wait(&reader->wait_cond, &reader->wait_mutex);
+        XSANE_READER_BARRIER();
+      }
+
+      reader->thread_waiting = FALSE;
+      pthread_mutex_unlock(&reader->wait_mutex);
+      continue;
+    }
+
+    pos   = reader->head & reader->mask;
+    chunk = reader->size - pos; /* do not read over the end of the buffer */
+    if (chunk > free_size)
+    {
+      chunk = free_size;
+    }
+
+    len = 0;
+    status = sane_read(reader->dev, reader->buffer + pos, (SANE_Int) chunk, &len);
+
+    if (status != SANE_STATUS_GOOD)
+    {
+      break;
+    }
+
+    if (len > 0)
+    {
+      XSANE_READER_BARRIER(); /* data must be visible before head is moved */
+      reader->head += len;
+      XSANE_READER_BARRIER();
+      xsane_reader_notify(reader);
+    }
+  }
+
+  if (reader->stop)
+  {
+    status = SANE_STATUS_CANCELLED;
+  }
+
+  DBG(DBG_info, "xsane_reader_thread: finished with status %s\n", XSANE_STRSTATUS(status));
+
+  reader->status = status;
+  XSANE_READER_BARRIER();
+  reader->finished = TRUE;
+  XSANE_READER_BARRIER();
+  xsane_reader_notify(reader);
+
+  /* the main loop finishes this page while the feeder takes the next sheet */
+  if ((status == SANE_STATUS_EOF) && (reader->start_next_page) && (!reader->stop))
+  {
+    reader->next_page_status = sane_start(reader->dev);
+    XSANE_READER_BARRIER();
+    reader->next_page_started = TRUE;
+
+    DBG(DBG_info, "xsane_reader_thread: sane_start for next page returned with status %s\n", XSANE_STRSTATUS(reader->next_page_status));
+  }
+
+ return NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+XsaneReader *xsane_reader_new(SANE_Handle dev, size_t buffer_size, int start_next_page)
+{
+ XsaneReader *reader;
+ size_t size;
+ sigset_t all_signals, old_signals;
+ int i;
+
+  DBG(DBG_proc, "xsane_reader_new(%lu, start_next_page=%d)\n", (unsigned long) buffer_size, start_next_page);
+
+  if (!buffer_size) /* reader thread disabled */
+  {
+   return NULL;
+  }
+
+  size = XSANE_READER_MIN_BUFFER_SIZE;
+  while ((size < buffer_size) && (size < ((size_t) 1 << (sizeof(size_t) * 8 - 2))))
+  {
+    size <<= 1;
+  }
+
+  reader = calloc(1, sizeof(XsaneReader));
+  if (!reader)
+  {
+   return NULL;
+  }
+
+  reader->buffer = malloc(size);
+  if (!reader->buffer)
+  {
+    DBG(DBG_error, "xsane_reader_new: could not allocate %lu bytes\n", (unsigned long) size);
+    free(reader);
+   return NULL;
+  }
+
+  if (pipe(reader->notify_pipe))
+  {
+    DBG(DBG_error, "xsane_reader_new: could not create notify pipe: %s\n", strerror(errno));
+    free(reader->buffer);
+    free(reader);
+   return NULL;
+  }
+
+  for (i = 0; i < 2; i++)
+  {
+    fcntl(reader->notify_pipe[i], F_SETFL, O_NONBLOCK);
+    fcntl(reader->notify_pipe[i], F_SETFD, FD_CLOEXEC);
+  }
+
+  reader->dev    = dev;
+  reader->size   = size;
+  reader->mask   = size - 1;
+  reader->status = SANE_STATUS_GOOD;
+  reader->start_next_page = start_next_page;
+
+  pthread_mutex_init(&reader->wait_mutex, NULL);
+  pthread_cond_init(&reader->wait_cond, NULL);
+
+  /* signals (SIGCHLD of ocr/fax/printer commands, SIGTERM, ...) are handled by the main thread */
+  sigfillset(&all_signals);
+  pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals);
+
+  if (pthread_create(&reader->thread, NULL, xsane_reader_thread, reader))
+  {
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    DBG(DBG_error, "xsane_reader_new: could not create reader thread\n");
+    pthread_cond_destroy(&reader->wait_cond);
+    pthread_mutex_destroy(&reader->wait_mutex);
+    close(reader->notify_pipe[0]);
+    close(reader->notify_pipe[1]);
+    free(reader->buffer);
+    free(reader);
+   return NULL;
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+  DBG(DBG_info, "xsane_reader_new: reader thread started with %lu bytes buffer\n", (unsigned long) size);
+
+ return reader;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_reader_get_fd(XsaneReader *reader)
+{
+ return reader->notify_pipe[0];
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* non blocking: returns SANE_STATUS_GOOD with len = 0 when no data is available */
+/* and the status of the reader thread when all data has been consumed */
+SANE_Status xsane_reader_read(XsaneReader *reader, SANE_Byte *buf, SANE_Int max_len, SANE_Int *len)
+{
+ size_t available, pos, chunk, copied;
+ int finished;
+ char drain[64];
+
+  *len = 0;
+
+  finished = reader->finished;
+  XSANE_READER_BARRIER();
+  available = reader->head - reader->tail;
+
+  if (!available)
+  {
+    /* reset the notification before the buffer is checked again, so data */
+    /* that is stored from now on will wake up the main loop */
+    reader->notify_pending = FALSE;
+    XSANE_READER_BARRIER();
+
+    while (read(reader->notify_pipe[0], drain, sizeof(drain)) > 0)
+    {
+    }
+
+    finished = reader->finished;
+    XSANE_READER_BARRIER();
+    available = reader->head - reader->tail;
+
+    if (!available)
+    {
+      if (finished)
+      {
+       return reader->status;
+      }
+     return SANE_STATUS_GOOD;
+    }
+  }
+
+  if (available > (size_t) max_len)
+  {
+    available = max_len;
+  }
+
+  copied = 0;
+  while (copied < available)
+  {
+    pos   = (reader->tail + copied) & reader->mask;
+    chunk = reader->size - pos;
+    if (chunk > available - copied)
+    {
+      chunk = available - copied;
+    }
+    memcpy(buf + copied, reader->buffer + pos, chunk);
+    copied += chunk;
+  }
+
+  XSANE_READER_BARRIER(); /* data must be copied before tail is moved */
+  reader->tail += copied;
+  XSANE_READER_BARRIER();
+
+  if (reader->thread_waiting)
+  {
+    pthread_mutex_lock(&reader->wait_mutex);
+    pthread_cond_signal(&reader->wait_cond);
+    pthread_mutex_unlock(&reader->wait_mutex);
+  }
+
+  *len = (SANE_Int) copied;
+
+ return SANE_STATUS_GOOD;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* waits until the thread is done, returns TRUE when it has called sane_start for the next page */
+int xsane_reader_next_page(XsaneReader *reader, SANE_Status *status)
+{
+  DBG(DBG_proc, "xsane_reader_next_page\n");
+
+  if (!reader->joined)
+  {
+    pthread_join(reader->thread, NULL);
+    reader->joined = TRUE;
+  }
+
+  *status = reader->next_page_status;
+
+ return reader->next_page_started;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_reader_free(XsaneReader *reader)
+{
+  DBG(DBG_proc, "xsane_reader_free\n");
+
+  if (!reader)
+  {
+    return;
+  }
+
+  if (!reader->finished)
+  {
+    /* the thread may be blocked in sane_read or waiting for free buffer space */
+    reader->stop = TRUE;
+    XSANE_READER_BARRIER();
+    sane_cancel(reader->dev);
+
+    pthread_mutex_lock(&reader->wait_mutex);
+    pthread_cond_signal(&reader->wait_cond);
+    pthread_mutex_unlock(&reader->wait_mutex);
+  }
+
+  if (!reader->joined)
+  {
+    pthread_join(reader->thread, NULL);
+  }
+
+  pthread_cond_destroy(&reader->wait_cond);
+  pthread_mutex_destroy(&reader->wait_mutex);
+  close(reader->notify_pipe[0]);
+  close(reader->notify_pipe[1]);
+  free(reader->buffer);
+  free(reader);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#else /* HAVE_LIBPTHREAD */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+struct XsaneReader
+{
+  int dummy;
+};
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+XsaneReader *xsane_reader_new(SANE_Handle dev, size_t buffer_size, int start_next_page)
+{
+  DBG(DBG_info, "xsane_reader_new: compiled without pthread support, reading in main loop\n");
+
+ return NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_reader_get_fd(XsaneReader *reader)
+{
+ return -1;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+SANE_Status xsane_reader_read(XsaneReader *reader, SANE_Byte *buf, SANE_Int max_len, SANE_Int *len)
+{
+  *len = 0;
+
+ return SANE_STATUS_INVAL;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_reader_next_page(XsaneReader *reader, SANE_Status *status)
+{
+ return FALSE;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_reader_free(XsaneReader *reader)
+{
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#endif /* HAVE_LIBPTHREAD */
@@ -0,0 +1,56 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-reader.h
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifndef HAVE_XSANE_READER_H
+#define HAVE_XSANE_READER_H
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* The reader runs sane_read in its own thread and stores the data in a ring buffer,
+ * so the scanner is read at full speed while the gtk main loop redraws the preview
+ * or handles dialogs. The gtk side adds a gdk_input for xsane_reader_get_fd and
+ * calls xsane_reader_read until it returns len = 0, just like a non blocking sane_read.
+ * With start_next_page the thread calls sane_start for the next adf page as soon as
+ * the page has been read completely, xsane_reader_next_page returns its status.
+ * If the next page is not scanned the caller has to call sane_cancel.
+ * Without pthread support xsane_reader_new returns NULL and sane_read is used directly.
+ */
+
+typedef struct XsaneReader XsaneReader;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+extern XsaneReader *xsane_reader_new(SANE_Handle dev, size_t buffer_size, int start_next_page);
+extern int xsane_reader_get_fd(XsaneReader *reader);
+extern SANE_Status xsane_reader_read(XsaneReader *reader, SANE_Byte *buf, SANE_Int max_len, SANE_Int *len);
+extern int xsane_reader_next_page(XsaneReader *reader, SANE_Status *status);
+extern void xsane_reader_free(XsaneReader *reader);
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+#endif
+/* ---------------------------------------------------------------------------------------------------------------------- */
@@ -0,0 +1,478 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-resample.c
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+#include "xsane-resample.h"
+
+/* the avx2 kernel is compiled with a function attribute and selected at runtime, */
+/* so xsane still runs on cpus without avx2 */
+#if defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))) && (defined(__x86_64__) || defined(__i386__))
+# define XSANE_RESAMPLE_AVX2
+# include <immintrin.h>
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* intermediate samples have 16 significant bits, 8 bit samples are shifted left by this */
+#define XSANE_RESAMPLE_SHIFT_8 8
+
+typedef void (*XsaneResampleVerticalFunc)(gint32 *weight, int taps, gint32 **lines, int first, int samples, int bytespp, unsigned char *out);
+
+static void xsane_resample_vertical_scalar(gint32 *weight, int taps, gint32 **lines, int first, int samples, int bytespp, unsigned char *out);
+#ifdef XSANE_RESAMPLE_AVX2
+static void xsane_resample_vertical_avx2(gint32 *weight, int taps, gint32 **lines, int first, int samples, int bytespp, unsigned char *out);
+#endif
+
+static XsaneResampleVerticalFunc xsane_resample_vertical_function = NULL;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static double xsane_resample_sinc(double t)
+{
+  if (fabs(t) < 1e-9)
+  {
+   return 1.0;
+  }
+
+  t *= M_PI;
+
+ return sin(t) / t;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static double xsane_resample_kernel(int filter, double t)
+/* t is the distance to the center of the new pixel in (scaled) original pixels */
+{
+  t = fabs(t);
+
+  switch (filter)
+  {
+    case XSANE_SCALE_FILTER_BILINEAR:
+      if (t < 1.0)
+      {
+       return 1.0 - t;
+      }
+     return 0.0;
+
+    case XSANE_SCALE_FILTER_LANCZOS3:
+      if (t < 3.0)
+      {
+       return xsane_resample_sinc(t) * xsane_resample_sinc(t / 3.0);
+      }
+     return 0.0;
+
+    default:
+     return 0.0;
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_resample_window(XsaneResampleAxis *axis, int new_pixel, int *first, int *end)
+/* range of original pixels that contribute to new_pixel */
+{
+ double ratio = (double) axis->original_size / axis->new_size;
+ double center, radius;
+
+  if (axis->filter == XSANE_SCALE_FILTER_BOX)
+  {
+    *first = floor(new_pixel * ratio);
+    *end   = ceil((new_pixel + 1) * ratio);
+  }
+  else
+  {
+    radius = (axis->filter == XSANE_SCALE_FILTER_LANCZOS3) ? 3.0 : 1.0;
+    if (ratio > 1.0) /* reduction: the kernel is stretched so it covers all original pixels */
+    {
+      radius *= ratio;
+    }
+    center = (new_pixel + 0.5) * ratio;
+
+    *first = floor(center - radius - 0.5);
+    *end   = ceil(center + radius - 0.5) + 1;
+  }
+
+  if (*first < 0)
+  {
+    *first = 0;
+  }
+
+  if (*end > axis->original_size)
+  {
+    *end = axis->original_size;
+  }
+
+  if (*end <= *first) /* rounding at the image border */
+  {
+    *first = (*end > 0) ? *end - 1 : 0;
+    *end   = *first + 1;
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_resample_weights(XsaneResampleAxis *axis, int new_pixel, double *weight)
+/* calculates the floating point weights of the taps of new_pixel, normalized to a sum of 1.0 */
+{
+ double ratio = (double) axis->original_size / axis->new_size;
+ double scale = (ratio > 1.0) ? ratio : 1.0;
+ double center = (new_pixel + 0.5) * ratio;
+ double left, right, sum;
+ int first, end;
+ int i;
+
+  xsane_resample_window(axis, new_pixel, &first, &end);
+
+  sum = 0.0;
+  for (i = 0; i < axis->taps; i++)
+  {
+   int original_pixel = axis->first[new_pixel] + i;
+
+    weight[i] = 0.0;
+
+    if ((original_pixel < first) || (original_pixel >= end))
+    {
+      continue;
+    }
+
+    if (axis->filter == XSANE_SCALE_FILTER_BOX) /* area of the original pixel that is covered by the new pixel */
+    {
+      left  = new_pixel * ratio;
+      right = (new_pixel + 1) * ratio;
+
+      if (left < original_pixel)
+      {
+        left = original_pixel;
+      }
+
+      if (right > original_pixel + 1)
+      {
+        right = original_pixel + 1;
+      }
+
+      if (right > left)
+      {
+        weight[i] = right - left;
+      }
+    }
+    else
+    {
+      weight[i] = xsane_resample_kernel(axis->filter, (original_pixel + 0.5 - center) / scale);
+    }
+
+    sum += weight[i];
+  }
+
+  if (sum == 0.0) /* can only happen by rounding, use the nearest original pixel */
+  {
+   int nearest = center;
+
+    if (nearest >= axis->original_size)
+    {
+      nearest = axis->original_size - 1;
+    }
+
+    weight[nearest - axis->first[new_pixel]] = 1.0;
+    sum = 1.0;
+  }
+
+  for (i = 0; i < axis->taps; i++)
+  {
+    weight[i] /= sum;
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+XsaneResampleAxis *xsane_resample_axis_new(int filter, int original_size, int new_size)
+{
+ XsaneResampleAxis *axis;
+ double *weight;
+ int first, end, sum, largest;
+ int x, i;
+
+  DBG(DBG_proc, "xsane_resample_axis_new(filter=%d, original_size=%d, new_size=%d)\n", filter, original_size, new_size);
+
+  if ((original_size < 1) || (new_size < 1))
+  {
+   return NULL;
+  }
+
+  axis = calloc(1, sizeof(XsaneResampleAxis));
+  if (!axis)
+  {
+   return NULL;
+  }
+
+  if ((filter != XSANE_SCALE_FILTER_BILINEAR) && (filter != XSANE_SCALE_FILTER_LANCZOS3))
+  {
+    filter = XSANE_SCALE_FILTER_BOX;
+  }
+
+  axis->filter        = filter;
+  axis->original_size = original_size;
+  axis->new_size      = new_size;
+
+  /* all new pixels use the largest number of taps, windows at the image border are moved into the image */
+  axis->taps = 1;
+  for (x = 0; x < new_size; x++)
+  {
+    xsane_resample_window(axis, x, &first, &end);
+    if (end - first > axis->taps)
+    {
+      axis->taps = end - first;
+    }
+  }
+
+  axis->first  = malloc(new_size * sizeof(int));
+  axis->weight = malloc((size_t) new_size * axis->taps * sizeof(gint32));
+  weight       = malloc(axis->taps * sizeof(double));
+
+  if (!axis->first || !axis->weight || !weight)
+  {
+    DBG(DBG_error, "xsane_resample_axis_new: out of memory\n");
+    free(weight);
+    xsane_resample_axis_free(axis);
+   return NULL;
+  }
+
+  for (x = 0; x < new_size; x++)
+  {
+   gint32 *fixed = axis->weight + (size_t) x * axis->taps;
+
+    xsane_resample_window(axis, x, &first, &end);
+
+    if (first > original_size - axis->taps)
+    {
+      first = original_size - axis->taps;
+    }
+    axis->first[x] = first;
+
+    xsane_resample_weights(axis, x, weight);
+
+    /* the rounding error is added to the largest weight, so the sum is exact and flat areas keep their value */
+    sum = 0;
+    largest = 0;
+    for (i = 0; i < axis->taps; i++)
+    {
+      fixed[i] = floor(weight[i] * (1 << XSANE_RESAMPLE_WEIGHT_BITS) + 0.5);
+      sum += fixed[i];
+
+      if (fixed[i] > fixed[largest])
+      {
+        largest = i;
+      }
+    }
+    fixed[largest] += (1 << XSANE_RESAMPLE_WEIGHT_BITS) - sum;
+  }
+
+  free(weight);
+
+  DBG(DBG_info, "xsane_resample_axis_new: %d taps\n", axis->taps);
+
+  if (!xsane_resample_vertical_function) /* selected here because xsane_resample_vertical is called by the filter threads */
+  {
+    xsane_resample_vertical_function = xsane_resample_vertical_scalar;
+
+#ifdef XSANE_RESAMPLE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+      xsane_resample_vertical_function = xsane_resample_vertical_avx2;
+    }
+#endif
+
+    DBG(DBG_info, "xsane_resample_axis_new: using %s vertical kernel\n", (xsane_resample_vertical_function == xsane_resample_vertical_scalar) ? "scalar" : "avx2");
+  }
+
+ return axis;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_resample_axis_free(XsaneResampleAxis *axis)
+{
+  if (!axis)
+  {
+    return;
+  }
+
+  free(axis->first);
+  free(axis->weight);
+  free(axis);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* channels is a constant in the calls of xsane_resample_horizontal, so the compiler */
+/* creates a kernel for each number of channels */
+#define XSANE_RESAMPLE_HORIZONTAL(type, channels) \
+  for (x = 0; x < axis->new_size; x++) \
+  { \
+   type *src = (type *) in + axis->first[x] * (channels); \
+   gint32 *weight = axis->weight + (size_t) x * taps; \
+   int c, k; \
+ \
+    for (c = 0; c < (channels); c++) \
+    { \
+     gint32 val = round; \
+ \
+      for (k = 0; k < taps; k++) \
+      { \
+        val += weight[k] * src[k * (channels) + c]; \
+      } \
+      out[x * (channels) + c] = val >> shift; \
+    } \
+  }
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_resample_horizontal(XsaneResampleAxis *axis, unsigned char *in, int bytespp, int channels, gint32 *out)
+/* converts one original line with 8 or 16 bit samples into an intermediate line of the new width */
+{
+ int taps = axis->taps;
+ int shift = XSANE_RESAMPLE_WEIGHT_BITS - ((bytespp == 1) ? XSANE_RESAMPLE_SHIFT_8 : 0);
+ gint32 round = 1 << (shift - 1);
+ int x;
+
+  if (bytespp == 1)
+  {
+    switch (channels)
+    {
+      case 1:  XSANE_RESAMPLE_HORIZONTAL(guint8, 1); break;
+      case 3:  XSANE_RESAMPLE_HORIZONTAL(guint8, 3); break;
+      case 4:  XSANE_RESAMPLE_HORIZONTAL(guint8, 4); break;
+      default: XSANE_RESAMPLE_HORIZONTAL(guint8, channels); break;
+    }
+  }
+  else
+  {
+    switch (channels)
+    {
+      case 1:  XSANE_RESAMPLE_HORIZONTAL(guint16, 1); break;
+      case 3:  XSANE_RESAMPLE_HORIZONTAL(guint16, 3); break;
+      case 4:  XSANE_RESAMPLE_HORIZONTAL(guint16, 4); break;
+      default: XSANE_RESAMPLE_HORIZONTAL(guint16, channels); break;
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_resample_vertical_scalar(gint32 *weight, int taps, gint32 **lines, int first, int samples, int bytespp, unsigned char *out)
+{
+ int shift = XSANE_RESAMPLE_WEIGHT_BITS + ((bytespp == 1) ? XSANE_RESAMPLE_SHIFT_8 : 0);
+ gint32 round = 1 << (shift - 1);
+ gint32 maxval = (bytespp == 1) ? 255 : 65535;
+ gint32 val;
+ int i, k;
+
+  for (i = first; i < samples; i++)
+  {
+    val = round;
+    for (k = 0; k < taps; k++)
+    {
+      val += weight[k] * lines[k][i];
+    }
+
+    val >>= shift;
+
+    if (val < 0) /* lanczos overshoots at edges */
+    {
+      val = 0;
+    }
+    else if (val > maxval)
+    {
+      val = maxval;
+    }
+
+    if (bytespp == 1)
+    {
+      out[i] = val;
+    }
+    else
+    {
+      ((guint16 *) out)[i] = val;
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifdef XSANE_RESAMPLE_AVX2
+__attribute__((target("avx2")))
+static void xsane_resample_vertical_avx2(gint32 *weight, int taps, gint32 **lines, int first, int samples, int bytespp, unsigned char *out)
+{
+ int shift = XSANE_RESAMPLE_WEIGHT_BITS + ((bytespp == 1) ? XSANE_RESAMPLE_SHIFT_8 : 0);
+ __m128i shift_count = _mm_cvtsi32_si128(shift);
+ __m256i round  = _mm256_set1_epi32(1 << (shift - 1));
+ __m256i maxval = _mm256_set1_epi32((bytespp == 1) ? 255 : 65535);
+ __m256i zero   = _mm256_setzero_si256();
+ __m256i val;
+ __m128i packed;
+ int i, k;
+
+  for (i = first; i + 8 <= samples; i += 8)
+  {
+    val = round;
+    for (k = 0; k < taps; k++)
+    {
+      val = _mm256_add_epi32(val, _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i *) (lines[k] + i)), _mm256_set1_epi32(weight[k])));
+    }
+
+    val = _mm256_sra_epi32(val, shift_count);
+    val = _mm256_min_epi32(_mm256_max_epi32(val, zero), maxval);
+
+    /* packus works within the 128 bit lanes, the permutation moves the 8 results to the lower lane */
+    val    = _mm256_permute4x64_epi64(_mm256_packus_epi32(val, val), 0x08);
+    packed = _mm256_castsi256_si128(val);
+
+    if (bytespp == 1)
+    {
+      _mm_storel_epi64((__m128i *) (out + i), _mm_packus_epi16(packed, packed));
+    }
+    else
+    {
+      _mm_storeu_si128((__m128i *) (out + 2 * i), packed);
+    }
+  }
+
+  if (i < samples)
+  {
+    xsane_resample_vertical_scalar(weight, taps, lines, i, samples, bytespp, out);
+  }
+}
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_resample_vertical(XsaneResampleAxis *axis, int new_line, gint32 **lines, int samples, int bytespp, unsigned char *out)
+/* combines the intermediate lines axis->first[new_line] .. axis->first[new_line] + axis->taps - 1 */
+/* (lines[0] .. lines[axis->taps - 1]) into samples 8 or 16 bit samples of new_line */
+{
+  xsane_resample_vertical_function(axis->weight + (size_t) new_line * axis->taps, axis->taps, lines, 0, samples, bytespp, out);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
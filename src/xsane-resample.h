@@ -0,0 +1,64 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-resample.h
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifndef HAVE_XSANE_RESAMPLE_H
+#define HAVE_XSANE_RESAMPLE_H
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* The resampler scales an image in two separable passes with fixed point weights.
+ * For each axis the weights of all new pixels are calculated once (XsaneResampleAxis),
+ * every new pixel uses the same number of taps so the inner loops do not depend on the position.
+ * The horizontal pass converts original lines into intermediate lines with the new width
+ * (signed 32 bit samples with 16 significant bits for 8 and 16 bit images), the vertical
+ * pass combines the intermediate lines of a new line. xsane_resample_vertical uses AVX2
+ * instructions when the cpu supports them.
+ */
+
+#define XSANE_RESAMPLE_WEIGHT_BITS 14	/* the weights of a new pixel sum up to 1 << XSANE_RESAMPLE_WEIGHT_BITS */
+
+typedef struct XsaneResampleAxis
+{
+  int filter;			/* XSANE_SCALE_FILTER_BOX, _BILINEAR or _LANCZOS3 */
+  int original_size;
+  int new_size;
+  int taps;			/* original pixels that are used for each new pixel */
+  int *first;			/* first original pixel of each new pixel, never decreases */
+  gint32 *weight;		/* taps weights for each new pixel */
+} XsaneResampleAxis;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+extern XsaneResampleAxis *xsane_resample_axis_new(int filter, int original_size, int new_size);
+extern void xsane_resample_axis_free(XsaneResampleAxis *axis);
+extern void xsane_resample_horizontal(XsaneResampleAxis *axis, unsigned char *in, int bytespp, int channels, gint32 *out);
+extern void xsane_resample_vertical(XsaneResampleAxis *axis, int new_line, gint32 **lines, int samples, int bytespp, unsigned char *out);
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+#endif
+/* ---------------------------------------------------------------------------------------------------------------------- */
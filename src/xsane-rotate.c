@@ -0,0 +1,217 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-rotate.c
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+#include "xsane-parallel.h"
+#include "xsane-rotate.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#define XSANE_ROTATE_COPY(bytespp) \
+  for (i = 0; i < pixels; i++) \
+  { \
+    memcpy(dst, src, bytespp); \
+    dst += bytespp; \
+    src += step; \
+  }
+
+static void xsane_rotate_copy(unsigned char *dst, unsigned char *src, long step, int pixels, int bytespp)
+/* copies pixels with distance step in the source to consecutive pixels, the */
+/* fixed sizes are handled by own loops so memcpy is replaced by simple moves */
+{
+ int i;
+
+  switch (bytespp)
+  {
+    case 1: /* 8 bit gray */
+      XSANE_ROTATE_COPY(1);
+     break;
+
+    case 2: /* 16 bit gray */
+      XSANE_ROTATE_COPY(2);
+     break;
+
+    case 3: /* 24 bit color */
+      XSANE_ROTATE_COPY(3);
+     break;
+
+    case 4: /* 32 bit color + infrared */
+      XSANE_ROTATE_COPY(4);
+     break;
+
+    case 6: /* 48 bit color */
+      XSANE_ROTATE_COPY(6);
+     break;
+
+    case 8: /* 64 bit color + infrared */
+      XSANE_ROTATE_COPY(8);
+     break;
+
+    default:
+      XSANE_ROTATE_COPY(bytespp);
+     break;
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static unsigned char *xsane_rotate_line_start(XsaneRotate *rotate, int line, long *step)
+/* returns the first source pixel of the output line and the distance to the next one */
+{
+ int pixel_width = rotate->pixel_width;
+ int pixel_height = rotate->pixel_height;
+ long bytespp = rotate->bytespp;
+ int x, y;
+
+  switch (rotate->rotation)
+  {
+    default:
+    case 0: /* 0 degree */
+      x = 0;
+      y = line;
+      *step = bytespp;
+     break;
+
+    case 1: /* 90 degree */
+      x = line;
+      y = pixel_height - 1;
+      *step = -rotate->stride;
+     break;
+
+    case 2: /* 180 degree */
+      x = pixel_width - 1;
+      y = pixel_height - 1 - line;
+      *step = -bytespp;
+     break;
+
+    case 3: /* 270 degree */
+      x = pixel_width - 1 - line;
+      y = 0;
+      *step = rotate->stride;
+     break;
+
+    case 4: /* 0 degree, x mirror */
+      x = pixel_width - 1;
+      y = line;
+      *step = -bytespp;
+     break;
+
+    case 5: /* 90 degree, x mirror */
+      x = line;
+      y = 0;
+      *step = rotate->stride;
+     break;
+
+    case 6: /* 180 degree, x mirror */
+      x = 0;
+      y = pixel_height - 1 - line;
+      *step = bytespp;
+     break;
+
+    case 7: /* 270 degree, x mirror */
+      x = pixel_width - 1 - line;
+      y = pixel_height - 1;
+      *step = -rotate->stride;
+     break;
+  }
+
+ return rotate->image + (y - rotate->y_origin) * rotate->stride + (x - rotate->x_origin) * bytespp;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_rotate_band(void *data, int band, int bands)
+/* copies the output lines of band into rotate->out */
+{
+ XsaneRotate *rotate = data;
+ int bytespp = rotate->bytespp;
+ size_t out_line_size = (size_t) rotate->out_width * bytespp;
+ unsigned char *src;
+ long step;
+ int first, end;
+ int tile_line, tile_x, line, pixels;
+
+  xsane_parallel_split(band, bands, rotate->end_line - rotate->first_line, &first, &end);
+
+  first += rotate->first_line;
+  end   += rotate->first_line;
+
+  if (!(rotate->rotation & 1)) /* 0/180 degree: source lines are read sequentially */
+  {
+    for (line = first; line < end; line++)
+    {
+      src = xsane_rotate_line_start(rotate, line, &step);
+
+      if (step == bytespp)
+      {
+        memcpy(rotate->out + (line - rotate->first_line) * out_line_size, src, out_line_size);
+      }
+      else
+      {
+        xsane_rotate_copy(rotate->out + (line - rotate->first_line) * out_line_size, src, step, rotate->out_width, bytespp);
+      }
+    }
+   return;
+  }
+
+  for (tile_line = first; tile_line < end; tile_line += XSANE_ROTATE_TILE)
+  {
+    for (tile_x = 0; tile_x < rotate->out_width; tile_x += XSANE_ROTATE_TILE)
+    {
+      pixels = MIN(XSANE_ROTATE_TILE, rotate->out_width - tile_x);
+
+      for (line = tile_line; (line < tile_line + XSANE_ROTATE_TILE) && (line < end); line++)
+      {
+        src = xsane_rotate_line_start(rotate, line, &step);
+
+        xsane_rotate_copy(rotate->out + (line - rotate->first_line) * out_line_size + tile_x * bytespp, src + tile_x * step, step, pixels, bytespp);
+      }
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_rotate_lines(unsigned char *image, int pixel_width, int pixel_height, int bytespp, int rotation, unsigned char *out, int first_line, int end_line)
+/* rotates the output lines first_line .. end_line-1 of an image in memory into out */
+{
+ XsaneRotate rotate;
+
+  rotate.image        = image;
+  rotate.stride       = (long) pixel_width * bytespp;
+  rotate.x_origin     = 0;
+  rotate.y_origin     = 0;
+  rotate.rotation     = rotation;
+  rotate.pixel_width  = pixel_width;
+  rotate.pixel_height = pixel_height;
+  rotate.bytespp      = bytespp;
+  rotate.out_width    = (rotation & 1) ? pixel_height : pixel_width;
+  rotate.out          = out;
+  rotate.first_line   = first_line;
+  rotate.end_line     = end_line;
+
+  xsane_rotate_band(&rotate, 0, 1);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
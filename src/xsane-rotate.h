@@ -0,0 +1,68 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-rotate.h
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifndef HAVE_XSANE_ROTATE_H
+#define HAVE_XSANE_ROTATE_H
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* Rotates and mirrors an image in memory, the rotation codes are those of xsane_save_rotate_image
+ * (0..3 = 0/90/180/270 degree, +4 = mirrored in x direction). xsane_rotate_band copies one band
+ * of the output lines first_line .. end_line-1 to out and can be passed to xsane_parallel_run.
+ * For 90 and 270 degree an output line is a column of the source, these lines are copied in
+ * tiles of XSANE_ROTATE_TILE x XSANE_ROTATE_TILE pixels, so the source lines of a tile stay
+ * in the cache. The source can be a part of the image (see x_origin, y_origin), it must
+ * contain all pixels that are needed for the output lines.
+ */
+
+#define XSANE_ROTATE_TILE 64
+
+typedef struct XsaneRotate
+{
+  unsigned char *image;		/* source data, pixel x/y is at (y - y_origin) * stride + (x - x_origin) * bytespp */
+  long stride;
+  int x_origin;
+  int y_origin;
+  int rotation;
+  int pixel_width;		/* size of the original image */
+  int pixel_height;
+  int bytespp;
+  int out_width;		/* pixels per output line */
+  unsigned char *out;
+  int first_line;		/* output line that is stored at out */
+  int end_line;
+} XsaneRotate;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+extern void xsane_rotate_band(void *data, int band, int bands);
+extern void xsane_rotate_lines(unsigned char *image, int pixel_width, int pixel_height, int bytespp, int rotation, unsigned char *out, int first_line, int end_line);
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+#endif
+/* ---------------------------------------------------------------------------------------------------------------------- */
@@ -26,6 +26,13 @@
 #include "xsane-back-gtk.h"
 #include "xsane-front-gtk.h"
 #include "xsane-save.h"
+#include "xsane-parallel.h"
+#include "xsane-rotate.h"
+#include "xsane-resample.h"
+#include "xsane-despeckle.h"
+#include "xsane-base64.h"
+#include "xsane-smtp.h"
+#include "xsane-lineart.h"
 #include <time.h>
 #include <sys/wait.h> 
 
@@ -816,7 +823,7 @@ int xsane_copy_file_by_name(char *output_filename, char *input_filename, GtkProg
   fclose(infile);
   fclose(outfile);
 
-  gtk_progress_set_format_string(GTK_PROGRESS(progress_bar), "");
+  xsane_progress_bar_set_text(GTK_PROGRESS_BAR(progress_bar), "");
   xsane_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), 0.0);
 
  return (*cancel_save);
@@ -825,11 +832,9 @@ int xsane_copy_file_by_name(char *output_filename, char *input_filename, GtkProg
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 #ifdef HAVE_LIBLCMS
-cmsHTRANSFORM xsane_create_cms_transform(Image_info *image_info, int cms_function, int cms_intent, int cms_bpc)
+XsaneCmsTransform *xsane_create_cms_transform(Image_info *image_info, int cms_function, int cms_intent, int cms_bpc)
 {
- cmsHPROFILE hInProfile = NULL;
- cmsHPROFILE hOutProfile = NULL;
- cmsHTRANSFORM hTransform = NULL;
+ XsaneCmsTransform *hTransform = NULL;
  DWORD cms_input_format;
  DWORD cms_output_format;
  DWORD cms_flags = 0;
@@ -841,8 +846,6 @@ cmsHTRANSFORM xsane_create_cms_transform(Image_info *image_info, int cms_functio
 
   DBG(DBG_info, "Prepare CMS transform\n");
 
-  cmsErrorAction(LCMS_ERROR_SHOW);
-
   if (cms_bpc)
   {
     cms_flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
@@ -875,68 +878,10 @@ cmsHTRANSFORM xsane_create_cms_transform(Image_info *image_info, int cms_functio
     }
   }
 
-  hInProfile  = cmsOpenProfileFromFile(image_info->icm_profile, "r");
-  if (!hInProfile)
-  {
-   char buf[TEXTBUFSIZE];
-
-    snprintf(buf, sizeof(buf), "%s\n%s %s: %s\n", ERR_CMS_CONVERSION, ERR_CMS_OPEN_ICM_FILE, CMS_SCANNER_ICM, image_info->icm_profile);
-    xsane_back_gtk_error(buf, TRUE);
-  }
-  if (cms_function == XSANE_CMS_FUNCTION_CONVERT_TO_SRGB)
-  {
-    if (image_info->channels == 1) /* == 1 (grayscale) */
-    {
-#if 1 /* xxx oli */
-     LPGAMMATABLE Gamma = cmsBuildGamma(256, 2.2);
-
-      hOutProfile = cmsCreateGrayProfile(cmsD50_xyY(), Gamma);
-      cmsFreeGamma(Gamma);
-#endif
-    }
-    else
-    {
-      hOutProfile = cmsCreate_sRGBProfile();
-    }
-  }
-  else
-  {
-    hOutProfile = cmsOpenProfileFromFile(preferences.working_color_space_icm_profile, "r");
-    if (!hOutProfile)
-    {
-     char buf[TEXTBUFSIZE];
-
-      cmsCloseProfile(hInProfile);
-
-      snprintf(buf, sizeof(buf), "%s\n%s %s: %s\n", ERR_CMS_CONVERSION, ERR_CMS_OPEN_ICM_FILE, CMS_DISPLAY_ICM, preferences.display_icm_profile);
-      xsane_back_gtk_error(buf, TRUE);
-    }
-  }
-
-  if (!hOutProfile)
-  {
-   char buf[TEXTBUFSIZE];
-
-    cmsCloseProfile(hInProfile);
-
-    snprintf(buf, sizeof(buf), "%s\n", ERR_CMS_CONVERSION);
-    xsane_back_gtk_error(buf, TRUE);
-  }
-
-  hTransform = cmsCreateTransform(hInProfile, cms_input_format,
-                                  hOutProfile, cms_output_format,
-                                  cms_intent, cms_flags);
-
-  cmsCloseProfile(hInProfile);
-  cmsCloseProfile(hOutProfile);
-
-  if (!hTransform)
-  {
-   char buf[TEXTBUFSIZE];
-
-    snprintf(buf, sizeof(buf), "%s\n%s\n", ERR_CMS_CONVERSION, ERR_CMS_CREATE_TRANSFORM);
-    xsane_back_gtk_error(buf, TRUE);
-  }
+  /* XSANE_CMS_FUNCTION_CONVERT_TO_SRGB: NULL = built in sRGB or gray profile */
+  hTransform = xsane_cms_transform_get(image_info->icm_profile,
+                                       (cms_function == XSANE_CMS_FUNCTION_CONVERT_TO_SRGB) ? NULL : preferences.working_color_space_icm_profile,
+                                       NULL, cms_input_format, cms_output_format, cms_intent, 0, cms_flags);
 
  return hTransform;
 }
@@ -946,47 +891,38 @@ cmsHTRANSFORM xsane_create_cms_transform(Image_info *image_info, int cms_functio
 
 int xsane_save_grayscale_image_as_lineart(FILE *outfile, FILE *imagefile, Image_info *image_info, GtkProgressBar *progress_bar, int *cancel_save)
 {
- int x, y, bit;
- u_char bitval, packed;
+ int y;
+ unsigned char *line;
+ unsigned char *packed_line;
+ int bytes_per_line = (image_info->image_width + 7) / 8;
 
   *cancel_save = 0;
 
+  line        = malloc(image_info->image_width);
+  packed_line = malloc(bytes_per_line);
+
+  if (!line || !packed_line)
+  {
+    free(line);
+    free(packed_line);
+    xsane_back_gtk_error(ERR_NO_MEM, TRUE);
+    *cancel_save = 1;
+   return (*cancel_save);
+  }
+
   image_info->depth = 1;
 
   xsane_write_pnm_header(outfile, image_info, 0);
 
   for (y = 0; y < image_info->image_height; y++)
   {
-    bit = 128;
-    packed = 0;
-
-    for (x = 0; x < image_info->image_width; x++)
+    if (fread(line, image_info->image_width, 1, imagefile) != 1)
     {
-      bitval = fgetc(imagefile);
-
-      if (!bitval) /* white gets 0 bit, black gets 1 bit */
-      {
-        packed |= bit;
-      }
-
-      if (bit == 1)
-      {
-        fputc(packed, outfile);
-        bit = 128;
-        packed = 0;
-      }
-      else
-      {
-        bit >>= 1;
-      }
+      memset(line, 0xff, image_info->image_width); /* missing data is white */
     }
 
-    if (bit != 128)
-    {
-      fputc(packed, outfile);
-      bit = 128;
-      packed = 0;
-    }
+    xsane_lineart_pack(line, packed_line, image_info->image_width); /* white gets 0 bit, black gets 1 bit */
+    fwrite(packed_line, bytes_per_line, 1, outfile);
 
     if (ferror(outfile))
     {
@@ -1007,35 +943,93 @@ int xsane_save_grayscale_image_as_lineart(FILE *outfile, FILE *imagefile, Image_
       break;
     }
   }
+
+  free(line);
+  free(packed_line);
  
  return (*cancel_save);
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-int xsane_save_scaled_image(FILE *outfile, FILE *imagefile, Image_info *image_info, float x_scale, float y_scale, GtkProgressBar *progress_bar, int *cancel_save)
+/* The image is scaled in batches: the original lines that are needed for the next new lines */
+/* are read and converted into intermediate lines of the new width by the horizontal pass, */
+/* then the vertical pass combines the intermediate lines into new lines. Both passes split */
+/* their lines into one band per thread. The intermediate lines that are also used by the */
+/* next batch are kept in the window. */
+
+#define XSANE_SAVE_SCALE_LINES 64	/* original lines that are read and new lines that are created per batch */
+#define XSANE_SAVE_REDUCE_MIN_SCALE 0.99	/* xsane_save_reduce_resolution does not scale by less than 1% */
+
+typedef struct
+{
+  XsaneResampleAxis *x_axis;
+  XsaneResampleAxis *y_axis;
+  int channels;
+  int bytespp;
+  size_t original_line_size;
+  size_t new_line_size;
+  unsigned char *original_lines;	/* original lines read_first ... read_end - 1 */
+  int read_first;
+  int read_end;
+  gint32 **window;			/* intermediate lines window_first ... */
+  int window_first;
+  unsigned char *new_lines;		/* new lines new_first ... new_end - 1 */
+  int new_first;
+  int new_end;
+} XsaneSaveScale;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_save_scale_horizontal_band(void *data, int band, int bands)
+{
+ XsaneSaveScale *scale = data;
+ int first, end, line;
+
+  xsane_parallel_split(band, bands, scale->read_end - scale->read_first, &first, &end);
+
+  for (line = scale->read_first + first; line < scale->read_first + end; line++)
+  {
+    xsane_resample_horizontal(scale->x_axis, scale->original_lines + (line - scale->read_first) * scale->original_line_size,
+                              scale->bytespp, scale->channels, scale->window[line - scale->window_first]);
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_save_scale_vertical_band(void *data, int band, int bands)
+{
+ XsaneSaveScale *scale = data;
+ int first, end, line;
+
+  xsane_parallel_split(band, bands, scale->new_end - scale->new_first, &first, &end);
+
+  for (line = scale->new_first + first; line < scale->new_first + end; line++)
+  {
+    xsane_resample_vertical(scale->y_axis, line, scale->window + (scale->y_axis->first[line] - scale->window_first),
+                            scale->x_axis->new_size * scale->channels, scale->bytespp,
+                            scale->new_lines + (line - scale->new_first) * scale->new_line_size);
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_save_scaled_image(FILE *outfile, FILE *imagefile, Image_info *image_info, float x_scale, float y_scale, int filter, GtkProgressBar *progress_bar, int *cancel_save)
+/* filter is XSANE_SCALE_FILTER_BOX (area average), XSANE_SCALE_FILTER_BILINEAR or XSANE_SCALE_FILTER_LANCZOS3 */
 {
+ XsaneSaveScale scale;
+ int bands = xsane_parallel_threads();
  int original_image_width  = image_info->image_width;
  int original_image_height = image_info->image_height;
  int new_image_width  = image_info->image_width  * x_scale + 0.5;
  int new_image_height = image_info->image_height * y_scale + 0.5;
- unsigned char *original_line;
- guint16 *original_line16 = NULL;
- unsigned char *new_line;
- float *pixel_val;
- float *pixel_norm;
+ int window_size;
+ int window_end;	/* intermediate lines window_first ... window_end - 1 are valid */
+ int new_line;
  int bytespp = 1;
- float x, y;
- int c;
- int oldy;
- int x_new, y_new;
- float x_go, y_go;
- float factor, x_factor, y_factor;
- guint16 color;
- int read_line;
- size_t bytes_read;
+ int i;
 
-  DBG(DBG_proc, "xsane_save_scaled_image\n");
+  DBG(DBG_proc, "xsane_save_scaled_image(filter=%d)\n", filter);
 
   *cancel_save = 0;
 
@@ -1044,197 +1038,235 @@ int xsane_save_scaled_image(FILE *outfile, FILE *imagefile, Image_info *image_in
     bytespp = 2;
   }
 
-  image_info->image_width  = new_image_width;
-  image_info->image_height = new_image_height;
-  image_info->resolution_x *= x_scale;
-  image_info->resolution_y *= y_scale;
-
-  original_line = malloc(original_image_width * image_info->channels * bytespp);
-  if (!original_line)
+  if (new_image_width < 1)
   {
-    DBG(DBG_error, "xsane_save_scaled_image: out of memory\n");
-   return -1;
+    new_image_width = 1;
   }
 
-  new_line = malloc(new_image_width * image_info->channels * bytespp);
-  if (!new_line)
+  if (new_image_height < 1)
   {
-    free(original_line);
-    DBG(DBG_error, "xsane_save_scaled_image: out of memory\n");
-   return -1;
+    new_image_height = 1;
   }
 
-  pixel_val = malloc(new_image_width * image_info->channels * sizeof(float));
-  if (!pixel_val)
-  {
-    free(original_line);
-    free(new_line);
-    DBG(DBG_error, "xsane_save_scaled_image: out of memory\n");
-   return -1;
-  }               
+  memset(&scale, 0, sizeof(scale));
+  scale.x_axis = xsane_resample_axis_new(filter, original_image_width,  new_image_width);
+  scale.y_axis = xsane_resample_axis_new(filter, original_image_height, new_image_height);
 
-  pixel_norm = malloc(new_image_width * image_info->channels * sizeof(float));
-  if (!pixel_norm)
+  if (!scale.x_axis || !scale.y_axis)
   {
-    free(original_line);
-    free(new_line);
-    free(pixel_val);
     DBG(DBG_error, "xsane_save_scaled_image: out of memory\n");
+    xsane_resample_axis_free(scale.x_axis);
+    xsane_resample_axis_free(scale.y_axis);
    return -1;
-  }               
-
-  xsane_write_pnm_header(outfile, image_info, 0);
+  }
 
-  read_line = TRUE;
+  scale.channels           = image_info->channels;
+  scale.bytespp            = bytespp;
+  scale.original_line_size = (size_t) original_image_width * image_info->channels * bytespp;
+  scale.new_line_size      = (size_t) new_image_width * image_info->channels * bytespp;
 
-  memset(pixel_val,  0, new_image_width * image_info->channels * sizeof(float));
-  memset(pixel_norm, 0, new_image_width * image_info->channels * sizeof(float));
+  window_size = scale.y_axis->taps + XSANE_SAVE_SCALE_LINES;
 
-  y_new = 0;
-  y_go = 1.0 / y_scale;
-  y_factor = 1.0;
-  y = 0.0;
+  scale.original_lines = malloc(window_size * scale.original_line_size);
+  scale.new_lines      = malloc(XSANE_SAVE_SCALE_LINES * scale.new_line_size);
+  scale.window         = calloc(window_size, sizeof(gint32 *));
 
-  while (y < original_image_height)
+  for (i = 0; scale.window && (i < window_size); i++)
   {
-    DBG(DBG_info2, "xsane_save_scaled_image: original line %d, new line %d\n", (int) y, y_new);
+    scale.window[i] = malloc((size_t) new_image_width * image_info->channels * sizeof(gint32));
+    if (!scale.window[i])
+    {
+     break;
+    }
+  }
 
-    xsane_progress_bar_set_fraction(progress_bar, (float) y / original_image_height);
+  if (!scale.original_lines || !scale.new_lines || !scale.window || (i < window_size))
+  {
+    DBG(DBG_error, "xsane_save_scaled_image: out of memory\n");
 
-    if (read_line)
+    for (i = 0; scale.window && (i < window_size); i++)
     {
-      DBG(DBG_info, "xsane_save_scaled_image: reading original line %d\n", (int) y);
-      bytes_read = fread(original_line, original_image_width, image_info->channels * bytespp, imagefile); /* read one line */
-      original_line16 = (guint16 *) original_line;
+      free(scale.window[i]);
     }
+    free(scale.window);
+    free(scale.original_lines);
+    free(scale.new_lines);
+    xsane_resample_axis_free(scale.x_axis);
+    xsane_resample_axis_free(scale.y_axis);
+   return -1;
+  }
+
+  image_info->image_width  = new_image_width;
+  image_info->image_height = new_image_height;
+  image_info->resolution_x *= x_scale;
+  image_info->resolution_y *= y_scale;
 
-    x_new = 0;
-    x_go = 1.0 / x_scale;
-    x = 0.0;
-    x_factor = 1.0;
+  xsane_write_pnm_header(outfile, image_info, 0);
 
-    while ( (x < original_image_width) && (x_new < new_image_width) ) /* add this line to anti aliasing buffer */
-    {
-      factor = x_factor * y_factor;
+  scale.window_first = 0;
+  window_end = 0;
+  new_line = 0;
 
-      for (c = 0; c < image_info->channels; c++)
-      {
-        if (bytespp == 1)
-        {
-          color = original_line[((int) x) * image_info->channels + c];
-        }
-        else /* bytespp == 2 */
-        {
-          color = original_line16[((int) x) * image_info->channels + c];
-        }
+  while ((new_line < new_image_height) && (!*cancel_save))
+  {
+   int first = scale.y_axis->first[new_line];
 
-        pixel_val [x_new * image_info->channels + c] += factor * color;
-        pixel_norm[x_new * image_info->channels + c] += factor;
-      }
+    DBG(DBG_info2, "xsane_save_scaled_image: new line %d, original line %d\n", new_line, first);
 
-      x_go -= x_factor;
+    if (first > scale.window_first) /* drop the intermediate lines that are not used any more */
+    {
+     int drop = first - scale.window_first;
 
-      if (x_go <= 0.0) /* change of pixel in new image */
+      if (drop > window_end - scale.window_first)
       {
-        x_new++;
-        x_go = 1.0 / x_scale;
-
-        x_factor = x - (int) x; /* use pixel rest */
-        if (x_factor > x_go)
-        {
-          x_factor = x_go;
-        }
+        drop = window_end - scale.window_first;
       }
-      else
+
+      for (i = 0; i < drop; i++) /* the line buffers are rotated to the end of the window */
       {
-        x_factor = x_go;
+       gint32 *line = scale.window[0];
+
+        memmove(scale.window, scale.window + 1, (window_size - 1) * sizeof(gint32 *));
+        scale.window[window_size - 1] = line;
       }
 
-      if (x_factor > 1.0)
+      if (window_end < first) /* skip original lines that are not used at all */
       {
-        x_factor = 1.0;
+        fseek(imagefile, (long) (first - window_end) * scale.original_line_size, SEEK_CUR);
+        window_end = first;
       }
 
-      x += x_factor;
+      scale.window_first = first;
     }
 
-    y_go -= y_factor;
-
-    if (y_go <= 0.0) /* normalize one line and write to destination image file */
+    /* the batch contains the new lines whose intermediate lines fit into the window */
+    scale.new_first = new_line;
+    scale.new_end   = new_line + 1;
+    while ((scale.new_end < new_image_height) && (scale.new_end - scale.new_first < XSANE_SAVE_SCALE_LINES) &&
+           (scale.y_axis->first[scale.new_end] + scale.y_axis->taps - scale.window_first <= window_size))
     {
-      DBG(DBG_info2, "xsane_save_scaled_image: writing new line %d\n", y_new);
-
-      if (bytespp == 1)
-      {
-        for (x_new = 0; x_new < new_image_width * image_info->channels; x_new++)
-        {
-          new_line[x_new] = (int) (pixel_val[x_new] / pixel_norm[x_new]);
-        }
-      }
-      else /* bytespp == 2 */
-      {
-       guint16 *new_line16 = (guint16 *) new_line;
+      scale.new_end++;
+    }
 
-        for (x_new = 0; x_new < new_image_width * image_info->channels; x_new++)
-        {
-          new_line16[x_new] = (int) (pixel_val[x_new] / pixel_norm[x_new]);
-        }
-      }
+    scale.read_first = window_end;
+    scale.read_end   = scale.y_axis->first[scale.new_end - 1] + scale.y_axis->taps;
 
-      fwrite(new_line, new_image_width, image_info->channels * bytespp, outfile); /* write one line */
+    if (scale.read_end > scale.read_first)
+    {
+     size_t lines_read;
 
-      if (ferror(outfile))
+      lines_read = fread(scale.original_lines, scale.original_line_size, scale.read_end - scale.read_first, imagefile);
+      if (lines_read < (size_t) (scale.read_end - scale.read_first)) /* truncated image */
       {
-       char buf[TEXTBUFSIZE];
- 
-        snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
-        DBG(DBG_error, "%s\n", buf);
-        xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
-        *cancel_save = 1;
-       break;
+        memset(scale.original_lines + lines_read * scale.original_line_size, 0, (scale.read_end - scale.read_first - lines_read) * scale.original_line_size);
       }
 
-      /* reset values and norm factors */
-      memset(pixel_val,  0, new_image_width * image_info->channels * sizeof(float));
-      memset(pixel_norm, 0, new_image_width * image_info->channels * sizeof(float));
+      xsane_parallel_run(xsane_save_scale_horizontal_band, &scale, bands);
+      window_end = scale.read_end;
+    }
 
-      y_new++;
-      y_go = 1.0 / y_scale;
+    xsane_parallel_run(xsane_save_scale_vertical_band, &scale, bands);
 
-      y_factor = y - (int) y;
-      if (y_factor > y_go)
-      {
-        y_factor = y_go;
-      }
-    }
-    else
-    {
-      y_factor = y_go;
-    }
+    fwrite(scale.new_lines, scale.new_line_size, scale.new_end - scale.new_first, outfile);
 
-    if (y_factor > 1.0)
+    if (ferror(outfile))
     {
-      y_factor = 1.0;
+     char buf[TEXTBUFSIZE];
+
+      snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
+      DBG(DBG_error, "%s\n", buf);
+      xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
+      *cancel_save = 1;
+     break;
     }
 
-    oldy = (int) y;
-    y += y_factor;
-    read_line = (oldy != (int) y);
+    new_line = scale.new_end;
+
+    xsane_progress_bar_set_fraction(progress_bar, (float) new_line / new_image_height);
   }
 
-  if (read_line) /* we have to write one more line */
+  for (i = 0; i < window_size; i++)
   {
-    fwrite(new_line, new_image_width, image_info->channels * bytespp, outfile); /* write one line */
+    free(scale.window[i]);
   }
-
-  free(original_line);
-  free(new_line);
-  free(pixel_val);
-  free(pixel_norm);
+  free(scale.window);
+  free(scale.original_lines);
+  free(scale.new_lines);
+  xsane_resample_axis_free(scale.x_axis);
+  xsane_resample_axis_free(scale.y_axis);
 
  return (*cancel_save);
 }
 
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_save_reduce_resolution(FILE **imagefile, Image_info *image_info, float resolution_x, float resolution_y, GtkProgressBar *progress_bar, int *cancel_save)
+/* scales the image down to resolution_x/resolution_y with preferences.scale_filter when it has a higher resolution, */
+/* *imagefile has to be positioned behind the pnm header. The scaled image is written to a temporary file that */
+/* is removed at once, *imagefile is closed and replaced by the temporary file positioned behind its header */
+/* and image_info is updated. Lineart images are not scaled. returns 0 on success or when nothing has to be done, */
+/* on error or cancel -1 is returned and *imagefile and image_info are unchanged */
+{
+ FILE *outfile;
+ Image_info original_image_info = *image_info;
+ long pos;
+ char filename[PATH_MAX];
+ float x_scale = 1.0, y_scale = 1.0;
+
+  DBG(DBG_proc, "xsane_save_reduce_resolution(%3.1f, %3.1f)\n", resolution_x, resolution_y);
+
+  *cancel_save = 0;
+
+  if ((resolution_x > 0) && (image_info->resolution_x > resolution_x))
+  {
+    x_scale = resolution_x / image_info->resolution_x;
+  }
+
+  if ((resolution_y > 0) && (image_info->resolution_y > resolution_y))
+  {
+    y_scale = resolution_y / image_info->resolution_y;
+  }
+
+  if ((image_info->depth < 8) || ((x_scale > XSANE_SAVE_REDUCE_MIN_SCALE) && (y_scale > XSANE_SAVE_REDUCE_MIN_SCALE)))
+  {
+   return 0;
+  }
+
+  DBG(DBG_info, "xsane_save_reduce_resolution: scaling image by %f x %f\n", x_scale, y_scale);
+
+  if (xsane_back_gtk_make_path(sizeof(filename), filename, 0, 0, "xsane-scaled-", xsane.dev_name, ".pnm", XSANE_PATH_TMP))
+  {
+    DBG(DBG_error, "xsane_save_reduce_resolution: could not create a temporary filename, using the original image\n");
+   return -1;
+  }
+
+  outfile = fopen(filename, "w+b"); /* b = binary mode for win32 */
+  if (!outfile)
+  {
+    DBG(DBG_error, "xsane_save_reduce_resolution: could not create %s: %s\n", filename, strerror(errno));
+   return -1;
+  }
+  remove(filename); /* the data is available until the file is closed */
+
+  pos = ftell(*imagefile);
+
+  if (xsane_save_scaled_image(outfile, *imagefile, image_info, x_scale, y_scale, preferences.scale_filter, progress_bar, cancel_save) || fflush(outfile))
+  {
+    fclose(outfile);
+    fseek(*imagefile, pos, SEEK_SET);
+    *image_info = original_image_info;
+   return -1;
+  }
+
+  fclose(*imagefile);
+  *imagefile = outfile;
+
+  rewind(outfile);
+  xsane_read_pnm_header(outfile, image_info);
+
+ return 0;
+}
+
 /* ---------------------------------------------------------------------------------------------------------------------- */
 #if 0
 int xsane_save_scaled_image(FILE *outfile, FILE *imagefile, Image_info *image_info, float x_scale, float y_scale, GtkProgressBar *progress_bar, int *cancel_save)
@@ -1319,176 +1351,108 @@ int xsane_save_scaled_image(FILE *outfile, FILE *imagefile, Image_info *image_in
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-int xsane_save_despeckle_image(FILE *outfile, FILE *imagefile, Image_info *image_info, int radius, GtkProgressBar *progress_bar, int *cancel_save)
+/* Neighbourhood filters (despeckle, blur) calculate each output line from the input lines */
+/* line-halo .. line+halo. xsane_save_filter_lines reads the image in chunks of lines, */
+/* keeps the halo lines of the previous chunk and splits each chunk into one band of lines */
+/* per thread. func calculates the lines first_line .. end_line-1 of one band, input line */
+/* n is stored at in + (n - in_first_line) * line_size. */
+
+#define XSANE_SAVE_BAND_LINES 32
+
+typedef void (*XsaneSaveLinesFunc)(void *data, int band, unsigned char *in, int in_first_line, unsigned char *out, int first_line, int end_line);
+
+typedef struct
 {
- int x, y, sx, sy, i;
- int xmin, xmax;
- int ymin, ymax;
- int count;
- unsigned char *line_cache;
- unsigned char *line_cache_ptr;
- guint16 *color_cache;
- guint16 *color_cache_ptr;
- int bytespp = 1;
- int color_radius;
- int color_width  = image_info->image_width * image_info->channels;
- size_t bytes_read;
+  XsaneSaveLinesFunc func;
+  void *data;
+  size_t line_size;
+  unsigned char *in;
+  int in_first_line;
+  unsigned char *out;
+  int first_line;
+  int end_line;
+} XsaneSaveLinesJob;
 
-  radius--; /* correct radius : 1 means nothing happens */
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-  if (radius < 1)
-  {
-    radius = 1;
-  }
+static void xsane_save_filter_lines_band(void *data, int band, int bands)
+{
+ XsaneSaveLinesJob *job = data;
+ int first, end;
 
-  color_radius = radius * image_info->channels;
+  xsane_parallel_split(band, bands, job->end_line - job->first_line, &first, &end);
 
-  if (image_info->depth > 8)
+  if (first < end)
   {
-    bytespp = 2;
+    job->func(job->data, band, job->in, job->in_first_line, job->out + (size_t) first * job->line_size, job->first_line + first, job->first_line + end);
   }
+}
 
-  xsane_write_pnm_header(outfile, image_info, 0);
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-  line_cache = malloc(color_width * bytespp * (2 * radius + 1));
-  if (!line_cache)
+static int xsane_save_filter_lines(FILE *outfile, FILE *imagefile, Image_info *image_info, int halo, XsaneSaveLinesFunc func, void *data, int bands,
+                                   GtkProgressBar *progress_bar, int *cancel_save)
+{
+ XsaneSaveLinesJob job;
+ int height = image_info->image_height;
+ int chunk_lines;
+ int in_lines, need_first, need_end;
+ int first;
+ size_t line_size;
+ size_t bytes_read;
+
+  line_size = (size_t) image_info->image_width * image_info->channels;
+
+  if (image_info->depth > 8)
   {
-    DBG(DBG_error, "xsane_despeckle_image: out of memory\n");
-   return -1;
+    line_size *= 2;
   }
 
-  bytes_read = fread(line_cache, color_width * bytespp, (2 * radius + 1), imagefile);
+  chunk_lines = bands * MAX(XSANE_SAVE_BAND_LINES, 2 * halo);
 
-  color_cache = malloc((size_t) sizeof(guint16) * (2*radius+1)*(2*radius+1));
+  job.func          = func;
+  job.data          = data;
+  job.line_size     = line_size;
+  job.in            = malloc((chunk_lines + 2 * halo) * line_size);
+  job.out           = malloc(chunk_lines * line_size);
+  job.in_first_line = 0;
+  in_lines = 0;
 
-  if (!color_cache)
+  if (!job.in || !job.out)
   {
-    free(line_cache);
-    DBG(DBG_error, "xsane_despeckle_image: out of memory\n");
+    DBG(DBG_error, "xsane_save_filter_lines: out of memory\n");
+    free(job.in);
+    free(job.out);
    return -1;
   }
 
-  for (y = 0; y < image_info->image_height; y++)
+  for (first = 0; first < height; first += chunk_lines)
   {
-    xsane_progress_bar_set_fraction(progress_bar, (float)  y / image_info->image_height);
+    xsane_progress_bar_set_fraction(progress_bar, (float) first / height);
 
-    ymin = y - radius;
-    ymax = y + radius;
+    job.first_line = first;
+    job.end_line   = MIN(first + chunk_lines, height);
 
-    if (ymin < 0)
+    need_first = MAX(first - halo, 0);
+    need_end   = MIN(job.end_line + halo, height);
+
+    if (need_first > job.in_first_line) /* keep the halo of the last chunk */
     {
-      ymin = 0;
+      memmove(job.in, job.in + (need_first - job.in_first_line) * line_size, (job.in_first_line + in_lines - need_first) * line_size);
+      in_lines -= need_first - job.in_first_line;
+      job.in_first_line = need_first;
     }
 
-    if (ymax > image_info->image_height)
+    bytes_read = fread(job.in + in_lines * line_size, line_size, need_end - job.in_first_line - in_lines, imagefile);
+    if (bytes_read != need_end - job.in_first_line - in_lines)
     {
-      ymax = image_info->image_height;
+      DBG(DBG_error, "xsane_save_filter_lines: could not read image lines\n");
     }
+    in_lines = need_end - job.in_first_line;
 
-    for (x = 0; x < color_width; x++)
-    {
-      xmin = x - color_radius;
-      xmax = x + color_radius;
+    xsane_parallel_run(xsane_save_filter_lines_band, &job, bands);
 
-      if (xmin < 0)
-      {
-        xmin = x % image_info->channels;
-      }
-
-      if (xmax > color_width)
-      {
-        xmax = color_width;
-      }
-
-      count = 0;
-
-      color_cache_ptr = color_cache;
-
-
-      if (bytespp == 1)
-      {
-        for (sy = ymin; sy <= ymax; sy++) /* search area defined by radius  - y part */
-        {
-          line_cache_ptr = line_cache + (sy-ymin) * color_width + xmin;
-
-          for (sx = xmin; sx <= xmax; sx+=image_info->channels) /* x part */
-          {
-            *color_cache_ptr = *line_cache_ptr;
-            color_cache_ptr++;
-            line_cache_ptr += image_info->channels;
-          }
-        }
-
-        /* sort color_cache */
-
-        count = color_cache_ptr - color_cache;
-
-        if (count > 1)
-        {
-         int d, j, val;
-
-          for (d = count / 2; d > 0; d = d / 2)
-          {
-            for (i = d; i < count; i++)
-            {
-              for (j = i - d, color_cache_ptr = color_cache + j; j >= 0 && color_cache_ptr[0] > color_cache_ptr[d]; j -= d, color_cache_ptr -= d)
-              {
-                val                = color_cache_ptr[0];
-                color_cache_ptr[0] = color_cache_ptr[d];
-                color_cache_ptr[d] = val;
-              };
-            }
-          }
-        }
-
-        fputc((char) (color_cache[count/2]), outfile);
-      }
-      else /* 16 bit/color */
-      {
-       guint16 val16;
-       guint16 *line_cache16 = (guint16 *) line_cache;
-       guint16 *line_cache16_ptr;
-       char *bytes16 = (char *) &val16;
-
-        for (sy = ymin; sy <= ymax; sy++)
-        {
-          line_cache16_ptr = line_cache16 + (sy-ymin) * color_width + xmin;
-
-          for (sx = xmin; sx <= xmax; sx+=image_info->channels)
-          {
-            *color_cache_ptr = *line_cache16_ptr;
-            color_cache_ptr++;
-            line_cache16_ptr += image_info->channels;
-          }
-        }
-
-        /* sort color_cache */
-
-        count = color_cache_ptr - color_cache;
-
-        if (count > 1)
-        {
-         int d,j, val;
-
-          for (d = count / 2; d > 0; d = d / 2)
-          {
-            for (i = d; i < count; i++)
-            {
-              for (j = i - d, color_cache_ptr = color_cache + j; j >= 0 && color_cache_ptr[0] > color_cache_ptr[d]; j -= d, color_cache_ptr -= d)
-              {
-                val                = color_cache_ptr[0];
-                color_cache_ptr[0] = color_cache_ptr[d];
-                color_cache_ptr[d] = val;
-              };
-            }
-          }
-        }
-
-        val16 = color_cache[count/2];
-        fputc(bytes16[0], outfile); /* write bytes in machine byte order */
-        fputc(bytes16[1], outfile);
-      }
-    }
+    fwrite(job.out, line_size, job.end_line - first, outfile);
 
     if (ferror(outfile))
     {
@@ -1501,234 +1465,291 @@ int xsane_save_despeckle_image(FILE *outfile, FILE *imagefile, Image_info *image
      break;
     }
 
-    if ((y > radius) && (y < image_info->image_height - radius))
+    if (*cancel_save)
     {
-      memcpy(line_cache, line_cache + color_width * bytespp, 
-             color_width * bytespp * 2 * radius);
-      bytes_read = fread(line_cache + color_width * bytespp * 2 * radius,
-            color_width * bytespp, 1, imagefile);
+      break;
     }
   }
 
   fflush(outfile);
 
-  free(line_cache);
-  free(color_cache);
+  free(job.in);
+  free(job.out);
 
  return 0;
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-int xsane_save_blur_image(FILE *outfile, FILE *imagefile, Image_info *image_info, float radius, GtkProgressBar *progress_bar, int *cancel_save)
+static void xsane_save_despeckle_lines(void *data, int band, unsigned char *in, int in_first_line, unsigned char *out, int first_line, int end_line)
 {
- int x, y, sx, sy;
- int xmin, xmax;
- int ymin, ymax;
- double val, norm, outer_factor;
- unsigned char *line_cache;
- int bytespp = 1;
- int intradius;
- int xmin_flag;
- int xmax_flag;
- int ymin_flag;
- int ymax_flag;
- size_t bytes_read;
+  xsane_despeckle_lines(data, band, in, in_first_line, out, first_line, end_line);
+}
 
-  *cancel_save = 0;
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int xsane_save_despeckle_image(FILE *outfile, FILE *imagefile, Image_info *image_info, int radius, GtkProgressBar *progress_bar, int *cancel_save)
+{
+ XsaneDespeckle *despeckle;
+ int bands = xsane_parallel_threads();
+ int status;
 
-  intradius = (int) radius;
+  DBG(DBG_proc, "xsane_save_despeckle_image(radius=%d)\n", radius);
 
-  outer_factor = radius - (int) radius;
+  *cancel_save = 0;
 
-  if (image_info->depth > 8)
+  radius--; /* correct radius : 1 means nothing happens */
+
+  if (radius < 1)
   {
-    bytespp = 2;
+    radius = 1;
   }
 
-  xsane_write_pnm_header(outfile, image_info, 0);
+  if (radius > XSANE_DESPECKLE_MAX_RADIUS)
+  {
+    DBG(DBG_info, "xsane_save_despeckle_image: radius reduced to %d\n", XSANE_DESPECKLE_MAX_RADIUS);
+    radius = XSANE_DESPECKLE_MAX_RADIUS;
+  }
 
-  line_cache = malloc(image_info->image_width * image_info->channels * bytespp * (2 * intradius + 1));
-  if (!line_cache)
+  despeckle = xsane_despeckle_new(image_info, radius, bands);
+  if (!despeckle)
   {
-    DBG(DBG_error, "xsane_blur_image: out of memory\n");
    return -1;
   }
 
-  bytes_read = fread(line_cache, image_info->image_width * image_info->channels * bytespp, (2 * intradius + 1), imagefile);
+  xsane_write_pnm_header(outfile, image_info, 0);
 
-  for (y = 0; y < image_info->image_height; y++)
-  {
-    xsane_progress_bar_set_fraction(progress_bar, (float)  y / image_info->image_height);
+  status = xsane_save_filter_lines(outfile, imagefile, image_info, radius, xsane_save_despeckle_lines, despeckle, bands, progress_bar, cancel_save);
 
-    for (x = 0; x < image_info->image_width * image_info->channels; x++)
-    {
-      xmin_flag = xmax_flag = ymin_flag = ymax_flag = TRUE;
+  xsane_despeckle_free(despeckle);
+
+ return status;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-      xmin = x - intradius * image_info->channels;
-      xmax = x + intradius * image_info->channels;
+/* The blur kernel is a (2*radius+1)^2 square: the inner (2*intradius-1)^2 square has weight 1, */
+/* the outer ring without the corners has weight outer_factor (the fractional part of radius). */
+/* This is the sum of separable box filters: */
+/*   (1 - 2 * outer_factor) * inner_x * inner_y + outer_factor * (outer_x * inner_y + inner_x * outer_y) */
+/* so only two running column sums (inner_y, outer_y) are updated per line and the horizontal */
+/* boxes are taken from prefix sums of these columns. The cost per sample does not depend on radius. */
+/* Samples outside of the image are ignored and the weight of the clipped kernel is used as norm. */
 
-      if (xmin < 0)
+typedef struct
+{
+  Image_info *image_info;
+  int intradius;
+  double outer_factor;
+  size_t line_size;
+  guint32 *inner_sum;		/* vertical sums over lines y-intradius+1 .. y+intradius-1, one set per band */
+  guint32 *outer_sum;		/* vertical sums over lines y-intradius .. y+intradius */
+  double *inner_prefix;		/* prefix sums of inner_sum / outer_sum for one line */
+  double *outer_prefix;
+} XsaneSaveBlur;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_save_blur_update_sum(XsaneSaveBlur *blur, unsigned char *in, int in_first_line, int line, guint32 *sum, int add)
+/* adds or subtracts line to/from the vertical sums, lines outside of the image are ignored */
+{
+ int samples = blur->image_info->image_width * blur->image_info->channels;
+ unsigned char *line_ptr;
+ int i;
+
+  if ((line < 0) || (line >= blur->image_info->image_height))
+  {
+   return;
+  }
+
+  line_ptr = in + (size_t) (line - in_first_line) * blur->line_size;
+
+  if (blur->image_info->depth <= 8)
+  {
+    if (add)
+    {
+      for (i = 0; i < samples; i++)
       {
-        xmin = x % image_info->channels;
-        xmin_flag = FALSE;
+        sum[i] += line_ptr[i];
       }
-
-      if (xmax > image_info->image_width * image_info->channels)
+    }
+    else
+    {
+      for (i = 0; i < samples; i++)
       {
-        xmax = image_info->image_width * image_info->channels;
-        xmax_flag = FALSE;
+        sum[i] -= line_ptr[i];
       }
+    }
+  }
+  else
+  {
+   guint16 *line_ptr16 = (guint16 *) line_ptr;
 
-      ymin = y - intradius;
-      ymax = y + intradius;
-
-      if (ymin < 0)
+    if (add)
+    {
+      for (i = 0; i < samples; i++)
       {
-        ymin = 0;
-        ymin_flag = FALSE;
+        sum[i] += line_ptr16[i];
       }
-
-      if (ymax > image_info->image_height)
+    }
+    else
+    {
+      for (i = 0; i < samples; i++)
       {
-        ymax = image_info->image_height;
-        ymax_flag = FALSE;
+        sum[i] -= line_ptr16[i];
       }
+    }
+  }
+}
 
-      val  = 0.0;
-      norm = 0.0;
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-      if (bytespp == 1)
-      {
-        if (xmin_flag) /* integrate over left margin */
-        {
-          for (sy = ymin+1; sy <= ymax-1 ; sy++)
-          {
-            val += outer_factor * line_cache[(sy-ymin) * image_info->image_width * image_info->channels + xmin];
-            norm += outer_factor;
-          }
-        }
+static void xsane_save_blur_lines(void *data, int band, unsigned char *in, int in_first_line, unsigned char *out, int first_line, int end_line)
+{
+ XsaneSaveBlur *blur = data;
+ int channels = blur->image_info->channels;
+ int width = blur->image_info->image_width;
+ int height = blur->image_info->image_height;
+ int samples = width * channels;
+ int intradius = blur->intradius;
+ double outer_factor = blur->outer_factor;
+ double inner_weight = 1.0 - 2.0 * outer_factor;
+ guint32 *inner_sum = blur->inner_sum + (size_t) band * samples;
+ guint32 *outer_sum = blur->outer_sum + (size_t) band * samples;
+ double *inner_prefix = blur->inner_prefix + (size_t) band * (samples + channels);
+ double *outer_prefix = blur->outer_prefix + (size_t) band * (samples + channels);
+ double inner_inner, outer_inner, inner_outer, norm, val;
+ int inner_x, outer_x, inner_y, outer_y;
+ int inner_xmin, inner_xmax, outer_xmin, outer_xmax;
+ int x, y, c, i;
 
-        if (xmax_flag) /* integrate over right margin */
-        {
-          for (sy = ymin+1; sy <= ymax-1 ; sy++)
-          {
-            val += outer_factor * line_cache[(sy-ymin) * image_info->image_width * image_info->channels + xmax];
-            norm += outer_factor;
-          }
-        }
+  memset(inner_sum, 0, samples * sizeof(guint32));
+  memset(outer_sum, 0, samples * sizeof(guint32));
 
-        if (ymin_flag) /* integrate over top margin */
-        {
-          for (sx = xmin+image_info->channels; sx <= xmax-image_info->channels ; sx += image_info->channels)
-          {
-            val += outer_factor * line_cache[sx];
-            norm += outer_factor;
-          }
-        }
+  for (y = first_line - intradius; y <= first_line + intradius; y++) /* windows of first_line */
+  {
+    xsane_save_blur_update_sum(blur, in, in_first_line, y, outer_sum, TRUE);
 
-        if (ymax_flag) /* integrate over bottom margin */
-        {
-          for (sx = xmin+image_info->channels; sx <= xmax-image_info->channels ; sx += image_info->channels)
-          {
-            val += outer_factor * line_cache[(ymax-ymin) * image_info->image_width * image_info->channels + sx];
-            norm += outer_factor;
-          }
-        }
+    if ((y > first_line - intradius) && (y < first_line + intradius))
+    {
+      xsane_save_blur_update_sum(blur, in, in_first_line, y, inner_sum, TRUE);
+    }
+  }
 
-        for (sy = ymin+1; sy <= ymax-1; sy++) /* integrate internal square */
-        {
-          for (sx = xmin+image_info->channels; sx <= xmax-image_info->channels; sx+=image_info->channels)
-          {
-            val += line_cache[(sy-ymin) * image_info->image_width * image_info->channels + sx];
-            norm += 1.0;
-          }
-        }
-        fputc((char) ((int) (val/norm)), outfile);
-      }
-      else /* bytespp == 2 */
-      {
-       guint16 *line_cache16 = (guint16 *) line_cache;
-       guint16 val16;
-       char *bytes16 = (char *) &val16;
+  for (y = first_line; y < end_line; y++)
+  {
+    outer_y = MIN(y + intradius, height - 1) - MAX(y - intradius, 0) + 1;
+    inner_y = MIN(y + intradius - 1, height - 1) - MAX(y - intradius + 1, 0) + 1;
 
-        if (xmin_flag) /* integrate over left margin */
-        {
-          for (sy = ymin+1; sy <= ymax-1 ; sy++)
-          {
-            val += outer_factor * line_cache16[(sy-ymin) * image_info->image_width * image_info->channels + xmin];
-            norm += outer_factor;
-          }
-        }
+    for (c = 0; c < channels; c++)
+    {
+      inner_prefix[c] = 0.0;
+      outer_prefix[c] = 0.0;
+    }
 
-        if (xmax_flag) /* integrate over right margin */
-        {
-          for (sy = ymin+1; sy <= ymax-1 ; sy++)
-          {
-            val += outer_factor * line_cache16[(sy-ymin) * image_info->image_width * image_info->channels + xmax];
-            norm += outer_factor;
-          }
-        }
+    for (i = 0; i < samples; i++)
+    {
+      inner_prefix[i + channels] = inner_prefix[i] + inner_sum[i];
+      outer_prefix[i + channels] = outer_prefix[i] + outer_sum[i];
+    }
 
-        if (ymin_flag) /* integrate over top margin */
-        {
-          for (sx = xmin+image_info->channels; sx <= xmax-image_info->channels ; sx += image_info->channels)
-          {
-            val += outer_factor * line_cache16[sx];
-            norm += outer_factor;
-          }
-        }
+    for (x = 0; x < width; x++)
+    {
+      inner_xmin = MAX(x - intradius + 1, 0) * channels;
+      inner_xmax = (MIN(x + intradius - 1, width - 1) + 1) * channels;
+      outer_xmin = MAX(x - intradius, 0) * channels;
+      outer_xmax = (MIN(x + intradius, width - 1) + 1) * channels;
+
+      inner_x = (inner_xmax - inner_xmin) / channels;
+      outer_x = (outer_xmax - outer_xmin) / channels;
+
+      norm = inner_weight * inner_x * inner_y + outer_factor * (outer_x * inner_y + inner_x * outer_y);
 
-        if (ymax_flag) /* integrate over bottom margin */
+      for (c = 0; c < channels; c++)
+      {
+        inner_inner = inner_prefix[inner_xmax + c] - inner_prefix[inner_xmin + c];
+        outer_inner = inner_prefix[outer_xmax + c] - inner_prefix[outer_xmin + c];
+        inner_outer = outer_prefix[inner_xmax + c] - outer_prefix[inner_xmin + c];
+
+        val = (inner_weight * inner_inner + outer_factor * (outer_inner + inner_outer)) / norm;
+
+        if (blur->image_info->depth <= 8)
         {
-          for (sx = xmin+image_info->channels; sx <= xmax-image_info->channels ; sx += image_info->channels)
-          {
-            val += outer_factor * line_cache16[(ymax-ymin) * image_info->image_width * image_info->channels + sx];
-            norm += outer_factor;
-          }
+          out[x * channels + c] = (unsigned char) val;
         }
-
-        for (sy = ymin; sy <= ymax; sy++) /* integrate internal square */
+        else
         {
-          for (sx = xmin; sx <= xmax; sx+=image_info->channels)
-          {
-            val += line_cache16[(sy-ymin) * image_info->image_width * image_info->channels + sx];
-            norm += 1.0;
-          }
+          ((guint16 *) out)[x * channels + c] = (guint16) val; /* machine byte order */
         }
-
-        val16 = val / norm;
-        fputc(bytes16[0], outfile); /* write bytes in machine byte order */
-        fputc(bytes16[1], outfile);
       }
     }
 
-    if (ferror(outfile))
+    if (y + 1 < end_line) /* move the windows to line y+1 */
     {
-     char buf[TEXTBUFSIZE];
-
-      snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
-      DBG(DBG_error, "%s\n", buf);
-      xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
-      *cancel_save = 1;
-     break;
+      xsane_save_blur_update_sum(blur, in, in_first_line, y - intradius, outer_sum, FALSE);
+      xsane_save_blur_update_sum(blur, in, in_first_line, y + intradius + 1, outer_sum, TRUE);
+      xsane_save_blur_update_sum(blur, in, in_first_line, y - intradius + 1, inner_sum, FALSE);
+      xsane_save_blur_update_sum(blur, in, in_first_line, y + intradius, inner_sum, TRUE);
     }
 
-      /* reset values and norm factors */
+    out += blur->line_size;
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-    if ((y > intradius) && (y < image_info->image_height - intradius))
-    {
-      memcpy(line_cache, line_cache + image_info->image_width * image_info->channels * bytespp, 
-             image_info->image_width * image_info->channels * bytespp * 2 * intradius);
-      bytes_read = fread(line_cache + image_info->image_width * image_info->channels * bytespp * 2 * intradius,
-            image_info->image_width * image_info->channels * bytespp, 1, imagefile);
-    }
+int xsane_save_blur_image(FILE *outfile, FILE *imagefile, Image_info *image_info, float radius, GtkProgressBar *progress_bar, int *cancel_save)
+{
+ XsaneSaveBlur blur;
+ int bands = xsane_parallel_threads();
+ int samples = image_info->image_width * image_info->channels;
+ int status;
+
+  DBG(DBG_proc, "xsane_save_blur_image(radius=%f)\n", radius);
+
+  *cancel_save = 0;
+
+  blur.image_info   = image_info;
+  blur.intradius    = (int) radius;
+  blur.outer_factor = radius - blur.intradius;
+  blur.line_size    = samples;
+
+  if (blur.intradius < 1) /* kernel only contains the sample itself */
+  {
+    blur.intradius = 1;
+    blur.outer_factor = 0.0;
   }
 
-  fflush(outfile);
-  free(line_cache);
+  if (image_info->depth > 8)
+  {
+    blur.line_size *= 2;
+  }
 
- return 0;
+  blur.inner_sum    = malloc((size_t) bands * samples * sizeof(guint32));
+  blur.outer_sum    = malloc((size_t) bands * samples * sizeof(guint32));
+  blur.inner_prefix = malloc((size_t) bands * (samples + image_info->channels) * sizeof(double));
+  blur.outer_prefix = malloc((size_t) bands * (samples + image_info->channels) * sizeof(double));
+
+  if (!blur.inner_sum || !blur.outer_sum || !blur.inner_prefix || !blur.outer_prefix)
+  {
+    DBG(DBG_error, "xsane_blur_image: out of memory\n");
+    free(blur.inner_sum);
+    free(blur.outer_sum);
+    free(blur.inner_prefix);
+    free(blur.outer_prefix);
+   return -1;
+  }
+
+  xsane_write_pnm_header(outfile, image_info, 0);
+
+  status = xsane_save_filter_lines(outfile, imagefile, image_info, blur.intradius, xsane_save_blur_lines, &blur, bands, progress_bar, cancel_save);
+
+  free(blur.inner_sum);
+  free(blur.outer_sum);
+  free(blur.inner_prefix);
+  free(blur.outer_prefix);
+
+ return status;
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
@@ -1848,470 +1869,244 @@ int xsane_save_blur_image(FILE *outfile, FILE *imagefile, Image_info *image_info
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-int xsane_save_rotate_image(FILE *outfile, FILE *imagefile, Image_info *image_info, int rotation, GtkProgressBar *progress_bar, int *cancel_save)
-/* returns true if operation was cancelled */
-{
- int x, y, pos0, bytespp, i;
- int pixel_width  = image_info->image_width;
- int pixel_height = image_info->image_height;
- float resolution_x = image_info->resolution_x;
- float resolution_y = image_info->resolution_y;
+/* Rotation is done in chunks of output lines, each thread rotates one band of lines of the */
+/* chunk into the output buffer (xsane-rotate.c). The source is either the memory mapped */
+/* file or a part of the image that has been read into memory: the lines that are needed for */
+/* the chunk (0/180 degree) or a strip of columns (90/270 degree, read in one pass through the file). */
 
-#ifdef HAVE_MMAP
- char *mmaped_imagefile = NULL;
-#endif
+#define XSANE_SAVE_ROTATE_BUFFER_SIZE (32 * 1024 * 1024) /* source data that is read into memory at once */
 
-  DBG(DBG_proc, "xsane_save_rotate_image\n");
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-  *cancel_save = 0;
+static int xsane_save_rotate_read_source(XsaneRotate *rotate, FILE *imagefile, long pos0, unsigned char *line_buffer)
+/* reads the part of the image that is needed for the output lines first_line .. end_line-1 */
+{
+ size_t line_size = (size_t) rotate->pixel_width * rotate->bytespp;
+ int y, x_end;
 
-  pos0 = ftell(imagefile); /* mark position to skip header */
+  if (!(rotate->rotation & 1)) /* 0/180 degree: lines of the original image */
+  {
+   int lines = rotate->end_line - rotate->first_line;
 
-  bytespp = image_info->channels;
+    if ((rotate->rotation == 0) || (rotate->rotation == 4))
+    {
+      rotate->y_origin = rotate->first_line;
+    }
+    else
+    {
+      rotate->y_origin = rotate->pixel_height - rotate->end_line;
+    }
 
-  if (image_info->depth > 8)
-  {
-    bytespp *= 2;
-  }
+    rotate->x_origin = 0;
+    rotate->stride   = line_size;
 
-  if (image_info->depth < 8) /* lineart images are expanded to grayscale until transformation is done */
-  {
-    image_info->depth = 8; /* so we have at least 8 bits/pixel here */
+    fseek(imagefile, pos0 + rotate->y_origin * line_size, SEEK_SET);
+    if (fread(rotate->image, line_size, lines, imagefile) != lines)
+    {
+     return -1;
+    }
+   return 0;
   }
 
-#ifdef HAVE_MMAP
-  mmaped_imagefile = mmap(NULL, pixel_width * pixel_height * bytespp + pos0, PROT_READ, MAP_PRIVATE, fileno(imagefile), 0);
-  if (mmaped_imagefile == (char *) -1) /* mmap failed */
+  /* 90/270 degree: a strip of columns of the original image */
+  if ((rotate->rotation == 1) || (rotate->rotation == 5))
   {
-    DBG(DBG_info, "xsane_save_rotate_image: unable to memory map image file, using standard file access\n");
-    mmaped_imagefile = NULL;
+    rotate->x_origin = rotate->first_line;
+    x_end = rotate->end_line;
   }
   else
   {
-    DBG(DBG_info, "xsane_save_rotate_image: using memory mapped image file\n");
+    rotate->x_origin = rotate->pixel_width - rotate->end_line;
+    x_end = rotate->pixel_width - rotate->first_line;
   }
-#endif
-
-  switch (rotation)
-  {
-    default:
-     break;
 
-    case 0: /* 0 degree */
-      xsane_write_pnm_header(outfile, image_info, 0);
+  rotate->y_origin = 0;
+  rotate->stride   = (x_end - rotate->x_origin) * rotate->bytespp;
 
-      for (y = 0; y < pixel_height; y++)
-      {
-        xsane_progress_bar_set_fraction(progress_bar, (float) y / pixel_height);
-
-        for (x = 0; x < pixel_width; x++)
-        {
-#ifdef HAVE_MMAP
-          if (mmaped_imagefile)
-          {
-           char *p = mmaped_imagefile + pos0 + bytespp * (x + y * pixel_width);  /* calculate correct position */
+  fseek(imagefile, pos0, SEEK_SET);
 
-            for (i=0; i<bytespp; i++)
-            {
-              fputc(*p++, outfile);
-            }
-          }
-          else
-#endif
-          {
-            for (i = 0; i < bytespp; i++)
-            {
-              fputc(fgetc(imagefile), outfile);
-            }
-          }
-        }
-
-        if (ferror(outfile))
-        {
-         char buf[TEXTBUFSIZE];
-
-          snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
-          DBG(DBG_error, "%s\n", buf);
-          xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
-          *cancel_save = 1;
-         break;
-        }
-
-        if (*cancel_save)
-        {
-          break;
-        }
-      }
-     break;
+  for (y = 0; y < rotate->pixel_height; y++)
+  {
+    if (fread(line_buffer, line_size, 1, imagefile) != 1)
+    {
+     return -1;
+    }
 
-    case 1: /* 90 degree */
-      image_info->image_width  = pixel_height;
-      image_info->image_height = pixel_width;
+    memcpy(rotate->image + y * rotate->stride, line_buffer + rotate->x_origin * rotate->bytespp, rotate->stride);
+  }
 
-      image_info->resolution_x = resolution_y;
-      image_info->resolution_y = resolution_x;
+ return 0;
+}
 
-      xsane_write_pnm_header(outfile, image_info, 0);
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-      for (x=0; x<pixel_width; x++)
-      {
-        xsane_progress_bar_set_fraction(progress_bar, (float) x / pixel_width);
+int xsane_save_rotate_image(FILE *outfile, FILE *imagefile, Image_info *image_info, int rotation, GtkProgressBar *progress_bar, int *cancel_save)
+/* returns true if operation was cancelled */
+{
+ XsaneRotate rotate;
+ int bands = xsane_parallel_threads();
+ long pos0;
+ int bytespp;
+ int chunk_lines;
+ int out_height;
+ size_t out_line_size;
+ unsigned char *source = NULL;
+ unsigned char *line_buffer = NULL;
+ int pixel_width  = image_info->image_width;
+ int pixel_height = image_info->image_height;
+ float resolution_x = image_info->resolution_x;
+ float resolution_y = image_info->resolution_y;
 
-        for (y=pixel_height-1; y>=0; y--)
-        {
 #ifdef HAVE_MMAP
-          if (mmaped_imagefile)
-          {
-           char *p = mmaped_imagefile + pos0 + bytespp * (x + y * pixel_width); /* calculate correct position */
-
-            for (i=0; i<bytespp; i++)
-            {
-              fputc(*p++, outfile);
-            }
-          }
-          else
+ char *mmaped_imagefile = NULL;
+ struct stat image_stat;
 #endif
-          {
-            fseek(imagefile, pos0 + bytespp * (x + y * pixel_width), SEEK_SET); /* go to the correct position */
-            for (i=0; i<bytespp; i++)
-            {
-              fputc(fgetc(imagefile), outfile);
-            }
-          }
-        }
-
-
-        if (ferror(outfile))
-        {
-         char buf[TEXTBUFSIZE];
-
-          snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
-          DBG(DBG_error, "%s\n", buf);
-          xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
-          *cancel_save = 1;
-         break;
-        }
-
-        if (*cancel_save)
-        {
-          break;
-        }
-      }
-
-     break;
 
-    case 2: /* 180 degree */
-      xsane_write_pnm_header(outfile, image_info, 0);
-
-      for (y = pixel_height-1; y >= 0; y--)
-      {
-        xsane_progress_bar_set_fraction(progress_bar, (float) (pixel_height - y) / pixel_height);
+  DBG(DBG_proc, "xsane_save_rotate_image\n");
 
-        for (x = pixel_width-1; x >= 0; x--)
-        {
-#ifdef HAVE_MMAP
-          if (mmaped_imagefile)
-          {
-           char *p = mmaped_imagefile + pos0 + bytespp * (x + y * pixel_width);  /* calculate correct position */
+  *cancel_save = 0;
 
-            for (i = 0; i < bytespp; i++)
-            {
-              fputc(*p++, outfile);
-            }
-          }
-          else
-#endif
-          {
-            fseek(imagefile, pos0 + bytespp * (x + y * pixel_width), SEEK_SET); /* go to the correct position */
-            for (i = 0; i < bytespp; i++)
-            {
-              fputc(fgetc(imagefile), outfile);
-            }
-          }
-        }
+  if ((rotation < 0) || (rotation > 7))
+  {
+   return 0;
+  }
 
+  pos0 = ftell(imagefile); /* mark position to skip header */
 
-        if (ferror(outfile))
-        {
-         char buf[TEXTBUFSIZE];
+  bytespp = image_info->channels;
 
-          snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
-          DBG(DBG_error, "%s\n", buf);
-          xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
-          *cancel_save = 1;
-         break;
-        }
+  if (image_info->depth > 8)
+  {
+    bytespp *= 2;
+  }
 
-        if (*cancel_save)
-        {
-          break;
-        }
-      }
-     break;
+  if (image_info->depth < 8) /* lineart images are expanded to grayscale until transformation is done */
+  {
+    image_info->depth = 8; /* so we have at least 8 bits/pixel here */
+  }
 
-    case 3: /* 270 degree */
-      image_info->image_width  = pixel_height;
-      image_info->image_height = pixel_width;
+  if (rotation & 1) /* 90 or 270 degree */
+  {
+    image_info->image_width  = pixel_height;
+    image_info->image_height = pixel_width;
 
-      image_info->resolution_x = resolution_y;
-      image_info->resolution_y = resolution_x;
+    image_info->resolution_x = resolution_y;
+    image_info->resolution_y = resolution_x;
+  }
 
-      xsane_write_pnm_header(outfile, image_info, 0);
+  rotate.rotation     = rotation;
+  rotate.pixel_width  = pixel_width;
+  rotate.pixel_height = pixel_height;
+  rotate.bytespp      = bytespp;
+  rotate.out_width    = image_info->image_width;
+  rotate.image        = NULL;
 
-      for (x = pixel_width-1; x >= 0; x--)
-      {
-        xsane_progress_bar_set_fraction(progress_bar, (float) (pixel_width - x) / pixel_width);
+  out_height    = image_info->image_height;
+  out_line_size = (size_t) rotate.out_width * bytespp;
 
-        for (y = 0; y < pixel_height; y++)
-        {
 #ifdef HAVE_MMAP
-          if (mmaped_imagefile)
-          {
-           char *p = mmaped_imagefile + pos0 + bytespp * (x + y * pixel_width);  /* calculate correct position */
+  if ((fstat(fileno(imagefile), &image_stat)) || (image_stat.st_size < pos0 + (off_t) pixel_width * pixel_height * bytespp))
+  {
+    mmaped_imagefile = (char *) -1; /* truncated file, pages behind the end of the file can not be accessed */
+  }
+  else
+  {
+    mmaped_imagefile = mmap(NULL, pixel_width * pixel_height * bytespp + pos0, PROT_READ, MAP_PRIVATE, fileno(imagefile), 0);
+  }
 
-            for (i = 0; i < bytespp; i++)
-            {
-              fputc(*p++, outfile);
-            }
-          }
-          else
+  if (mmaped_imagefile == (char *) -1) /* mmap failed */
+  {
+    DBG(DBG_info, "xsane_save_rotate_image: unable to memory map image file, using standard file access\n");
+    mmaped_imagefile = NULL;
+  }
+  else
+  {
+    DBG(DBG_info, "xsane_save_rotate_image: using memory mapped image file\n");
+    rotate.image    = (unsigned char *) mmaped_imagefile + pos0;
+    rotate.stride   = (long) pixel_width * bytespp;
+    rotate.x_origin = 0;
+    rotate.y_origin = 0;
+  }
 #endif
-          {
-            fseek(imagefile, pos0 + bytespp * (x + y * pixel_width), SEEK_SET); /* go to the correct position */
-            for (i = 0; i < bytespp; i++)
-            {
-              fputc(fgetc(imagefile), outfile);
-            }
-          }
-        }
 
+  chunk_lines = bands * XSANE_ROTATE_TILE;
 
-        if (ferror(outfile))
-        {
-         char buf[TEXTBUFSIZE];
+  if (!rotate.image) /* source data is read into memory, each chunk needs a line or column of the original image per output line */
+  {
+    chunk_lines = MAX(XSANE_SAVE_ROTATE_BUFFER_SIZE / (int) out_line_size, 1);
 
-          snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
-          DBG(DBG_error, "%s\n", buf);
-          xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
-          *cancel_save = 1;
-         break;
-        }
+    source = malloc(chunk_lines * out_line_size);
+    line_buffer = malloc((size_t) pixel_width * bytespp);
 
-        if (*cancel_save)
-        {
-          break;
-        }
-      }
-     break;
+    if (!source || !line_buffer)
+    {
+      DBG(DBG_error, "xsane_save_rotate_image: out of memory\n");
+      free(source);
+      free(line_buffer);
+     return -1;
+    }
 
-    case 4: /* 0 degree, x mirror */
-      xsane_write_pnm_header(outfile, image_info, 0);
+    rotate.image = source;
+  }
 
-      for (y = 0; y < pixel_height; y++)
-      {
-        xsane_progress_bar_set_fraction(progress_bar, (float) y / pixel_height);
+  chunk_lines = MIN(chunk_lines, out_height);
 
-        for (x = pixel_width-1; x >= 0; x--)
-        {
+  rotate.out = malloc(chunk_lines * out_line_size);
+  if (!rotate.out)
+  {
+    DBG(DBG_error, "xsane_save_rotate_image: out of memory\n");
+    free(source);
+    free(line_buffer);
 #ifdef HAVE_MMAP
-          if (mmaped_imagefile)
-          {
-           char *p = mmaped_imagefile + pos0 + bytespp * (x + y * pixel_width);  /* calculate correct position */
-
-            for (i = 0; i < bytespp; i++)
-            {
-              fputc(*p++, outfile);
-            }
-          }
-          else
+    if (mmaped_imagefile)
+    {
+      munmap(mmaped_imagefile, pos0 + pixel_width * pixel_height * bytespp);
+    }
 #endif
-          {
-            fseek(imagefile, pos0 + bytespp * (x + y * pixel_width), SEEK_SET); /* go to the correct position */
-            for (i = 0; i < bytespp; i++)
-            {
-              fputc(fgetc(imagefile), outfile);
-            }
-          }
-        }
-
-
-        if (ferror(outfile))
-        {
-         char buf[TEXTBUFSIZE];
-
-          snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
-          DBG(DBG_error, "%s\n", buf);
-          xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
-          *cancel_save = 1;
-         break;
-        }
-
-        if (*cancel_save)
-        {
-          break;
-        }
-      }
-     break;
+   return -1;
+  }
 
-    case 5: /* 90 degree, x mirror */
-      image_info->image_width  = pixel_height;
-      image_info->image_height = pixel_width;
+  xsane_write_pnm_header(outfile, image_info, 0);
 
-      image_info->resolution_x = resolution_y;
-      image_info->resolution_y = resolution_x;
+  for (rotate.first_line = 0; rotate.first_line < out_height; rotate.first_line += chunk_lines)
+  {
+    xsane_progress_bar_set_fraction(progress_bar, (float) rotate.first_line / out_height);
 
-      xsane_write_pnm_header(outfile, image_info, 0);
+    rotate.end_line = MIN(rotate.first_line + chunk_lines, out_height);
 
-      for (x = 0; x < pixel_width; x++)
+    if (source)
+    {
+      if (xsane_save_rotate_read_source(&rotate, imagefile, pos0, line_buffer))
       {
-        xsane_progress_bar_set_fraction(progress_bar, (float) x / pixel_width);
-
-        for (y = 0; y < pixel_height; y++)
-        {
-#ifdef HAVE_MMAP
-          if (mmaped_imagefile)
-          {
-           char *p = mmaped_imagefile + pos0 + bytespp * (x + y * pixel_width); /* calculate correct position */
-
-            for (i=0; i<bytespp; i++)
-            {
-              fputc(*p++, outfile);
-            }
-          }
-          else
-#endif
-          {
-            fseek(imagefile, pos0 + bytespp * (x + y * pixel_width), SEEK_SET); /* go to the correct position */
-            for (i = 0; i < bytespp; i++)
-            {
-              fputc(fgetc(imagefile), outfile);
-            }
-          }
-        }
-
-
-        if (ferror(outfile))
-        {
-         char buf[TEXTBUFSIZE];
-
-          snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
-          DBG(DBG_error, "%s\n", buf);
-          xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
-          *cancel_save = 1;
-         break;
-        }
+       char buf[TEXTBUFSIZE];
 
-        if (*cancel_save)
-        {
-          break;
-        }
+        snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_READ, (ferror(imagefile)) ? strerror(errno) : ""); /* short read: truncated file */
+        DBG(DBG_error, "xsane_save_rotate_image: %s\n", buf);
+        xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
+        *cancel_save = 1;
+       break; /* the source buffer does not hold valid data */
       }
+    }
 
-     break;
-
-    case 6: /* 180 degree, x mirror */
-      xsane_write_pnm_header(outfile, image_info, 0);
-
-      for (y = pixel_height-1; y >= 0; y--)
-      {
-        xsane_progress_bar_set_fraction(progress_bar, (float) (pixel_height - y) / pixel_height);
-
-        for (x = 0; x < pixel_width; x++)
-        {
-#ifdef HAVE_MMAP
-          if (mmaped_imagefile)
-          {
-           char *p = mmaped_imagefile + pos0 + bytespp * (x + y * pixel_width);  /* calculate correct position */
-
-            for (i = 0; i < bytespp; i++)
-            {
-              fputc(*p++, outfile);
-            }
-          }
-          else
-#endif
-          {
-            fseek(imagefile, pos0 + bytespp * (x + y * pixel_width), SEEK_SET); /* go to the correct position */
-            for (i = 0; i < bytespp; i++)
-            {
-              fputc(fgetc(imagefile), outfile);
-            }
-          }
-        }
-
+    xsane_parallel_run(xsane_rotate_band, &rotate, bands);
 
-        if (ferror(outfile))
-        {
-         char buf[TEXTBUFSIZE];
+    fwrite(rotate.out, out_line_size, rotate.end_line - rotate.first_line, outfile);
 
-          snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
-          DBG(DBG_error, "%s\n", buf);
-          xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
-          *cancel_save = 1;
-         break;
-        }
+    if (ferror(outfile))
+    {
+     char buf[TEXTBUFSIZE];
 
-        if (*cancel_save)
-        {
-          break;
-        }
-      }
+      snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
+      DBG(DBG_error, "%s\n", buf);
+      xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
+      *cancel_save = 1;
      break;
+    }
 
-    case 7: /* 270 degree, x mirror */
-      image_info->image_width  = pixel_height;
-      image_info->image_height = pixel_width;
-
-      image_info->resolution_x = resolution_y;
-      image_info->resolution_y = resolution_x;
-
-      xsane_write_pnm_header(outfile, image_info, 0);
-
-      for (x = pixel_width-1; x >= 0; x--)
-      {
-        xsane_progress_bar_set_fraction(progress_bar, (float) (pixel_width - x) / pixel_width);
-
-        for (y = pixel_height-1; y >= 0; y--)
-        {
-#ifdef HAVE_MMAP
-          if (mmaped_imagefile)
-          {
-           char *p = mmaped_imagefile + pos0 + bytespp * (x + y * pixel_width);  /* calculate correct position */
-
-            for (i = 0; i < bytespp; i++)
-            {
-              fputc(*p++, outfile);
-            }
-          }
-          else
-#endif
-          {
-            fseek(imagefile, pos0 + bytespp * (x + y * pixel_width), SEEK_SET); /* go to the correct position */
-            for (i = 0; i < bytespp; i++)
-            {
-              fputc(fgetc(imagefile), outfile);
-            }
-          }
-        }
-
-
-        if (ferror(outfile))
-        {
-         char buf[TEXTBUFSIZE];
-
-          snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
-          DBG(DBG_error, "%s\n", buf);
-          xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
-          *cancel_save = 1;
-         break;
-        }
-
-        if (*cancel_save)
-        {
-          break;
-        }
-      }
-     break;
+    if (*cancel_save)
+    {
+      break;
+    }
   }
 
 #ifdef HAVE_MMAP
@@ -2321,9 +2116,13 @@ int xsane_save_rotate_image(FILE *outfile, FILE *imagefile, Image_info *image_in
   }
 #endif
 
+  free(rotate.out);
+  free(source);
+  free(line_buffer);
+
   fflush(outfile);
 
-  return (*cancel_save);
+ return (*cancel_save);
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
@@ -2458,425 +2257,423 @@ static void xsane_save_ps_create_image_header(FILE *outfile,
   fprintf(outfile, "\n");
   fprintf(outfile, ">>\n");
   {
-    fprintf(outfile, "image\n");
-    fprintf(outfile, "\n");
+    fprintf(outfile, "image\n");
+    fprintf(outfile, "\n");
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_save_ps_create_page_trailer(FILE *outfile)
+{
+  fprintf(outfile, "\n");
+  fprintf(outfile, "showpage\n");
+  fprintf(outfile, "%%%%PageTrailer\n");
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* An XsaneSaveStream encodes the data of one PS or PDF stream: zlib compression (FlateDecode) */
+/* and/or ASCII85 encoding. All state is kept in the stream, so several documents can be */
+/* written at the same time. The data is compressed in blocks of XSANE_SAVE_DEFLATE_BLOCK bytes */
+/* that are processed by the filter threads (one block per thread and batch). Each block is */
+/* compressed as raw deflate data with the last 32 KB of the preceding data as dictionary and */
+/* is finished with a sync flush, so the concatenated blocks form one zlib stream. The output */
+/* does not depend on the number of threads. */
+
+#define XSANE_SAVE_DEFLATE_BLOCK  (128 * 1024)
+#define XSANE_SAVE_DEFLATE_WINDOW (32 * 1024)
+#define XSANE_SAVE_A85_LINE_LEN 40
+
+#ifdef HAVE_LIBZ
+typedef struct
+{
+  z_stream zstream;		/* reused for all blocks of the slot */
+  int initialized;
+  unsigned char *out;
+  size_t out_size;
+  size_t out_len;
+  int error;
+} XsaneSaveDeflateSlot;
+#endif
+
+typedef struct
+{
+  FILE *outfile;
+  int ascii85;			/* ASCII85 encode the (compressed) data */
+  int flatedecode;		/* zlib compress the data */
+
+  guint32 a85tuple;
+  int a85count;			/* bytes in a85tuple */
+  int a85column;		/* characters in the current output line */
+
+#ifdef HAVE_LIBZ
+  int slots;			/* blocks per batch */
+  XsaneSaveDeflateSlot *slot;
+  unsigned char *data;		/* XSANE_SAVE_DEFLATE_WINDOW bytes of preceding data followed by the blocks */
+  size_t dictionary_len;	/* valid bytes of preceding data */
+  size_t data_len;		/* collected bytes for the blocks */
+  int blocks;			/* blocks in the batch */
+  int finish;			/* the last block of the batch ends the stream */
+  uLong adler;			/* adler32 checksum of the uncompressed data */
+  int header_written;
+#endif
+} XsaneSaveStream;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_save_stream_a85_putc(XsaneSaveStream *stream, int c)
+{
+  if (stream->a85column == XSANE_SAVE_A85_LINE_LEN)
+  {
+    putc('\n', stream->outfile);
+    stream->a85column = 0;
   }
+
+  putc(c, stream->outfile);
+  stream->a85column++;
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-static void xsane_save_ps_create_page_trailer(FILE *outfile)
+static void xsane_save_stream_a85_tuple(XsaneSaveStream *stream, int bytes)
+/* writes the first bytes + 1 characters of the ASCII85 code of a85tuple */
 {
-  fprintf(outfile, "\n");
-  fprintf(outfile, "showpage\n");
-  fprintf(outfile, "%%%%PageTrailer\n");
+ unsigned char a85block[5];
+ guint32 tuple = stream->a85tuple;
+ int j;
+
+  for (j = 4; j >= 0; j--)
+  {
+    a85block[j] = tuple % 85 + '!';
+    tuple /= 85;
+  }
+
+  for (j = 0; j <= bytes; j++)
+  {
+    xsane_save_stream_a85_putc(stream, a85block[j]);
+  }
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-#ifdef HAVE_LIBZ
-/* Utility function for the PDF output */
-static int xsane_write_flatedecode(FILE *outfile, unsigned char *line, int len, int finish)
+static void xsane_save_stream_output(XsaneSaveStream *stream, unsigned char *data, size_t len)
+/* writes encoded data to the file */
 {
-  static unsigned char *cbuf = NULL;
-  static int cbuflen = 0;
-  static int linelen = 0;
-  int outlen;
-  static int init = 0;
-  static z_stream s;
-  int ret;
-  int flush;
-  static int count = 0;
+ size_t i;
 
-  DBG(DBG_proc, "xsane_write_flatedecode\n");
+  if (!stream->ascii85)
+  {
+    fwrite(data, 1, len, stream->outfile);
+   return;
+  }
 
-  if (linelen != len)
+  for (i = 0; i < len; i++)
   {
-    linelen = len;
-    if (cbuf != NULL)
+    stream->a85tuple |= (guint32) data[i] << (24 - 8 * stream->a85count);
+    stream->a85count++;
+
+    if (stream->a85count == 4)
     {
-      free(cbuf);
+      if (stream->a85tuple == 0)
+      {
+        xsane_save_stream_a85_putc(stream, 'z');
+      }
+      else
+      {
+        xsane_save_stream_a85_tuple(stream, 4);
+      }
+
+      stream->a85tuple = 0;
+      stream->a85count = 0;
     }
-    /* buffer length = length + 0.1 * length + 12 (mandatory) */
-    cbuflen = len + len / 10 + 12;
-    cbuf = malloc(cbuflen);
   }
+}
 
-  if (cbuf == NULL)
-  {
-    DBG(DBG_error, "cbuf allocation failed\n");
-   return 1;
-  }
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-  if (!init)
-  {
-    s.zalloc = Z_NULL;
-    s.zfree = Z_NULL;
-    s.opaque = Z_NULL;
+#ifdef HAVE_LIBZ
+static void xsane_save_stream_deflate_band(void *data, int band, int bands)
+{
+ XsaneSaveStream *stream = data;
+ int block;
 
-    ret = deflateInit(&s, Z_DEFAULT_COMPRESSION);
+  for (block = band; block < stream->blocks; block += bands)
+  {
+   XsaneSaveDeflateSlot *slot = &stream->slot[block];
+   unsigned char *block_data = stream->data + XSANE_SAVE_DEFLATE_WINDOW + (size_t) block * XSANE_SAVE_DEFLATE_BLOCK;
+   size_t block_len = stream->data_len - (size_t) block * XSANE_SAVE_DEFLATE_BLOCK;
+   size_t dictionary_len = stream->dictionary_len + (size_t) block * XSANE_SAVE_DEFLATE_BLOCK;
+   int last = stream->finish && (block == stream->blocks - 1);
+   int ret;
 
-    if (ret != Z_OK)
+    if (block_len > XSANE_SAVE_DEFLATE_BLOCK)
     {
-      DBG(DBG_error, "deflateInit failed\n");
-      free(cbuf);
-     return 1;
+      block_len = XSANE_SAVE_DEFLATE_BLOCK;
     }
 
-    init = 1;
-  }
-  
-  s.avail_in = len;
-  s.next_in = line;
-
-  do
-  {
-    s.avail_out = cbuflen;
-    s.next_out = cbuf;
+    if (dictionary_len > XSANE_SAVE_DEFLATE_WINDOW)
+    {
+      dictionary_len = XSANE_SAVE_DEFLATE_WINDOW;
+    }
 
-    flush = (finish) ? Z_FINISH : Z_NO_FLUSH;
+    slot->error = (deflateReset(&slot->zstream) != Z_OK);
 
-    ret = deflate(&s, flush);
+    if (!slot->error && dictionary_len)
+    {
+      slot->error = (deflateSetDictionary(&slot->zstream, block_data - dictionary_len, dictionary_len) != Z_OK);
+    }
 
-    if (ret == Z_STREAM_ERROR)
+    if (slot->error)
     {
-      DBG(DBG_error, "deflate failed\n");
-      free(cbuf);
-     return 1;
+      continue;
     }
 
-    outlen = cbuflen - s.avail_out;
+    slot->zstream.next_in   = block_data;
+    slot->zstream.avail_in  = block_len;
+    slot->zstream.next_out  = slot->out;
+    slot->zstream.avail_out = slot->out_size;
 
-    fwrite(cbuf, outlen, 1, outfile);
-  } while (s.avail_out == 0);
+    ret = deflate(&slot->zstream, last ? Z_FINISH : Z_SYNC_FLUSH);
 
-  if (finish)
-  {
-    DBG(DBG_info, "xsane_write_flatedecode finished\n");
-    deflateEnd(&s);
-    free(cbuf);
-    cbuf = NULL;
-    init = 0;
-    cbuflen = 0;
-    linelen = 0;
-    count = 0;
+    /* the output buffer is large enough for the whole block, otherwise something went wrong */
+    slot->error   = (ret != (last ? Z_STREAM_END : Z_OK)) || (slot->zstream.avail_in != 0) || (slot->zstream.avail_out == 0);
+    slot->out_len = slot->out_size - slot->zstream.avail_out;
   }
-
- return 0;
 }
-#endif
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-#ifdef HAVE_LIBZ
-/* Utility function for the PostScript output */
-static int xsane_write_compressed_a85_flatedecode(FILE *outfile, unsigned char *line, int len, int finish)
+static int xsane_save_stream_deflate(XsaneSaveStream *stream, int finish)
+/* compresses the collected blocks and writes them in order */
 {
-  static unsigned char *cbuf = NULL;
-  static int cbuflen = 0;
-  static int linelen = 0;
-  int i, j;
-  int outlen;
-  static int init = 0;
-  static z_stream s;
-  int ret;
-  int flush;
-  static int a85count = 0;
-  static guint32 a85tuple = 0;
-  static unsigned char a85block[6] = {0, 0, 0, 0, 0, 0};
-  static int count = 0;
+ unsigned char header[2] = {0x78, 0x9c}; /* deflate with 32 KB window, default compression */
+ size_t keep;
+ int block;
 
-  DBG(DBG_proc, "xsane_write_compressed_a85_flatedecode\n");
+  stream->blocks = (stream->data_len + XSANE_SAVE_DEFLATE_BLOCK - 1) / XSANE_SAVE_DEFLATE_BLOCK;
+  stream->finish = finish;
 
-  if (linelen != len)
+  if (finish && !stream->blocks) /* an empty final block ends the stream */
   {
-    linelen = len;
-    if (cbuf != NULL)
-    {
-      free(cbuf);
-    }
-    /* buffer length = length + 0.1 * length + 12 (mandatory) */
-    cbuflen = len + len / 10 + 12;
-    cbuf = malloc(cbuflen);
+    stream->blocks = 1;
   }
 
-  if (cbuf == NULL)
+  for (block = 0; block < stream->blocks; block++)
   {
-    DBG(DBG_error, "cbuf allocation failed\n");
-   return 1;
-  }
+   XsaneSaveDeflateSlot *slot = &stream->slot[block];
 
-  if (!init)
-  {
-    s.zalloc = Z_NULL;
-    s.zfree = Z_NULL;
-    s.opaque = Z_NULL;
+    if (!slot->initialized)
+    {
+      memset(&slot->zstream, 0, sizeof(z_stream));
 
-    ret = deflateInit(&s, Z_DEFAULT_COMPRESSION);
+      /* negative window bits: raw deflate data without zlib header and checksum */
+      if (deflateInit2(&slot->zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      {
+        DBG(DBG_error, "xsane_save_stream_deflate: deflateInit2 failed\n");
+       return 1;
+      }
+      slot->initialized = TRUE;
 
-    if (ret != Z_OK)
-    {
-      DBG(DBG_error, "deflateInit failed\n");
-      free(cbuf);
-     return 1;
-    }
+      /* the sync flush marker and the final block need a few bytes more than deflateBound */
+      slot->out_size = deflateBound(&slot->zstream, XSANE_SAVE_DEFLATE_BLOCK) + 64;
+      slot->out      = malloc(slot->out_size);
 
-    init = 1;
+      if (!slot->out)
+      {
+        DBG(DBG_error, "xsane_save_stream_deflate: out of memory\n");
+       return 1;
+      }
+    }
   }
-  
-  s.avail_in = len;
-  s.next_in = line;
 
-  do
-  {
-    s.avail_out = cbuflen;
-    s.next_out = cbuf;
+  stream->adler = adler32(stream->adler, stream->data + XSANE_SAVE_DEFLATE_WINDOW, stream->data_len);
 
-    flush = (finish) ? Z_FINISH : Z_NO_FLUSH;
+  xsane_parallel_run(xsane_save_stream_deflate_band, stream, xsane_parallel_threads());
 
-    ret = deflate(&s, flush);
+  if (!stream->header_written)
+  {
+    xsane_save_stream_output(stream, header, sizeof(header));
+    stream->header_written = TRUE;
+  }
 
-    if (ret == Z_STREAM_ERROR)
+  for (block = 0; block < stream->blocks; block++)
+  {
+    if (stream->slot[block].error)
     {
-      DBG(DBG_error, "deflate failed\n");
-      free(cbuf);
+      DBG(DBG_error, "xsane_save_stream_deflate: deflate failed\n");
      return 1;
     }
 
-    outlen = cbuflen - s.avail_out;
+    xsane_save_stream_output(stream, stream->slot[block].out, stream->slot[block].out_len);
+  }
 
-    /* ASCII85 (base 85) encoding */
-    for (i = 0; i < outlen; i++)
-    {
-      switch (a85count)
-      {
-        case 0:
-          a85tuple |= (cbuf[i] << 24);
-          a85count++;
-         break;
+  /* the end of the data is the dictionary of the next batch */
+  keep = stream->dictionary_len + stream->data_len;
+  if (keep > XSANE_SAVE_DEFLATE_WINDOW)
+  {
+    keep = XSANE_SAVE_DEFLATE_WINDOW;
+  }
+  memmove(stream->data + XSANE_SAVE_DEFLATE_WINDOW - keep, stream->data + XSANE_SAVE_DEFLATE_WINDOW + stream->data_len - keep, keep);
+  stream->dictionary_len = keep;
+  stream->data_len = 0;
 
-        case 1:
-          a85tuple |= (cbuf[i] << 16);
-          a85count++;
-         break;
+ return 0;
+}
+#endif
 
-        case 2:
-          a85tuple |= (cbuf[i] << 8);
-          a85count++;
-         break;
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-        case 3:
-          a85tuple |= (cbuf[i] << 0);
+static XsaneSaveStream *xsane_save_stream_new(FILE *outfile, int ascii85, int flatedecode)
+{
+ XsaneSaveStream *stream;
 
-          if (count == 40)
-          {
-            fprintf(outfile, "\n");
-            count = 0;
-          }
+  DBG(DBG_proc, "xsane_save_stream_new(ascii85=%d, flatedecode=%d)\n", ascii85, flatedecode);
 
-          if (a85tuple == 0)
-          {
-            fprintf(outfile, "z");
-            count++;
-          }
-          else
-          {
-            /* The ASCII chars must be written in reverse order, hence -> a85block[4-j] */
-            for (j = 0; j < 5; j++)
-            {
-              a85block[4-j] = a85tuple % 85 + '!';
-              a85tuple /= 85;
-            }
+  stream = calloc(1, sizeof(XsaneSaveStream));
+  if (!stream)
+  {
+   return NULL;
+  }
 
-            for (j = 0; j < 5; j++)
-            {
-              fprintf(outfile, "%c", a85block[j]);
-              count++;
-              if (count == 40)
-              {
-                fprintf(outfile, "\n");
-                count = 0;
-              }
-            }
-          }
+  stream->outfile = outfile;
+  stream->ascii85 = ascii85;
 
-          a85count = 0;
-          a85tuple = 0;
-         break;
+#ifdef HAVE_LIBZ
+  stream->flatedecode = flatedecode;
 
-        default:
-         break;
-      }
+  if (flatedecode)
+  {
+    stream->slots = xsane_parallel_threads();
+    stream->slot  = calloc(stream->slots, sizeof(XsaneSaveDeflateSlot));
+    stream->data  = malloc(XSANE_SAVE_DEFLATE_WINDOW + (size_t) stream->slots * XSANE_SAVE_DEFLATE_BLOCK);
+    stream->adler = adler32(0L, Z_NULL, 0);
+
+    if (!stream->slot || !stream->data)
+    {
+      free(stream->slot);
+      free(stream->data);
+      free(stream);
+     return NULL;
     }
-  } while (s.avail_out == 0);
+  }
+#endif
+
+ return stream;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-  if (finish)
+static int xsane_save_stream_write(XsaneSaveStream *stream, unsigned char *data, size_t len)
+/* returns 0 on success, otherwise there was a zlib error */
+{
+#ifdef HAVE_LIBZ
+  if (stream->flatedecode)
   {
-    DBG(DBG_info, "finish\n");
-    if (a85count > 0)
+   size_t batch_size = (size_t) stream->slots * XSANE_SAVE_DEFLATE_BLOCK;
+   size_t chunk;
+
+    while (len)
     {
-      a85count++;
-      for (j = 0; j <= a85count; j++)
+      /* a full batch is compressed when more data follows, so the last block always ends the stream */
+      if ((stream->data_len == batch_size) && xsane_save_stream_deflate(stream, FALSE))
       {
-        a85block[j] = a85tuple % 85 + '!';
-        a85tuple /= 85;
+       return 1;
       }
-      /* Reverse order */
-      for (j--; j > 0; j--)
+
+      chunk = batch_size - stream->data_len;
+      if (chunk > len)
       {
-        if (count == 40)
-        {
-          fprintf(outfile, "\n");
-          count = 0;
-        }
-        fprintf(outfile, "%c", a85block[j]);
-        count++;
+        chunk = len;
       }
-    }
 
-    /* ASCII85 EOD marker + newline*/
-    if (count + 2 > 40)
-    {
-      fprintf(outfile, "\n");
+      memcpy(stream->data + XSANE_SAVE_DEFLATE_WINDOW + stream->data_len, data, chunk);
+      stream->data_len += chunk;
+      data += chunk;
+      len  -= chunk;
     }
-    fprintf(outfile, "~>\n");
-    deflateEnd(&s);
-    free(cbuf);
-    cbuf = NULL;
-    init = 0;
-    a85tuple = 0;
-    a85count = 0;
-    cbuflen = 0;
-    linelen = 0;
-    count = 0;
+
+   return 0;
   }
+#endif
+
+  xsane_save_stream_output(stream, data, len);
 
  return 0;
 }
-#endif
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-/* Utility function for the PostScript output */
-static int xsane_write_compressed_a85(FILE *outfile, unsigned char *line, int len, int finish)
+static int xsane_save_stream_finish(XsaneSaveStream *stream)
+/* writes the remaining data and the end of the stream */
 {
-  static unsigned char *cbuf = NULL;
-  static int cbuflen = 0;
-  static int linelen = 0;
-  int i, j;
-  int outlen;
-  static int a85count = 0;
-  static guint32 a85tuple = 0;
-  static unsigned char a85block[6] = {0, 0, 0, 0, 0, 0};
-  static int count = 0;
-
-  DBG(DBG_proc, "xsane_write_compressed_a85\n");
+  DBG(DBG_proc, "xsane_save_stream_finish\n");
 
-    cbuf = line;
-    outlen = len;
+#ifdef HAVE_LIBZ
+  if (stream->flatedecode)
+  {
+   unsigned char trailer[4];
 
-    /* ASCII85 (base 85) encoding */
-    for (i = 0; i < outlen; i++)
+    if (xsane_save_stream_deflate(stream, TRUE))
     {
-      switch (a85count)
-      {
-        case 0:
-          a85tuple |= (cbuf[i] << 24);
-          a85count++;
-         break;
-
-        case 1:
-          a85tuple |= (cbuf[i] << 16);
-          a85count++;
-         break;
-
-        case 2:
-          a85tuple |= (cbuf[i] << 8);
-          a85count++;
-         break;
+     return 1;
+    }
 
-        case 3:
-          a85tuple |= (cbuf[i] << 0);
+    trailer[0] = (stream->adler >> 24) & 255;
+    trailer[1] = (stream->adler >> 16) & 255;
+    trailer[2] = (stream->adler >>  8) & 255;
+    trailer[3] =  stream->adler        & 255;
+    xsane_save_stream_output(stream, trailer, sizeof(trailer));
+  }
+#endif
 
-          if (count == 40)
-          {
-            fprintf(outfile, "\n");
-            count = 0;
-          }
+  if (stream->ascii85)
+  {
+    if (stream->a85count > 0)
+    {
+      xsane_save_stream_a85_tuple(stream, stream->a85count);
+    }
 
-          if (a85tuple == 0)
-          {
-            fprintf(outfile, "z");
-            count++;
-          }
-          else
-          {
-            /* The ASCII chars must be written in reverse order, hence -> a85block[4-j] */
-            for (j = 0; j < 5; j++)
-            {
-              a85block[4-j] = a85tuple % 85 + '!';
-              a85tuple /= 85;
-            }
+    /* ASCII85 EOD marker + newline */
+    if (stream->a85column + 2 > XSANE_SAVE_A85_LINE_LEN)
+    {
+      putc('\n', stream->outfile);
+    }
+    fprintf(stream->outfile, "~>\n");
+  }
 
-            for (j = 0; j < 5; j++)
-            {
-              fprintf(outfile, "%c", a85block[j]);
-              count++;
-              if (count == 40)
-              {
-                fprintf(outfile, "\n");
-                count = 0;
-              }
-            }
-          }
+ return 0;
+}
 
-          a85count = 0;
-          a85tuple = 0;
-         break;
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-        default:
-         break;
-      }
-    }
+static void xsane_save_stream_free(XsaneSaveStream *stream)
+{
+  if (!stream)
+  {
+    return;
+  }
 
-  if (finish)
+#ifdef HAVE_LIBZ
+  if (stream->slot)
   {
-    DBG(DBG_info, "finish\n");
-    if (a85count > 0)
+   int i;
+
+    for (i = 0; i < stream->slots; i++)
     {
-      a85count++;
-      for (j = 0; j <= a85count; j++)
-      {
-        a85block[j] = a85tuple % 85 + '!';
-        a85tuple /= 85;
-      }
-      /* Reverse order */
-      for (j--; j > 0; j--)
+      if (stream->slot[i].initialized)
       {
-        if (count == 40)
-        {
-          fprintf(outfile, "\n");
-          count = 0;
-        }
-        fprintf(outfile, "%c", a85block[j]);
-        count++;
+        deflateEnd(&stream->slot[i].zstream);
       }
+      free(stream->slot[i].out);
     }
-
-    /* ASCII85 EOD marker + newline*/
-    if (count + 2 > 40)
-    {
-      fprintf(outfile, "\n");
-    }
-    fprintf(outfile, "~>\n");
-    a85tuple = 0;
-    a85count = 0;
-    cbuflen = 0;
-    linelen = 0;
-    count = 0;
   }
 
- return 0;
+  free(stream->slot);
+  free(stream->data);
+#endif
+
+  free(stream);
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
@@ -2970,6 +2767,7 @@ static int xsane_save_ps_pdf_bw(FILE *outfile, FILE *imagefile, Image_info *imag
  int x, y;
  int bytes_per_line = (image_info->image_width+7)/8;
  int ret = 0;
+ XsaneSaveStream *stream;
  unsigned char *line;
 
   DBG(DBG_proc, "xsane_save_ps_pdf_bw\n");
@@ -2989,7 +2787,18 @@ static int xsane_save_ps_pdf_bw(FILE *outfile, FILE *imagefile, Image_info *imag
    return (*cancel_save);
   }
 
-  for (y = 0; y < image_info->image_height; y++)
+  stream = xsane_save_stream_new(outfile, ascii85decode, flatedecode);
+  if (!stream)
+  {
+   char buf[TEXTBUFSIZE];
+
+    snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, ERR_ZLIB);
+    DBG(DBG_error, "%s\n", buf);
+    xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
+    *cancel_save = 1;
+  }
+
+  for (y = 0; (stream) && (y < image_info->image_height); y++)
   {
     xsane_progress_bar_set_fraction(progress_bar, (float) y / image_info->image_height);
 
@@ -2998,29 +2807,11 @@ static int xsane_save_ps_pdf_bw(FILE *outfile, FILE *imagefile, Image_info *imag
       line[x] = fgetc(imagefile) ^ 255;
     }
 
-    if (ascii85decode)
-    {
-#ifdef HAVE_LIBZ
-      if (flatedecode)
-      {
-        ret = xsane_write_compressed_a85_flatedecode(outfile, line, bytes_per_line, (y == image_info->image_height - 1));
-      }
-      else
-#endif
-      {
-        ret = xsane_write_compressed_a85(outfile, line, bytes_per_line, (y == image_info->image_height - 1));
-      }
-    }
-#ifdef HAVE_LIBZ
-    else if (flatedecode)
-    {
-      ret = xsane_write_flatedecode(outfile, line, bytes_per_line, (y == image_info->image_height - 1));
-    }
-#endif
-    else
+    ret = xsane_save_stream_write(stream, line, bytes_per_line);
+
+    if ((ret == 0) && (y == image_info->image_height - 1))
     {
-      fwrite(line, bytes_per_line, 1, outfile);
-      ret = 0;
+      ret = xsane_save_stream_finish(stream);
     }
 
     if ((ret != 0) || (ferror(outfile)))
@@ -3049,6 +2840,7 @@ static int xsane_save_ps_pdf_bw(FILE *outfile, FILE *imagefile, Image_info *imag
     }
   }
 
+  xsane_save_stream_free(stream);
   free(line);
 
  return (*cancel_save);
@@ -3056,10 +2848,11 @@ static int xsane_save_ps_pdf_bw(FILE *outfile, FILE *imagefile, Image_info *imag
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-static int xsane_save_ps_pdf_gray(FILE *outfile, FILE *imagefile, Image_info *image_info, int ascii85decode, int flatedecode, cmsHTRANSFORM hTransform, int do_transform, GtkProgressBar *progress_bar, int *cancel_save)
+static int xsane_save_ps_pdf_gray(FILE *outfile, FILE *imagefile, Image_info *image_info, int ascii85decode, int flatedecode, XsaneCmsTransform *hTransform, int do_transform, GtkProgressBar *progress_bar, int *cancel_save)
 {
  int x, y;
  int ret = 0;
+ XsaneSaveStream *stream;
  unsigned char *line = NULL, *linep = NULL, *line16 = NULL;
  int bytes_per_line;
  int bytes_per_line16 = 0;
@@ -3153,7 +2946,18 @@ static int xsane_save_ps_pdf_gray(FILE *outfile, FILE *imagefile, Image_info *im
   }
 #endif
 
-  for (y = 0; y < image_info->image_height; y++)
+  stream = xsane_save_stream_new(outfile, ascii85decode, flatedecode);
+  if (!stream)
+  {
+   char buf[TEXTBUFSIZE];
+
+    snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, ERR_ZLIB);
+    DBG(DBG_error, "%s\n", buf);
+    xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
+    *cancel_save = 1;
+  }
+
+  for (y = 0; (stream) && (y < image_info->image_height); y++)
   {
     if (image_info->depth > 8) /* reduce 16 bit images */
     {
@@ -3171,7 +2975,7 @@ static int xsane_save_ps_pdf_gray(FILE *outfile, FILE *imagefile, Image_info *im
       if (do_transform && (hTransform != NULL))
       {
         bytes_read = fread(line_raw, 2, image_info->image_width, imagefile);
-        cmsDoTransform(hTransform, line_raw, line16, image_info->image_width);
+        xsane_cms_transform_apply(hTransform, line_raw, line16, image_info->image_width);
       }
       else
 #endif
@@ -3224,7 +3028,7 @@ static int xsane_save_ps_pdf_gray(FILE *outfile, FILE *imagefile, Image_info *im
       if (do_transform && (hTransform != NULL))
       {
         bytes_read = fread(line_raw, 1, image_info->image_width, imagefile);
-        cmsDoTransform(hTransform, line_raw, line, image_info->image_width);
+        xsane_cms_transform_apply(hTransform, line_raw, line, image_info->image_width);
       }
       else
 #endif
@@ -3233,29 +3037,11 @@ static int xsane_save_ps_pdf_gray(FILE *outfile, FILE *imagefile, Image_info *im
       }
     }
 
-    if (ascii85decode)
-    {
-#ifdef HAVE_LIBZ
-      if (flatedecode)
-      {
-        ret = xsane_write_compressed_a85_flatedecode(outfile, line, bytes_per_line, (y == image_info->image_height - 1));
-      }
-      else
-#endif
-      {
-        ret = xsane_write_compressed_a85(outfile, line, bytes_per_line, (y == image_info->image_height - 1));
-      }
-    }
-#ifdef HAVE_LIBZ
-    else if (flatedecode)
-    {
-      ret = xsane_write_flatedecode(outfile, line, bytes_per_line, (y == image_info->image_height - 1));
-    }
-#endif
-    else
+    ret = xsane_save_stream_write(stream, line, bytes_per_line);
+
+    if ((ret == 0) && (y == image_info->image_height - 1))
     {
-      fwrite(line, bytes_per_line, 1, outfile);
-      ret = 0;
+      ret = xsane_save_stream_finish(stream);
     }
 
     if ((ret != 0) || (ferror(outfile)))
@@ -3298,6 +3084,7 @@ static int xsane_save_ps_pdf_gray(FILE *outfile, FILE *imagefile, Image_info *im
     free(line16);
   }
 
+  xsane_save_stream_free(stream);
   free(line);
 
  return (*cancel_save);
@@ -3306,11 +3093,12 @@ static int xsane_save_ps_pdf_gray(FILE *outfile, FILE *imagefile, Image_info *im
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 static int xsane_save_ps_pdf_color(FILE *outfile, FILE *imagefile, Image_info *image_info, int ascii85decode, int flatedecode,
-                                   cmsHTRANSFORM hTransform, int do_transform,
+                                   XsaneCmsTransform *hTransform, int do_transform,
                                    GtkProgressBar *progress_bar, int *cancel_save)
 {
  int x, y;
  int ret = 0;
+ XsaneSaveStream *stream;
  unsigned char *line = NULL, *linep = NULL, *line16 = NULL;
  int bytes_per_line;
  int bytes_per_line16 = 0;
@@ -3407,7 +3195,18 @@ static int xsane_save_ps_pdf_color(FILE *outfile, FILE *imagefile, Image_info *i
   }
 #endif
  
-  for (y = 0; y < image_info->image_height; y++)
+  stream = xsane_save_stream_new(outfile, ascii85decode, flatedecode);
+  if (!stream)
+  {
+   char buf[TEXTBUFSIZE];
+
+    snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, ERR_ZLIB);
+    DBG(DBG_error, "%s\n", buf);
+    xsane_back_gtk_decision(ERR_HEADER_ERROR, (gchar **) error_xpm, buf, BUTTON_OK, NULL, TRUE /* wait */);
+    *cancel_save = 1;
+  }
+
+  for (y = 0; (stream) && (y < image_info->image_height); y++)
   {
     xsane_progress_bar_set_fraction(progress_bar, (float) y / image_info->image_height);
 
@@ -3419,7 +3218,7 @@ static int xsane_save_ps_pdf_color(FILE *outfile, FILE *imagefile, Image_info *i
       if (do_transform && (hTransform != NULL))
       {
         bytes_read = fread(line_raw, 6, image_info->image_width, imagefile);
-        cmsDoTransform(hTransform, line_raw, line16, image_info->image_width);
+        xsane_cms_transform_apply(hTransform, line_raw, line16, image_info->image_width);
       }
       else
 #endif
@@ -3479,7 +3278,7 @@ static int xsane_save_ps_pdf_color(FILE *outfile, FILE *imagefile, Image_info *i
       if (do_transform && (hTransform != NULL))
       {
         bytes_read = fread(line_raw, 3, image_info->image_width, imagefile);
-        cmsDoTransform(hTransform, line_raw, line, image_info->image_width);
+        xsane_cms_transform_apply(hTransform, line_raw, line, image_info->image_width);
       }
       else
 #endif
@@ -3487,30 +3286,12 @@ static int xsane_save_ps_pdf_color(FILE *outfile, FILE *imagefile, Image_info *i
         bytes_read = fread(line, 3, image_info->image_width, imagefile);
       }
     }
-
-    if (ascii85decode)
-    {
-#ifdef HAVE_LIBZ
-      if (flatedecode)
-      {
-        ret = xsane_write_compressed_a85_flatedecode(outfile, line, bytes_per_line, (y == image_info->image_height - 1));
-      }
-      else
-#endif
-      {
-        ret = xsane_write_compressed_a85(outfile, line, bytes_per_line, (y == image_info->image_height - 1));
-      }
-    }
-#ifdef HAVE_LIBZ
-    else if (flatedecode)
-    {
-      ret = xsane_write_flatedecode(outfile, line, bytes_per_line, (y == image_info->image_height - 1));
-    }
-#endif
-    else
+
+    ret = xsane_save_stream_write(stream, line, bytes_per_line);
+
+    if ((ret == 0) && (y == image_info->image_height - 1))
     {
-      fwrite(line, bytes_per_line, 1, outfile);
-      ret = 0;
+      ret = xsane_save_stream_finish(stream);
     }
 
     if ((ret != 0) || (ferror(outfile)))
@@ -3551,6 +3332,7 @@ static int xsane_save_ps_pdf_color(FILE *outfile, FILE *imagefile, Image_info *i
     free(line16);
   }
 
+  xsane_save_stream_free(stream);
   free(line);
 
  return (*cancel_save);
@@ -3562,7 +3344,7 @@ int xsane_save_ps_page(FILE *outfile, int page,
                        FILE *imagefile, Image_info *image_info, float width, float height,
                        int paper_left_margin, int paper_bottom_margin, int paper_width, int paper_height, int paper_orientation,
                        int flatedecode,
-                       cmsHTRANSFORM hTransform, int apply_ICM_profile, int embed_CSA, char *CSA_profile, int intent,
+                       XsaneCmsTransform *hTransform, int apply_ICM_profile, int embed_CSA, char *CSA_profile, int intent,
                        GtkProgressBar *progress_bar, int *cancel_save)
 {
  int degree, position_left, position_bottom, box_left, box_bottom, box_right, box_top;
@@ -3710,7 +3492,7 @@ int xsane_save_ps_page(FILE *outfile, int page,
 int xsane_save_ps(FILE *outfile, FILE *imagefile, Image_info *image_info, float width, float height,
                   int paper_left_margin, int paper_bottom_margin, int paper_width, int paper_height, int paper_orientation,
                   int flatedecode,
-		  cmsHTRANSFORM hTransform, int apply_ICM_profile, int embed_CSA, char *CSA_profile,
+		  XsaneCmsTransform *hTransform, int apply_ICM_profile, int embed_CSA, char *CSA_profile,
                   int embed_CRD, char *CRD_profile, int cms_bpc, int intent,
                   GtkProgressBar *progress_bar, int *cancel_save)
 {
@@ -3759,6 +3541,7 @@ static int xsane_embed_pdf_icm_profile(FILE *outfile, struct pdf_xref *xref, cha
  size_t size, embed_len;
  unsigned char *embed_buffer;
  int ret;
+ XsaneSaveStream *stream;
 
   DBG(DBG_proc, "xsane_embed_pdf_icm_profile(%s)\n", icm_filename);
 
@@ -3801,16 +3584,16 @@ static int xsane_embed_pdf_icm_profile(FILE *outfile, struct pdf_xref *xref, cha
     embed_buffer[embed_len] = 0;
     fclose(icm_profile);
 
-#ifdef HAVE_LIBZ
-    if (flatedecode)
-    {
-      ret = xsane_write_flatedecode(outfile, embed_buffer, size, TRUE); 
-    }
-    else
-#endif
+    stream = xsane_save_stream_new(outfile, FALSE, flatedecode);
+    ret = 1;
+    if (stream)
     {
-      fwrite(embed_buffer, size, 1, outfile);
-      ret = 0;
+      ret = xsane_save_stream_write(stream, embed_buffer, size);
+      if (ret == 0)
+      {
+        ret = xsane_save_stream_finish(stream);
+      }
+      xsane_save_stream_free(stream);
     }
   
     /* Go back and write the length of the stream */
@@ -3839,10 +3622,30 @@ static int xsane_embed_pdf_icm_profile(FILE *outfile, struct pdf_xref *xref, cha
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-void xsane_save_pdf_create_document_header(FILE *outfile, struct pdf_xref *xref, int pages, int flatedecode)
+static void xsane_save_pdf_create_pages_object(FILE *outfile, struct pdf_xref *xref, int pages)
 {
  int i;
 
+  xref->obj[3] = ftell(outfile);
+  fprintf(outfile, "3 0 obj\n");
+  fprintf(outfile, "   << /Type /Pages\n");
+  fprintf(outfile, "      /Kids [\n");
+  for (i=0; i < pages; i++)
+  {
+    fprintf(outfile, "             %d 0 R\n", PDF_PAGE_OBJECT(i + 1));
+  }
+  fprintf(outfile, "            ]\n");
+  fprintf(outfile, "      /Count %d\n", pages);
+  fprintf(outfile, "   >>\n");
+  fprintf(outfile, "endobj\n");
+  fprintf(outfile, "\n");
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* pages = 0 => number of pages is not known yet, the pages object is written by the document trailer */
+void xsane_save_pdf_create_document_header(FILE *outfile, struct pdf_xref *xref, int pages, int flatedecode)
+{
   DBG(DBG_proc, "xsane_save_pdf_create_document_header\n");
 
   fprintf(outfile, "%%PDF-1.4\n");
@@ -3862,19 +3665,15 @@ void xsane_save_pdf_create_document_header(FILE *outfile, struct pdf_xref *xref,
   fprintf(outfile, "   >>\n");
   fprintf(outfile, "endobj\n");
   fprintf(outfile, "\n");
-  xref->obj[3] = ftell(outfile);
-  fprintf(outfile, "3 0 obj\n");
-  fprintf(outfile, "   << /Type /Pages\n");
-  fprintf(outfile, "      /Kids [\n");
-  for (i=0; i < pages; i++)
+
+  if (pages)
   {
-    fprintf(outfile, "             %d 0 R\n", i * 2 + 6);
+    xsane_save_pdf_create_pages_object(outfile, xref, pages);
+  }
+  else
+  {
+    xref->obj[3] = 0;
   }
-  fprintf(outfile, "            ]\n");
-  fprintf(outfile, "      /Count %d\n", pages);
-  fprintf(outfile, "   >>\n");
-  fprintf(outfile, "endobj\n");
-  fprintf(outfile, "\n");
 
   xref->obj[4] = 0;
   xref->obj[5] = 0;
@@ -3882,6 +3681,170 @@ void xsane_save_pdf_create_document_header(FILE *outfile, struct pdf_xref *xref,
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
+/* The image data of a pdf page is written as raw samples (optionally zlib compressed),
+ * as baseline jpeg data for grayscale and color images or as CCITT group 4 data
+ * for lineart images. Jpeg and CCITT data are written by libjpeg and libtiff, when
+ * xsane is compiled without them the raw samples are used.
+ */
+enum
+{
+  XSANE_SAVE_PDF_FILTER_SAMPLES = 0,
+  XSANE_SAVE_PDF_FILTER_DCT,
+  XSANE_SAVE_PDF_FILTER_CCITT_G4
+};
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_save_pdf_image_filter(Image_info *image_info, int compression)
+{
+  if (compression != XSANE_PDF_COMPRESSION_JPEG)
+  {
+   return XSANE_SAVE_PDF_FILTER_SAMPLES;
+  }
+
+  if (image_info->depth == 1) /* lineart, halftone */
+  {
+#ifdef HAVE_LIBTIFF
+   return XSANE_SAVE_PDF_FILTER_CCITT_G4;
+#endif
+  }
+  else /* grayscale, color */
+  {
+#ifdef HAVE_LIBJPEG
+   return XSANE_SAVE_PDF_FILTER_DCT;
+#endif
+  }
+
+ return XSANE_SAVE_PDF_FILTER_SAMPLES;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifdef HAVE_LIBTIFF
+/* libtiff has no interface to encode CCITT data into memory, so the image is written */
+/* as single strip tiff file (filename) and the compressed strip is copied to the pdf file */
+static int xsane_save_pdf_ccitt_g4(FILE *outfile, FILE *imagefile, Image_info *image_info, char *filename, GtkProgressBar *progress_bar, int *cancel_save)
+{
+ char buf[TEXTBUFSIZE];
+ TIFF *tiffile;
+ unsigned char *data;
+ tsize_t size;
+ int bytes_per_line = (image_info->image_width + 7) / 8;
+ int y;
+
+  DBG(DBG_proc, "xsane_save_pdf_ccitt_g4\n");
+
+  *cancel_save = 0;
+
+  data = malloc(bytes_per_line);
+  if (!data)
+  {
+    snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, ERR_NO_MEM);
+    xsane_back_gtk_error(buf, TRUE);
+    *cancel_save = 1;
+   return (*cancel_save);
+  }
+
+  tiffile = TIFFOpen(filename, "w");
+  if (!tiffile)
+  {
+    snprintf(buf, sizeof(buf), "%s %s %s\n", ERR_DURING_SAVE, ERR_OPEN_FAILED, filename);
+    xsane_back_gtk_error(buf, TRUE);
+    free(data);
+    *cancel_save = 1;
+   return (*cancel_save);
+  }
+
+  TIFFSetField(tiffile, TIFFTAG_IMAGEWIDTH, image_info->image_width);
+  TIFFSetField(tiffile, TIFFTAG_IMAGELENGTH, image_info->image_height);
+  TIFFSetField(tiffile, TIFFTAG_BITSPERSAMPLE, 1);
+  TIFFSetField(tiffile, TIFFTAG_SAMPLESPERPIXEL, 1);
+  TIFFSetField(tiffile, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+  TIFFSetField(tiffile, TIFFTAG_FILLORDER, FILLORDER_MSB2LSB);
+  TIFFSetField(tiffile, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISWHITE);
+  TIFFSetField(tiffile, TIFFTAG_COMPRESSION, COMPRESSION_CCITTFAX4);
+  TIFFSetField(tiffile, TIFFTAG_ROWSPERSTRIP, image_info->image_height); /* one strip = one CCITT data block */
+
+  for (y = 0; y < image_info->image_height; y++)
+  {
+    xsane_progress_bar_set_fraction(progress_bar, (float) y / image_info->image_height);
+
+    if ((fread(data, 1, bytes_per_line, imagefile) != (size_t) bytes_per_line) || (TIFFWriteScanline(tiffile, data, y, 0) < 0))
+    {
+      snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, ERR_LIBTIFF);
+      xsane_back_gtk_error(buf, TRUE);
+      *cancel_save = 1;
+    }
+
+    if (*cancel_save)
+    {
+      break;
+    }
+  }
+
+  TIFFClose(tiffile);
+  free(data);
+
+  if (*cancel_save)
+  {
+    remove(filename);
+   return (*cancel_save);
+  }
+
+  tiffile = TIFFOpen(filename, "r");
+  remove(filename);
+
+  if (!tiffile)
+  {
+    snprintf(buf, sizeof(buf), "%s %s %s\n", ERR_DURING_SAVE, ERR_OPEN_FAILED, filename);
+    xsane_back_gtk_error(buf, TRUE);
+    *cancel_save = 1;
+   return (*cancel_save);
+  }
+
+  size = TIFFRawStripSize(tiffile, 0);
+  data = malloc(size);
+
+  if ((!data) || (TIFFReadRawStrip(tiffile, 0, data, size) != size))
+  {
+    snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, ERR_LIBTIFF);
+    xsane_back_gtk_error(buf, TRUE);
+    *cancel_save = 1;
+  }
+  else
+  {
+    fwrite(data, 1, size, outfile);
+    fprintf(outfile, "\n");
+  }
+
+  if (data)
+  {
+    free(data);
+  }
+
+  TIFFClose(tiffile);
+
+ return (*cancel_save);
+}
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_save_pdf_end_stream(FILE *outfile, struct pdf_xref *xref)
+{
+  /* Go back and write the length of the stream */
+  xref->slen = ftell(outfile) - xref->slen; /* we had a "-1" at the end but I do not understand the reason for -1, without looks better */
+  fseek(outfile, xref->slenp, SEEK_SET);
+  fprintf(outfile, "%lu", xref->slen);
+  fseek(outfile, 0L, SEEK_END);
+
+  fprintf(outfile, "endstream\n");
+  fprintf(outfile, "endobj\n");
+  fprintf(outfile, "\n");
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
 /* page = [1 .. pages] */
 static void xsane_save_pdf_create_page_header(FILE *outfile, struct pdf_xref *xref, int page,
                                               Image_info *image_info,
@@ -3889,7 +3852,7 @@ static void xsane_save_pdf_create_page_header(FILE *outfile, struct pdf_xref *xr
                                               int paper_left_margin, int paper_bottom_margin,
                                               int paper_width, int paper_height,
                                               int paper_orientation,
-                                              int flatedecode, int icc_object,
+                                              int flatedecode, int image_filter, int icc_object,
                                               GtkProgressBar *progress_bar)
 {
  int position_left, position_bottom, box_left, box_bottom, box_right, box_top, depth;
@@ -3977,26 +3940,28 @@ static void xsane_save_pdf_create_page_header(FILE *outfile, struct pdf_xref *xr
 
   depth = image_info->depth;
 
-  if (depth > 8) /* PDF does not support 16bits/sample in a standard image */
+  if ((depth > 8) || (image_filter == XSANE_SAVE_PDF_FILTER_DCT)) /* PDF does not support 16bits/sample in a standard image */
   {
     depth = 8;
   }
 
-  xref->obj[page * 2 + 4] = ftell(outfile);
-  fprintf(outfile, "%d 0 obj\n", page * 2 + 4);
+  xref->obj[PDF_PAGE_OBJECT(page)] = ftell(outfile);
+  fprintf(outfile, "%d 0 obj\n", PDF_PAGE_OBJECT(page));
   fprintf(outfile, "    << /Type /Page\n");
   fprintf(outfile, "       /Parent 3 0 R\n");
   fprintf(outfile, "       /MediaBox [%d %d %d %d]\n", box_left, box_bottom, box_right, box_top);
-  fprintf(outfile, "       /Contents %d 0 R\n", page * 2 + 5);
-  fprintf(outfile, "       /Resources << /ProcSet %d 0 R >>\n", page * 2 + 6);
+  fprintf(outfile, "       /Contents %d 0 R\n", PDF_CONTENTS_OBJECT(page));
+  fprintf(outfile, "       /Resources << /ProcSet [/PDF /ImageB /ImageC]\n");
+  fprintf(outfile, "                     /XObject << /Im1 %d 0 R >>\n", PDF_IMAGE_OBJECT(page));
+  fprintf(outfile, "                  >>\n");
   fprintf(outfile, "    >>\n");
   fprintf(outfile, "endobj\n");
   fprintf(outfile, "\n");
 
-  /* Offset of object 5, for xref */
-  xref->obj[page * 2 + 5] = ftell(outfile);
+  /* the page contents only place the image, the image data is a separate stream */
+  xref->obj[PDF_CONTENTS_OBJECT(page)] = ftell(outfile);
 
-  fprintf(outfile, "%d 0 obj\n", page * 2 + 5);
+  fprintf(outfile, "%d 0 obj\n", PDF_CONTENTS_OBJECT(page));
   fprintf(outfile, "    << /Length             >>\n");
 
   /* Position of the stream length, to be written later on */
@@ -4011,45 +3976,61 @@ static void xsane_save_pdf_create_page_header(FILE *outfile, struct pdf_xref *xr
   fprintf(outfile, "1 0 0 1 %d %d cm\n", position_left, position_bottom); /* translate */
   fprintf(outfile, "%f %f -%f %f 0 0 cm\n", cos(rad), sin(rad), sin(rad), cos(rad)); /* rotate */
   fprintf(outfile, "%f 0 0 %f 0 0 cm\n", width, height); /* scale */
-  fprintf(outfile, "BI\n");
-  fprintf(outfile, "  /W %d\n", image_info->image_width);
-  fprintf(outfile, "  /H %d\n", image_info->image_height);
+  fprintf(outfile, "/Im1 Do\n");
+  fprintf(outfile, "Q\n");
+
+  xsane_save_pdf_end_stream(outfile, xref);
+
+  /* image XObject, the stream data is written by xsane_save_pdf_page */
+  xref->obj[PDF_IMAGE_OBJECT(page)] = ftell(outfile);
+
+  fprintf(outfile, "%d 0 obj\n", PDF_IMAGE_OBJECT(page));
+  fprintf(outfile, "    << /Type /XObject\n");
+  fprintf(outfile, "       /Subtype /Image\n");
+  fprintf(outfile, "       /Width %d\n", image_info->image_width);
+  fprintf(outfile, "       /Height %d\n", image_info->image_height);
 
   if ((icc_object) && (image_info->depth != 1))
   {
-    fprintf(outfile, "  /ColorSpace [/ICCBased %d 0 R]\n", icc_object);
+    fprintf(outfile, "       /ColorSpace [/ICCBased %d 0 R]\n", icc_object);
   }
-
-  if (image_info->channels == 3) /* what about RGBA here ? */
+  else if (image_info->channels == 3) /* what about RGBA here ? */
   {
-    if (icc_object == 0)
-    {
-      fprintf(outfile, "  /CS /RGB\n");
-    }
-    fprintf(outfile, "  /BPC %d\n", depth);
+    fprintf(outfile, "       /ColorSpace /DeviceRGB\n");
   }
-  else if (image_info->depth == 1) /* BW */
+  else /* gray, BW */
   {
-    fprintf(outfile, "  /CS /G\n");
-    fprintf(outfile, "  /BPC 1\n");
+    fprintf(outfile, "       /ColorSpace /DeviceGray\n");
   }
-  else /* gray */
+
+  fprintf(outfile, "       /BitsPerComponent %d\n", depth);
+
+  if (image_filter == XSANE_SAVE_PDF_FILTER_DCT)
   {
-    if (icc_object == 0)
-    {
-      fprintf(outfile, "  /CS /G\n");
-    }
-    fprintf(outfile, "  /BPC %d\n", depth);
+    fprintf(outfile, "       /Filter /DCTDecode\n");
+  }
+  else if (image_filter == XSANE_SAVE_PDF_FILTER_CCITT_G4)
+  {
+    fprintf(outfile, "       /Filter /CCITTFaxDecode\n");
+    fprintf(outfile, "       /DecodeParms << /K -1 /Columns %d /Rows %d >>\n", image_info->image_width, image_info->image_height);
   }
-
 #ifdef HAVE_LIBZ
-  if (flatedecode)
+  else if (flatedecode)
   {  
-    fprintf(outfile, "  /F /FlateDecode\n");
+    fprintf(outfile, "       /Filter /FlateDecode\n");
   }
 #endif
 
-  fprintf(outfile, "ID\n");
+  fprintf(outfile, "       /Length             \n");
+
+  /* Position of the stream length, to be written later on */
+  xref->slenp = ftell(outfile) - 13;
+
+  fprintf(outfile, "    >>\n");
+  fprintf(outfile, "stream\n");
+
+  /* Start of the stream data */
+  xref->slen = ftell(outfile);
 }
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
@@ -4062,18 +4043,15 @@ void xsane_save_pdf_create_document_trailer(FILE *outfile, struct pdf_xref *xref
 
   /* PDF document trailer */
 
-  /* Offset of object 6, for xref */
-  xref->obj[pages * 2 + 6] = ftell(outfile);
-
-  fprintf(outfile, "%d 0 obj\n", pages * 2 + 6);
-  fprintf(outfile, "    [/PDF]\n");
-  fprintf(outfile, "endobj\n");
-  fprintf(outfile, "\n");
+  if (!xref->obj[3]) /* pages have been appended to a document without pages object */
+  {
+    xsane_save_pdf_create_pages_object(outfile, xref, pages);
+  }
 
-  /* Offset of object 7, for xref */
-  xref->obj[pages * 2 + 7] = ftell(outfile);
+  /* Offset of the info object, for xref */
+  xref->obj[PDF_INFO_OBJECT(pages)] = ftell(outfile);
 
-  fprintf(outfile, "%d 0 obj\n", pages * 2 + 7);
+  fprintf(outfile, "%d 0 obj\n", PDF_INFO_OBJECT(pages));
   fprintf(outfile, "   << /Title (XSane scanned image)\n");
   fprintf(outfile, "      /Creator (XSane version %s (sane %d.%d) - by Oliver Rauch)\n",
 	  VERSION,
@@ -4094,10 +4072,10 @@ void xsane_save_pdf_create_document_trailer(FILE *outfile, struct pdf_xref *xref
   xref->xref = ftell(outfile);
 
   fprintf(outfile, "xref\n");
-  fprintf(outfile, "0 %d\n", pages * 2 + 8);
+  fprintf(outfile, "0 %d\n", PDF_INFO_OBJECT(pages) + 1);
   fprintf(outfile, "0000000000 65535 f \n");
 
-  for (i=1; i <= pages * 2 + 7; i++)
+  for (i=1; i <= PDF_INFO_OBJECT(pages); i++)
   {
     if (xref->obj[i] > 0)
     {
@@ -4111,9 +4089,9 @@ void xsane_save_pdf_create_document_trailer(FILE *outfile, struct pdf_xref *xref
 
   fprintf(outfile, "\n");
   fprintf(outfile, "trailer\n");
-  fprintf(outfile, "    << /Size %d\n", pages * 2 + 8);
+  fprintf(outfile, "    << /Size %d\n", PDF_INFO_OBJECT(pages) + 1);
   fprintf(outfile, "       /Root 1 0 R\n");
-  fprintf(outfile, "       /Info %d 0 R\n", pages * 2 + 7);
+  fprintf(outfile, "       /Info %d 0 R\n", PDF_INFO_OBJECT(pages));
   fprintf(outfile, "    >>\n");
   fprintf(outfile, "startxref\n");
   fprintf(outfile, "%lu\n", xref->xref);
@@ -4122,42 +4100,54 @@ void xsane_save_pdf_create_document_trailer(FILE *outfile, struct pdf_xref *xref
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
-static void xsane_save_pdf_create_page_trailer(FILE *outfile, struct pdf_xref *xref)
-{
-  /* PDF page trailer */
-  fprintf(outfile, "EI\n");
-  fprintf(outfile, "Q\n");
-
-  /* Go back and write the length of the stream */
-  xref->slen = ftell(outfile) - xref->slen; /* we had a "-1" at the end but I do not understand the reason for -1, without looks better */
-  fseek(outfile, xref->slenp, SEEK_SET);
-  fprintf(outfile, "%lu", xref->slen);
-  fseek(outfile, 0L, SEEK_END);
-
-  fprintf(outfile, "endstream\n");
-  fprintf(outfile, "endobj\n");
-  fprintf(outfile, "\n");
-}
-
-/* ---------------------------------------------------------------------------------------------------------------------- */
-
 int xsane_save_pdf_page(FILE *outfile, struct pdf_xref *xref, int page,
                         FILE *imagefile, Image_info *image_info, float width, float height,
                         int paper_left_margin, int paper_bottom_margin, int paper_width, int paper_height, int paper_orientation,
-			int flatedecode,
-                        cmsHTRANSFORM hTransform, int do_transform, int icc_object,
+			int flatedecode, int compression,
+                        XsaneCmsTransform *hTransform, int do_transform, int icc_object,
                         GtkProgressBar *progress_bar, int *cancel_save)
 {
+ int image_filter;
+#ifdef HAVE_LIBTIFF
+ char ccitt_filename[PATH_MAX];
+#endif
 
   DBG(DBG_proc, "xsane_save_pdf_page\n");
 
+  image_filter = xsane_save_pdf_image_filter(image_info, compression);
+
+#ifdef HAVE_LIBTIFF
+  /* the filter is part of the page header, so the temporary file for the CCITT data must be known before */
+  if ( (image_filter == XSANE_SAVE_PDF_FILTER_CCITT_G4) &&
+       (xsane_back_gtk_make_path(sizeof(ccitt_filename), ccitt_filename, 0, 0, "xsane-ccitt-", xsane.dev_name, ".tif", XSANE_PATH_TMP) < 0) )
+  {
+    DBG(DBG_error, "xsane_save_pdf_page: could not create temporary file name, lineart is saved without CCITT compression\n");
+    image_filter = XSANE_SAVE_PDF_FILTER_SAMPLES;
+  }
+#endif
+
   xsane_save_pdf_create_page_header(outfile, xref, page,
                                     image_info, width, height,
 			            paper_left_margin, paper_bottom_margin, paper_width, paper_height, paper_orientation,
-                                    flatedecode, icc_object,
+                                    flatedecode, image_filter, icc_object,
 			            progress_bar);
 
-  if (image_info->channels == 1) /* lineart, halftone, grayscale */
+  if (image_filter == XSANE_SAVE_PDF_FILTER_DCT)
+  {
+#ifdef HAVE_LIBJPEG
+    /* the color space of the page is defined in the image header, so no profile is embedded into the jpeg data */
+    xsane_save_jpeg(outfile, preferences.jpeg_quality, imagefile, image_info,
+                    hTransform, do_transform, XSANE_CMS_FUNCTION_CONVERT_TO_SRGB, progress_bar, cancel_save);
+    fprintf(outfile, "\n");
+#endif
+  }
+  else if (image_filter == XSANE_SAVE_PDF_FILTER_CCITT_G4)
+  {
+#ifdef HAVE_LIBTIFF
+    xsane_save_pdf_ccitt_g4(outfile, imagefile, image_info, ccitt_filename, progress_bar, cancel_save);
+#endif
+  }
+  else if (image_info->channels == 1) /* lineart, halftone, grayscale */
   {
     if (image_info->depth == 1) /* lineart, halftone */
     {
@@ -4173,7 +4163,7 @@ int xsane_save_pdf_page(FILE *outfile, struct pdf_xref *xref, int page,
     xsane_save_ps_pdf_color(outfile, imagefile, image_info, FALSE, flatedecode, hTransform, do_transform, progress_bar, cancel_save);
   }
 
-  xsane_save_pdf_create_page_trailer(outfile, xref);
+  xsane_save_pdf_end_stream(outfile, xref);
 
   if (ferror(outfile))
   {
@@ -4192,8 +4182,8 @@ int xsane_save_pdf_page(FILE *outfile, struct pdf_xref *xref, int page,
 
 int xsane_save_pdf(FILE *outfile, FILE *imagefile, Image_info *image_info, float width, float height,
                    int paper_left_margin, int paper_bottom_margin, int paper_width, int paper_height, int paper_orientation,
-                   int flatedecode,
-                   cmsHTRANSFORM hTransform, int apply_ICM_profile, int cms_function,
+                   int flatedecode, int compression,
+                   XsaneCmsTransform *hTransform, int apply_ICM_profile, int cms_function,
                    GtkProgressBar *progress_bar, int *cancel_save)
 {
  struct pdf_xref xref;
@@ -4214,7 +4204,7 @@ int xsane_save_pdf(FILE *outfile, FILE *imagefile, Image_info *image_info, float
   xsane_save_pdf_page(outfile, &xref, 1,
                    imagefile, image_info, width, height,
                    paper_left_margin, paper_bottom_margin, paper_width, paper_height, paper_orientation,
-                   flatedecode,
+                   flatedecode, compression,
                    hTransform, apply_ICM_profile && ((cms_function != XSANE_CMS_FUNCTION_EMBED_SCANNER_ICM_PROFILE)) /* do_transform */, icc_object,
                    progress_bar, cancel_save);
 
@@ -4365,7 +4355,7 @@ static void xsane_jpeg_embed_scanner_icm_profile(j_compress_ptr cinfo_ptr, const
 /* ---------------------------------------------------------- */
 
 int xsane_save_jpeg(FILE *outfile, int quality, FILE *imagefile, Image_info *image_info,
-                    cmsHTRANSFORM hTransform, int apply_ICM_profile, int cms_function,
+                    XsaneCmsTransform *hTransform, int apply_ICM_profile, int cms_function,
                     GtkProgressBar *progress_bar, int *cancel_save)
 {
  unsigned char *data;
@@ -4504,7 +4494,7 @@ int xsane_save_jpeg(FILE *outfile, int quality, FILE *imagefile, Image_info *ima
       if (apply_ICM_profile && (cms_function != XSANE_CMS_FUNCTION_EMBED_SCANNER_ICM_PROFILE) && (hTransform != NULL))
       {
         bytes_read = fread(data_raw, components * 2, image_info->image_width, imagefile);
-        cmsDoTransform(hTransform, data_raw, data, image_info->image_width);
+        xsane_cms_transform_apply(hTransform, data_raw, data, image_info->image_width);
       }
       else
 #endif
@@ -4524,7 +4514,7 @@ int xsane_save_jpeg(FILE *outfile, int quality, FILE *imagefile, Image_info *ima
       if (apply_ICM_profile && (cms_function != XSANE_CMS_FUNCTION_EMBED_SCANNER_ICM_PROFILE) && (hTransform != NULL))
       {
         bytes_read = fread(data_raw, components, image_info->image_width, imagefile);
-        cmsDoTransform(hTransform, data_raw, data, image_info->image_width);
+        xsane_cms_transform_apply(hTransform, data_raw, data, image_info->image_width);
       }
       else
 #endif
@@ -4610,8 +4600,9 @@ static void xsane_tiff_embed_scanner_icm_profile(TIFF *tiffile, const char *icm_
 
 /* pages = 0 => single page tiff, page = 0 */
 /* pages > 0 => page = [1 .. pages] */
+/* pages < 0 => page = [1 .. ], number of pages is not known yet */
 int xsane_save_tiff_page(TIFF *tiffile, int page, int pages, int quality, FILE *imagefile, Image_info *image_info,
-                         cmsHTRANSFORM hTransform, int apply_ICM_profile, int cms_function,
+                         XsaneCmsTransform *hTransform, int apply_ICM_profile, int cms_function,
                          GtkProgressBar *progress_bar, int *cancel_save)
 {
  char *data;
@@ -4765,7 +4756,7 @@ int xsane_save_tiff_page(TIFF *tiffile, int page, int pages, int quality, FILE *
   if (pages)
   {
     TIFFSetField(tiffile, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
-    TIFFSetField(tiffile, TIFFTAG_PAGENUMBER, page, pages);
+    TIFFSetField(tiffile, TIFFTAG_PAGENUMBER, page, (pages > 0) ? pages : 0);
   }
 
   w = TIFFScanlineSize(tiffile);
@@ -4778,7 +4769,7 @@ int xsane_save_tiff_page(TIFF *tiffile, int page, int pages, int quality, FILE *
     if ((cms_function != XSANE_CMS_FUNCTION_EMBED_SCANNER_ICM_PROFILE) && (hTransform != NULL))
     {
       bytes_read = fread(data_raw, 1, w, imagefile);
-      cmsDoTransform(hTransform, data_raw, data, image_info->image_width);
+      xsane_cms_transform_apply(hTransform, data_raw, data, image_info->image_width);
     }
     else
 #endif
@@ -4874,7 +4865,7 @@ static void xsane_png_embed_scanner_icm_profile(png_structp png_ptr, png_infop p
 #ifdef HAVE_LIBPNG
 #ifdef HAVE_LIBZ
 int xsane_save_png(FILE *outfile, int compression, FILE *imagefile, Image_info *image_info,
-                   cmsHTRANSFORM hTransform, int apply_ICM_profile, int cms_function,
+                   XsaneCmsTransform *hTransform, int apply_ICM_profile, int cms_function,
                    GtkProgressBar *progress_bar, int *cancel_save)
 {
  png_structp png_ptr;
@@ -5027,7 +5018,7 @@ int xsane_save_png(FILE *outfile, int compression, FILE *imagefile, Image_info *
     if ((cms_function != XSANE_CMS_FUNCTION_EMBED_SCANNER_ICM_PROFILE) && (hTransform != NULL))
     {
       bytes_read = fread(data_raw, components, byte_width, imagefile);
-      cmsDoTransform(hTransform, data_raw, data, image_info->image_width);
+      xsane_cms_transform_apply(hTransform, data_raw, data, image_info->image_width);
     }
     else
 #endif
@@ -5064,7 +5055,7 @@ int xsane_save_png(FILE *outfile, int compression, FILE *imagefile, Image_info *
 #ifdef HAVE_LIBPNG
 #ifdef HAVE_LIBZ
 int xsane_save_png_16(FILE *outfile, int compression, FILE *imagefile, Image_info *image_info,
-                      cmsHTRANSFORM hTransform, int apply_ICM_profile, int cms_function,
+                      XsaneCmsTransform *hTransform, int apply_ICM_profile, int cms_function,
                       GtkProgressBar *progress_bar, int *cancel_save)
 {
  png_structp png_ptr;
@@ -5200,7 +5191,7 @@ int xsane_save_png_16(FILE *outfile, int compression, FILE *imagefile, Image_inf
     if ((cms_function != XSANE_CMS_FUNCTION_EMBED_SCANNER_ICM_PROFILE) && (hTransform != NULL))
     {
       bytes_read = fread(data_raw, components * 2, image_info->image_width, imagefile);
-      cmsDoTransform(hTransform, data_raw, data, image_info->image_width);
+      xsane_cms_transform_apply(hTransform, data_raw, data, image_info->image_width);
     }
     else
 #endif
@@ -5250,7 +5241,7 @@ int xsane_save_png_16(FILE *outfile, int compression, FILE *imagefile, Image_inf
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 static int xsane_save_pnm_16_ascii_gray(FILE *outfile, FILE *imagefile, Image_info *image_info,
-                                        cmsHTRANSFORM hTransform, int apply_ICM_profile,
+                                        XsaneCmsTransform *hTransform, int apply_ICM_profile,
                                         GtkProgressBar *progress_bar, int *cancel_save)
 {
  int x,y;
@@ -5302,7 +5293,7 @@ static int xsane_save_pnm_16_ascii_gray(FILE *outfile, FILE *imagefile, Image_in
     if ((apply_ICM_profile) && (hTransform != NULL))
     {
       bytes_read = fread(data_raw, 2, image_info->image_width, imagefile);
-      cmsDoTransform(hTransform, data_raw, data, image_info->image_width);
+      xsane_cms_transform_apply(hTransform, data_raw, data, image_info->image_width);
     }
     else
 #endif
@@ -5358,7 +5349,7 @@ static int xsane_save_pnm_16_ascii_gray(FILE *outfile, FILE *imagefile, Image_in
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 static int xsane_save_pnm_16_ascii_color(FILE *outfile, FILE *imagefile, Image_info *image_info,
-                                         cmsHTRANSFORM hTransform, int apply_ICM_profile,
+                                         XsaneCmsTransform *hTransform, int apply_ICM_profile,
                                          GtkProgressBar *progress_bar, int *cancel_save)
 {
  int x,y;
@@ -5411,7 +5402,7 @@ static int xsane_save_pnm_16_ascii_color(FILE *outfile, FILE *imagefile, Image_i
     if ((apply_ICM_profile) && (hTransform != NULL))
     {
       bytes_read = fread(data_raw, 6, image_info->image_width, imagefile);
-      cmsDoTransform(hTransform, data_raw, data, image_info->image_width);
+      xsane_cms_transform_apply(hTransform, data_raw, data, image_info->image_width);
     }
     else
 #endif
@@ -5468,7 +5459,7 @@ static int xsane_save_pnm_16_ascii_color(FILE *outfile, FILE *imagefile, Image_i
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 static int xsane_save_pnm_16_binary_gray(FILE *outfile, FILE *imagefile, Image_info *image_info,
-                                         cmsHTRANSFORM hTransform, int apply_ICM_profile,
+                                         XsaneCmsTransform *hTransform, int apply_ICM_profile,
                                          GtkProgressBar *progress_bar, int *cancel_save)
 {
  int x,y;
@@ -5519,7 +5510,7 @@ static int xsane_save_pnm_16_binary_gray(FILE *outfile, FILE *imagefile, Image_i
     if (hTransform != NULL)
     {
       bytes_read = fread(data_raw, 2, image_info->image_width, imagefile);
-      cmsDoTransform(hTransform, data_raw, data, image_info->image_width);
+      xsane_cms_transform_apply(hTransform, data_raw, data, image_info->image_width);
     }
     else
 #endif
@@ -5566,7 +5557,7 @@ static int xsane_save_pnm_16_binary_gray(FILE *outfile, FILE *imagefile, Image_i
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 static int xsane_save_pnm_16_binary_color(FILE *outfile, FILE *imagefile, Image_info *image_info,
-                                          cmsHTRANSFORM hTransform, int apply_ICM_profile,
+                                          XsaneCmsTransform *hTransform, int apply_ICM_profile,
                                           GtkProgressBar *progress_bar, int *cancel_save)
 {
  int x,y;
@@ -5617,7 +5608,7 @@ static int xsane_save_pnm_16_binary_color(FILE *outfile, FILE *imagefile, Image_
     if (hTransform != NULL)
     {
       bytes_read = fread(data_raw, 6, image_info->image_width, imagefile);
-      cmsDoTransform(hTransform, data_raw, data, image_info->image_width);
+      xsane_cms_transform_apply(hTransform, data_raw, data, image_info->image_width);
     }
     else
 #endif
@@ -5668,7 +5659,7 @@ static int xsane_save_pnm_16_binary_color(FILE *outfile, FILE *imagefile, Image_
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 static int xsane_save_pnm_8_gray(FILE *outfile, FILE *imagefile, Image_info *image_info,
-                                 cmsHTRANSFORM hTransform, int apply_ICM_profile,
+                                 XsaneCmsTransform *hTransform, int apply_ICM_profile,
                                  GtkProgressBar *progress_bar, int *cancel_save)
 {
  int x,y;
@@ -5719,7 +5710,7 @@ static int xsane_save_pnm_8_gray(FILE *outfile, FILE *imagefile, Image_info *ima
     if (hTransform != NULL)
     {
       bytes_read = fread(data_raw, 1, image_info->image_width, imagefile);
-      cmsDoTransform(hTransform, data_raw, data, image_info->image_width);
+      xsane_cms_transform_apply(hTransform, data_raw, data, image_info->image_width);
     }
     else
 #endif
@@ -5764,7 +5755,7 @@ static int xsane_save_pnm_8_gray(FILE *outfile, FILE *imagefile, Image_info *ima
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 static int xsane_save_pnm_8_color(FILE *outfile, FILE *imagefile, Image_info *image_info,
-                                  cmsHTRANSFORM hTransform, int apply_ICM_profile,
+                                  XsaneCmsTransform *hTransform, int apply_ICM_profile,
                                   GtkProgressBar *progress_bar, int *cancel_save)
 {
  int x,y;
@@ -5815,7 +5806,7 @@ static int xsane_save_pnm_8_color(FILE *outfile, FILE *imagefile, Image_info *im
     if (hTransform != NULL)
     {
       bytes_read = fread(data_raw, 3, image_info->image_width, imagefile);
-      cmsDoTransform(hTransform, data_raw, data, image_info->image_width);
+      xsane_cms_transform_apply(hTransform, data_raw, data, image_info->image_width);
     }
     else
 #endif
@@ -5863,7 +5854,7 @@ static int xsane_save_pnm_8_color(FILE *outfile, FILE *imagefile, Image_info *im
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 static int xsane_save_pnm_8(FILE *outfile, FILE *imagefile, Image_info *image_info,
-                            cmsHTRANSFORM hTransform, int apply_ICM_profile,
+                            XsaneCmsTransform *hTransform, int apply_ICM_profile,
                             GtkProgressBar *progress_bar, int *cancel_save)
 {
   DBG(DBG_proc, "xsane_save_pnm_8\n");
@@ -5887,7 +5878,7 @@ static int xsane_save_pnm_8(FILE *outfile, FILE *imagefile, Image_info *image_in
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 int xsane_save_pnm_16(FILE *outfile, FILE *imagefile, Image_info *image_info,
-                      cmsHTRANSFORM hTransform, int apply_ICM_profile,
+                      XsaneCmsTransform *hTransform, int apply_ICM_profile,
                       GtkProgressBar *progress_bar, int *cancel_save)
 {
   DBG(DBG_proc, "xsane_save_pnm_16\n");
@@ -6147,7 +6138,7 @@ int xsane_save_image_as_text(char *output_filename, char *input_filename, GtkPro
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 /* save image in destination file format. lineart images that are stored as grayscale image are reduced to lineart! */
-int xsane_save_image_as(char *output_filename, char *input_filename, int output_format,
+int xsane_save_image_as(char *output_filename, char *input_filename, int output_format, int pdf_compression,
                         int apply_ICM_profile, int cms_function, int cms_intent, int cms_bpc,
                         GtkProgressBar *progress_bar, int *cancel_save)
 {
@@ -6157,7 +6148,7 @@ int xsane_save_image_as(char *output_filename, char *input_filename, int output_
  Image_info image_info;
  char temporary_filename[PATH_MAX];
  int remove_input_file = FALSE;
- cmsHTRANSFORM hTransform = NULL;
+ XsaneCmsTransform *hTransform = NULL;
   
   DBG(DBG_proc, "xsane_save_image_as(output_file=%s, input_file=%s, type=%d)\n", output_filename, input_filename, output_format);
 
@@ -6183,7 +6174,7 @@ int xsane_save_image_as(char *output_filename, char *input_filename, int output_
 
     snprintf(buf, sizeof(buf), "%s: %s", PROGRESS_PACKING_DATA, output_filename);
 
-    gtk_progress_set_format_string(GTK_PROGRESS(progress_bar), buf);
+    xsane_progress_bar_set_text(GTK_PROGRESS_BAR(progress_bar), buf);
     xsane_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), 0.0);
 
     xsane_save_image_as_lineart(temporary_filename, input_filename, progress_bar, cancel_save);
@@ -6220,8 +6211,7 @@ int xsane_save_image_as(char *output_filename, char *input_filename, int output_
     snprintf(buf, sizeof(buf), "%s", PROGRESS_SAVING_DATA);
   }
 
-  gtk_progress_bar_set_ellipsize(GTK_PROGRESS_BAR(progress_bar), PANGO_ELLIPSIZE_START); /* this is new API, can be removed for old GTK versions */
-  gtk_progress_set_format_string(GTK_PROGRESS(progress_bar), buf);
+  xsane_progress_bar_set_text(GTK_PROGRESS_BAR(progress_bar), buf);
   xsane_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), 0.0);
 
 
@@ -6341,7 +6331,7 @@ int xsane_save_image_as(char *output_filename, char *input_filename, int output_
                           (int) imagewidth, /* paper_width */
                           (int) imageheight, /* paper_height */
                           0 /* portrait top left */,
-                          preferences.save_pdf_flatedecoded,
+                          preferences.save_pdf_flatedecoded, pdf_compression,
                           hTransform, apply_ICM_profile, cms_function,
                           progress_bar,
                           cancel_save);
@@ -6368,7 +6358,7 @@ int xsane_save_image_as(char *output_filename, char *input_filename, int output_
             remove(input_filename); /* remove lineart pbm file  */
           }
 
-          gtk_progress_set_format_string(GTK_PROGRESS(progress_bar), "");
+          xsane_progress_bar_set_text(GTK_PROGRESS_BAR(progress_bar), "");
           xsane_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), 0.0);
 
          return -2;
@@ -6388,7 +6378,7 @@ int xsane_save_image_as(char *output_filename, char *input_filename, int output_
         remove(input_filename); /* remove lineart pbm file  */
       }
 
-      gtk_progress_set_format_string(GTK_PROGRESS(progress_bar), "");
+      xsane_progress_bar_set_text(GTK_PROGRESS_BAR(progress_bar), "");
       xsane_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), 0.0);
 
      return -2;
@@ -6400,7 +6390,7 @@ int xsane_save_image_as(char *output_filename, char *input_filename, int output_
 #ifdef HAVE_LIBLCMS
   if (hTransform != NULL)
   {
-    cmsDeleteTransform(hTransform);
+    xsane_cms_transform_release(hTransform);
   }
 #endif
 
@@ -6414,7 +6404,7 @@ int xsane_save_image_as(char *output_filename, char *input_filename, int output_
     remove(output_filename);
   }
 
-  gtk_progress_set_format_string(GTK_PROGRESS(progress_bar), "");
+  xsane_progress_bar_set_text(GTK_PROGRESS_BAR(progress_bar), "");
   xsane_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), 0.0);
 
  return (*cancel_save);
@@ -6749,7 +6739,7 @@ int xsane_transfer_to_gimp(char *input_filename, int apply_ICM_profile, int cms_
  size_t bytes_read;
 #ifdef HAVE_LIBLCMS
  unsigned char *data_raw = NULL;
- cmsHTRANSFORM hTransform = NULL;
+ XsaneCmsTransform *hTransform = NULL;
 #endif
 
   DBG(DBG_info, "xsane_transer_to_gimp\n");
@@ -6953,7 +6943,7 @@ int xsane_transfer_to_gimp(char *input_filename, int apply_ICM_profile, int cms_
           if ((cms_function != XSANE_CMS_FUNCTION_EMBED_SCANNER_ICM_PROFILE) && apply_ICM_profile && (hTransform != NULL))
           {
             bytes_read = fread(data_raw, 1, image_info.image_width, imagefile);
-            cmsDoTransform(hTransform, data_raw, data, image_info.image_width);
+            xsane_cms_transform_apply(hTransform, data_raw, data, image_info.image_width);
           }
           else
 #endif
@@ -6991,7 +6981,7 @@ int xsane_transfer_to_gimp(char *input_filename, int apply_ICM_profile, int cms_
           if ((cms_function != XSANE_CMS_FUNCTION_EMBED_SCANNER_ICM_PROFILE) && apply_ICM_profile && (hTransform != NULL))
           {
             bytes_read = fread(data_raw, 2, image_info.image_width, imagefile);
-            cmsDoTransform(hTransform, data_raw, data, image_info.image_width);
+            xsane_cms_transform_apply(hTransform, data_raw, data, image_info.image_width);
           }
           else
 #endif
@@ -7037,7 +7027,7 @@ int xsane_transfer_to_gimp(char *input_filename, int apply_ICM_profile, int cms_
           if ((cms_function != XSANE_CMS_FUNCTION_EMBED_SCANNER_ICM_PROFILE) && apply_ICM_profile && (hTransform != NULL))
           {
             bytes_read = fread(data_raw, 3, image_info.image_width, imagefile);
-            cmsDoTransform(hTransform, data_raw, data, image_info.image_width);
+            xsane_cms_transform_apply(hTransform, data_raw, data, image_info.image_width);
           }
           else
 #endif
@@ -7078,7 +7068,7 @@ int xsane_transfer_to_gimp(char *input_filename, int apply_ICM_profile, int cms_
           if ((cms_function != XSANE_CMS_FUNCTION_EMBED_SCANNER_ICM_PROFILE) && apply_ICM_profile && (hTransform != NULL))
           {
             bytes_read = fread(data_raw, 6, image_info.image_width, imagefile);
-            cmsDoTransform(hTransform, data_raw, data, image_info.image_width);
+            xsane_cms_transform_apply(hTransform, data_raw, data, image_info.image_width);
           }
           else
 #endif
@@ -7182,7 +7172,7 @@ int xsane_transfer_to_gimp(char *input_filename, int apply_ICM_profile, int cms_
 #ifdef HAVE_LIBLCMS
   if (hTransform != NULL)
   {
-    cmsDeleteTransform(hTransform);
+    xsane_cms_transform_release(hTransform);
   }
 
   if (data_raw)
@@ -7199,126 +7189,49 @@ int xsane_transfer_to_gimp(char *input_filename, int apply_ICM_profile, int cms_
 /* ---------------------------------------------------------------------------------------------------------------------- */
 /* ---------------------------------------------------------------------------------------------------------------------- */
 /* ---------------------------------------------------------------------------------------------------------------------- */
-/* ---------------------------------------------------------------------------------------------------------------------- */
-
-#ifdef XSANE_ACTIVATE_EMAIL
-
-/* character base of base64 coding */
-static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
-/* ---------------------------------------------------------------------------------------------------------------------- */
-
-static void write_3chars_as_base64(unsigned char c1, unsigned char c2, unsigned char c3, int pads, int fd_socket)
-{
- char buf[4];
- ssize_t bytes_written;
-
-  buf[0] = base64[c1>>2]; /* wirte bits 7-2 of first char */
-  buf[1] = base64[((c1 & 0x3)<< 4) | ((c2 & 0xF0) >> 4)]; /* write bits 1,0 of first and bits 7-4 of second char */
-
-  if (pads == 2) /* only one byte used */
-  {
-    buf[2] = '='; /* char not used */
-    buf[3] = '='; /* char not used */
-  }
-  else if (pads) /* only two bytes used */
-  {
-    buf[2] = base64[((c2 & 0xF) << 2)]; /* write bits 3-0 of second char */
-    buf[3] = '='; /* char not used */
-  }
-  else
-  {
-    buf[2] = base64[((c2 & 0xF) << 2) | ((c3 & 0xC0) >>6)]; /* write bits 3-0 of second and bits 7,6 of third char */
-    buf[3] = base64[c3 & 0x3F]; /* write bits 5-0 of third char as lsb */
-  }
-
-  bytes_written = write(fd_socket, buf, 4);
-}
-
-/* ---------------------------------------------------------------------------------------------------------------------- */
-
-void write_string_base64(int fd_socket, char *string, int len)
-{
- int i;
- int pad;
- unsigned char c1, c2, c3;
- ssize_t bytes_written;
-
-  for (i = 0; i < len; i+=3)
-  {
-    c1 = (unsigned char) string[i];
-    c2 = (unsigned char) string[i+1];
-    c3 = (unsigned char) string[i+2];
-
-    pad = i - len + 3;
-
-    if (pad < 0)
-    {
-      pad = 0;
-    }
-    else if (pad)
-    {
-      c3 = 0;
-
-      if (pad == 2)
-      {
-        c2 = 0;
-      }
-    }
+/* ---------------------------------------------------------------------------------------------------------------------- */
 
-    write_3chars_as_base64(c1, c2, c3, pad, fd_socket);
-  }
-  bytes_written = write(fd_socket, "\r\n", 2);
-}
+#ifdef XSANE_ACTIVATE_EMAIL
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 void write_base64(int fd_socket, FILE *infile) 
 {
- int c1, c2, c3;
- int pos = 0;
- ssize_t bytes_written;
+ unsigned char *in;
+ char *out;
+ size_t len;
 
-  while ((c1 = getc(infile)) != EOF)
+  in  = malloc(XSANE_BASE64_BLOCK_SIZE);
+  out = malloc(XSANE_BASE64_BLOCK_CHARS);
+
+  if (!in || !out)
   {
-    c2 = getc(infile);
-    if (c2 == EOF)
-    {
-      write_3chars_as_base64(c1, 0, 0, 2, fd_socket);
-    }
-    else
-    {
-      c3 = getc(infile);
-      if (c3 == EOF)
-      {
-        write_3chars_as_base64(c1, c2, 0, 1, fd_socket);
-      }
-      else
-      {
-        write_3chars_as_base64(c1, c2, c3, 0, fd_socket);
-      }
-    }
+    DBG(DBG_error, "write_base64: out of memory\n");
+    free(in);
+    free(out);
+   return;
+  }
+
+  do
+  {
+    len = xsane_base64_read_block(infile, in);
 
-    pos += 4;
-    if (pos > 71)
+    if (write_all(fd_socket, out, xsane_base64_encode_block(in, len, out)))
     {
-      bytes_written = write(fd_socket, "\r\n", 2);
-      
-      pos = 0;
+      break;
     }
 
-    xsane.email_progress_bytes += 3;
-    if ((int)  ((xsane.email_progress_bytes * 100) / xsane.email_progress_size) != (int) (xsane.email_progress_val * 100))
+    xsane.email_progress_bytes += len;
+    if ((int) (((float) xsane.email_progress_bytes * 100) / xsane.email_progress_size) != (int) (xsane.email_progress_val * 100))
     {
       xsane.email_progress_val = (float) xsane.email_progress_bytes / xsane.email_progress_size;
       xsane_front_gtk_email_project_update_lockfile_status();
     }
   }
+  while (len == XSANE_BASE64_BLOCK_SIZE);
 
-  if (pos)
-  {
-    bytes_written = write(fd_socket, "\r\n", 2);
-  }
+  free(in);
+  free(out);
 
   xsane.email_progress_val = 1.0;
   xsane_front_gtk_email_project_update_lockfile_status();
@@ -7422,32 +7335,23 @@ void write_email_mime_html(int fd_socket, char *boundary)
 
 void write_email_attach_image(int fd_socket, char *boundary, char *content_id, char *content_type, FILE *infile, char *filename)
 {
- char buf[1024];
- ssize_t bytes_written;
-
-  snprintf(buf, sizeof(buf), "--%s\r\n", boundary);
-  bytes_written = write(fd_socket, buf, strlen(buf));
+ char buf[2048];
 
-  snprintf(buf, sizeof(buf), "Content-Type: %s\r\n", content_type);
-  bytes_written = write(fd_socket, buf, strlen(buf));
+  /* the header of the part is written at once */
+  snprintf(buf, sizeof(buf), "--%s\r\n"
+                             "Content-Type: %s\r\n", boundary, content_type);
 
   if (content_id)
   {
-    snprintf(buf, sizeof(buf), "Content-ID: <%s>\r\n", content_id);
-    bytes_written = write(fd_socket, buf, strlen(buf));
+    snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "Content-ID: <%s>\r\n", content_id);
   }
 
-  snprintf(buf, sizeof(buf), "Content-Transfer-Encoding: base64\r\n");
-  bytes_written = write(fd_socket, buf, strlen(buf));
-
-  snprintf(buf, sizeof(buf), "Content-Disposition: inline;\r\n");
-  bytes_written = write(fd_socket, buf, strlen(buf));
-
-  snprintf(buf, sizeof(buf), "        filename=\"%s\"\r\n", filename);
-  bytes_written = write(fd_socket, buf, strlen(buf));
+  snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "Content-Transfer-Encoding: base64\r\n"
+                                                         "Content-Disposition: inline;\r\n"
+                                                         "        filename=\"%s\"\r\n"
+                                                         "\r\n", filename);
 
-  snprintf(buf, sizeof(buf), "\r\n");
-  bytes_written = write(fd_socket, buf, strlen(buf));
+  write_all(fd_socket, buf, strlen(buf));
 
   write_base64(fd_socket, infile);
 }
@@ -7456,434 +7360,22 @@ void write_email_attach_image(int fd_socket, char *boundary, char *content_id, c
 
 void write_email_attach_file(int fd_socket, char *boundary, FILE *infile, char *filename)
 {
- char buf[1024];
- ssize_t bytes_written;
-
-  snprintf(buf, sizeof(buf), "--%s\r\n", boundary);
-  bytes_written = write(fd_socket, buf, strlen(buf));
-
-  snprintf(buf, sizeof(buf), "Content-Type: application/octet-stream\r\n");
-  bytes_written = write(fd_socket, buf, strlen(buf));
-
-  snprintf(buf, sizeof(buf), "        name=\"%s\"\r\n", filename);
-  bytes_written = write(fd_socket, buf, strlen(buf));
-
-  snprintf(buf, sizeof(buf), "Content-Transfer-Encoding: base64\r\n");
-  bytes_written = write(fd_socket, buf, strlen(buf));
-
-  snprintf(buf, sizeof(buf), "Content-Disposition: attachment;\r\n");
-  bytes_written = write(fd_socket, buf, strlen(buf));
+ char buf[2048];
 
-  snprintf(buf, sizeof(buf), "        filename=\"%s\"\r\n", filename);
-  bytes_written = write(fd_socket, buf, strlen(buf));
+  /* the header of the part is written at once */
+  snprintf(buf, sizeof(buf), "--%s\r\n"
+                             "Content-Type: application/octet-stream\r\n"
+                             "        name=\"%s\"\r\n"
+                             "Content-Transfer-Encoding: base64\r\n"
+                             "Content-Disposition: attachment;\r\n"
+                             "        filename=\"%s\"\r\n"
+                             "\r\n", boundary, filename, filename);
 
-  snprintf(buf, sizeof(buf), "\r\n");
-  bytes_written = write(fd_socket, buf, strlen(buf));
+  write_all(fd_socket, buf, strlen(buf));
 
   write_base64(fd_socket, infile);
 }
 
-/* ---------------------------------------------------------------------------------------------------------------------- */
-
-/* returns fd_socket if sucessfull, < 0 when error occured */
-int open_socket(char *server, int port)
-{
- int fd_socket;
- struct sockaddr_in sin;
- struct hostent *he;
-
-  he = gethostbyname(server);
-  if (!he)
-  {
-    DBG(DBG_error, "open_socket: Could not get hostname of \"%s\"\n", server);
-   return -1;
-  }
-  else
-  {
-    DBG(DBG_info, "open_socket: connecting to \"%s\" = %d.%d.%d.%d\n",
-        he->h_name,
-        (unsigned char) he->h_addr_list[0][0],
-        (unsigned char) he->h_addr_list[0][1],
-        (unsigned char) he->h_addr_list[0][2],
-        (unsigned char) he->h_addr_list[0][3]);
-  }
- 
-  if (he->h_addrtype != AF_INET)
-  {
-    DBG(DBG_error, "open_socket: Unknown address family: %d\n", he->h_addrtype);
-   return -1;
-  }
-
-  fd_socket = socket(AF_INET, SOCK_STREAM, 0);
-
-  if (fd_socket < 0)
-  {
-    DBG(DBG_error, "open_socket: Could not create socket: %s\n", strerror(errno));
-   return -1;
-  }
-
-/*  setsockopt (dev->ctl, level, TCP_NODELAY, &on, sizeof (on)); */
-
-  sin.sin_port = htons(port);
-  sin.sin_family = AF_INET;
-  memcpy(&sin.sin_addr, he->h_addr_list[0], he->h_length);
-
-  if (connect(fd_socket, &sin, sizeof(sin)))
-  {
-    DBG(DBG_error, "open_socket: Could not connect with port %d of socket: %s\n", ntohs(sin.sin_port), strerror(errno));
-   return -1;
-  }
-
-  DBG(DBG_info, "open_socket: Connected with port %d\n", ntohs(sin.sin_port));
-
- return fd_socket;
-}
-
-/* ---------------------------------------------------------------------------------------------------------------------- */
-
-/* returns 0 if success */
-/* not only a write routine, also reads data */
-int pop3_login(int fd_socket, char *user, char *passwd)
-{
- char buf[1024];
- int len;
- ssize_t bytes_written;
-
-  len = read(fd_socket, buf, sizeof(buf));
-  if (len >= 0)
-  {
-    buf[len] = 0;
-  }
-  DBG(DBG_info2, "< %s\n", buf);
-
-  snprintf(buf, sizeof(buf), "USER %s\r\n", user);
-  DBG(DBG_info2, "> USER xxx\n");
-  bytes_written = write(fd_socket, buf, strlen(buf));
-  len = read(fd_socket, buf, sizeof(buf));
-  if (len >= 0)
-  {
-    buf[len] = 0;
-  }
-  DBG(DBG_info2, "< %s\n", buf);
-  if (buf[0] != '+')
-  {
-    return -1;
-  }
-
-  snprintf(buf, sizeof(buf), "PASS %s\r\n", passwd);
-  DBG(DBG_info2, "> PASS xxx\n");
-  bytes_written = write(fd_socket, buf, strlen(buf));
-  len = read(fd_socket, buf, sizeof(buf));
-  if (len >= 0)
-  {
-    buf[len] = 0;
-  }
-  DBG(DBG_info2, "< %s\n", buf);
-  if (buf[0] != '+')
-  {
-    return -1;
-  }
-
-  snprintf(buf, sizeof(buf), "QUIT\r\n");
-  DBG(DBG_info2, "> QUIT\n");
-  bytes_written = write(fd_socket, buf, strlen(buf));
-  len = read(fd_socket, buf, sizeof(buf));
-  if (len >= 0)
-  {
-    buf[len] = 0;
-  }
-  DBG(DBG_info2, "< %s\n", buf);
-
- return 0;
-}
-
-/* ---------------------------------------------------------------------------------------------------------------------- */
-
-int asmtp_authentication(int fd_socket, int auth_type, char *user, char *passwd)
-{
- int len;
- char buf[1024];
- ssize_t bytes_written;
-
-  DBG(DBG_proc, "asmtp_authentication\n");
-
-  switch (auth_type)
-  {
-    case EMAIL_AUTH_ASMTP_PLAIN:
-      snprintf(buf, sizeof(buf), "AUTH PLAIN ");
-      DBG(DBG_info2, "> %s\\0(USER)\\0(PASSWORD)\n", buf);
-      bytes_written = write(fd_socket, buf, strlen(buf));
-      snprintf(buf, sizeof(buf), "%c%s%c%s", 0, user, 0, passwd);
-      write_string_base64(fd_socket, buf, strlen(user)+strlen(passwd)+2);
-      len = read(fd_socket, buf, sizeof(buf));
-      if (len >= 0)
-      {
-        buf[len] = 0;
-      }
-      DBG(DBG_info2, "< %s", buf);
-     break;
-
-    case EMAIL_AUTH_ASMTP_LOGIN:
-      snprintf(buf, sizeof(buf), "AUTH LOGIN\r\n");
-      DBG(DBG_info2, "> %s", buf);
-      bytes_written = write(fd_socket, buf, strlen(buf));
-      len = read(fd_socket, buf, sizeof(buf));
-      if (len >= 0)
-      {
-        buf[len] = 0;
-      }
-      DBG(DBG_info2, "< %s", buf);
-      if (buf[0] != '3')
-      {
-        DBG(DBG_info, "=> error\n");
-       return (-1);
-      }
-
-      DBG(DBG_info2, "> (USERNAME)\n");
-      write_string_base64(fd_socket, user, strlen(user));
-
-      len = read(fd_socket, buf, sizeof(buf));
-      if (len >= 0)
-      {
-        buf[len] = 0;
-      }
-      DBG(DBG_info2, "< %s", buf);
-      if (buf[0] != '3')
-      {
-        DBG(DBG_info, "=> error\n");
-       return (-1);
-      }
-
-      DBG(DBG_info2, "> (PASSWORD)\n");
-      write_string_base64(fd_socket, passwd, strlen(passwd));
-
-      len = read(fd_socket, buf, sizeof(buf));
-      if (len >= 0)
-      {
-        buf[len] = 0;
-      }
-      DBG(DBG_info2, "< %s", buf);
-      if (buf[0] != '2')
-      {
-        DBG(DBG_info, "=> error\n");
-       return (-1);
-      }
-     break;
-
-#if 0
-    case EMAIL_AUTH_ASMTP_CRAM_MD5:
-      snprintf(buf, sizeof(buf), "AUTH CRAM-MD5\r\n");
-      DBG(DBG_info2, "> %s", buf);
-      bytes_written = write(fd_socket, buf, strlen(buf));
-      len = read(fd_socket, buf, sizeof(buf));
-      if (len >= 0)
-      {
-        buf[len] = 0;
-      }
-      DBG(DBG_info2, "< %s", buf);
-     break;
-#endif
-
-    default:
-       DBG(DBG_proc, "no valid asmtp authentication type\n");
-     break;
-  }
-
- return 0;
-}
-
-/* ---------------------------------------------------------------------------------------------------------------------- */
-
-/* not only a write routine, also reads data */
-/* returns -1 on error, 0 when ok */
-int write_smtp_header(int fd_socket, char *from, char *to, int auth_type, char *user, char *passwd)
-{
- char buf[1024];
- int len;
- char to_line[1024];
- char *to_pos = NULL;
- char *pos = NULL;
- ssize_t bytes_written;
-
-  len = read(fd_socket, buf, sizeof(buf));
-  if (len >= 0)
-  {
-    buf[len] = 0;
-  }
-  DBG(DBG_info2, "< %s\n", buf);
-
-  if (auth_type < EMAIL_AUTH_ASMTP_PLAIN)
-  {
-    snprintf(buf, sizeof(buf), "HELO localhost\r\n");
-  }
-  else
-  {
-    snprintf(buf, sizeof(buf), "EHLO localhost\r\n");
-  }
-  DBG(DBG_info2, "> %s", buf);
-  bytes_written = write(fd_socket, buf, strlen(buf));
-  len = read(fd_socket, buf, sizeof(buf));
-  if (len >= 0)
-  {
-    buf[len] = 0;
-  }
-  DBG(DBG_info2, "< %s\n", buf);
-
-  if (buf[0] != '2')
-  {
-    DBG(DBG_info, "=> error\n");
-
-    if (xsane.email_status)
-    {
-      free(xsane.email_status);
-    }
-    xsane.email_status = strdup(TEXT_EMAIL_STATUS_SMTP_CONNECTION_FAILED);
-    xsane_front_gtk_email_project_update_lockfile_status();
-   return -1;
-  }
-
-  if (asmtp_authentication(fd_socket, auth_type, user, passwd))
-  {
-    xsane.email_status = strdup(TEXT_EMAIL_STATUS_ASMTP_AUTH_FAILED);
-    xsane_front_gtk_email_project_update_lockfile_status();
-   return -1;
-  }
-
-  while (from[0] == ' ')
-  {
-    from = from + 1;
-  }
-  snprintf(buf, sizeof(buf), "MAIL FROM: <%s>\r\n", from);
-  DBG(DBG_info2, "> %s", buf);
-  bytes_written = write(fd_socket, buf, strlen(buf));
-  len = read(fd_socket, buf, sizeof(buf));
-  if (len >= 0)
-  {
-    buf[len] = 0;
-  }
-  DBG(DBG_info2, "< %s\n", buf);
-
-  if (buf[0] != '2')
-  {
-    DBG(DBG_info, "=> error\n");
-
-    if (xsane.email_status)
-    {
-      free(xsane.email_status);
-    }
-    xsane.email_status = strdup(TEXT_EMAIL_STATUS_SMTP_ERR_FROM);
-    xsane_front_gtk_email_project_update_lockfile_status();
-   return -1;
-  }
- 
-
-  strncpy(to_line, to, sizeof(to_line)); /* it is not allowed to modify the "to" string, so we make a copy */
-  to_pos = to_line;
-  while (to_pos != NULL)
-  {
-    while (*to_pos == ' ')
-    {
-      to_pos = to_pos + 1;
-    }
-    pos = strchr(to_pos, ',');
-
-    if (pos)
-    {
-      *pos = 0; /* end of string marker */
-    }
-
-    snprintf(buf, sizeof(buf), "RCPT TO: <%s>\r\n", to_pos);
-
-    DBG(DBG_info2, "> %s", buf);
-    bytes_written = write(fd_socket, buf, strlen(buf));
-    len = read(fd_socket, buf, sizeof(buf));
-    if (len >= 0)
-    {
-      buf[len] = 0;
-    }
-    DBG(DBG_info2, "< %s\n", buf);
-  
-    if (buf[0] != '2')
-    {
-      DBG(DBG_info, "=> error\n");
-
-      if (xsane.email_status)
-      {
-        free(xsane.email_status);
-      }
-      xsane.email_status = strdup(TEXT_EMAIL_STATUS_SMTP_ERR_RCPT);
-      xsane_front_gtk_email_project_update_lockfile_status();
-     return -1;
-    }
-
-    if (pos)
-    {
-      to_pos = pos+1;
-    }
-    else
-    {
-      to_pos = NULL;
-    }
-  }
-
-  snprintf(buf, sizeof(buf), "DATA\r\n");
-  DBG(DBG_info2, "> %s", buf);
-  bytes_written = write(fd_socket, buf, strlen(buf));
-  len = read(fd_socket, buf, sizeof(buf));
-  if (len >= 0)
-  {
-    buf[len] = 0;
-  }
-  DBG(DBG_info2, "< %s\n", buf);
-
-  if ((buf[0] != '2') && (buf[0] != '3'))
-  {
-    DBG(DBG_info, "=> error\n");
-
-    if (xsane.email_status)
-    {
-      free(xsane.email_status);
-    }
-    xsane.email_status = strdup(TEXT_EMAIL_STATUS_SMTP_ERR_DATA);
-    xsane_front_gtk_email_project_update_lockfile_status();
-   return -1;
-  }
-
- return 0;
-}
-
-/* ---------------------------------------------------------------------------------------------------------------------- */
-
-/* not only a write routine, also reads data */
-int write_smtp_footer(int fd_socket)
-{
- char buf[1024];
- int len;
- ssize_t bytes_written;
-
-  snprintf(buf, sizeof(buf), "\r\n.\r\n");
-  DBG(DBG_info2, "> %s", buf);
-  bytes_written = write(fd_socket, buf, strlen(buf));
-  len = read(fd_socket, buf, sizeof(buf));
-  if (len >= 0)
-  {
-    buf[len] = 0;
-  }
-  DBG(DBG_info2, "< %s\n", buf);
-
-  snprintf(buf, sizeof(buf), "QUIT\r\n");
-  DBG(DBG_info2, "> %s", buf);
-  bytes_written = write(fd_socket, buf, strlen(buf));
-  len = read(fd_socket, buf, sizeof(buf));
-  if (len >= 0)
-  {
-    buf[len] = 0;
-  }
-  DBG(DBG_info2, "< %s\n", buf);
-
- return 0;
-}
-
 #endif
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
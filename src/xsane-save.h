@@ -28,6 +28,7 @@
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
 #include <xsane.h>
+#include "xsane-cms.h"
 #ifdef HAVE_LIBTIFF
 # include "tiffio.h"
 #endif
@@ -35,15 +36,22 @@
 /* ---------------------------------------------------------------------------------------------------------------------- */
                                                                                                                    
 /* The pdf_xref struct holds byte offsets from the beginning of the PDF
- * file to each object of the PDF file -- used to build the xref table
+ * file to each object of the PDF file -- used to build the xref table.
+ * Objects 1-3 are catalog, outlines and pages, 4 is the icc profile, 5 is
+ * unused. Each page has a page, a contents and an image object, the info
+ * object follows the last page.
  */
 #define PDF_PAGES_MAX 1000
+#define PDF_PAGE_OBJECT(page)     ((page) * 3 + 3)
+#define PDF_CONTENTS_OBJECT(page) ((page) * 3 + 4)
+#define PDF_IMAGE_OBJECT(page)    ((page) * 3 + 5)
+#define PDF_INFO_OBJECT(pages)    ((pages) * 3 + 6)
 struct pdf_xref
 {
-  unsigned long obj[PDF_PAGES_MAX * 2 + 8];
+  unsigned long obj[PDF_INFO_OBJECT(PDF_PAGES_MAX) + 1];
   unsigned long xref; /* xref table */
-  unsigned long slen; /* length of image stream */
-  unsigned long slenp; /* position of image stream length */
+  unsigned long slen; /* length of stream */
+  unsigned long slenp; /* position of stream length */
 };
                                                                                                                    
 /* ---------------------------------------------------------------------------------------------------------------------- */
@@ -61,10 +69,11 @@ extern void xsane_write_pnm_header(FILE *file, Image_info *image_info, int save_
 extern int xsane_copy_file(FILE *outfile, FILE *infile, GtkProgressBar *progress_bar, int *cancel_save);
 extern int xsane_copy_file_by_name(char *output_filename, char *input_filename, GtkProgressBar *progress_bar, int *cancel_save);
 #ifdef HAVE_LIBLCMS
-extern cmsHTRANSFORM xsane_create_cms_transform(Image_info *image_info, int cms_function, int cms_intent, int cms_bpc);
+extern XsaneCmsTransform *xsane_create_cms_transform(Image_info *image_info, int cms_function, int cms_intent, int cms_bpc);
 #endif
 extern int xsane_save_grayscale_image_as_lineart(FILE *outfile, FILE *imagefile, Image_info *image_info, GtkProgressBar *progress_bar, int *cancel_save);
-extern int xsane_save_scaled_image(FILE *outfile, FILE *imagefile, Image_info *image_info, float x_scale, float y_scale, GtkProgressBar *progress_bar, int *cancel_save);
+extern int xsane_save_scaled_image(FILE *outfile, FILE *imagefile, Image_info *image_info, float x_scale, float y_scale, int filter, GtkProgressBar *progress_bar, int *cancel_save);
+extern int xsane_save_reduce_resolution(FILE **imagefile, Image_info *image_info, float resolution_x, float resolution_y, GtkProgressBar *progress_bar, int *cancel_save);
 extern int xsane_save_despeckle_image(FILE *outfile, FILE *imagefile, Image_info *image_info, int radius, GtkProgressBar *progress_bar, int *cancel_save);
 extern int xsane_save_blur_image(FILE *outfile, FILE *imagefile, Image_info *image_info, float radius, GtkProgressBar *progress_bar, int *cancel_save);
 extern int xsane_save_rotate_image(FILE *outfile, FILE *imagefile, Image_info *image_info, int rotation, GtkProgressBar *progress_bar, int *cancel_save);
@@ -77,13 +86,13 @@ extern int xsane_save_ps_page(FILE *outfile, int page,
                        FILE *imagefile, Image_info *image_info, float width, float height,
                        int paper_left_margin, int paper_bottom_margin, int paper_width, int paper_height, int paper_orientation,
                        int flatedecode,
-                       cmsHTRANSFORM hTransform, int apply_ICM_profile, int embed_CSA, char *CSA_profile, int intent,
+                       XsaneCmsTransform *hTransform, int apply_ICM_profile, int embed_CSA, char *CSA_profile, int intent,
                        GtkProgressBar *progress_bar, int *cancel_save);
 extern int xsane_save_ps(FILE *outfile, FILE *imagefile, Image_info *image_info,
                          float width, float height,
                          int paper_left_margin, int paper_bottom_margin, int paper_width, int paper_height, int paper_orientation,
 			 int flatedecode,
-                         cmsHTRANSFORM hTransform, int apply_ICM_profile, int embed_CSA, char *CSA_profile,
+                         XsaneCmsTransform *hTransform, int apply_ICM_profile, int embed_CSA, char *CSA_profile,
                          int embed_CRD, char *CRD_profile, int blackpointcompensation, int intent,
                          GtkProgressBar *progress_bar, int *cancel_save);
 extern void xsane_save_pdf_create_document_header(FILE *outfile, struct pdf_xref *xref, int pages, int flatedecode);
@@ -91,28 +100,28 @@ extern void xsane_save_pdf_create_document_trailer(FILE *outfile, struct pdf_xre
 extern int xsane_save_pdf_page(FILE *outfile, struct pdf_xref *xref, int page,
                                FILE *imagefile, Image_info *image_info, float width, float height,
                                int paper_left_margin, int paper_bottom_margin, int paper_width, int paper_height, int paper_orientation,
-                               int flatedecode,
-                               cmsHTRANSFORM hTransform, int embed__scanner_icm_profile, int icc_object,
+                               int flatedecode, int compression,
+                               XsaneCmsTransform *hTransform, int embed__scanner_icm_profile, int icc_object,
                                GtkProgressBar *progress_bar, int *cancel_save);
 extern int xsane_save_pdf(FILE *outfile, FILE *imagefile, Image_info *image_info,
                           float width, float height,
                           int paper_left_margin, int paper_bottom_margin, int paper_width, int paper_height, int paper_orientation,
-                          int flatedecode,
-                          cmsHTRANSFORM hTransform, int apply_ICM_profile, int cms_function,
+                          int flatedecode, int compression,
+                          XsaneCmsTransform *hTransform, int apply_ICM_profile, int cms_function,
                           GtkProgressBar *progress_bar, int *cancel_save);
 #ifdef HAVE_LIBJPEG
-extern int xsane_save_jpeg(FILE *outfile, int quality, FILE *imagefile, Image_info *image_info, cmsHTRANSFORM hTransform,  int apply_ICM_profile, int cms_function, GtkProgressBar *progress_bar, int *cancel_save);
+extern int xsane_save_jpeg(FILE *outfile, int quality, FILE *imagefile, Image_info *image_info, XsaneCmsTransform *hTransform,  int apply_ICM_profile, int cms_function, GtkProgressBar *progress_bar, int *cancel_save);
 #endif
 #ifdef HAVE_LIBTIFF
-extern int xsane_save_tiff_page(TIFF *tiffile, int page, int pages, int quality, FILE *imagefile, Image_info *image_info, cmsHTRANSFORM hTransform, int apply_ICM_profile, int cms_function,
+extern int xsane_save_tiff_page(TIFF *tiffile, int page, int pages, int quality, FILE *imagefile, Image_info *image_info, XsaneCmsTransform *hTransform, int apply_ICM_profile, int cms_function,
 	                         GtkProgressBar *progress_bar, int *cancel_save);
 #endif
-extern int xsane_save_png(FILE *outfile, int compression, FILE *imagefile, Image_info *image_info, cmsHTRANSFORM hTransform, int apply_ICM_profile, int cms_function, GtkProgressBar *progress_bar, int *cancel_save);
-extern int xsane_save_png_16(FILE *outfile, int compression, FILE *imagefile, Image_info *image_info, cmsHTRANSFORM hTransform, int apply_ICM_profile, int cms_function, GtkProgressBar *progress_bar, int *cancel_save);
-extern int xsane_save_pnm_16(FILE *outfile, FILE *imagefile, Image_info *image_info, cmsHTRANSFORM hTransform, int apply_ICM_profile, GtkProgressBar *progress_bar, int *cancel_save);
+extern int xsane_save_png(FILE *outfile, int compression, FILE *imagefile, Image_info *image_info, XsaneCmsTransform *hTransform, int apply_ICM_profile, int cms_function, GtkProgressBar *progress_bar, int *cancel_save);
+extern int xsane_save_png_16(FILE *outfile, int compression, FILE *imagefile, Image_info *image_info, XsaneCmsTransform *hTransform, int apply_ICM_profile, int cms_function, GtkProgressBar *progress_bar, int *cancel_save);
+extern int xsane_save_pnm_16(FILE *outfile, FILE *imagefile, Image_info *image_info, XsaneCmsTransform *hTransform, int apply_ICM_profile, GtkProgressBar *progress_bar, int *cancel_save);
 extern int xsane_save_image_as_lineart(char *output_filename, char *input_filename, GtkProgressBar *progress_bar, int *cancel_save);
 extern int xsane_save_image_as_text(char *output_filename, char *input_filename, GtkProgressBar *progress_bar, int *cancel_save);
-extern int xsane_save_image_as(char *output_filename, char *input_filename, int output_format, int apply_ICM_profile, int cms_function, int cms_intent, int cms_bpc, GtkProgressBar *progress_bar, int *cancel_save);
+extern int xsane_save_image_as(char *output_filename, char *input_filename, int output_format, int pdf_compression, int apply_ICM_profile, int cms_function, int cms_intent, int cms_bpc, GtkProgressBar *progress_bar, int *cancel_save);
 extern void null_print_func(gchar *msg);
 extern int xsane_transfer_to_gimp(char *input_filename, int apply_ICM_profile, int cms_function, GtkProgressBar *progress_bar, int *cancel_save);
 extern void write_base64(int fd_socket, FILE *infile);
@@ -122,10 +131,6 @@ extern void write_email_mime_ascii(int fd_socket, char *boundary);
 extern void write_email_mime_html(int fd_socket, char *boundary);
 extern void write_email_attach_image(int fd_socket, char *boundary, char *content_id, char *content_type, FILE *infile, char *filename);
 extern void write_email_attach_file(int fd_socket, char *boundary, FILE *infile, char *filename);
-extern int open_socket(char *server, int port);
-extern int pop3_login(int fd_socket, char *user, char *passwd);
-extern int write_smtp_header(int fd_socket, char *from, char *to, int auth_type, char *user, char *pass);
-extern int write_smtp_footer(int fd_socket);
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 #endif
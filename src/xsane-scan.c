@@ -34,6 +34,12 @@
 #include "xsane-multipage-project.h"
 #include "xsane-fax-project.h"
 #include "xsane-email-project.h"
+#include "xsane-pipeline.h"
+#include "xsane-reader.h"
+#include "xsane-lut.h"
+#include "xsane-planar.h"
+#include "xsane-lineart.h"
+#include "xsane-job.h"
 
 #ifdef HAVE_LIBPNG
 #ifdef HAVE_LIBZ
@@ -47,14 +53,19 @@
 /* forward declarations: */
 
 static int xsane_generate_dummy_filename(int conversion_level);
+static SANE_Status xsane_scan_read(SANE_Byte *buf, SANE_Int max_len, SANE_Int *len);
 static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition cond);
 static RETSIGTYPE xsane_sigpipe_handler(int signal);
 static int xsane_test_multi_scan(void);
+static void xsane_scan_drop_next_page(void);
+static void xsane_scan_cancel_next_page(void);
 void xsane_scan_done(SANE_Status status);
 void xsane_cancel(void);
 static void xsane_start_scan(void);
 gint xsane_scan_dialog(gpointer *data);
 static void xsane_create_internal_gamma_tables(void);
+static int xsane_create_scan_lut(void);
+static void xsane_create_scan_pipeline(Image_info *image_info);
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
@@ -74,7 +85,7 @@ static int xsane_generate_dummy_filename(int conversion_level)
     free(xsane.dummy_filename);
   }
 
-  if ( (conversion_level == 0) && (xsane.scan_rotation) ) /* scan level with rotation */
+  if ( (conversion_level == 0) && (xsane.scan_rotation) && (!xsane.pipeline) ) /* scan level with rotation that is not done by the pipeline */
   {
     tempfile = TRUE;
   }
@@ -134,9 +145,21 @@ static int xsane_generate_dummy_filename(int conversion_level)
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
+/* reads from the reader thread when it is active, otherwise directly from the backend */
+static SANE_Status xsane_scan_read(SANE_Byte *buf, SANE_Int max_len, SANE_Int *len)
+{
+  if (xsane.reader)
+  {
+   return xsane_reader_read(xsane.reader, buf, max_len, len);
+  }
+
+ return sane_read(xsane.dev, buf, max_len, len);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
 static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition cond)
 {
- SANE_Handle dev = xsane.dev;
  SANE_Status status;
  SANE_Int len;
  int i, j;
@@ -147,7 +170,91 @@ static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition
 
   xsane.reading_data = TRUE;
 
-  if ( (xsane.param.depth == 1) || (xsane.param.depth == 8) )
+  if (xsane.pipeline) /* gamma correction, lineart expansion and rotation are done by the pipeline */
+  {
+   guint16 buf16[32768];
+   unsigned char *buf8 = (unsigned char *) buf16; /* aligned for 16 bit data */
+
+    DBG(DBG_info, "using scan pipeline\n");
+
+    while (1)
+    {
+      if (xsane.cancel_scan)
+      {
+        break; /* leave while loop */
+      }
+
+      status = xsane_scan_read((SANE_Byte *) buf8, sizeof(buf16), &len);
+
+      DBG(DBG_info, "sane_read returned with status %s\n", XSANE_STRSTATUS(status));
+      DBG(DBG_info, "sane_read: len = %d\n", len);
+
+      if (!xsane.scanning) /* scan may have been canceled while sane_read was executed */
+      {
+        return; /* ok, the scan has been canceled */
+      }
+
+      if (status == SANE_STATUS_EOF)
+      {
+        xsane_scan_done(SANE_STATUS_EOF); /* image complete, stop scanning */
+        return;
+      }
+
+      if (status == SANE_STATUS_CANCELLED)
+      {
+        xsane_scan_done(status); /* status = return of sane_read */
+        snprintf(buf, sizeof(buf), "%s.", XSANE_STRSTATUS(status));
+        xsane_back_gtk_warning(buf, TRUE);
+        return;
+      }
+
+      if (status != SANE_STATUS_GOOD)
+      {
+        xsane_scan_done(status); /* status = return of sane_read */
+        snprintf(buf, sizeof(buf), "%s %s.", ERR_DURING_READ, XSANE_STRSTATUS(status));
+        xsane_back_gtk_error(buf, TRUE);
+        return;
+      }
+
+      if (!len) /* nothing read */
+      {
+        if (xsane.input_tag >= 0)
+        {
+          break; /* leave xsane_read_image_data, will be called by gdk when select_fd event occurs */
+        }
+        else /* no select fd available */
+        {
+          while (gtk_events_pending())
+          {
+            DBG(DBG_info, "calling gtk_main_iteration\n");
+            gtk_main_iteration();
+          }
+          continue; /* we have to keep this loop running because it will never be called again */
+        }
+      }
+
+      xsane.bytes_read += len;
+      xsane_progress_update(xsane.bytes_read / (gfloat) xsane.num_bytes);
+
+      if (xsane_pipeline_write(xsane.pipeline, buf8, len))
+      {
+        xsane_scan_done(-1); /* -1 = error */
+        snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
+        xsane_back_gtk_error(buf, TRUE);
+        return;
+      }
+
+      if (xsane.input_tag < 0)
+      {
+        while (gtk_events_pending())
+        {
+          DBG(DBG_info, "calling gtk_main_iteration\n");
+          gtk_main_iteration();
+        }
+      }
+    }
+  }
+  else if ( (xsane.param.depth == 1) || (xsane.param.depth == 8) )
   {
    unsigned char buf8[2*32768];
    unsigned char *buf8ptr;
@@ -161,7 +268,7 @@ static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition
         break; /* leave while loop */
       }
 
-      status = sane_read(dev, (SANE_Byte *) buf8, sizeof(buf8), &len);
+      status = xsane_scan_read((SANE_Byte *) buf8, sizeof(buf8), &len);
 
       DBG(DBG_info, "sane_read returned with status %s\n", XSANE_STRSTATUS(status));
       DBG(DBG_info, "sane_read: len = %d\n", len);
@@ -237,34 +344,31 @@ static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition
         case SANE_FRAME_GRAY:
           {
            int i;
-           u_char val;
 
             DBG(DBG_info, "grayscale\n");
 
-            if ((!xsane.scanner_gamma_gray) && (xsane.param.depth > 1))
+            if (xsane.lut) /* gamma correction by xsane */
             {
-              buf8ptr = buf8;
-
-              for (i=0; i < len; ++i) /* do gamma correction by xsane */
-              {
-                *buf8ptr = xsane.gamma_data[(int) (*buf8ptr)];
-                buf8ptr++;
-              }
+              xsane.pixelcolor = xsane_lut_apply(xsane.lut, buf8, buf8, len, xsane.pixelcolor);
 
               fwrite(buf8, 1, len, xsane.out); /* write gamma corrected data */
             }
             else if ((xsane.param.depth == 1) && (xsane.expand_lineart_to_grayscale)) 
             {
-             unsigned char *expanded_buf8;
              unsigned char *expanded_buf8ptr;
+             int bytes, pixels;
  
               /* if we want to do any postprocessing (e.g. rotation) */
               /* we save lineart images in grayscale mode */
               /* to speed up transformation and saving the transformed  expanded (1bit->1byte) */
               /* is written in a buffer and saved as full buffer */
  
-              expanded_buf8 = malloc(len * 8); /* one byte for each pixel (bit) */
-              if (!expanded_buf8)
+              if (!xsane.expanded_buf8) /* freed by xsane_scan_done */
+              {
+                xsane.expanded_buf8 = malloc(sizeof(buf8) * 8); /* one byte for each pixel (bit) */
+              }
+
+              if (!xsane.expanded_buf8)
               {
                 xsane_scan_done(-1); /* -1 = error */
                 snprintf(buf, sizeof(buf), "%s", ERR_NO_MEM);
@@ -272,28 +376,28 @@ static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition
                return;
               }
  
-              expanded_buf8ptr = expanded_buf8;
+              expanded_buf8ptr = xsane.expanded_buf8;
               buf8ptr = buf8;
- 
-              for (i = 0; i < len; ++i)
+              i = len;
+
+              while (i > 0) /* the padding bits at the end of each line are dropped */
               {
-                val = *buf8ptr;
-                for (j = 7; j >= 0; --j)
+                bytes  = MIN(i, (xsane.lineart_to_grayscale_x + 7) / 8);
+                pixels = MIN(bytes * 8, xsane.lineart_to_grayscale_x);
+
+                xsane_lineart_expand(buf8ptr, expanded_buf8ptr, pixels);
+
+                buf8ptr          += bytes;
+                expanded_buf8ptr += pixels;
+                i                -= bytes;
+
+                xsane.lineart_to_grayscale_x -= pixels;
+                if (xsane.lineart_to_grayscale_x <= 0)
                 {
-                  *expanded_buf8ptr = (val & (1 << j)) ? 0x00 : 0xff;
-                  expanded_buf8ptr++;
-
-                  xsane.lineart_to_grayscale_x--;
-                  if (xsane.lineart_to_grayscale_x <= 0)
-                  {
-                    xsane.lineart_to_grayscale_x = xsane.param.pixels_per_line;
-                    break;
-                  }
+                  xsane.lineart_to_grayscale_x = xsane.param.pixels_per_line;
                 }
-                buf8ptr++;
               }
-              fwrite(expanded_buf8, 1, (size_t) (expanded_buf8ptr - expanded_buf8), xsane.out);
-              free(expanded_buf8);
+              fwrite(xsane.expanded_buf8, 1, (size_t) (expanded_buf8ptr - xsane.expanded_buf8), xsane.out);
             }
             else /* save direct to the file */
             {
@@ -304,34 +408,11 @@ static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition
 
         case SANE_FRAME_RGB:
           {
-           int i;
-
             DBG(DBG_info, "1 pass color\n");
 
-            if (!xsane.scanner_gamma_color) /* do gamma correction by xsane */
+            if (xsane.lut) /* gamma correction by xsane */
             {
-              buf8ptr = buf8;
-              for (i=0; i < len; ++i)
-              {
-                if (xsane.pixelcolor == 0)
-                {
-                  *buf8ptr = xsane.gamma_data_red[(int) (*buf8ptr)];
-                  buf8ptr++;
-                  xsane.pixelcolor++;
-                }
-                else if (xsane.pixelcolor == 1)
-                {
-                  *buf8ptr = xsane.gamma_data_green[(int) (*buf8ptr)];
-                  buf8ptr++;
-                  xsane.pixelcolor++;
-                }
-                else
-                {
-                  *buf8ptr = xsane.gamma_data_blue[(int) (*buf8ptr)];
-                  buf8ptr++;
-                  xsane.pixelcolor = 0;
-                }
-              }
+              xsane.pixelcolor = xsane_lut_apply(xsane.lut, buf8, buf8, len, xsane.pixelcolor);
               fwrite(buf8, 1, len, xsane.out); /* write buffer */
             }
             else /* gamma correction has been done by scanner */
@@ -350,27 +431,15 @@ static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition
 
             DBG(DBG_info, "3 pass color\n");
 
-            if (!xsane.scanner_gamma_color) /* gamma correction by xsane */
+            if (xsane.lut) /* gamma correction by xsane */
             {
-             SANE_Int *gamma;
-
-              if (xsane.param.format == SANE_FRAME_RED)
-              {
-                gamma = xsane.gamma_data_red;
-              }
-              else if (xsane.param.format == SANE_FRAME_GREEN)
-              {
-                gamma = xsane.gamma_data_green;
-              }
-              else
-              {
-                gamma = xsane.gamma_data_blue;
-              }
+              xsane_lut_apply(xsane.lut, buf8, buf8, len, 0);
+            }
 
-              for (i = 0; i < len; ++i)
-              {
-                buf8[i] = gamma[(int) buf8[i]];
-              }
+            if (xsane.planar) /* the planes are interleaved when the scan is done */
+            {
+              xsane_planar_write(xsane.planar, xsane.param.format - SANE_FRAME_RED, buf8, len);
+              break;
             }
 
             buf8ptr = buf8;
@@ -420,42 +489,13 @@ static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition
 #ifdef SUPPORT_RGBA
         case SANE_FRAME_RGBA: /* Scanning including Infrared channel */
           {
-           int i;
            char val;
 
             DBG(DBG_info, "1 pass color+alpha (RGBA)\n");
 
-            if (!xsane.scanner_gamma_color) /* gamma correction by xsane */
+            if (xsane.lut) /* gamma correction by xsane */
             {
-              buf8ptr = buf8;
-
-              for (i=0; i < len; ++i)
-              {
-                if (xsane.pixelcolor == 0)
-                {
-                  *buf8ptr = xsane.gamma_data_red[(int) (*buf8ptr)];
-                  buf8ptr++;
-                  xsane.pixelcolor++;
-                }
-                else if (xsane.pixelcolor == 1)
-                {
-                  *buf8ptr = xsane.gamma_data_green[(int) (*buf8ptr)];
-                  buf8ptr++;
-                  xsane.pixelcolor++;
-                }
-                else if (xsane.pixelcolor == 2)
-                {
-                  *buf8ptr = xsane.gamma_data_blue[(int) (*buf8ptr)];
-                  buf8ptr++;
-                  xsane.pixelcolor++;
-                }
-                else
-                {
-                  /* no gamma table for infrared channel */
-                  buf8ptr++;
-                  xsane.pixelcolor = 0;
-                }
-              }
+              xsane.pixelcolor = xsane_lut_apply(xsane.lut, buf8, buf8, len, xsane.pixelcolor);
 
               fwrite(buf8, 1, len, xsane.out);
             }
@@ -495,7 +535,7 @@ static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition
       if (xsane.read_offset_16) /* if we have had an odd number of bytes */
       {
         buf8[0] = xsane.last_offset_16_byte;
-        status = sane_read(dev, ((SANE_Byte *) buf16) + 1, sizeof(buf16) - 1, &len);
+        status = xsane_scan_read(((SANE_Byte *) buf16) + 1, sizeof(buf16) - 1, &len);
         if (len)
         {
           len++;
@@ -503,7 +543,7 @@ static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition
       }
       else /* last read we had an even number of bytes */
       {
-        status = sane_read(dev, (SANE_Byte *) buf16, sizeof(buf16), &len);
+        status = xsane_scan_read((SANE_Byte *) buf16, sizeof(buf16), &len);
       }
 
       DBG(DBG_info, "sane_read returned with status %s\n", XSANE_STRSTATUS(status));
@@ -599,17 +639,9 @@ static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition
             {
               DBG(DBG_info, "reducing 16 bit image to 8 bit\n");
 
-              if (!xsane.scanner_gamma_gray) /* gamma correction by xsane */
+              if (xsane.lut) /* gamma correction by xsane */
               {
-                buf8ptr = buf8;
-                buf16ptr = buf16;
-
-                for (i=0; i < len/2; ++i)
-                {
-                  *buf8ptr = (xsane.gamma_data[(*buf16ptr)]) >> 8; /* reduce to 8 bit */
-                  buf8ptr++;
-                  buf16ptr++;
-                }
+                xsane.pixelcolor = xsane_lut_apply(xsane.lut, buf16, buf8, len/2, xsane.pixelcolor); /* reduce to 8 bit */
 
                 fwrite(buf8, 1, len/2, xsane.out);
               }
@@ -630,15 +662,9 @@ static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition
             }
             else /* save as 16 bit image */
             {
-              if (!xsane.scanner_gamma_gray) /* gamma correction by xsane */
+              if (xsane.lut) /* gamma correction by xsane */
               {
-                buf16ptr = buf16;
-
-                for (i=0; i < len/2; ++i)
-                {
-                  *buf16ptr = xsane.gamma_data[(*buf16ptr)];
-                  buf16ptr++;
-                }
+                xsane.pixelcolor = xsane_lut_apply(xsane.lut, buf16, buf16, len/2, xsane.pixelcolor);
                 fwrite(buf16, 2, len/2, xsane.out);
               }
               else /* gamma correction by scanner */
@@ -657,35 +683,10 @@ static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition
             {
               DBG(DBG_info, "reducing 16 bit image to 8 bit\n");
 
-              if (!xsane.scanner_gamma_color) /* gamma correction by xsane */
+              if (xsane.lut) /* gamma correction by xsane */
               {
-                buf8ptr = buf8;
-                buf16ptr = buf16;
+                xsane.pixelcolor = xsane_lut_apply(xsane.lut, buf16, buf8, len/2, xsane.pixelcolor); /* reduce to 8 bit */
 
-                for (i=0; i < len/2; ++i)
-                {
-                  if (xsane.pixelcolor == 0)
-                  {
-                    *buf8ptr = (xsane.gamma_data_red[(*buf16ptr)]) >> 8; /* reduce to 8 bit */
-                    buf8ptr++;
-                    buf16ptr++;
-                    xsane.pixelcolor++;
-                  }
-                  else if (xsane.pixelcolor == 1)
-                  {
-                    *buf8ptr = (xsane.gamma_data_green[(*buf16ptr)]) >> 8; /* reduce to 8 bit */
-                    buf8ptr++;
-                    buf16ptr++;
-                    xsane.pixelcolor++;
-                  }
-                  else
-                  {
-                    *buf8ptr = (xsane.gamma_data_blue[(*buf16ptr)]) >> 8; /* reduce to 8 bit */
-                    buf8ptr++;
-                    buf16ptr++;
-                    xsane.pixelcolor = 0;
-                  }
-                }
                 fwrite(buf8, 1, len/2, xsane.out);
               }
               else /* gamma correction by scanner */
@@ -705,31 +706,9 @@ static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition
             }
             else /* save as 16 bit image */
             {
-              if (!xsane.scanner_gamma_color) /* gamma correction by xsane */
+              if (xsane.lut) /* gamma correction by xsane */
               {
-                buf16ptr = buf16;
-
-                for (i=0; i < len/2; ++i)
-                {
-                  if (xsane.pixelcolor == 0)
-                  {
-                    *buf16ptr = xsane.gamma_data_red[(*buf16ptr)];
-                    buf16ptr++;
-                    xsane.pixelcolor++;
-                  }
-                  else if (xsane.pixelcolor == 1)
-                  {
-                    *buf16ptr = xsane.gamma_data_green[(*buf16ptr)];
-                    buf16ptr++;
-                    xsane.pixelcolor++;
-                  }
-                  else
-                  {
-                    *buf16ptr = xsane.gamma_data_blue[(*buf16ptr)];
-                    buf16ptr++;
-                    xsane.pixelcolor = 0;
-                  }
-                }
+                xsane.pixelcolor = xsane_lut_apply(xsane.lut, buf16, buf16, len/2, xsane.pixelcolor);
                 fwrite(buf16, 2, len/2, xsane.out);
               }
               else /* gamma correction by scanner */
@@ -744,11 +723,21 @@ static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition
         case SANE_FRAME_GREEN:
         case SANE_FRAME_BLUE:
           /* this is incomplete:
-             - missing: gamma correction by xsane
              - missing: reduction to 8 bit
              but I do not think there are 3 pass scanners with more
              than 24 bits/pixel */
           {
+            if (xsane.lut) /* gamma correction by xsane */
+            {
+              xsane_lut_apply(xsane.lut, buf16, buf16, len/2, 0);
+            }
+
+            if (xsane.planar) /* the planes are interleaved when the scan is done */
+            {
+              xsane_planar_write(xsane.planar, xsane.param.format - SANE_FRAME_RED, buf16, len);
+              break;
+            }
+
             for (i = 0; i < len/2; ++i)
             {
               fwrite(buf16 + i, 2, 1, xsane.out);
@@ -767,45 +756,11 @@ static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition
             {
               DBG(DBG_info, "reducing 16 bit image to 8 bit\n");
 
-              if (!xsane.scanner_gamma_color)
+              if (xsane.lut) /* gamma correction by xsane */
               {
-                buf8ptr = buf8;
-                buf16ptr = buf16;
+                xsane.pixelcolor = xsane_lut_apply(xsane.lut, buf16, buf8, len/2, xsane.pixelcolor); /* reduce to 8 bit */
 
-                for (i=0; i < len/2; ++i)
-                {
-                  if (xsane.pixelcolor == 0)
-                  {
-                    *buf8ptr = (xsane.gamma_data_red[(*buf16ptr)]) >> 8; /* reduce to 8 bit */
-                    buf8ptr++;
-                    buf16ptr++;
-                    xsane.pixelcolor++;
-                  }
-                  else if (xsane.pixelcolor == 1)
-                  {
-                    *buf8ptr = (xsane.gamma_data_green[(*buf16ptr)]) >> 8; /* reduce to 8 bit */
-                    buf8ptr++;
-                    buf16ptr++;
-                    xsane.pixelcolor++;
-                  }
-                  else if (xsane.pixelcolor == 2)
-                  {
-                    *buf8ptr = (xsane.gamma_data_blue[(*buf16ptr)]) >> 8; /* reduce to 8 bit */
-                    buf8ptr++;
-                    buf16ptr++;
-                    xsane.pixelcolor++;
-                  }
-                  else
-                  {
-                    /* no gamma table for infrared channel */
-                    *buf8ptr = (*buf16ptr) >> 8; /* reduce to 8 bit */
-                    buf8ptr++;
-                    buf16ptr++;
-                    xsane.pixelcolor = 0;
-                  }
-                }
-
-                fwrite(buf8, 1, len, xsane.out);
+                fwrite(buf8, 1, len/2, xsane.out);
               }
               else /* gamma correction done by scanner */
               {
@@ -824,38 +779,9 @@ static void xsane_read_image_data(gpointer data, gint source, GdkInputCondition
             }
             else /* save as 16 bit image */
             {
-              if (!xsane.scanner_gamma_color)
+              if (xsane.lut) /* gamma correction by xsane */
               {
-                buf16ptr = buf16;
-
-                for (i=0; i < len/2; ++i)
-                {
-                  if (xsane.pixelcolor == 0)
-                  {
-                    *buf16ptr = xsane.gamma_data_red[(*buf16ptr)];
-                    buf16ptr++;
-                    xsane.pixelcolor++;
-                  }
-                  else if (xsane.pixelcolor == 1)
-                  {
-                    *buf16ptr = xsane.gamma_data_green[(*buf16ptr)];
-                    buf16ptr++;
-                    xsane.pixelcolor++;
-                  }
-                  else if (xsane.pixelcolor == 2)
-                  {
-                    *buf16ptr = xsane.gamma_data_blue[(*buf16ptr)];
-                    buf16ptr++;
-                    xsane.pixelcolor++;
-                  }
-                  else
-                  {
-                    /* no gamma table for infrared channel */
-                    buf16ptr++;
-                    xsane.pixelcolor = 0;
-                  }
-                }
-
+                xsane.pixelcolor = xsane_lut_apply(xsane.lut, buf16, buf16, len/2, xsane.pixelcolor);
                 fwrite(buf16, 2, len/2, xsane.out);
               }
               else /* gamma correction done by scanner */
@@ -941,6 +867,39 @@ static int xsane_test_multi_scan(void)
 
   return FALSE;
 }
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* the next adf page is not scanned: wait for the reader thread, the caller has to call sane_cancel */
+static void xsane_scan_drop_next_page(void)
+{
+ SANE_Status status;
+
+  if (xsane.next_page_reader)
+  {
+    DBG(DBG_info, "xsane_scan_drop_next_page\n");
+
+    xsane_reader_next_page(xsane.next_page_reader, &status);
+    xsane_reader_free(xsane.next_page_reader);
+    xsane.next_page_reader = NULL;
+  }
+
+  xsane.next_page_started = FALSE;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* xsane_scan_dialog does not scan the next adf page that already has been started */
+static void xsane_scan_cancel_next_page(void)
+{
+  if (xsane.next_page_started)
+  {
+    DBG(DBG_info, "xsane_scan_cancel_next_page\n");
+
+    xsane.next_page_started = FALSE;
+    sane_cancel(xsane.dev);
+  }
+}
                                     
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
@@ -983,6 +942,7 @@ static int xsane_reduce_to_lineart()
   if (abort)
   {
     xsane_set_sensitivity(TRUE);		/* reactivate buttons etc */
+    xsane_scan_drop_next_page();
     sane_cancel(xsane.dev); /* stop scanning */
     xsane_update_histogram(TRUE /* update raw */);
     xsane_update_param(0);
@@ -1002,6 +962,7 @@ static int xsane_reduce_to_lineart()
 void xsane_scan_done(SANE_Status status)
 {
  Image_info image_info;
+ int pipeline_done = FALSE;
 
   DBG(DBG_proc, "xsane_scan_done\n");
 
@@ -1019,6 +980,20 @@ void xsane_scan_done(SANE_Status status)
     xsane.input_tag = -1;
   }
 
+  if (xsane.reader)
+  {
+    if ( (status == SANE_STATUS_EOF) && (preferences.adf_overlap) )
+    {
+      /* the reader thread got EOF and may start the next adf page while this one is saved */
+      xsane.next_page_reader = xsane.reader;
+    }
+    else
+    {
+      xsane_reader_free(xsane.reader); /* cancels the scan if the reader thread is still running */
+    }
+    xsane.reader = NULL;
+  }
+
   xsane_progress_clear(); /* clear progress bar and reset cancel callback */
 
   while(gtk_events_pending())	/* let gtk remove the progress bar and update everything that needs it */
@@ -1028,6 +1003,42 @@ void xsane_scan_done(SANE_Status status)
   }
 
 
+  if (xsane.pipeline)
+  {
+    if ( (status == SANE_STATUS_GOOD) || (status == SANE_STATUS_EOF) )
+    {
+      if (xsane_pipeline_finish(xsane.pipeline)) /* flush rotation and correct pnm header */
+      {
+       char buf[TEXTBUFSIZE];
+
+        snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
+        xsane_back_gtk_error(buf, TRUE);
+        status = -1; /* error */
+      }
+      else
+      {
+        pipeline_done = TRUE;
+
+        if ( (xsane.param.depth == 1) && (xsane.pipeline->last_stage->image_info.depth == 1) )
+        {
+          xsane.expand_lineart_to_grayscale = 0; /* lineart has already been packed again */
+        }
+      }
+    }
+
+    xsane_pipeline_free(xsane.pipeline);
+    xsane.pipeline = NULL;
+  }
+
+  if (xsane.lut)
+  {
+    xsane_lut_free(xsane.lut);
+    xsane.lut = NULL;
+  }
+
+  free(xsane.expanded_buf8);
+  xsane.expanded_buf8 = NULL;
+
   /* we have to free the gamma tables if we used software gamma correction */
   
   if (xsane.gamma_data) 
@@ -1051,13 +1062,34 @@ void xsane_scan_done(SANE_Status status)
     xsane.gamma_data_blue  = 0;
   }
 
+  if (xsane.planar) /* 3 pass scan: write the interleaved planes */
+  {
+    if ( ((status == SANE_STATUS_GOOD) || (status == SANE_STATUS_EOF)) && (xsane.out) )
+    {
+      fseek(xsane.out, xsane.header_size, SEEK_SET);
+
+      if (xsane_planar_write_interleaved(xsane.planar, xsane.out))
+      {
+       char buf[TEXTBUFSIZE];
+
+        snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
+        xsane_back_gtk_error(buf, TRUE);
+        status = -1; /* error */
+      }
+    }
+
+    xsane_planar_free(xsane.planar);
+    xsane.planar = NULL;
+  }
+
   if (xsane.out) /* close file - this is dummy_file but if there is no conversion it is the wanted file */
   {
    int pixel_height = xsane.bytes_read / xsane.param.bytes_per_line;
 
     /* correct image height if necessary, e.g. when scanning with hand scanner */
+    /* the pipeline already has corrected the header */
 
-    if (xsane.param.lines != pixel_height)
+    if ((!pipeline_done) && (xsane.param.lines != pixel_height))
     {
       DBG(DBG_info, "correcting image height to %d lines\n", pixel_height);
       xsane.param.lines = pixel_height;
@@ -1125,7 +1157,7 @@ void xsane_scan_done(SANE_Status status)
   if ( (status == SANE_STATUS_GOOD) || (status == SANE_STATUS_EOF) ) /* no error, do conversion etc. */
   {
     /* do we have to rotate the image ? */
-    if (xsane.scan_rotation)
+    if ((xsane.scan_rotation) && (!pipeline_done))
     {
      char *old_dummy_filename;
      int abort = 0;
@@ -1204,6 +1236,7 @@ void xsane_scan_done(SANE_Status status)
       if (abort)
       {
         xsane_set_sensitivity(TRUE);		/* reactivate buttons etc */
+        xsane_scan_drop_next_page();
         sane_cancel(xsane.dev); /* stop scanning */
         xsane_update_histogram(TRUE /* update raw */);
         xsane_update_param(0);
@@ -1244,9 +1277,21 @@ void xsane_scan_done(SANE_Status status)
 
     if (xsane.xsane_mode == XSANE_SAVE)
     {
-      if ( ( (xsane.xsane_output_format != XSANE_PNM) && /* these files do not need any transformation */
-             (xsane.xsane_output_format != XSANE_RGBA) ) ||
-           (xsane.mode == XSANE_GIMP_EXTENSION) )
+     int converted_by_job = FALSE;
+
+      if ( (xsane.mode != XSANE_GIMP_EXTENSION) &&
+           (xsane.xsane_output_format != XSANE_PNM) && (xsane.xsane_output_format != XSANE_RGBA) &&
+           (xsane.xsane_output_format != XSANE_TEXT) && /* ocr runs an external program and needs the gtk main loop */
+           (!xsane_job_add_save(xsane.output_filename, xsane.dummy_filename, xsane.xsane_output_format, preferences.save_pdf_compression,
+                                xsane.enable_color_management, preferences.cms_function, preferences.cms_intent, preferences.cms_bpc,
+                                xsane.print_filenames)) )
+      { /* the job thread converts the image while the next scan is running, it removes the dummy file and prints the filename */
+        DBG(DBG_info, "conversion of %s is done by the job thread\n", xsane.output_filename);
+        converted_by_job = TRUE;
+      }
+      else if ( ( (xsane.xsane_output_format != XSANE_PNM) && /* these files do not need any transformation */
+                  (xsane.xsane_output_format != XSANE_RGBA) ) ||
+                (xsane.mode == XSANE_GIMP_EXTENSION) )
       { /* ok, we have to do a transformation */
 
         /* open progressbar */
@@ -1265,7 +1310,7 @@ void xsane_scan_done(SANE_Status status)
         else
 #endif /* HAVE_ANY_GIMP */
         {
-          xsane_save_image_as(xsane.output_filename, xsane.dummy_filename, xsane.xsane_output_format, xsane.enable_color_management, preferences.cms_function, preferences.cms_intent, preferences.cms_bpc, xsane.progress_bar, &xsane.cancel_save);
+          xsane_save_image_as(xsane.output_filename, xsane.dummy_filename, xsane.xsane_output_format, preferences.save_pdf_compression, xsane.enable_color_management, preferences.cms_function, preferences.cms_intent, preferences.cms_bpc, xsane.progress_bar, &xsane.cancel_save);
         }
 
         xsane_progress_clear();
@@ -1278,7 +1323,7 @@ void xsane_scan_done(SANE_Status status)
         remove(xsane.dummy_filename);
       }
 
-      if (xsane.print_filenames) /* print created filenames to stdout? */
+      if ((xsane.print_filenames) && (!converted_by_job)) /* print created filenames to stdout? */
       {
         if (xsane.output_filename[0] != '/') /* relative path */
         {
@@ -1353,6 +1398,11 @@ void xsane_scan_done(SANE_Status status)
 
         xsane_read_pnm_header(infile, &image_info);
 
+        /* the printer does not use more pixels than printer_resolution, so the image is reduced before */
+        /* it is sent to the printer. The original image is printed when this is not possible */
+        xsane_save_reduce_resolution(&infile, &image_info, printer_resolution * xsane.zoom, printer_resolution * xsane.zoom,
+                                     xsane.progress_bar, &xsane.cancel_save);
+
         imagewidth  = 72.0 * image_info.image_width /image_info.resolution_x * xsane.zoom; /* desired width in 1/72 inch */
         imageheight = 72.0 * image_info.image_height/image_info.resolution_y * xsane.zoom; /* desired height in 1/72 inch */
 
@@ -1364,21 +1414,24 @@ void xsane_scan_done(SANE_Status status)
         DBG(DBG_info, "imageheight = %f 1/72 inch\n", imageheight);
         DBG(DBG_info, "zoom        = %f\n", xsane.zoom);
 
-        xsane_save_ps(outfile, infile,
-                      &image_info,
-                      imagewidth, imageheight,
-                      preferences.printer[preferences.printernr]->leftoffset   * 72.0/MM_PER_INCH, /* paper_left_margin */
-                      preferences.printer[preferences.printernr]->bottomoffset * 72.0/MM_PER_INCH, /* paper_bottom_margin */
-                      preferences.printer[preferences.printernr]->width  * 72.0/MM_PER_INCH, /* usable paper_width */
-                      preferences.printer[preferences.printernr]->height * 72.0/MM_PER_INCH, /* usable paper_height */
-                      preferences.paper_orientation,
-                      preferences.printer[preferences.printernr]->ps_flatedecoded, /* ps level 3 */
-                      NULL /* hTransform */, xsane.enable_color_management,
-                      preferences.printer[preferences.printernr]->embed_csa, xsane.scanner_default_color_icm_profile,
-                      preferences.printer[preferences.printernr]->embed_crd, preferences.printer[preferences.printernr]->icm_profile, preferences.printer[preferences.printernr]->cms_bpc,
-                      0 /* intent */,
-                      xsane.progress_bar,
-                      &xsane.cancel_save);
+        if (!xsane.cancel_save)
+        {
+          xsane_save_ps(outfile, infile,
+                        &image_info,
+                        imagewidth, imageheight,
+                        preferences.printer[preferences.printernr]->leftoffset   * 72.0/MM_PER_INCH, /* paper_left_margin */
+                        preferences.printer[preferences.printernr]->bottomoffset * 72.0/MM_PER_INCH, /* paper_bottom_margin */
+                        preferences.printer[preferences.printernr]->width  * 72.0/MM_PER_INCH, /* usable paper_width */
+                        preferences.printer[preferences.printernr]->height * 72.0/MM_PER_INCH, /* usable paper_height */
+                        preferences.paper_orientation,
+                        preferences.printer[preferences.printernr]->ps_flatedecoded, /* ps level 3 */
+                        NULL /* hTransform */, xsane.enable_color_management,
+                        preferences.printer[preferences.printernr]->embed_csa, xsane.scanner_default_color_icm_profile,
+                        preferences.printer[preferences.printernr]->embed_crd, preferences.printer[preferences.printernr]->icm_profile, preferences.printer[preferences.printernr]->cms_bpc,
+                        0 /* intent */,
+                        xsane.progress_bar,
+                        &xsane.cancel_save);
+        }
       }
       else
       {
@@ -1463,6 +1516,7 @@ void xsane_scan_done(SANE_Status status)
 
       xsane_update_counter_in_filename(&xsane.multipage_filename, TRUE, 1, preferences.filename_counter_len);
       xsane_multipage_project_save();
+      xsane_multipage_project_append_page(); /* convert the page now, saving the project only writes the trailer */
       free(page);
       free(type);
 
@@ -1591,12 +1645,21 @@ void xsane_scan_done(SANE_Status status)
 
     DBG(DBG_info, "ADF mode end of scan: increment page counter and restart scan\n");
     xsane.adf_page_counter += 1;
-    gtk_timeout_add(100, (GtkFunction)xsane_scan_dialog, NULL); /* wait 100ms then call xsane_scan_dialog(); */
+
+    if (xsane.next_page_reader) /* the reader thread already feeds the next page */
+    {
+      gtk_idle_add((GtkFunction)xsane_scan_dialog, NULL);
+    }
+    else
+    {
+      gtk_timeout_add(100, (GtkFunction)xsane_scan_dialog, NULL); /* wait 100ms then call xsane_scan_dialog(); */
+    }
   }
   else if ( ( (status == SANE_STATUS_GOOD) || (status == SANE_STATUS_EOF) ) && (xsane.batch_loop  == BATCH_MODE_LOOP) )
   {
     /* batch scan loop, this is not the last scan */
     DBG(DBG_info, "Batch mode end of scan\n");
+    xsane_scan_drop_next_page();
     sane_cancel(xsane.dev); /* we have to call sane_cancel otherwise we are not able to set new parameters */
   }
 /*  else if ( ( (status != SANE_STATUS_GOOD) && (status != SANE_STATUS_EOF) ) || (!xsane.batch_loop) ) */ /* last scan: update histogram */
@@ -1605,6 +1668,7 @@ void xsane_scan_done(SANE_Status status)
     DBG(DBG_info, "Normal end of scan\n");
     xsane.adf_page_counter = 0;
     xsane_set_sensitivity(TRUE);		/* reactivate buttons etc */
+    xsane_scan_drop_next_page();
     sane_cancel(xsane.dev); /* stop scanning */
     xsane_update_histogram(TRUE /* update raw */);
     xsane_update_param(0);
@@ -1662,13 +1726,36 @@ static void xsane_start_scan(void)
 
   xsane.read_offset_16 = 0; /* no last byte of old 16 bit data */
 
-  status = sane_start(dev);
+  if (xsane.next_page_started) /* the reader thread of the last adf page did call sane_start */
+  {
+    status = xsane.next_page_status;
+    xsane.next_page_started = FALSE;
+  }
+  else
+  {
+    status = sane_start(dev);
+  }
   DBG(DBG_info, "sane_start returned with status %s\n", XSANE_STRSTATUS(status));
 
+  if (xsane.adf_page_counter == 0)
+  {
+    if (xsane.adf_timer)
+    {
+      g_timer_start(xsane.adf_timer);
+    }
+    else
+    {
+      xsane.adf_timer = g_timer_new();
+    }
+  }
+
   if ((status == SANE_STATUS_NO_DOCS) && (xsane.adf_page_counter>0)) /* ADF out of docs but not first page */
   {
+   double minutes = g_timer_elapsed(xsane.adf_timer, NULL) / 60.0;
+
     xsane_scan_done(status); /* ok, stop multi image scan */
-    snprintf(buf, sizeof(buf), "%s %d", TEXT_ADF_PAGES_SCANNED, xsane.adf_page_counter);
+    snprintf(buf, sizeof(buf), "%s %d\n%s %.1f", TEXT_ADF_PAGES_SCANNED, xsane.adf_page_counter,
+             TEXT_ADF_PAGES_PER_MINUTE, (minutes > 0.0) ? xsane.adf_page_counter / minutes : 0.0);
     xsane_back_gtk_info(buf, FALSE);
     xsane.adf_page_counter = 0;
    return;
@@ -1728,31 +1815,6 @@ static void xsane_start_scan(void)
   {
     xsane_create_internal_gamma_tables(); /* create gamma tables that are not supported by scanner */
 
-    /* temporary file is created with permission 0600 in xsane_generate_dummy_filename */
-    if (!xsane_generate_dummy_filename(0)) /* create filename the scanned data is saved to */
-    {
-      /* no temporary file */
-      if (xsane_create_secure_file(xsane.dummy_filename)) /* remove possibly existing symbolic links for security */
-      {
-        snprintf(buf, sizeof(buf), "%s %s %s\n", ERR_DURING_SAVE, ERR_CREATE_SECURE_FILE, xsane.dummy_filename);
-        xsane_scan_done(-1); /* -1 = error */
-        xsane_back_gtk_error(buf, TRUE);
-       return;
-      }
-    }
-
-    /* create file: + = also allow read for blocked rgb multiplexing,  b = binary mode for win32 */
-    xsane.out = fopen(xsane.dummy_filename, "wb+");
-
-    if (!xsane.out) /* error while opening the dummy_file for writing */
-    {
-      xsane_scan_done(-1); /* -1 = error */
-      DBG(DBG_info, "open of file `%s'failed : %s\n", xsane.dummy_filename, strerror(errno));
-      snprintf(buf, sizeof(buf), "%s `%s': %s", ERR_OPEN_FAILED, xsane.dummy_filename, strerror(errno));
-      xsane_back_gtk_error(buf, TRUE);
-     return;
-    }
-
     if ( (xsane.expand_lineart_to_grayscale) || (xsane.reduce_16bit_to_8bit) )
     {
       xsane.depth = 8;
@@ -1808,13 +1870,68 @@ static void xsane_start_scan(void)
       }
     }
 
-    xsane_write_pnm_header(xsane.out, &image_info, 0);
+    xsane_create_scan_pipeline(&image_info); /* sets xsane.pipeline when the scan can be processed line by line */
+
+    /* temporary file is created with permission 0600 in xsane_generate_dummy_filename */
+    if (!xsane_generate_dummy_filename(0)) /* create filename the scanned data is saved to */
+    {
+      /* no temporary file */
+      if (xsane_create_secure_file(xsane.dummy_filename)) /* remove possibly existing symbolic links for security */
+      {
+        snprintf(buf, sizeof(buf), "%s %s %s\n", ERR_DURING_SAVE, ERR_CREATE_SECURE_FILE, xsane.dummy_filename);
+        xsane_scan_done(-1); /* -1 = error */
+        xsane_back_gtk_error(buf, TRUE);
+       return;
+      }
+    }
+
+    /* create file: + = also allow read for blocked rgb multiplexing,  b = binary mode for win32 */
+    xsane.out = fopen(xsane.dummy_filename, "wb+");
+
+    if (!xsane.out) /* error while opening the dummy_file for writing */
+    {
+      xsane_scan_done(-1); /* -1 = error */
+      DBG(DBG_info, "open of file `%s'failed : %s\n", xsane.dummy_filename, strerror(errno));
+      snprintf(buf, sizeof(buf), "%s `%s': %s", ERR_OPEN_FAILED, xsane.dummy_filename, strerror(errno));
+      xsane_back_gtk_error(buf, TRUE);
+     return;
+    }
+
+    if (xsane.pipeline)
+    {
+      if (xsane_pipeline_add_pnm_sink(xsane.pipeline, xsane.out)) /* writes the pnm header */
+      {
+        xsane_scan_done(-1); /* -1 = error */
+        snprintf(buf, sizeof(buf), "%s %s", ERR_DURING_SAVE, strerror(errno));
+        xsane_back_gtk_error(buf, TRUE);
+       return;
+      }
+    }
+    else
+    {
+      xsane_write_pnm_header(xsane.out, &image_info, 0);
+    }
 
     fflush(xsane.out);
     xsane.header_size = ftell(xsane.out); /* store header size for 3 pass scan */
+
+    if ( (xsane.param.format >= SANE_FRAME_RED) && (xsane.param.format <= SANE_FRAME_BLUE) &&
+         ((xsane.param.depth == 8) || (xsane.param.depth == 16)) )
+    {
+      /* keep the planes in memory instead of interleaving them in the file */
+      xsane.planar = xsane_planar_new(xsane.param.bytes_per_line, xsane.param.lines, xsane.param.depth / 8, XSANE_3PASS_MEMORY_MAX);
+      DBG(DBG_info, "3 pass planes are %s\n", (xsane.planar) ? "kept in memory" : "interleaved in the file");
+    }
+  }
+
+  if (xsane_create_scan_lut()) /* lut for the gamma correction of this frame */
+  {
+    xsane_scan_done(-1); /* -1 = error */
+    xsane_back_gtk_error(ERR_NO_MEM, TRUE);
+   return;
   }
 
-  if (xsane.param.format >= SANE_FRAME_RED && xsane.param.format <= SANE_FRAME_BLUE)
+  if ((!xsane.planar) && (xsane.param.format >= SANE_FRAME_RED && xsane.param.format <= SANE_FRAME_BLUE))
   {
 /* correct this using read_pnm_header */
     fseek(xsane.out, xsane.header_size + xsane.param.format - SANE_FRAME_RED, SEEK_SET);
@@ -1827,13 +1944,24 @@ static void xsane_start_scan(void)
   if (preferences.adf_pages_max > 1)
   {
    char buf2[TEXTBUFSIZE];
+   char ppm[TEXTBUFSIZE];
+   double minutes = g_timer_elapsed(xsane.adf_timer, NULL) / 60.0;
+
+    ppm[0] = 0;
+
+    if ((xsane.adf_page_counter > 0) && (minutes > 0.0))
+    {
+      snprintf(ppm, sizeof(ppm), ", ");
+      snprintf(ppm + 2, sizeof(ppm) - 2, PROGRESS_PAGES_PER_MINUTE, xsane.adf_page_counter / minutes);
+    }
+
     if (preferences.adf_pages_max > 1)
     {
-      snprintf(buf2, sizeof(buf2), "%s (%d/%d)", PROGRESS_SCANNING, xsane.adf_page_counter+1, preferences.adf_pages_max);
+      snprintf(buf2, sizeof(buf2), "%s (%d/%d%s)", PROGRESS_SCANNING, xsane.adf_page_counter+1, preferences.adf_pages_max, ppm);
     }
     else
     {
-      snprintf(buf2, sizeof(buf2), "%s (%d)", PROGRESS_SCANNING, xsane.adf_page_counter+1);
+      snprintf(buf2, sizeof(buf2), "%s (%d%s)", PROGRESS_SCANNING, xsane.adf_page_counter+1, ppm);
     }
     xsane_progress_new(buf, buf2, (GtkSignalFunc) xsane_cancel, NULL);
   }
@@ -1850,6 +1978,24 @@ static void xsane_start_scan(void)
   xsane.input_tag = -1;
 
   xsane.lineart_to_grayscale_x = xsane.param.pixels_per_line;
+
+  if (xsane.reader) /* reader thread of the previous frame in 3 pass mode, it already got EOF */
+  {
+    xsane_reader_free(xsane.reader);
+    xsane.reader = NULL;
+  }
+
+  /* read the scanner in its own thread, so gtk events do not stall the scanner */
+  /* after the last frame of an adf page the thread can start the next page */
+  xsane.reader = xsane_reader_new(dev, (size_t) preferences.scan_buffer_size * 1024,
+                                  (preferences.adf_overlap) && (xsane.param.last_frame) && (xsane.mode != XSANE_GIMP_EXTENSION) &&
+                                  (!xsane.batch_loop) && (xsane.adf_page_counter+1 < preferences.adf_pages_max));
+  if (xsane.reader)
+  {
+    DBG(DBG_info, "gdk_input_add for reader thread\n");
+    xsane.input_tag = gdk_input_add(xsane_reader_get_fd(xsane.reader), GDK_INPUT_READ, xsane_read_image_data, 0);
+  }
+  else
 #ifndef BUGGY_GDK_INPUT_EXCEPTION
   if ((sane_set_io_mode(dev, SANE_TRUE) == SANE_STATUS_GOOD) && (sane_get_select_fd(dev, &fd) == SANE_STATUS_GOOD))
   {
@@ -1878,6 +2024,13 @@ gint xsane_scan_dialog(gpointer *data)
 
   xsane_set_sensitivity(FALSE);
 
+  if (xsane.next_page_reader) /* wait until the reader thread of the last adf page has called sane_start */
+  {
+    xsane.next_page_started = xsane_reader_next_page(xsane.next_page_reader, &xsane.next_page_status);
+    xsane_reader_free(xsane.next_page_reader);
+    xsane.next_page_reader = NULL;
+  }
+
   xsane.reduce_16bit_to_8bit = preferences.reduce_16bit_to_8bit; /* reduce 16 bit image to 8 bit ? */
 
   sane_get_parameters(xsane.dev, &xsane.param); /* update xsane.param */
@@ -1918,6 +2071,7 @@ gint xsane_scan_dialog(gpointer *data)
         snprintf(buf, sizeof(buf), WARN_FILE_EXISTS, xsane.output_filename);
         if (xsane_back_gtk_decision(ERR_HEADER_WARNING, (gchar **) warning_xpm, buf, BUTTON_OVERWRITE, BUTTON_CANCEL, TRUE /* wait */) == FALSE)
         {
+          xsane_scan_cancel_next_page();
           xsane_set_sensitivity(TRUE);
           return FALSE;
         }
@@ -1939,6 +2093,7 @@ gint xsane_scan_dialog(gpointer *data)
           snprintf(buf, sizeof(buf), "%s", ERR_NO_OUTPUT_FORMAT);
         }
         xsane_back_gtk_error(buf, TRUE);
+        xsane_scan_cancel_next_page();
         xsane_set_sensitivity(TRUE);
        return FALSE;
       }
@@ -1963,6 +2118,7 @@ gint xsane_scan_dialog(gpointer *data)
       {
         snprintf(buf, sizeof(buf), "No RGBA data format !!!"); /* user selected output format RGBA, scanner uses other format */
         xsane_back_gtk_error(buf, TRUE);
+        xsane_scan_cancel_next_page();
         xsane_set_sensitivity(TRUE);
        return FALSE;
       }
@@ -1973,6 +2129,7 @@ gint xsane_scan_dialog(gpointer *data)
     {
       snprintf(buf, sizeof(buf), "Special format RGBA only supported in scan mode !!!");
       xsane_back_gtk_error(buf, TRUE);
+      xsane_scan_cancel_next_page();
       xsane_set_sensitivity(TRUE);
      return FALSE;
     }
@@ -1985,6 +2142,7 @@ gint xsane_scan_dialog(gpointer *data)
       {
         snprintf(buf, sizeof(buf), "Image data of type SANE_FRAME_RGBA\ncan only be saved in rgba or png format");
         xsane_back_gtk_error(buf, TRUE);
+        xsane_scan_cancel_next_page();
         xsane_set_sensitivity(TRUE);
        return FALSE;
       }
@@ -2009,7 +2167,12 @@ gint xsane_scan_dialog(gpointer *data)
   }
 
   /* create scanner gamma tables, xsane internal gamma tables are created after sane_start */
-  if ( (xsane.xsane_channels > 1) && /* color scan */
+  if (xsane.next_page_started)
+  {
+    /* options can not be set while the next adf page is scanned, they did not change since the last page */
+    DBG(DBG_info, "next adf page already started, scanner gamma tables are not sent again\n");
+  }
+  else if ( (xsane.xsane_channels > 1) && /* color scan */
        xsane.scanner_gamma_color ) /* gamma table for red, green and blue available */
   {
    double gamma_red, gamma_green, gamma_blue;
@@ -2165,6 +2328,190 @@ gint xsane_scan_dialog(gpointer *data)
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
+static void xsane_create_scan_pipeline(Image_info *image_info)
+/* one pass scans are processed line by line while they are read from the scanner: */
+/* gamma correction, lineart expansion, rotation and packing of lineart are done in memory */
+/* so the image is written only once. If the pipeline can not be created (3 pass scan, */
+/* not enough memory for the rotation) xsane.pipeline is NULL and the temporary files are used. */
+{
+ Image_info input_info;
+
+  DBG(DBG_proc, "xsane_create_scan_pipeline\n");
+
+  xsane.pipeline = NULL;
+
+  if ( ( (xsane.param.format != SANE_FRAME_GRAY) && (xsane.param.format != SANE_FRAME_RGB) ) || (!xsane.param.last_frame) )
+  {
+    DBG(DBG_info, "frame format is not supported by scan pipeline\n");
+   return;
+  }
+
+  memcpy(&input_info, image_info, sizeof(Image_info));
+  input_info.depth = xsane.param.depth;
+  input_info.reduce_to_lineart = FALSE;
+
+  xsane.pipeline = xsane_pipeline_new(&input_info, xsane.param.bytes_per_line);
+  if (!xsane.pipeline)
+  {
+    return;
+  }
+
+  if (xsane.param.depth == 1)
+  {
+    if ( (xsane.expand_lineart_to_grayscale) && (xsane_pipeline_add_lineart_expand(xsane.pipeline)) )
+    {
+      goto failed;
+    }
+  }
+  else if (xsane.param.format == SANE_FRAME_GRAY)
+  {
+    if (xsane_pipeline_add_gamma(xsane.pipeline, (!xsane.scanner_gamma_gray) ? xsane.gamma_data : NULL, NULL, NULL, NULL,
+                                 xsane.reduce_16bit_to_8bit))
+    {
+      goto failed;
+    }
+  }
+  else /* SANE_FRAME_RGB */
+  {
+    if (xsane.scanner_gamma_color)
+    {
+      if (xsane_pipeline_add_gamma(xsane.pipeline, NULL, NULL, NULL, NULL, xsane.reduce_16bit_to_8bit))
+      {
+        goto failed;
+      }
+    }
+    else if (xsane_pipeline_add_gamma(xsane.pipeline, NULL, xsane.gamma_data_red, xsane.gamma_data_green, xsane.gamma_data_blue,
+                                      xsane.reduce_16bit_to_8bit))
+    {
+      goto failed;
+    }
+  }
+
+  if (xsane_pipeline_add_rotation(xsane.pipeline, xsane.scan_rotation))
+  {
+    goto failed;
+  }
+
+  /* in viewer and project modes lineart is kept as grayscale, see xsane_scan_done */
+  if ( (xsane.param.depth == 1) && (xsane.expand_lineart_to_grayscale) &&
+       (xsane.xsane_mode != XSANE_VIEWER) && (xsane.xsane_mode != XSANE_MULTIPAGE) &&
+       (xsane.xsane_mode != XSANE_FAX) && (xsane.xsane_mode != XSANE_EMAIL) )
+  {
+    if (xsane_pipeline_add_lineart_pack(xsane.pipeline))
+    {
+      goto failed;
+    }
+  }
+
+ return;
+
+failed:
+  DBG(DBG_info, "could not create scan pipeline, using temporary files\n");
+  xsane_pipeline_free(xsane.pipeline);
+  xsane.pipeline = NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int xsane_create_scan_lut(void)
+/* creates the lut for the software gamma correction in xsane_read_image_data, */
+/* the scan pipeline does its own gamma correction. returns -1 when out of memory */
+{
+ SANE_Int *table[3] = {NULL, NULL, NULL};
+ int channels = 1;
+ int output_depth = xsane.param.depth;
+ int c;
+
+  DBG(DBG_proc, "xsane_create_scan_lut\n");
+
+  if (xsane.lut) /* lut of the previous frame */
+  {
+    xsane_lut_free(xsane.lut);
+    xsane.lut = NULL;
+  }
+
+  if ((xsane.pipeline) || (xsane.param.depth < 8))
+  {
+   return 0;
+  }
+
+  switch (xsane.param.format)
+  {
+    case SANE_FRAME_GRAY:
+      if (xsane.scanner_gamma_gray)
+      {
+       return 0;
+      }
+      table[0] = xsane.gamma_data;
+     break;
+
+    case SANE_FRAME_RGB:
+#ifdef SUPPORT_RGBA
+    case SANE_FRAME_RGBA:
+#endif
+      if (xsane.scanner_gamma_color)
+      {
+       return 0;
+      }
+      channels = (xsane.param.format == SANE_FRAME_RGB) ? 3 : 4; /* infrared channel is not gamma corrected */
+      table[0] = xsane.gamma_data_red;
+      table[1] = xsane.gamma_data_green;
+      table[2] = xsane.gamma_data_blue;
+     break;
+
+    case SANE_FRAME_RED:
+    case SANE_FRAME_GREEN:
+    case SANE_FRAME_BLUE:
+      if (xsane.scanner_gamma_color)
+      {
+       return 0;
+      }
+
+      if (xsane.param.format == SANE_FRAME_RED)
+      {
+        table[0] = xsane.gamma_data_red;
+      }
+      else if (xsane.param.format == SANE_FRAME_GREEN)
+      {
+        table[0] = xsane.gamma_data_green;
+      }
+      else
+      {
+        table[0] = xsane.gamma_data_blue;
+      }
+     break;
+
+    default:
+     return 0;
+  }
+
+  if (!table[0])
+  {
+   return 0;
+  }
+
+  if ( (xsane.param.depth == 16) && (xsane.reduce_16bit_to_8bit) &&
+       ((xsane.param.format < SANE_FRAME_RED) || (xsane.param.format > SANE_FRAME_BLUE)) ) /* 3 pass 16 bit data is not reduced */
+  {
+    output_depth = 8;
+  }
+
+  xsane.lut = xsane_lut_new(channels, xsane.param.depth, xsane.param.depth, output_depth);
+  if (!xsane.lut)
+  {
+   return -1;
+  }
+
+  for (c = 0; (c < channels) && (c < 3); c++)
+  {
+    xsane_lut_set_table(xsane.lut, c, table[c]);
+  }
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
 static void xsane_create_internal_gamma_tables(void)
 {
  int size, maxval;
@@ -459,6 +459,24 @@ static void xsane_setup_filename_counter_len_callback(GtkWidget *widget, gpointe
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
+static void xsane_setup_scale_filter_callback(GtkWidget *widget, gpointer data)
+{
+  DBG(DBG_proc, "xsane_setup_scale_filter_callback\n");
+
+  xsane_setup.scale_filter = (int) data;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void xsane_setup_save_pdf_compression_callback(GtkWidget *widget, gpointer data)
+{
+  DBG(DBG_proc, "xsane_setup_save_pdf_compression_callback\n");
+
+  xsane_setup.save_pdf_compression = (int) data;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
 #ifdef HAVE_LIBTIFF
 static void xsane_setup_tiff_compression16_callback(GtkWidget *widget, gpointer data)
 {
@@ -613,6 +631,22 @@ static void xsane_setup_saving_apply_changes(GtkWidget *widget, gpointer data)
   DBG(DBG_proc, "xsane_setup_saving_apply_changes\n");
 
   preferences.filename_counter_len  = xsane_setup.filename_counter_len;
+  preferences.scale_filter          = xsane_setup.scale_filter;
+  xsane_update_int(xsane_setup.scan_buffer_size_entry, &preferences.scan_buffer_size);
+
+  if (preferences.scan_buffer_size < 0)
+  {
+    preferences.scan_buffer_size = 0;
+  }
+
+  xsane_update_bool(xsane_setup.adf_overlap_button, &preferences.adf_overlap);
+
+  xsane_update_int(xsane_setup.filter_threads_entry, &preferences.filter_threads);
+
+  if (preferences.filter_threads < 0)
+  {
+    preferences.filter_threads = 0;
+  }
 
   if (strcmp(preferences.tmp_path, gtk_entry_get_text(GTK_ENTRY(xsane_setup.tmp_path_entry))))
   {
@@ -676,6 +710,7 @@ static void xsane_setup_image_apply_changes(GtkWidget *widget, gpointer data)
   xsane_update_bool(xsane_setup.save_ps_flatedecoded_button,    &preferences.save_ps_flatedecoded);
   xsane_update_bool(xsane_setup.save_pdf_flatedecoded_button,   &preferences.save_pdf_flatedecoded);
 #endif
+  preferences.save_pdf_compression = xsane_setup.save_pdf_compression;
 
   xsane_define_maximum_output_size();
 }
@@ -1639,6 +1674,8 @@ static void xsane_saving_notebook(GtkWidget *notebook)
 {
  GtkWidget *setup_vbox, *vbox, *hbox, *button, *label, *text;
  GtkWidget *filename_counter_len_option_menu, *filename_counter_len_menu, *filename_counter_len_item;
+ GtkWidget *scale_filter_option_menu, *scale_filter_menu, *scale_filter_item;
+ char *scale_filter_names[] = { MENU_ITEM_SCALE_FILTER_BOX, MENU_ITEM_SCALE_FILTER_BILINEAR, MENU_ITEM_SCALE_FILTER_LANCZOS3 };
  char buf[64];
  int i, select = 1;
 
@@ -1684,6 +1721,85 @@ static void xsane_saving_notebook(GtkWidget *notebook)
   gtk_widget_show(hbox);
 
 
+  /* scan buffer size */
+  hbox = gtk_hbox_new(/* homogeneous */ FALSE, 0);
+  gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 2);
+
+  label = gtk_label_new(TEXT_SETUP_SCAN_BUFFER_SIZE);
+  gtk_box_pack_start(GTK_BOX(hbox), label, FALSE, FALSE, 2);
+  gtk_widget_show(label);
+
+  text = gtk_entry_new();
+  xsane_back_gtk_set_tooltip(xsane.tooltips, text, DESC_SCAN_BUFFER_SIZE);
+  gtk_widget_set_size_request(text, 70, -1); /* set minimum size */
+  snprintf(buf, sizeof(buf), "%d", preferences.scan_buffer_size);
+  gtk_entry_set_text(GTK_ENTRY(text), (char *) buf);
+  gtk_box_pack_end(GTK_BOX(hbox), text, FALSE, FALSE, 2);
+  gtk_widget_show(text);
+  gtk_widget_show(hbox);
+  xsane_setup.scan_buffer_size_entry = text;
+
+
+  /* adf overlap */
+  hbox = gtk_hbox_new(/* homogeneous */ FALSE, 0);
+  gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 2);
+  button = gtk_check_button_new_with_label(RADIO_BUTTON_ADF_OVERLAP);
+  xsane_back_gtk_set_tooltip(xsane.tooltips, button, DESC_ADF_OVERLAP);
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(button), preferences.adf_overlap);
+  gtk_box_pack_start(GTK_BOX(hbox), button, TRUE, TRUE, 2);
+  gtk_widget_show(button);
+  gtk_widget_show(hbox);
+  xsane_setup.adf_overlap_button = button;
+
+
+  /* filter threads */
+  hbox = gtk_hbox_new(/* homogeneous */ FALSE, 0);
+  gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 2);
+
+  label = gtk_label_new(TEXT_SETUP_FILTER_THREADS);
+  gtk_box_pack_start(GTK_BOX(hbox), label, FALSE, FALSE, 2);
+  gtk_widget_show(label);
+
+  text = gtk_entry_new();
+  xsane_back_gtk_set_tooltip(xsane.tooltips, text, DESC_FILTER_THREADS);
+  gtk_widget_set_size_request(text, 70, -1); /* set minimum size */
+  snprintf(buf, sizeof(buf), "%d", preferences.filter_threads);
+  gtk_entry_set_text(GTK_ENTRY(text), (char *) buf);
+  gtk_box_pack_end(GTK_BOX(hbox), text, FALSE, FALSE, 2);
+  gtk_widget_show(text);
+  gtk_widget_show(hbox);
+  xsane_setup.filter_threads_entry = text;
+
+
+  /* scale filter */
+  hbox = gtk_hbox_new(/* homogeneous */ FALSE, 0);
+  gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 2);
+
+  label = gtk_label_new(TEXT_SETUP_SCALE_FILTER);
+  gtk_box_pack_start(GTK_BOX(hbox), label, FALSE, FALSE, 2);
+  gtk_widget_show(label);
+
+  scale_filter_option_menu = gtk_option_menu_new();
+  xsane_back_gtk_set_tooltip(xsane.tooltips, scale_filter_option_menu, DESC_SCALE_FILTER);
+  gtk_box_pack_end(GTK_BOX(hbox), scale_filter_option_menu, FALSE, FALSE, 2);
+  gtk_widget_show(scale_filter_option_menu);
+  gtk_widget_show(hbox);
+
+  scale_filter_menu = gtk_menu_new();
+
+  for (i = XSANE_SCALE_FILTER_BOX; i <= XSANE_SCALE_FILTER_LANCZOS3; i++)
+  {
+    scale_filter_item = gtk_menu_item_new_with_label(scale_filter_names[i]);
+    gtk_container_add(GTK_CONTAINER(scale_filter_menu), scale_filter_item);
+    g_signal_connect(GTK_OBJECT(scale_filter_item), "activate", (GtkSignalFunc) xsane_setup_scale_filter_callback, (void *) i);
+    gtk_widget_show(scale_filter_item);
+  }
+
+  gtk_option_menu_set_menu(GTK_OPTION_MENU(scale_filter_option_menu), scale_filter_menu);
+  gtk_option_menu_set_history(GTK_OPTION_MENU(scale_filter_option_menu), preferences.scale_filter);
+  xsane_setup.scale_filter = preferences.scale_filter;
+
+
   xsane_separator_new(vbox, 4);
 
 
@@ -1806,6 +1922,9 @@ static void xsane_saving_notebook(GtkWidget *notebook)
 static void xsane_filetype_notebook(GtkWidget *notebook)
 {
  GtkWidget *setup_vbox, *vbox, *hbox, *button, *label;
+ GtkWidget *pdf_compression_option_menu, *pdf_compression_menu, *pdf_compression_item;
+ char *pdf_compression_names[] = { MENU_ITEM_PDF_COMPRESSION_ZLIB, MENU_ITEM_PDF_COMPRESSION_JPEG };
+ int compression;
 #ifdef HAVE_LIBTIFF
  int i, select = 1;
 
@@ -1925,6 +2044,35 @@ static void xsane_filetype_notebook(GtkWidget *notebook)
 #endif
 
 
+  /* pdf image compression */
+  hbox = gtk_hbox_new(/* homogeneous */ FALSE, 0);
+  gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 2);
+
+  label = gtk_label_new(TEXT_PDF_COMPRESSION);
+  gtk_box_pack_start(GTK_BOX(hbox), label, FALSE, FALSE, 2);
+  gtk_widget_show(label);
+
+  pdf_compression_option_menu = gtk_option_menu_new();
+  xsane_back_gtk_set_tooltip(xsane.tooltips, pdf_compression_option_menu, DESC_PDF_COMPRESSION);
+  gtk_box_pack_end(GTK_BOX(hbox), pdf_compression_option_menu, FALSE, FALSE, 2);
+  gtk_widget_show(pdf_compression_option_menu);
+  gtk_widget_show(hbox);
+
+  pdf_compression_menu = gtk_menu_new();
+
+  for (compression = XSANE_PDF_COMPRESSION_ZLIB; compression <= XSANE_PDF_COMPRESSION_JPEG; compression++)
+  {
+    pdf_compression_item = gtk_menu_item_new_with_label(pdf_compression_names[compression]);
+    gtk_container_add(GTK_CONTAINER(pdf_compression_menu), pdf_compression_item);
+    g_signal_connect(GTK_OBJECT(pdf_compression_item), "activate", (GtkSignalFunc) xsane_setup_save_pdf_compression_callback, (void *) compression);
+    gtk_widget_show(pdf_compression_item);
+  }
+
+  gtk_option_menu_set_menu(GTK_OPTION_MENU(pdf_compression_option_menu), pdf_compression_menu);
+  gtk_option_menu_set_history(GTK_OPTION_MENU(pdf_compression_option_menu), preferences.save_pdf_compression);
+  xsane_setup.save_pdf_compression = preferences.save_pdf_compression;
+
+
 #ifdef HAVE_LIBJPEG 
   xsane_separator_new(vbox, 4);
 #else
@@ -0,0 +1,578 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-smtp.c
+
+   Oliver Rauch <Oliver.Rauch@rauch-domain.de>
+   Copyright (C) 1998-2013 Oliver Rauch
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */ 
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#include "xsane.h"
+#include "xsane-front-gtk.h"
+#include "xsane-base64.h"
+#include "xsane-smtp.h"
+
+/* the following test is always false */
+#ifdef _native_WIN32
+# include <winsock.h>
+#else
+# include <sys/socket.h>
+# include <netinet/in.h>
+# include <netdb.h>
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifdef XSANE_ACTIVATE_EMAIL
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int write_all(int fd_socket, char *buf, size_t len)
+/* returns 0 when all data has been written */
+{
+ ssize_t bytes_written;
+
+  while (len > 0)
+  {
+    bytes_written = write(fd_socket, buf, len);
+
+    if (bytes_written < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      DBG(DBG_error, "write_all: %s\n", strerror(errno));
+     return -1;
+    }
+
+    buf += bytes_written;
+    len -= bytes_written;
+  }
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void write_string_base64(int fd_socket, char *string, int len)
+/* the string is written in one line */
+{
+ char buf[4 * 256 + 2];
+ size_t out_len;
+ int i, n;
+
+  for (i = 0; i < len; i += n)
+  {
+    n = MIN(len - i, 3 * 256); /* all chunks but the last one have no padding */
+
+    out_len = xsane_base64_encode((unsigned char *) string + i, n, buf);
+
+    if (i + n >= len)
+    {
+      buf[out_len++] = '\r';
+      buf[out_len++] = '\n';
+    }
+
+    if (write_all(fd_socket, buf, out_len))
+    {
+      return;
+    }
+  }
+
+  if (!len)
+  {
+    write_all(fd_socket, "\r\n", 2);
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* returns fd_socket if sucessfull, < 0 when error occured */
+int open_socket(char *server, int port)
+{
+ int fd_socket;
+ struct sockaddr_in sin;
+ struct hostent *he;
+
+  he = gethostbyname(server);
+  if (!he)
+  {
+    DBG(DBG_error, "open_socket: Could not get hostname of \"%s\"\n", server);
+   return -1;
+  }
+  else
+  {
+    DBG(DBG_info, "open_socket: connecting to \"%s\" = %d.%d.%d.%d\n",
+        he->h_name,
+        (unsigned char) he->h_addr_list[0][0],
+        (unsigned char) he->h_addr_list[0][1],
+        (unsigned char) he->h_addr_list[0][2],
+        (unsigned char) he->h_addr_list[0][3]);
+  }
+ 
+  if (he->h_addrtype != AF_INET)
+  {
+    DBG(DBG_error, "open_socket: Unknown address family: %d\n", he->h_addrtype);
+   return -1;
+  }
+
+  fd_socket = socket(AF_INET, SOCK_STREAM, 0);
+
+  if (fd_socket < 0)
+  {
+    DBG(DBG_error, "open_socket: Could not create socket: %s\n", strerror(errno));
+   return -1;
+  }
+
+/*  setsockopt (dev->ctl, level, TCP_NODELAY, &on, sizeof (on)); */
+
+  sin.sin_port = htons(port);
+  sin.sin_family = AF_INET;
+  memcpy(&sin.sin_addr, he->h_addr_list[0], he->h_length);
+
+  if (connect(fd_socket, (struct sockaddr *) &sin, sizeof(sin)))
+  {
+    DBG(DBG_error, "open_socket: Could not connect with port %d of socket: %s\n", ntohs(sin.sin_port), strerror(errno));
+   return -1;
+  }
+
+  DBG(DBG_info, "open_socket: Connected with port %d\n", ntohs(sin.sin_port));
+
+ return fd_socket;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* returns 0 if success */
+/* not only a write routine, also reads data */
+int pop3_login(int fd_socket, char *user, char *passwd)
+{
+ char buf[1024];
+ int len;
+
+  len = read(fd_socket, buf, sizeof(buf));
+  if (len >= 0)
+  {
+    buf[len] = 0;
+  }
+  DBG(DBG_info2, "< %s\n", buf);
+
+  snprintf(buf, sizeof(buf), "USER %s\r\n", user);
+  DBG(DBG_info2, "> USER xxx\n");
+  if (write_all(fd_socket, buf, strlen(buf)))
+  {
+    return -1;
+  }
+  len = read(fd_socket, buf, sizeof(buf));
+  if (len >= 0)
+  {
+    buf[len] = 0;
+  }
+  DBG(DBG_info2, "< %s\n", buf);
+  if (buf[0] != '+')
+  {
+    return -1;
+  }
+
+  snprintf(buf, sizeof(buf), "PASS %s\r\n", passwd);
+  DBG(DBG_info2, "> PASS xxx\n");
+  if (write_all(fd_socket, buf, strlen(buf)))
+  {
+    return -1;
+  }
+  len = read(fd_socket, buf, sizeof(buf));
+  if (len >= 0)
+  {
+    buf[len] = 0;
+  }
+  DBG(DBG_info2, "< %s\n", buf);
+  if (buf[0] != '+')
+  {
+    return -1;
+  }
+
+  snprintf(buf, sizeof(buf), "QUIT\r\n");
+  DBG(DBG_info2, "> QUIT\n");
+  if (write_all(fd_socket, buf, strlen(buf)))
+  {
+    return -1;
+  }
+  len = read(fd_socket, buf, sizeof(buf));
+  if (len >= 0)
+  {
+    buf[len] = 0;
+  }
+  DBG(DBG_info2, "< %s\n", buf);
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* SMTP replies are read through a buffer: with pipelining the replies of several commands */
+/* can arrive with one read. The connection is kept open for all queued emails, each email */
+/* is started with write_smtp_header and ended with write_smtp_footer. */
+
+static char smtp_buffer[4096];
+static int smtp_buffer_len = 0;
+static int smtp_pipelining = 0; /* server accepts pipelined commands (RFC 2920) */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int smtp_read_reply(int fd_socket, int *pipelining)
+/* reads one complete (multiline) reply and returns its code, -1 when the connection is closed */
+/* when pipelining is not NULL it is set if the reply contains the PIPELINING extension */
+{
+ char *line_end;
+ int len, consumed, last;
+
+  while (1)
+  {
+    line_end = memchr(smtp_buffer, '\n', smtp_buffer_len);
+
+    if (!line_end)
+    {
+      if (smtp_buffer_len >= (int) sizeof(smtp_buffer) - 1) /* line too long, drop it */
+      {
+        smtp_buffer_len = 0;
+      }
+
+      len = read(fd_socket, smtp_buffer + smtp_buffer_len, sizeof(smtp_buffer) - 1 - smtp_buffer_len);
+
+      if ((len < 0) && (errno == EINTR))
+      {
+        continue;
+      }
+
+      if (len <= 0)
+      {
+        DBG(DBG_error, "smtp_read_reply: connection closed\n");
+       return -1;
+      }
+
+      smtp_buffer_len += len;
+      continue;
+    }
+
+    *line_end = 0;
+    DBG(DBG_info2, "< %s\n", smtp_buffer);
+
+    last = (line_end - smtp_buffer < 4) || (smtp_buffer[3] != '-'); /* "250-..." is followed by more lines */
+
+    if ((pipelining) && (line_end - smtp_buffer >= 14) && (!strncasecmp(smtp_buffer + 4, "PIPELINING", 10)))
+    {
+      *pipelining = 1;
+    }
+
+    len = atoi(smtp_buffer);
+
+    consumed = line_end - smtp_buffer + 1;
+    smtp_buffer_len -= consumed;
+    memmove(smtp_buffer, smtp_buffer + consumed, smtp_buffer_len);
+
+    if (last)
+    {
+     return len;
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int smtp_command(int fd_socket, char *command, int *pipelining)
+/* sends one command and returns the code of the reply */
+{
+  DBG(DBG_info2, "> %s", command);
+
+  if (write_all(fd_socket, command, strlen(command)))
+  {
+   return -1;
+  }
+
+ return smtp_read_reply(fd_socket, pipelining);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void smtp_set_status(char *status)
+{
+  if (xsane.email_status)
+  {
+    free(xsane.email_status);
+  }
+  xsane.email_status = strdup(status);
+  xsane_front_gtk_email_project_update_lockfile_status();
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int asmtp_authentication(int fd_socket, int auth_type, char *user, char *passwd)
+{
+ char buf[1024];
+
+  DBG(DBG_proc, "asmtp_authentication\n");
+
+  switch (auth_type)
+  {
+    case EMAIL_AUTH_ASMTP_PLAIN:
+      snprintf(buf, sizeof(buf), "AUTH PLAIN ");
+      DBG(DBG_info2, "> %s\\0(USER)\\0(PASSWORD)\n", buf);
+      write_all(fd_socket, buf, strlen(buf));
+      snprintf(buf, sizeof(buf), "%c%s%c%s", 0, user, 0, passwd);
+      write_string_base64(fd_socket, buf, strlen(user)+strlen(passwd)+2);
+      if (smtp_read_reply(fd_socket, NULL) / 100 != 2)
+      {
+        DBG(DBG_info, "=> error\n");
+       return (-1);
+      }
+     break;
+
+    case EMAIL_AUTH_ASMTP_LOGIN:
+      if (smtp_command(fd_socket, "AUTH LOGIN\r\n", NULL) / 100 != 3)
+      {
+        DBG(DBG_info, "=> error\n");
+       return (-1);
+      }
+
+      DBG(DBG_info2, "> (USERNAME)\n");
+      write_string_base64(fd_socket, user, strlen(user));
+
+      if (smtp_read_reply(fd_socket, NULL) / 100 != 3)
+      {
+        DBG(DBG_info, "=> error\n");
+       return (-1);
+      }
+
+      DBG(DBG_info2, "> (PASSWORD)\n");
+      write_string_base64(fd_socket, passwd, strlen(passwd));
+
+      if (smtp_read_reply(fd_socket, NULL) / 100 != 2)
+      {
+        DBG(DBG_info, "=> error\n");
+       return (-1);
+      }
+     break;
+
+#if 0
+    case EMAIL_AUTH_ASMTP_CRAM_MD5:
+      smtp_command(fd_socket, "AUTH CRAM-MD5\r\n", NULL);
+     break;
+#endif
+
+    default:
+       DBG(DBG_proc, "no valid asmtp authentication type\n");
+     break;
+  }
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* returns fd_socket of the connected and authenticated smtp session, < 0 when error occured */
+int smtp_open(char *server, int port, int auth_type, char *user, char *passwd)
+{
+ int fd_socket;
+
+  DBG(DBG_proc, "smtp_open\n");
+
+  fd_socket = open_socket(server, port);
+
+  if (fd_socket < 0) /* could not open socket */
+  {
+    smtp_set_status(TEXT_EMAIL_STATUS_SMTP_CONNECTION_FAILED);
+   return -1;
+  }
+
+  smtp_buffer_len = 0;
+  smtp_pipelining = 0;
+
+  /* greeting, the extensions of the server are only listed for EHLO */
+  if ( (smtp_read_reply(fd_socket, NULL) / 100 != 2) ||
+       ( (smtp_command(fd_socket, "EHLO localhost\r\n", &smtp_pipelining) / 100 != 2) &&
+         ( (auth_type >= EMAIL_AUTH_ASMTP_PLAIN) || (smtp_command(fd_socket, "HELO localhost\r\n", NULL) / 100 != 2) ) ) )
+  {
+    DBG(DBG_info, "=> error\n");
+    close(fd_socket);
+    smtp_set_status(TEXT_EMAIL_STATUS_SMTP_CONNECTION_FAILED);
+   return -1;
+  }
+
+  DBG(DBG_info, "smtp_open: server %s pipelining\n", (smtp_pipelining) ? "supports" : "does not support");
+
+  if (asmtp_authentication(fd_socket, auth_type, user, passwd))
+  {
+    close(fd_socket);
+    smtp_set_status(TEXT_EMAIL_STATUS_ASMTP_AUTH_FAILED);
+   return -1;
+  }
+
+ return fd_socket;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* not only a write routine, also reads data */
+/* returns -1 on error, 0 when ok */
+int write_smtp_header(int fd_socket, char *from, char *to)
+{
+ char commands[16384];
+ char to_line[1024];
+ char *to_pos = NULL;
+ char *pos = NULL;
+ char *command, *command_end;
+ char *error = NULL;
+ int code;
+
+  while (from[0] == ' ')
+  {
+    from = from + 1;
+  }
+  snprintf(commands, sizeof(commands), "MAIL FROM: <%s>\r\n", from);
+
+  strncpy(to_line, to, sizeof(to_line)); /* it is not allowed to modify the "to" string, so we make a copy */
+  to_line[sizeof(to_line) - 1] = 0;
+  to_pos = to_line;
+  while (to_pos != NULL)
+  {
+    while (*to_pos == ' ')
+    {
+      to_pos = to_pos + 1;
+    }
+    pos = strchr(to_pos, ',');
+
+    if (pos)
+    {
+      *pos = 0; /* end of string marker */
+    }
+
+    snprintf(commands + strlen(commands), sizeof(commands) - strlen(commands), "RCPT TO: <%s>\r\n", to_pos);
+
+    if (pos)
+    {
+      to_pos = pos+1;
+    }
+    else
+    {
+      to_pos = NULL;
+    }
+  }
+
+  snprintf(commands + strlen(commands), sizeof(commands) - strlen(commands), "DATA\r\n");
+
+  if (smtp_pipelining) /* send all commands at once and read the replies in the same order */
+  {
+    DBG(DBG_info2, "> %s", commands);
+    if (write_all(fd_socket, commands, strlen(commands)))
+    {
+      smtp_set_status(TEXT_EMAIL_STATUS_SMTP_CONNECTION_FAILED);
+     return -1;
+    }
+  }
+
+  for (command = commands; (command_end = strstr(command, "\r\n")) != NULL; command = command_end)
+  {
+    command_end += 2;
+
+    if (!smtp_pipelining)
+    {
+      DBG(DBG_info2, "> %.*s", (int) (command_end - command), command);
+      if (write_all(fd_socket, command, command_end - command))
+      {
+        error = TEXT_EMAIL_STATUS_SMTP_CONNECTION_FAILED;
+       break;
+      }
+    }
+
+    code = smtp_read_reply(fd_socket, NULL);
+
+    if (code < 0)
+    {
+      error = TEXT_EMAIL_STATUS_SMTP_CONNECTION_FAILED;
+     break;
+    }
+
+    if (error) /* read the remaining replies of the pipelined commands */
+    {
+      continue;
+    }
+
+    if (!strncmp(command, "MAIL", 4))
+    {
+      if (code / 100 != 2)
+      {
+        error = TEXT_EMAIL_STATUS_SMTP_ERR_FROM;
+      }
+    }
+    else if (!strncmp(command, "RCPT", 4))
+    {
+      if (code / 100 != 2)
+      {
+        error = TEXT_EMAIL_STATUS_SMTP_ERR_RCPT;
+      }
+    }
+    else if ((code / 100 != 2) && (code / 100 != 3)) /* DATA */
+    {
+      error = TEXT_EMAIL_STATUS_SMTP_ERR_DATA;
+    }
+
+    if ((error) && (!smtp_pipelining))
+    {
+      break;
+    }
+  }
+
+  if (error)
+  {
+    DBG(DBG_info, "=> error\n");
+    smtp_set_status(error);
+   return -1;
+  }
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* not only a write routine, also reads data */
+/* returns -1 when the email has not been accepted, 0 when ok */
+int write_smtp_footer(int fd_socket)
+{
+  if (smtp_command(fd_socket, "\r\n.\r\n", NULL) / 100 != 2)
+  {
+    DBG(DBG_info, "=> error\n");
+    smtp_set_status(TEXT_EMAIL_STATUS_SMTP_ERR_DATA);
+   return -1;
+  }
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void smtp_close(int fd_socket)
+{
+  smtp_command(fd_socket, "QUIT\r\n", NULL);
+  close(fd_socket);
+}
+
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
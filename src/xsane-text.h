@@ -160,6 +160,7 @@
 #define RADIO_BUTTON_HTML_EMAIL				_("HTML e-mail")
 #define RADIO_BUTTON_SAVE_DEVPREFS_AT_EXIT		_("Save device preferences at exit")
 #define RADIO_BUTTON_OVERWRITE_WARNING			_("Overwrite warning")
+#define RADIO_BUTTON_ADF_OVERLAP			_("Feed next ADF page while saving")
 #define RADIO_BUTTON_SKIP_EXISTING_NRS			_("Skip existing filenames")
 #define RADIO_BUTTON_SAVE_PS_FLATEDECODED		_("Save postscript zlib compressed (PS level 3)")
 #define RADIO_BUTTON_SAVE_PDF_FLATEDECODED		_("Save PDF zlib compressed")
@@ -246,6 +247,7 @@
 #define TEXT_INFO_BOX					_("0x0: 0KB")
 
 #define TEXT_ADF_PAGES_SCANNED				_("Scanned pages: ")
+#define TEXT_ADF_PAGES_PER_MINUTE			_("Pages per minute: ")
 
 #define TEXT_EMAIL_TEXT					_("E-mail text:")
 #define TEXT_ATTACHMENTS				_("Attachments:")
@@ -254,6 +256,7 @@
 
 #define TEXT_PAGES					_("Pages:")
 #define TEXT_MULTIPAGE_FILETYPE				_("Multipage document filetype:")
+#define TEXT_PDF_COMPRESSION				_("PDF image compression:")
 
 #define TEXT_MEDIUM_DEFINITION_NAME			_("Medium Name:")
 
@@ -261,6 +264,7 @@
 #define TEXT_DESPECKLE_RADIUS				_("Despeckle radius:")
 #define TEXT_BLUR_RADIUS				_("Blur radius:")
 #define TEXT_BATCH_AREA_DEFAULT_NAME			_("(no name)")
+#define TEXT_BATCH_AREA_OBJECT_NAME			_("object %d, skew %+.1f degree")
 #define TEXT_BATCH_LIST_AREANAME			_("Area name:")
 #define TEXT_BATCH_LIST_SCANMODE			_("Scanmode:")
 #define TEXT_BATCH_LIST_GEOMETRY_TL			_("Top left:")
@@ -292,6 +296,9 @@
 #define TEXT_SETUP_PRINTER_CMS_BPC			_("Apply black point compensation")
 #define TEXT_SETUP_PRINTER_PS_FLATEDECODED		_("Create zlib compressed postscript image (PS level 3) for printing")
 #define TEXT_SETUP_TMP_PATH				_("Temporary directory")
+#define TEXT_SETUP_SCAN_BUFFER_SIZE			_("Scan buffer size [KB]:")
+#define TEXT_SETUP_FILTER_THREADS			_("Filter threads:")
+#define TEXT_SETUP_SCALE_FILTER				_("Scale filter:")
 #define TEXT_SETUP_IMAGE_PERMISSION			_("Image-file permissions")
 #define TEXT_SETUP_DIR_PERMISSION			_("Directory permissions")
 #define TEXT_SETUP_JPEG_QUALITY				_("JPEG image quality")
@@ -426,6 +433,11 @@
 #define SUBMENU_ITEM_CMS_COLOR_BLUE			_("Blue")
 
 #define MENU_ITEM_COUNTER_LEN_INACTIVE	_("inactive")
+#define MENU_ITEM_SCALE_FILTER_BOX	_("Box (area average)")
+#define MENU_ITEM_SCALE_FILTER_BILINEAR	_("Bilinear")
+#define MENU_ITEM_SCALE_FILTER_LANCZOS3	_("Lanczos3")
+#define MENU_ITEM_PDF_COMPRESSION_ZLIB	_("lossless (zlib)")
+#define MENU_ITEM_PDF_COMPRESSION_JPEG	_("JPEG / CCITT G4")
 #define MENU_ITEM_TIFF_COMP_NONE	_("no compression")
 #define MENU_ITEM_TIFF_COMP_CCITTRLE	_("CCITT 1D Huffman compression")
 #define MENU_ITEM_TIFF_COMP_CCITFAX3	_("CCITT Group 3 fax compression")
@@ -466,6 +478,7 @@
 #define MENU_ITEM_FUNCTION_CONVERT_TO_WORKING_CS		_("Convert to working color space")
 
 #define PROGRESS_SCANNING		_("Scanning")
+#define PROGRESS_PAGES_PER_MINUTE	_("%.1f pages/min")
 #define PROGRESS_RECEIVING_FRAME_DATA	_("Receiving %s data")
 #define PROGRESS_PAGE			_("page")
 
@@ -481,9 +494,11 @@
 #define PROGRESS_BLURING_DATA		_("Bluring image")
 #define PROGRESS_OCR			_("OCR in progress")
 #define PROGRESS_ICM_CONVERSION		_("converting colors")
+#define PROGRESS_JOBS_WAITING		_("%s (%d more images waiting)")
 
 #define DESC_SCAN_START			_("Start scan <Ctrl-Enter>")
 #define DESC_SCAN_CANCEL		_("Cancel scan <ESC>")
+#define DESC_JOB_CANCEL			_("Cancel conversion of the current image")
 #define DESC_PREVIEW_ACQUIRE		_("Acquire preview scan <Alt-p>")
 #define DESC_PREVIEW_CANCEL		_("Cancel preview scan <Alt-ESC>")
 #define DESC_XSANE_MODE			_("viewer-<Ctrl-v>, save-<Ctrl-s>, photocopy-<Ctrl-c>, " \
@@ -509,6 +524,10 @@
 #define DESC_MULTIPAGE_PROJECT		_("Enter multipage project directory name")
 #define DESC_MULTIPAGE_PROJECT_BROWSE	_("Browse for multipage project directory")
 #define DESC_MULTIPAGE_FILETYPE		_("Select filetype for multipage file")
+#define DESC_PDF_COMPRESSION		_("Select how images are compressed in PDF files:\n" \
+                                          "lossless (zlib) or JPEG for grayscale and color images\n" \
+                                          "and CCITT group 4 for lineart images.\n" \
+                                          "The JPEG quality is defined in the saving options of the setup")
 #define DESC_PRESET_AREA_RENAME		_("Enter new name for preset area")
 #define DESC_PRESET_AREA_ADD		_("Enter name for new preset area")
 #define DESC_MEDIUM_RENAME		_("Enter new name for medium definition")
@@ -586,6 +605,12 @@
                                           "The printer has to understand postscript level 3!")
 #define DESC_TMP_PATH			_("Path to temp directory")
 #define DESC_BUTTON_TMP_PATH_BROWSE	_("Browse for temporary directory")
+#define DESC_SCAN_BUFFER_SIZE		_("The scanner is read by its own thread into a buffer of this size, so the scanner\n" \
+                                          "does not have to wait while the preview is redrawn. 0 reads the scanner in the main loop")
+#define DESC_FILTER_THREADS		_("Number of threads that are used to scale, rotate, blur and despeckle images.\n" \
+                                          "0 uses one thread per cpu")
+#define DESC_SCALE_FILTER		_("Filter that is used to scale images in the viewer and to reduce the resolution\n" \
+                                          "of copies and faxes. Lanczos3 is the sharpest, box averages the covered pixels")
 #define DESC_JPEG_QUALITY		_("Quality in percent if image is saved as JPEG or TIFF with JPEG compression")
 #define DESC_PNG_COMPRESSION		_("Compression if image is saved as PNG")
 #define DESC_FILENAME_COUNTER_LEN	_("Minimum length of counter in filename")
@@ -595,6 +620,8 @@
 #define DESC_TIFF_COMPRESSION_1		_("Compression type if lineart image is saved as TIFF")
 #define DESC_SAVE_DEVPREFS_AT_EXIT	_("Save device dependant preferences in default file at exit of xsane")
 #define DESC_OVERWRITE_WARNING		_("Warn before overwriting an existing file")
+#define DESC_ADF_OVERLAP		_("Start the next ADF page as soon as a page has been read, "\
+                                          "the page is saved while the scanner feeds the next sheet")
 #define DESC_SKIP_EXISTING		_("If filename counter is automatically increased, used numbers are skipped")
 #define DESC_SAVE_PS_FLATEDECODED	_("compress postscript image with zlib algorithm (flatedecode). " \
                                           "When you want to print such a file your printer has to understand postscript level 3")
@@ -715,6 +742,7 @@
 #define DESC_BATCH_LIST_LOAD		_("Load batch list")
 #define DESC_BATCH_RENAME		_("Rename area")
 #define DESC_BATCH_ADD			_("Add selected preview area to batch list")
+#define DESC_BATCH_ADD_OBJECTS		_("Add the objects that are found in the preview to batch list")
 #define DESC_BATCH_DEL			_("Delete selected area from batch list")
 #define DESC_AUTOMATIC			_("Turns on automatic mode")
 
@@ -805,6 +833,7 @@ YOU ARE ALONE!\
 #define ERR_NO_DRC_FILE			_("is not a device-rc-file !!!")
 #define ERR_NETSCAPE_EXECUTE_FAIL	_("Failed to execute netscape!")
 #define ERR_SENDFAX_RECEIVER_MISSING	_("Send fax: no receiver defined")
+#define ERR_NO_OBJECTS_FOUND		_("No objects found in the preview")
 
 #define ERR_CREATED_FOR_DEVICE		_("has been created for device")
 #define ERR_USED_FOR_DEVICE		_("you want to use it for device")
@@ -935,6 +964,7 @@ The format of [DEVICE] is backendname:devicefile (e.g. umax:/dev/scanner).\n\
 #define TEXT_EMAIL_STATUS_SMTP_ERR_DATA		N_("E-mail data not accepted")
 #define TEXT_EMAIL_STATUS_SENDING		N_("Sending e-mail")
 #define TEXT_EMAIL_STATUS_SENT			N_("E-mail has been sent")
+#define TEXT_EMAIL_STATUS_SENDER_FAILED	N_("Could not start e-mail sender")
 
 #define TEXT_FAX_STATUS_QUEUEING_FAX		N_("Queueing fax")
 #define TEXT_FAX_STATUS_FAX_QUEUED		N_("Fax is queued")
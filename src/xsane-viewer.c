@@ -30,6 +30,7 @@
 #include "xsane-gamma.h"
 #include "xsane-icons.h"
 #include "xsane-save.h"
+#include "xsane-cms.h"
 #include <gdk/gdkkeysyms.h>
 #include <sys/wait.h>
 
@@ -52,6 +53,7 @@ static void xsane_viewer_clone_callback(GtkWidget *window, gpointer data);
 static void xsane_viewer_despeckle_callback(GtkWidget *window, gpointer data);
 static void xsane_viewer_blur_callback(GtkWidget *window, gpointer data);
 static void xsane_viewer_scale_image(GtkWidget *window, gpointer data);
+static void xsane_viewer_scale_filter_callback(GtkWidget *widget, gpointer data);
 static void xsane_viewer_despeckle_image(GtkWidget *window, gpointer data);
 static void xsane_viewer_blur_image(GtkWidget *window, gpointer data);
 static void xsane_viewer_rotate(Viewer *v, int rotation);
@@ -358,7 +360,7 @@ static void xsane_viewer_save_callback(GtkWidget *window, gpointer data)
   }
   else
   {
-    xsane_save_image_as(v->output_filename, inputfilename, output_format, v->cms_enable, v->cms_function, v->cms_intent, v->cms_bpc, v->progress_bar, &v->cancel_save);
+    xsane_save_image_as(v->output_filename, inputfilename, output_format, preferences.save_pdf_compression, v->cms_enable, v->cms_function, v->cms_intent, v->cms_bpc, v->progress_bar, &v->cancel_save);
   }
 
   free(inputfilename);
@@ -583,12 +585,15 @@ static void xsane_viewer_scale_callback(GtkWidget *window, gpointer data)
  GtkAdjustment *adjustment_size_x;
  GtkAdjustment *adjustment_size_y;
  GtkWidget *spinbutton;
+ GtkWidget *label, *filter_option_menu, *filter_menu, *filter_menu_item;
  GdkPixmap *pixmap;
  GdkBitmap *mask;
  GtkWidget *pixmapwidget;
  char buf[TEXTBUFSIZE];
+ char *filter_names[] = { MENU_ITEM_SCALE_FILTER_BOX, MENU_ITEM_SCALE_FILTER_BILINEAR, MENU_ITEM_SCALE_FILTER_LANCZOS3 };
  FILE *infile;
  Image_info image_info;
+ int i;
 
   if (v->block_actions == TRUE) /* actions blocked: return */
   {
@@ -646,6 +651,7 @@ static void xsane_viewer_scale_callback(GtkWidget *window, gpointer data)
     v->x_scale_factor = 1.0;
     v->y_scale_factor = 1.0;
     v->bind_scale = TRUE;
+    v->scale_filter = preferences.scale_filter;
   }
 
   frame = gtk_frame_new(0);
@@ -810,6 +816,36 @@ static void xsane_viewer_scale_callback(GtkWidget *window, gpointer data)
     gtk_object_set_data(GTK_OBJECT(adjustment_size_y), "image_height",       (void *) image_info.image_height);
   }
 
+  /* scale filter */
+
+  hbox = gtk_hbox_new(FALSE, 0);
+  gtk_container_set_border_width(GTK_CONTAINER(hbox), 4); 
+  gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 2);
+  gtk_widget_show(hbox);
+
+  label = gtk_label_new(TEXT_SETUP_SCALE_FILTER);
+  gtk_box_pack_start(GTK_BOX(hbox), label, FALSE, FALSE, 2);
+  gtk_widget_show(label);
+
+  filter_option_menu = gtk_option_menu_new();
+  xsane_back_gtk_set_tooltip(xsane.tooltips, filter_option_menu, DESC_SCALE_FILTER);
+  gtk_box_pack_end(GTK_BOX(hbox), filter_option_menu, FALSE, FALSE, 2);
+  gtk_widget_show(filter_option_menu);
+
+  filter_menu = gtk_menu_new();
+
+  for (i = XSANE_SCALE_FILTER_BOX; i <= XSANE_SCALE_FILTER_LANCZOS3; i++)
+  {
+    filter_menu_item = gtk_menu_item_new_with_label(filter_names[i]);
+    gtk_menu_append(GTK_MENU(filter_menu), filter_menu_item);
+    g_signal_connect(GTK_OBJECT(filter_menu_item), "activate", (GtkSignalFunc) xsane_viewer_scale_filter_callback, v);
+    gtk_object_set_data(GTK_OBJECT(filter_menu_item), "Selection", (void *) i);
+    gtk_widget_show(filter_menu_item);
+  }
+
+  gtk_option_menu_set_menu(GTK_OPTION_MENU(filter_option_menu), filter_menu);
+  gtk_option_menu_set_history(GTK_OPTION_MENU(filter_option_menu), v->scale_filter);
+
   /* Apply Cancel */
 
   hbox = gtk_hbox_new(FALSE, 0);
@@ -837,6 +873,17 @@ static void xsane_viewer_scale_callback(GtkWidget *window, gpointer data)
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
 
+static void xsane_viewer_scale_filter_callback(GtkWidget *widget, gpointer data)
+{
+ Viewer *v = (Viewer *) data;
+
+  DBG(DBG_proc, "xsane_viewer_scale_filter_callback\n");
+
+  v->scale_filter = (int) gtk_object_get_data(GTK_OBJECT(widget), "Selection");
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
 static void xsane_viewer_despeckle_callback(GtkWidget *window, gpointer data)
 {
  Viewer *v = (Viewer *) data;
@@ -1106,7 +1153,7 @@ static void xsane_viewer_scale_image(GtkWidget *window, gpointer data)
     v->y_scale_factor = v->x_scale_factor;
   }
 
-  xsane_save_scaled_image(outfile, infile, &image_info, v->x_scale_factor, v->y_scale_factor, v->progress_bar, &v->cancel_save);
+  xsane_save_scaled_image(outfile, infile, &image_info, v->x_scale_factor, v->y_scale_factor, v->scale_filter, v->progress_bar, &v->cancel_save);
 
   fclose(infile);
   fclose(outfile);
@@ -2166,11 +2213,7 @@ static int xsane_viewer_read_image(Viewer *v)
  int width, height;
 
 #ifdef HAVE_LIBLCMS
- cmsHPROFILE hInProfile = NULL;
- cmsHPROFILE hOutProfile = NULL;
- cmsHPROFILE hProofProfile = NULL;
- cmsHTRANSFORM hTransform = NULL;
- int proof = 0;
+ XsaneCmsTransform *hTransform = NULL;
  char *cms_proof_icm_profile = NULL;
  DWORD cms_input_format;
  DWORD cms_output_format;
@@ -2203,8 +2246,6 @@ static int xsane_viewer_read_image(Viewer *v)
 
   if ((v->enable_color_management) && (v->cms_enable))
   {
-    cmsErrorAction(LCMS_ERROR_SHOW);
-
     if (v->cms_bpc)
     {
       cms_flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
@@ -2241,50 +2282,19 @@ static int xsane_viewer_read_image(Viewer *v)
     {
       default:
       case 0: /* display */
-        proof = 0;
+        cms_proof_icm_profile = NULL;
        break;
 
       case 1: /* proof printer */
         cms_proof_icm_profile  = preferences.printer[preferences.printernr]->icm_profile;
-        proof = 1;
        break;
 
       case 2: /* proof custom proofing */
         cms_proof_icm_profile  = preferences.custom_proofing_icm_profile;
-        proof = 1;
        break;
     }
 
-    hInProfile  = cmsOpenProfileFromFile(image_info.icm_profile, "r");
-    if (!hInProfile)
-    {
-     char buf[TEXTBUFSIZE];
-
-      snprintf(buf, sizeof(buf), "%s\n%s %s: %s\n", ERR_CMS_CONVERSION, ERR_CMS_OPEN_ICM_FILE, CMS_SCANNER_ICM, image_info.icm_profile);
-      xsane_back_gtk_error(buf, TRUE);
-     return -1;
-    }
-
-    hOutProfile = cmsOpenProfileFromFile(preferences.display_icm_profile, "r");
-    if (!hOutProfile)
-    {
-     char buf[TEXTBUFSIZE];
-
-      cmsCloseProfile(hInProfile);
-
-      snprintf(buf, sizeof(buf), "%s\n%s %s: %s\n", ERR_CMS_CONVERSION, ERR_CMS_OPEN_ICM_FILE, CMS_DISPLAY_ICM, preferences.display_icm_profile);
-      xsane_back_gtk_error(buf, TRUE);
-     return -1;
-    }
-      
-
-    if (proof == 0)
-    {
-      hTransform = cmsCreateTransform(hInProfile, cms_input_format,
-                                      hOutProfile, cms_output_format,
-                                      v->cms_intent, cms_flags); 
-    }
-    else /* proof */
+    if (cms_proof_icm_profile)
     {
       cms_flags |= cmsFLAGS_SOFTPROOFING;
 
@@ -2292,39 +2302,14 @@ static int xsane_viewer_read_image(Viewer *v)
       {
         cms_flags |= cmsFLAGS_GAMUTCHECK;
       }
-
-      hProofProfile = cmsOpenProfileFromFile(cms_proof_icm_profile, "r");
-      if (!hProofProfile)
-      {
-       char buf[TEXTBUFSIZE];
-
-        cmsCloseProfile(hInProfile);
-        cmsCloseProfile(hOutProfile);
-
-        snprintf(buf, sizeof(buf), "%s\n%s %s: %s\n", ERR_CMS_CONVERSION, ERR_CMS_OPEN_ICM_FILE, CMS_PROOF_ICM, cms_proof_icm_profile);
-        xsane_back_gtk_error(buf, TRUE);
-       return -1;
-      }
-
-      hTransform = cmsCreateProofingTransform(hInProfile, cms_input_format,
-                                              hOutProfile, cms_output_format,
-                                              hProofProfile,
-                                              v->cms_intent, v->cms_proofing_intent, cms_flags); 
     }
 
-    cmsCloseProfile(hInProfile);
-    cmsCloseProfile(hOutProfile);
-    if (proof)
-    {
-      cmsCloseProfile(hProofProfile);
-    }
+    hTransform = xsane_cms_transform_get(image_info.icm_profile, preferences.display_icm_profile, cms_proof_icm_profile,
+                                         cms_input_format, cms_output_format, v->cms_intent, v->cms_proofing_intent, cms_flags);
 
-    if (!hTransform)
+    if (!hTransform) /* error message has been shown */
     {
-     char buf[TEXTBUFSIZE];
-
-      snprintf(buf, sizeof(buf), "%s\n%s\n", ERR_CMS_CONVERSION, ERR_CMS_CREATE_TRANSFORM);
-      xsane_back_gtk_error(buf, TRUE);
+      fclose(infile);
      return -1;
     }
   }
@@ -2393,6 +2378,8 @@ static int xsane_viewer_read_image(Viewer *v)
     {
       free(cms_row);
     }
+
+    xsane_cms_transform_release(hTransform);
 #endif
 
     fclose(infile);
@@ -2492,7 +2479,7 @@ static int xsane_viewer_read_image(Viewer *v)
 #ifdef HAVE_LIBLCMS
     if ((v->enable_color_management) && (v->cms_enable))
     {
-      cmsDoTransform(hTransform, row, cms_row, image_info.image_width * v->zoom);
+      xsane_cms_transform_apply(hTransform, row, cms_row, image_info.image_width * v->zoom);
     }
 #endif
     gtk_preview_draw_row(GTK_PREVIEW(v->window), cms_row, 0, y, image_info.image_width * v->zoom);
@@ -2568,7 +2555,7 @@ static int xsane_viewer_read_image(Viewer *v)
 #ifdef HAVE_LIBLCMS
   if ((v->enable_color_management) && (v->cms_enable))
   {
-    cmsDeleteTransform(hTransform);
+    xsane_cms_transform_release(hTransform);
   }
 #endif
 
@@ -71,6 +71,7 @@ typedef struct Viewer
   int bind_scale;
   double x_scale_factor;
   double y_scale_factor;
+  int scale_filter;
 
   GtkWidget *top;
   GtkWidget *button_box;
@@ -38,6 +38,8 @@
 #include "xsane-preferences.h"
 #include "xsane-icons.h"
 #include "xsane-batch-scan.h"
+#include "xsane-cms.h"
+#include "xsane-job.h"
 
 #ifdef HAVE_LIBPNG
 #ifdef HAVE_LIBZ
@@ -2376,6 +2378,8 @@ static void xsane_quit(void)
   }
 #endif
 
+  xsane_job_finish(); /* convert the images that are in the job queue */
+
   while (xsane.back_gtk_message_dialog_active)
   {
     gtk_main_iteration();
@@ -2389,6 +2393,10 @@ static void xsane_quit(void)
   sane_exit();
   gtk_main_quit();
 
+#ifdef HAVE_LIBLCMS
+  xsane_cms_cache_free();
+#endif
+
   if (xsane.preview_gamma_data_red)
   {
     free(xsane.preview_gamma_data_red);
@@ -5250,7 +5258,7 @@ static void xsane_device_dialog(void)
   gtk_box_pack_end(GTK_BOX(xsane_window), hbox, FALSE, FALSE, 8);
   gtk_widget_show(hbox);
 
-  table = gtk_table_new(2, 2, FALSE);
+  table = gtk_table_new(3, 2, FALSE);
   gtk_box_pack_start(GTK_BOX(hbox), table, TRUE, TRUE, 8);
   gtk_widget_show(table);
 
@@ -5303,6 +5311,24 @@ static void xsane_device_dialog(void)
   gtk_table_attach_defaults(GTK_TABLE(table), button, 1, 2, 1, 2);
 
 
+  /* job progress bar and cancel button, shown while the job thread converts images */
+  xsane.job_progress_bar = (GtkProgressBar *) gtk_progress_bar_new();
+  gtk_progress_set_show_text(GTK_PROGRESS(xsane.job_progress_bar), TRUE);
+  gtk_progress_set_format_string(GTK_PROGRESS(xsane.job_progress_bar), "");
+  gtk_progress_bar_set_ellipsize(xsane.job_progress_bar, PANGO_ELLIPSIZE_START); /* this is new API, can be removed for old GTK versions */
+  gtk_table_attach_defaults(GTK_TABLE(table), GTK_WIDGET(xsane.job_progress_bar), 0, 1, 2, 3);
+
+#ifdef HAVE_GTK2
+  button = gtk_button_new_from_stock(GTK_STOCK_CANCEL);
+#else
+  button = gtk_button_new_with_label(BUTTON_CANCEL);
+#endif
+  xsane_back_gtk_set_tooltip(xsane.tooltips, button, DESC_JOB_CANCEL);
+  g_signal_connect(GTK_OBJECT(button), "clicked", (GtkSignalFunc) xsane_job_cancel_callback, NULL);
+  xsane.job_cancel_button = button;
+  gtk_table_attach_defaults(GTK_TABLE(table), button, 1, 2, 2, 3);
+
+
   /* create backend dependend options */
   xsane_panel_build();
 
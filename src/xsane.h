@@ -71,8 +71,6 @@
 
 #ifdef HAVE_LIBLCMS
 # include "lcms.h"
-#else
-# define cmsHTRANSFORM void *
 #endif
 
 /* ---------------------------------------------------------------------------------------------------------------------- */
@@ -109,6 +107,7 @@
 #define XSANE_CONTINUOUS_HOLD_TIME	10
 #define XSANE_DEFAULT_DEVICE		"SANE_DEFAULT_DEVICE"
 #define XSANE_3PASS_BUFFER_RGB_SIZE	1024
+#define XSANE_3PASS_MEMORY_MAX		(256 * 1024 * 1024) /* 3 pass planes up to this size are kept in memory */
 #define TEXTBUFSIZE			255
 
 #ifndef M_PI_2
@@ -481,6 +480,19 @@ enum
   XSANE_LINEART_GRAYSCALE
 };
 
+enum
+{
+  XSANE_SCALE_FILTER_BOX = 0,
+  XSANE_SCALE_FILTER_BILINEAR,
+  XSANE_SCALE_FILTER_LANCZOS3
+};
+
+enum
+{
+  XSANE_PDF_COMPRESSION_ZLIB = 0,
+  XSANE_PDF_COMPRESSION_JPEG
+};
+
 enum
 {
   EMAIL_AUTH_NONE = 0,
@@ -752,9 +764,12 @@ typedef struct Xsane
     char last_offset_16_byte;
     int  lineart_to_grayscale_x;
     GtkProgressBar *progress_bar;
+    GtkProgressBar *job_progress_bar; /* conversions of the job thread */
+    GtkWidget *job_cancel_button;
     int input_tag;
     SANE_Parameters param;
     int adf_page_counter;
+    GTimer *adf_timer;		/* started with the first adf page, for pages per minute */
     int scan_rotation;
 
     /* for standalone mode: */
@@ -766,6 +781,14 @@ typedef struct Xsane
 
     /* saving and transformation values: */
     FILE *out;
+    struct XsanePipeline *pipeline; /* line oriented processing of the scanned data, NULL when not used */
+    struct XsaneLut *lut;	/* software gamma correction of the frame when the scan pipeline is not used */
+    unsigned char *expanded_buf8; /* lineart expanded to grayscale when the scan pipeline is not used */
+    struct XsaneReader *reader;	/* thread that reads the scanner, NULL when sane_read is called in the main loop */
+    struct XsaneReader *next_page_reader; /* reader of the last adf page, it calls sane_start for the next page */
+    int next_page_started;	/* sane_start for the next adf page has been called by the reader */
+    SANE_Status next_page_status; /* status of this sane_start */
+    struct XsanePlanar *planar;	/* planes of a 3 pass scan, NULL when the planes are interleaved in the file */
     int xsane_mode;
     int xsane_output_format;
     long header_size;
@@ -1061,6 +1084,9 @@ typedef struct XsaneSetup
   GtkWidget *fax_ps_flatedecoded_button;
 
   GtkWidget *tmp_path_entry;
+  GtkWidget *scan_buffer_size_entry;
+  GtkWidget *adf_overlap_button;
+  GtkWidget *filter_threads_entry;
 
   GtkWidget *email_smtp_server_entry;
   GtkWidget *email_smtp_port_entry;
@@ -1089,6 +1115,8 @@ typedef struct XsaneSetup
   GtkWidget *working_color_space_icm_profile_entry;
 
   int filename_counter_len;
+  int scale_filter;
+  int save_pdf_compression;
 
   int tiff_compression16_nr;
   int tiff_compression8_nr;
@@ -0,0 +1,228 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-base64-bench.c
+
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* Measures the throughput (attachment MB/s, best of several runs) of the base64 encoding of an */
+/* email attachment that is written to a socket: the encoder before xsane-base64.c that read the */
+/* file with getc and wrote every 4 characters with a separate write call, and the block encoder */
+/* of write_base64 (xsane_base64_read_block, xsane_base64_encode_block, write_all). */
+/* The socket is one end of a socketpair, a child process reads the other end and checks the */
+/* number of characters. */
+
+#include "xsane.h"
+#include "xsane-base64.h"
+#include "xsane-smtp.h"
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#define BENCH_FILE_SIZE (4 * 1024 * 1024)
+#define BENCH_RUNS 5
+#define BENCH_LEGACY_RUNS 1 /* the legacy encoder needs several seconds */
+
+int DBG_LEVEL = 0;
+struct Xsane xsane;
+
+static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_front_gtk_email_project_update_lockfile_status(void)
+{
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#ifdef XSANE_ACTIVATE_EMAIL
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static double bench_time(void)
+{
+ struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+ return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void bench_legacy(int fd_socket, FILE *infile)
+/* the encoder before xsane-base64.c: getc for each byte, one write for each 4 characters */
+{
+ char buf[4];
+ int c1, c2, c3;
+ int pos = 0;
+
+  while ((c1 = getc(infile)) != EOF)
+  {
+    c2 = getc(infile);
+    c3 = (c2 == EOF) ? EOF : getc(infile);
+
+    buf[0] = base64_chars[c1 >> 2];
+    buf[1] = base64_chars[((c1 & 3) << 4) | ((c2 == EOF) ? 0 : (c2 >> 4))];
+    buf[2] = (c2 == EOF) ? '=' : base64_chars[((c2 & 15) << 2) | ((c3 == EOF) ? 0 : (c3 >> 6))];
+    buf[3] = (c3 == EOF) ? '=' : base64_chars[c3 & 63];
+    write_all(fd_socket, buf, 4);
+
+    pos += 4;
+    if (pos > 71)
+    {
+      write_all(fd_socket, "\r\n", 2);
+      pos = 0;
+    }
+  }
+
+  if (pos)
+  {
+    write_all(fd_socket, "\r\n", 2);
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void bench_block(int fd_socket, FILE *infile)
+/* the loop of write_base64 */
+{
+ unsigned char *in;
+ char *out;
+ size_t len;
+
+  in  = malloc(XSANE_BASE64_BLOCK_SIZE);
+  out = malloc(XSANE_BASE64_BLOCK_CHARS);
+
+  do
+  {
+    len = xsane_base64_read_block(infile, in);
+
+    if (write_all(fd_socket, out, xsane_base64_encode_block(in, len, out)))
+    {
+      break;
+    }
+  }
+  while (len == XSANE_BASE64_BLOCK_SIZE);
+
+  free(in);
+  free(out);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static double bench_encoder(const char *name, void (*encoder)(int fd_socket, FILE *infile), FILE *infile, size_t chars, int runs)
+/* returns the best throughput in MB/s, 0 when the reader did not get the expected number of characters */
+{
+ char buf[65536];
+ int fd[2];
+ pid_t pid;
+ size_t received;
+ ssize_t len;
+ double t, best = 0;
+ int status, run;
+
+  for (run = 0; run < runs; run++)
+  {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd))
+    {
+      printf("%s: socketpair: %s\n", name, strerror(errno));
+     return 0;
+    }
+
+    rewind(infile);
+    t = bench_time();
+
+    pid = fork();
+    if (pid == 0) /* reader */
+    {
+      close(fd[0]);
+      received = 0;
+      while ((len = read(fd[1], buf, sizeof(buf))) > 0)
+      {
+        received += len;
+      }
+      _exit((received == chars) ? 0 : 1);
+    }
+
+    close(fd[1]);
+    if (pid > 0)
+    {
+      encoder(fd[0], infile);
+    }
+    close(fd[0]);
+
+    if ((pid < 0) || (waitpid(pid, &status, 0) != pid) || (!WIFEXITED(status)) || (WEXITSTATUS(status)))
+    {
+      printf("%s: the reader did not get %lu characters\n", name, (unsigned long) chars);
+     return 0;
+    }
+
+    t = bench_time() - t;
+    best = MAX(best, BENCH_FILE_SIZE / t / 1e6);
+  }
+
+ return best;
+}
+
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+#ifdef XSANE_ACTIVATE_EMAIL
+ FILE *infile;
+ size_t chars;
+ double legacy, block;
+ int i;
+
+  infile = tmpfile();
+  if (!infile)
+  {
+    printf("xsane-base64-bench: can not create temporary file: %s\n", strerror(errno));
+   return 1;
+  }
+
+  for (i = 0; i < BENCH_FILE_SIZE; i++)
+  {
+    putc(rand(), infile);
+  }
+  fflush(infile);
+
+  chars = (BENCH_FILE_SIZE + 2) / 3 * 4;
+
+  legacy = bench_encoder("legacy", bench_legacy, infile, chars + (chars + 71) / 72 * 2, BENCH_LEGACY_RUNS); /* 72 characters per line */
+  block  = bench_encoder("block", bench_block, infile, chars + (chars + 75) / 76 * 2, BENCH_RUNS); /* 76 characters per line */
+
+  printf("base64 to socket %d MB:  legacy %6.0f  block %6.0f  MB/s\n", BENCH_FILE_SIZE / (1024 * 1024), legacy, block);
+
+  fclose(infile);
+
+ return (legacy && block) ? 0 : 1;
+#else
+  printf("xsane-base64-bench: email is not activated, skipped\n");
+
+ return 0;
+#endif
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
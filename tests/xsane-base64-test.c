@@ -0,0 +1,221 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-base64-test.c
+
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* Encodes files of 0-200 bytes and of sizes around the block boundaries like write_base64 */
+/* does it (xsane_base64_read_block + xsane_base64_encode_block) and compares the result */
+/* with a bitwise encoder that breaks the lines after 76 characters. The output is also */
+/* decoded again and compared with the input. */
+
+#include "xsane.h"
+#include "xsane-base64.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#define MIME_LINE_CHARS 76
+
+int DBG_LEVEL = 0;
+
+static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static size_t reference_encode(unsigned char *in, size_t len, char *out)
+/* takes 6 bits at a time, pads the last group with zero bits and '=' */
+{
+ size_t bits = len * 8;
+ size_t bit, n = 0, line_chars = 0;
+ int val, i;
+
+  for (bit = 0; bit < bits; bit += 6)
+  {
+    val = 0;
+    for (i = 0; i < 6; i++)
+    {
+      val <<= 1;
+      if ((bit + i < bits) && (in[(bit + i) / 8] & (0x80 >> ((bit + i) % 8))))
+      {
+        val |= 1;
+      }
+    }
+
+    out[n++] = base64_chars[val];
+    line_chars++;
+
+    if (bit + 6 >= bits) /* last character */
+    {
+      while (line_chars % 4)
+      {
+        out[n++] = '=';
+        line_chars++;
+      }
+    }
+
+    if ((line_chars == MIME_LINE_CHARS) || (bit + 6 >= bits))
+    {
+      out[n++] = '\r';
+      out[n++] = '\n';
+      line_chars = 0;
+    }
+  }
+
+ return n;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static long decode(char *in, size_t len, unsigned char *out)
+/* returns the number of bytes or -1 for a line that is too long or a wrong character */
+{
+ size_t i, n = 0, line_chars = 0;
+ unsigned int val = 0;
+ int bits = 0;
+ const char *c;
+
+  for (i = 0; i < len; i++)
+  {
+    if ((in[i] == '\r') && (i + 1 < len) && (in[i + 1] == '\n'))
+    {
+      i++;
+      line_chars = 0;
+     continue;
+    }
+
+    if (++line_chars > MIME_LINE_CHARS)
+    {
+     return -1;
+    }
+
+    if (in[i] == '=')
+    {
+     continue;
+    }
+
+    c = strchr(base64_chars, in[i]);
+    if (!c || !in[i])
+    {
+     return -1;
+    }
+
+    val = (val << 6) | (c - base64_chars);
+    bits += 6;
+
+    if (bits >= 8)
+    {
+      bits -= 8;
+      out[n++] = val >> bits;
+    }
+  }
+
+ return n;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int base64_test(size_t len)
+{
+ FILE *file;
+ unsigned char *data, *block, *decoded;
+ char *expected, *out;
+ size_t chars = (len / 3 + 1) * 4 + (len / XSANE_BASE64_LINE_BYTES + 1) * 2;
+ size_t expected_len, out_len, block_len, i;
+ int errors = 0;
+
+  data     = malloc(len + 1);
+  decoded  = malloc(len + 1);
+  block    = malloc(XSANE_BASE64_BLOCK_SIZE);
+  expected = malloc(chars);
+  out      = malloc(chars + XSANE_BASE64_BLOCK_CHARS);
+  file     = tmpfile();
+
+  if (!data || !decoded || !block || !expected || !out || !file)
+  {
+    printf("can not create test data\n");
+   return 1;
+  }
+
+  for (i = 0; i < len; i++)
+  {
+    data[i] = (i * 131 + (i >> 8)) & 0xff;
+  }
+
+  fwrite(data, 1, len, file);
+  rewind(file);
+
+  /* the loop of write_base64 */
+  out_len = 0;
+  do
+  {
+    block_len = xsane_base64_read_block(file, block);
+    out_len += xsane_base64_encode_block(block, block_len, out + out_len);
+  }
+  while (block_len == XSANE_BASE64_BLOCK_SIZE);
+
+  expected_len = reference_encode(data, len, expected);
+
+  if ((out_len != expected_len) || memcmp(out, expected, out_len))
+  {
+    printf("%lu bytes: output differs from the reference encoder\n", (unsigned long) len);
+    errors++;
+  }
+  else if ((decode(out, out_len, decoded) != (long) len) || memcmp(decoded, data, len))
+  {
+    printf("%lu bytes: decoded output differs from the input\n", (unsigned long) len);
+    errors++;
+  }
+
+  fclose(file);
+  free(data);
+  free(decoded);
+  free(block);
+  free(expected);
+  free(out);
+
+ return errors;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+ static const size_t block_lengths[] = { XSANE_BASE64_BLOCK_SIZE, 2 * XSANE_BASE64_BLOCK_SIZE };
+ size_t len;
+ int i;
+ int errors = 0;
+
+  for (len = 0; len <= 200; len++)
+  {
+    errors += base64_test(len);
+  }
+
+  for (i = 0; i < sizeof(block_lengths) / sizeof(size_t); i++)
+  {
+    errors += base64_test(block_lengths[i] - 1);
+    errors += base64_test(block_lengths[i]);
+    errors += base64_test(block_lengths[i] + 1);
+  }
+
+  printf("xsane-base64-test: %s\n", errors ? "FAILED" : "ok");
+
+ return errors ? 1 : 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
@@ -0,0 +1,309 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-despeckle-test.c
+
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* Compares the histogram despeckle filter with the sorting implementation it replaced on */
+/* the pnm images in the tests directory. The reference is the old code with its two bugs */
+/* fixed: the old line cache did not contain the window lines after the first 2*radius lines, */
+/* and the window included one line / sample behind the image. The lines are calculated in */
+/* chunks and bands like xsane_save_filter_lines does it, so only the needed input lines */
+/* are in memory and several histograms are used at the same time. */
+
+#include "xsane.h"
+#include "xsane-despeckle.h"
+#include <ctype.h>
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#define TEST_BANDS 3
+#define TEST_BAND_LINES 5
+
+int DBG_LEVEL = 0;
+
+static const char *test_images[] = { "despeckle-gray.pgm", "despeckle-color.ppm", "despeckle-gray16.pgm", "despeckle-color16.ppm" };
+static const int test_radius[] = { 1, 2, 4, 40 };
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int read_pnm_value(FILE *file)
+/* reads a decimal header value, skips whitespace and comments */
+{
+ int c, val = 0;
+
+  do
+  {
+    c = getc(file);
+    if (c == '#')
+    {
+      while ((c != '\n') && (c != EOF))
+      {
+        c = getc(file);
+      }
+    }
+  } while (isspace(c));
+
+  while (isdigit(c))
+  {
+    val = val * 10 + c - '0';
+    c = getc(file);
+  }
+
+ return val;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static unsigned char *read_pnm(const char *filename, Image_info *image_info)
+/* returns the image data with 16 bit samples in machine byte order */
+{
+ FILE *file;
+ unsigned char *image;
+ size_t samples, i;
+ int maxval;
+
+  file = fopen(filename, "rb");
+  if (!file)
+  {
+    printf("can not open %s\n", filename);
+   return NULL;
+  }
+
+  memset(image_info, 0, sizeof(Image_info));
+
+  if (getc(file) != 'P')
+  {
+    printf("%s is not a pnm file\n", filename);
+    fclose(file);
+   return NULL;
+  }
+
+  image_info->channels     = (getc(file) == '6') ? 3 : 1;
+  image_info->image_width  = read_pnm_value(file);
+  image_info->image_height = read_pnm_value(file);
+  maxval                   = read_pnm_value(file);
+  image_info->depth        = (maxval > 255) ? 16 : 8;
+
+  samples = (size_t) image_info->image_width * image_info->image_height * image_info->channels;
+  image = malloc(samples * image_info->depth / 8);
+
+  if (!image || (fread(image, image_info->depth / 8, samples, file) != samples))
+  {
+    printf("can not read %s\n", filename);
+    free(image);
+    fclose(file);
+   return NULL;
+  }
+
+  fclose(file);
+
+  if (image_info->depth == 16) /* pnm files are big endian */
+  {
+    for (i = 0; i < samples; i++)
+    {
+      ((guint16 *) image)[i] = (image[2 * i] << 8) | image[2 * i + 1];
+    }
+  }
+
+ return image;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void reference_despeckle(unsigned char *image, Image_info *image_info, int radius, unsigned char *out)
+/* the sorting despeckle filter of xsane 0.999 for an image in memory */
+{
+ int channels = image_info->channels;
+ int color_width = image_info->image_width * channels;
+ int color_radius = radius * channels;
+ guint16 *color_cache;
+ guint16 *color_cache_ptr;
+ int x, y, sx, sy, xmin, xmax, ymin, ymax;
+ int count, d, i, j, val;
+
+  color_cache = malloc(sizeof(guint16) * (2 * radius + 1) * (2 * radius + 1));
+
+  for (y = 0; y < image_info->image_height; y++)
+  {
+    ymin = MAX(y - radius, 0);
+    ymax = MIN(y + radius, image_info->image_height - 1);
+
+    for (x = 0; x < color_width; x++)
+    {
+      xmin = x - color_radius;
+      xmax = x + color_radius;
+
+      if (xmin < 0)
+      {
+        xmin = x % channels;
+      }
+
+      if (xmax >= color_width)
+      {
+        xmax = color_width - 1;
+      }
+
+      color_cache_ptr = color_cache;
+
+      for (sy = ymin; sy <= ymax; sy++)
+      {
+        for (sx = xmin; sx <= xmax; sx += channels)
+        {
+          if (image_info->depth == 8)
+          {
+            *color_cache_ptr++ = image[(size_t) sy * color_width + sx];
+          }
+          else
+          {
+            *color_cache_ptr++ = ((guint16 *) image)[(size_t) sy * color_width + sx];
+          }
+        }
+      }
+
+      count = color_cache_ptr - color_cache;
+
+      for (d = count / 2; d > 0; d = d / 2) /* shell sort */
+      {
+        for (i = d; i < count; i++)
+        {
+          for (j = i - d, color_cache_ptr = color_cache + j; j >= 0 && color_cache_ptr[0] > color_cache_ptr[d]; j -= d, color_cache_ptr -= d)
+          {
+            val                = color_cache_ptr[0];
+            color_cache_ptr[0] = color_cache_ptr[d];
+            color_cache_ptr[d] = val;
+          }
+        }
+      }
+
+      if (image_info->depth == 8)
+      {
+        out[(size_t) y * color_width + x] = color_cache[count / 2];
+      }
+      else
+      {
+        ((guint16 *) out)[(size_t) y * color_width + x] = color_cache[count / 2];
+      }
+    }
+  }
+
+  free(color_cache);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void chunked_despeckle(unsigned char *image, Image_info *image_info, int radius, unsigned char *out)
+/* calculates the image in chunks of TEST_BANDS bands, each band gets a copy of the input */
+/* lines it needs, so reading other lines gives wrong results */
+{
+ XsaneDespeckle *despeckle;
+ int height = image_info->image_height;
+ size_t line_size = (size_t) image_info->image_width * image_info->channels * image_info->depth / 8;
+ unsigned char *in;
+ int first, band, band_first, band_end, in_first, in_end;
+
+  despeckle = xsane_despeckle_new(image_info, radius, TEST_BANDS);
+  in = malloc((TEST_BAND_LINES + 2 * radius) * line_size);
+
+  for (first = 0; first < height; first += TEST_BANDS * TEST_BAND_LINES)
+  {
+    for (band = 0; band < TEST_BANDS; band++)
+    {
+      band_first = first + band * TEST_BAND_LINES;
+      band_end   = MIN(band_first + TEST_BAND_LINES, height);
+
+      if (band_first >= band_end)
+      {
+        break;
+      }
+
+      in_first = MAX(band_first - radius, 0);
+      in_end   = MIN(band_end + radius, height);
+
+      memset(in, 0xaa, (TEST_BAND_LINES + 2 * radius) * line_size);
+      memcpy(in, image + in_first * line_size, (in_end - in_first) * line_size);
+
+      xsane_despeckle_lines(despeckle, band, in, in_first, out + band_first * line_size, band_first, band_end);
+    }
+  }
+
+  free(in);
+  xsane_despeckle_free(despeckle);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int despeckle_test(const char *srcdir, const char *name, int radius)
+{
+ Image_info image_info;
+ unsigned char *image, *expected, *out;
+ char filename[PATH_MAX];
+ size_t size;
+ int errors = 0;
+
+  snprintf(filename, sizeof(filename), "%s/%s", srcdir, name);
+
+  image = read_pnm(filename, &image_info);
+  if (!image)
+  {
+   return 1;
+  }
+
+  size = (size_t) image_info.image_width * image_info.image_height * image_info.channels * image_info.depth / 8;
+  expected = malloc(size);
+  out = malloc(size);
+
+  reference_despeckle(image, &image_info, radius, expected);
+  chunked_despeckle(image, &image_info, radius, out);
+
+  if (memcmp(out, expected, size))
+  {
+    printf("%s, radius %d: output differs from the reference\n", name, radius);
+    errors++;
+  }
+
+  free(image);
+  free(expected);
+  free(out);
+
+ return errors;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+ const char *srcdir = (argc > 1) ? argv[1] : ".";
+ int i, j;
+ int errors = 0;
+
+  for (i = 0; i < sizeof(test_images) / sizeof(char *); i++)
+  {
+    for (j = 0; j < sizeof(test_radius) / sizeof(int); j++)
+    {
+      errors += despeckle_test(srcdir, test_images[i], test_radius[j]);
+    }
+  }
+
+  printf("xsane-despeckle-test: %s\n", errors ? "FAILED" : "ok");
+
+ return errors ? 1 : 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
@@ -0,0 +1,180 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-lut-bench.c
+
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* Measures the throughput (input MB/s, best of several runs) of the lut kernels and of the */
+/* per sample gamma loop with a channel counter that was used before the lut module. */
+/* The buffer is processed in lines of a 600 dpi A4 scan like in the scan pipeline. */
+
+#include "xsane.h"
+#include "xsane-lut.h"
+#include <sys/time.h>
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#define BENCH_LINE_PIXELS 5100
+#define BENCH_LINES 400
+#define BENCH_RUNS 7
+
+int DBG_LEVEL = 0;
+
+static const char *kernel_name[] = { "auto", "scalar", "sse2", "avx2" };
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static double bench_time(void)
+{
+ struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+ return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void bench_legacy(void *buf, int samples, int channels, int input_depth, int output_depth, SANE_Int **gamma)
+/* the loop of the scan code before the lut module: one channel counter per sample */
+{
+ int pixel_channel = 0;
+ int i;
+
+  for (i = 0; i < samples; i++)
+  {
+    if (input_depth == 8)
+    {
+      ((guint8 *) buf)[i] = gamma[pixel_channel][((guint8 *) buf)[i]];
+    }
+    else if (output_depth == 8)
+    {
+      ((guint8 *) buf)[i] = gamma[pixel_channel][((guint16 *) buf)[i]] >> 8;
+    }
+    else
+    {
+      ((guint16 *) buf)[i] = gamma[pixel_channel][((guint16 *) buf)[i]];
+    }
+
+    pixel_channel++;
+    if (pixel_channel >= channels)
+    {
+      pixel_channel = 0;
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void bench_format(int channels, int input_depth, int output_depth)
+{
+ int line_samples = BENCH_LINE_PIXELS * channels;
+ size_t size = (size_t) line_samples * BENCH_LINES * (input_depth / 8);
+ int entries = 1 << input_depth;
+ SANE_Int *gamma[XSANE_LUT_MAX_CHANNELS];
+ XsaneLut *lut;
+ unsigned char *buf;
+ double t, best;
+ int kernel, run, line, c, i;
+
+  buf = malloc(size);
+  lut = xsane_lut_new(channels, input_depth, input_depth, output_depth);
+
+  for (i = 0; i < size; i++)
+  {
+    buf[i] = rand();
+  }
+
+  for (c = 0; c < channels; c++)
+  {
+    gamma[c] = malloc(entries * sizeof(SANE_Int));
+
+    for (i = 0; i < entries; i++)
+    {
+      gamma[c][i] = (i * 7 + c) & (entries - 1);
+    }
+
+    xsane_lut_set_table(lut, c, gamma[c]);
+  }
+
+  printf("%d channels %2d->%2d bit:", channels, input_depth, output_depth);
+
+  best = 0;
+  for (run = 0; run < BENCH_RUNS; run++)
+  {
+    t = bench_time();
+    for (line = 0; line < BENCH_LINES; line++)
+    {
+      bench_legacy(buf + (size_t) line * line_samples * (input_depth / 8), line_samples, channels, input_depth, output_depth, gamma);
+    }
+    t = bench_time() - t;
+    best = MAX(best, size / t / 1e6);
+  }
+  printf("  legacy %6.0f", best);
+
+  for (kernel = XSANE_LUT_KERNEL_SCALAR; kernel <= XSANE_LUT_KERNEL_AVX2; kernel++)
+  {
+    if (xsane_lut_set_kernel(kernel))
+    {
+      continue;
+    }
+
+    best = 0;
+    for (run = 0; run < BENCH_RUNS; run++)
+    {
+      t = bench_time();
+      for (line = 0; line < BENCH_LINES; line++)
+      {
+        xsane_lut_apply(lut, buf + (size_t) line * line_samples * (input_depth / 8), buf + (size_t) line * line_samples * (output_depth / 8),
+                        line_samples, 0);
+      }
+      t = bench_time() - t;
+      best = MAX(best, size / t / 1e6);
+    }
+    printf("  %s %6.0f", kernel_name[kernel], best);
+  }
+
+  printf("  MB/s\n");
+
+  for (c = 0; c < channels; c++)
+  {
+    free(gamma[c]);
+  }
+  xsane_lut_free(lut);
+  free(buf);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+ static const int bench_channels[] = { 1, 3, 4 };
+ int i;
+
+  for (i = 0; i < sizeof(bench_channels) / sizeof(int); i++)
+  {
+    bench_format(bench_channels[i], 8, 8);
+    bench_format(bench_channels[i], 16, 8);
+    bench_format(bench_channels[i], 16, 16);
+  }
+
+ return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
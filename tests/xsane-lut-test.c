@@ -0,0 +1,167 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-lut-test.c
+
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* Compares every lut kernel the cpu supports with a plain table lookup for all lut */
+/* formats. The data is passed in pieces of odd size, so the kernels have to continue */
+/* in the middle of a pixel and in the middle of a block, in and out are the same buffer. */
+
+#include "xsane.h"
+#include "xsane-lut.h"
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#define SAMPLES 4099
+
+int DBG_LEVEL = 0;
+
+static const char *kernel_name[] = { "auto", "scalar", "sse2", "avx2" };
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int lut_test(int kernel, int channels, int input_depth, int input_bits, int output_depth)
+{
+ XsaneLut *lut;
+ SANE_Int *table;
+ guint16 in[SAMPLES];
+ guint16 expected[SAMPLES];
+ guint16 buf[SAMPLES];
+ int entries = 1 << input_bits;
+ int shift = input_depth - input_bits;
+ int c, i, pos, len, channel;
+ int errors = 0;
+
+  lut = xsane_lut_new(channels, input_depth, input_bits, output_depth);
+  table = malloc(entries * sizeof(SANE_Int));
+
+  if (!lut || !table)
+  {
+    printf("out of memory\n");
+   return 1;
+  }
+
+  for (c = 0; c < channels; c++)
+  {
+    for (i = 0; i < entries; i++)
+    {
+      table[i] = (entries - 1 - i + c * 37) & (entries - 1);
+    }
+    xsane_lut_set_table(lut, c, table);
+  }
+
+  for (i = 0; i < SAMPLES; i++)
+  {
+    if (input_depth == 8)
+    {
+      ((guint8 *) in)[i] = rand();
+    }
+    else
+    {
+      in[i] = rand();
+    }
+  }
+
+  /* expected values from the converted tables */
+  for (i = 0; i < SAMPLES; i++)
+  {
+    c = i % channels;
+
+    if (output_depth == 8)
+    {
+      ((guint8 *) expected)[i] = lut->table[c * entries + (((input_depth == 8) ? ((guint8 *) in)[i] : in[i]) >> shift)];
+    }
+    else
+    {
+      expected[i] = ((guint16 *) lut->table)[c * entries + (in[i] >> shift)];
+    }
+  }
+
+  memcpy(buf, in, sizeof(buf));
+  channel = 0;
+
+  for (pos = 0; pos < SAMPLES; pos += len)
+  {
+    len = MIN(1 + (pos * 7) % 61, SAMPLES - pos);
+
+    if (output_depth == 8)
+    {
+      channel = xsane_lut_apply(lut, (guint8 *) buf + pos * input_depth / 8, (guint8 *) buf + pos, len, channel);
+    }
+    else
+    {
+      channel = xsane_lut_apply(lut, buf + pos, buf + pos, len, channel);
+    }
+
+    if (channel != (pos + len) % channels)
+    {
+      printf("%s kernel, %d channels %d->%d bit: wrong channel %d after sample %d\n",
+             kernel_name[kernel], channels, input_depth, output_depth, channel, pos + len);
+      errors++;
+     break;
+    }
+  }
+
+  if (memcmp(buf, expected, SAMPLES * output_depth / 8))
+  {
+    printf("%s kernel, %d channels %d->%d bit (%d index bits): wrong output\n",
+           kernel_name[kernel], channels, input_depth, output_depth, input_bits);
+    errors++;
+  }
+
+  free(table);
+  xsane_lut_free(lut);
+
+ return errors;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+ int kernel, channels;
+ int errors = 0;
+
+  for (kernel = XSANE_LUT_KERNEL_SCALAR; kernel <= XSANE_LUT_KERNEL_AVX2; kernel++)
+  {
+    if (xsane_lut_set_kernel(kernel))
+    {
+      printf("%s kernel not supported, skipped\n", kernel_name[kernel]);
+     continue;
+    }
+
+    for (channels = 1; channels <= XSANE_LUT_MAX_CHANNELS; channels++)
+    {
+      errors += lut_test(kernel, channels, 8, 8, 8);
+      errors += lut_test(kernel, channels, 8, 6, 8);
+      errors += lut_test(kernel, channels, 16, 8, 8);
+      errors += lut_test(kernel, channels, 16, 12, 8);
+      errors += lut_test(kernel, channels, 16, 16, 8);
+      errors += lut_test(kernel, channels, 16, 16, 16);
+      errors += lut_test(kernel, channels, 16, 12, 16);
+    }
+  }
+
+  printf("xsane-lut-test: %s\n", errors ? "FAILED" : "ok");
+
+ return errors ? 1 : 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
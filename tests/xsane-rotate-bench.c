@@ -0,0 +1,188 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-rotate-bench.c
+
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* Measures the throughput (image MB/s, best of several runs) of the 90 and 270 degree rotation */
+/* of a 300 dpi A4 image in memory: the pixel by pixel column walk of the code before the tiled */
+/* rotation, the tiled rotation with one thread and with the bands distributed to all cpus. */
+/* The results of the tiled rotation are compared with the column walk. */
+
+#include "xsane.h"
+#include "xsane-parallel.h"
+#include "xsane-rotate.h"
+#include <sys/time.h>
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#define BENCH_PIXEL_WIDTH 2480
+#define BENCH_PIXEL_HEIGHT 3508
+#define BENCH_RUNS 5
+
+int DBG_LEVEL = 0;
+Preferences preferences; /* filter_threads = 0: one thread per cpu */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static double bench_time(void)
+{
+ struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+ return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void bench_legacy(unsigned char *image, int pixel_width, int pixel_height, int bytespp, int rotation, unsigned char *out)
+/* the loop of the rotation before the tiles: one output pixel after the other walking down a column */
+{
+ int x, y;
+
+  if (rotation == 1) /* 90 degree */
+  {
+    for (x = 0; x < pixel_width; x++)
+    {
+      for (y = pixel_height - 1; y >= 0; y--)
+      {
+        memcpy(out, image + ((size_t) y * pixel_width + x) * bytespp, bytespp);
+        out += bytespp;
+      }
+    }
+  }
+  else /* 270 degree */
+  {
+    for (x = pixel_width - 1; x >= 0; x--)
+    {
+      for (y = 0; y < pixel_height; y++)
+      {
+        memcpy(out, image + ((size_t) y * pixel_width + x) * bytespp, bytespp);
+        out += bytespp;
+      }
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int bench_format(const char *name, int bytespp, int rotation)
+{
+ size_t size = (size_t) BENCH_PIXEL_WIDTH * BENCH_PIXEL_HEIGHT * bytespp;
+ int bands = xsane_parallel_threads();
+ unsigned char *image, *out, *expected;
+ XsaneRotate rotate;
+ double t, best;
+ int run, errors = 0;
+ size_t i;
+
+  image    = malloc(size);
+  out      = malloc(size);
+  expected = malloc(size);
+
+  if (!image || !out || !expected)
+  {
+    printf("%s %3d degree: out of memory\n", name, rotation * 90);
+    free(image);
+    free(out);
+    free(expected);
+   return 1;
+  }
+
+  for (i = 0; i < size; i++)
+  {
+    image[i] = rand();
+  }
+
+  printf("%s %3d degree:", name, rotation * 90);
+
+  best = 0;
+  for (run = 0; run < BENCH_RUNS; run++)
+  {
+    t = bench_time();
+    bench_legacy(image, BENCH_PIXEL_WIDTH, BENCH_PIXEL_HEIGHT, bytespp, rotation, expected);
+    t = bench_time() - t;
+    best = MAX(best, size / t / 1e6);
+  }
+  printf("  legacy %6.0f", best);
+
+  best = 0;
+  for (run = 0; run < BENCH_RUNS; run++)
+  {
+    memset(out, 0, size);
+    t = bench_time();
+    xsane_rotate_lines(image, BENCH_PIXEL_WIDTH, BENCH_PIXEL_HEIGHT, bytespp, rotation, out, 0, BENCH_PIXEL_WIDTH);
+    t = bench_time() - t;
+    best = MAX(best, size / t / 1e6);
+  }
+  printf("  tiled %6.0f", best);
+  errors += (memcmp(out, expected, size) != 0);
+
+  rotate.image        = image;
+  rotate.stride       = (long) BENCH_PIXEL_WIDTH * bytespp;
+  rotate.x_origin     = 0;
+  rotate.y_origin     = 0;
+  rotate.rotation     = rotation;
+  rotate.pixel_width  = BENCH_PIXEL_WIDTH;
+  rotate.pixel_height = BENCH_PIXEL_HEIGHT;
+  rotate.bytespp      = bytespp;
+  rotate.out_width    = BENCH_PIXEL_HEIGHT;
+  rotate.out          = out;
+  rotate.first_line   = 0;
+  rotate.end_line     = BENCH_PIXEL_WIDTH;
+
+  best = 0;
+  for (run = 0; run < BENCH_RUNS; run++)
+  {
+    memset(out, 0, size);
+    t = bench_time();
+    xsane_parallel_run(xsane_rotate_band, &rotate, bands);
+    t = bench_time() - t;
+    best = MAX(best, size / t / 1e6);
+  }
+  printf("  %d threads %6.0f", bands, best);
+  errors += (memcmp(out, expected, size) != 0);
+
+  printf("  MB/s%s\n", (errors) ? "  FAILED: result differs" : "");
+
+  free(image);
+  free(out);
+  free(expected);
+
+ return errors;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+ int errors = 0;
+
+  errors += bench_format(" 8 bit gray", 1, 1);
+  errors += bench_format(" 8 bit gray", 1, 3);
+  errors += bench_format("24 bit rgb ", 3, 1);
+  errors += bench_format("24 bit rgb ", 3, 3);
+  errors += bench_format("48 bit rgb ", 6, 1);
+  errors += bench_format("48 bit rgb ", 6, 3);
+
+ return (errors) ? 1 : 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
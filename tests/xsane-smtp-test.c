@@ -0,0 +1,333 @@
+/* xsane -- a graphical (X11, gtk) scanner-oriented SANE frontend
+
+   xsane-smtp-test.c
+
+   This file is part of the XSANE package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+/* Runs the smtp client against a stand-in server in a child process, once with and once */
+/* without the PIPELINING extension. The server splits its multiline EHLO reply over several */
+/* writes, checks that the envelope commands are pipelined only when the extension has been */
+/* announced and rejects receivers that start with "bad@". After the rejected receiver the */
+/* client closes the connection and sends the next email through a new connection like */
+/* xsane_email_send_process does. */
+
+#include "xsane.h"
+#include "xsane-text.h"
+#include "xsane-smtp.h"
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <poll.h>
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+#define SERVER_CONNECTIONS 2
+#define SERVER_MESSAGES 2
+#define SERVER_TIMEOUT 2000 /* ms to wait for pipelined commands */
+
+int DBG_LEVEL = 0;
+struct Xsane xsane;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+void xsane_front_gtk_email_project_update_lockfile_status(void)
+/* the status is checked by the test */
+{
+}
+
+#ifdef XSANE_ACTIVATE_EMAIL
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static char server_buffer[16384];
+static int server_buffer_len;
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int server_read_line(int fd, char *line, size_t size, int timeout)
+/* returns the length of the line without CRLF, -1 when the connection is closed or the timeout is over */
+{
+ struct pollfd pfd;
+ char *end;
+ int len;
+
+  while (!(end = memchr(server_buffer, '\n', server_buffer_len)))
+  {
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    if ( (poll(&pfd, 1, timeout) <= 0) ||
+         ((len = read(fd, server_buffer + server_buffer_len, sizeof(server_buffer) - server_buffer_len)) <= 0) )
+    {
+     return -1;
+    }
+    server_buffer_len += len;
+  }
+
+  len = end - server_buffer + 1;
+  snprintf(line, size, "%.*s", (len >= 2) ? len - 2 : 0, server_buffer);
+  server_buffer_len -= len;
+  memmove(server_buffer, server_buffer + len, server_buffer_len);
+
+ return strlen(line);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static void server_write(int fd, char *reply)
+{
+  write_all(fd, reply, strlen(reply));
+  usleep(10000); /* the client gets each write with a separate read */
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int server_connection(int fd, int pipelining, int *messages)
+/* returns the number of protocol errors of the client */
+{
+ char line[1024];
+ char replies[1024];
+ int errors = 0;
+
+  server_buffer_len = 0;
+  server_write(fd, "220 test ESMTP\r\n");
+
+  while (server_read_line(fd, line, sizeof(line), -1) >= 0)
+  {
+    if ((!pipelining) && (server_buffer_len)) /* next command sent without waiting for the reply */
+    {
+      printf("server: \"%s\" was followed by another command without pipelining\n", line);
+      errors++;
+    }
+
+    if ((!strncasecmp(line, "EHLO", 4)) || (!strncasecmp(line, "HELO", 4)))
+    {
+      server_write(fd, "250-test.local\r\n250-SIZE");
+      server_write(fd, " 10240000\r\n");
+      if (pipelining)
+      {
+        server_write(fd, "250-PIPELINING\r\n");
+      }
+      server_write(fd, "250 8BITMIME\r\n");
+    }
+    else if (!strncasecmp(line, "MAIL", 4))
+    {
+      strcpy(replies, "250 sender ok\r\n");
+
+      if (pipelining) /* the replies are sent when all envelope commands have been received */
+      {
+        do
+        {
+          if (server_read_line(fd, line, sizeof(line), SERVER_TIMEOUT) < 0)
+          {
+            printf("server: envelope commands have not been pipelined\n");
+           return errors + 1;
+          }
+
+          if (!strncasecmp(line, "RCPT", 4))
+          {
+            strcat(replies, (strstr(line, "<bad@")) ? "550 no such user\r\n" : "250 receiver ok\r\n");
+          }
+        }
+        while (strncasecmp(line, "DATA", 4));
+
+        strcat(replies, "354 end data with .\r\n");
+      }
+
+      server_write(fd, replies);
+    }
+    else if (!strncasecmp(line, "RCPT", 4))
+    {
+      server_write(fd, (strstr(line, "<bad@")) ? "550 no such user\r\n" : "250 receiver ok\r\n");
+    }
+    else if (!strncasecmp(line, "DATA", 4))
+    {
+      server_write(fd, "354 end data with .\r\n");
+    }
+    else if (!strncasecmp(line, "QUIT", 4))
+    {
+      server_write(fd, "221 bye\r\n");
+     break;
+    }
+    else
+    {
+      printf("server: unknown command \"%s\"\n", line);
+      server_write(fd, "500 unknown command\r\n");
+      errors++;
+     continue;
+    }
+
+    if ((line[0] == 'D') || (line[0] == 'd')) /* message data until "." */
+    {
+      while ((server_read_line(fd, line, sizeof(line), -1) >= 0) && (strcmp(line, ".")))
+      {
+      }
+
+      if (!strcmp(line, "."))
+      {
+        (*messages)++;
+        server_write(fd, "250 queued\r\n");
+      }
+    }
+  }
+
+ return errors;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int server(int fd_listen, int pipelining)
+/* child process: serves SERVER_CONNECTIONS connections, returns the number of errors */
+{
+ int fd, i;
+ int messages = 0;
+ int errors = 0;
+
+  for (i = 0; i < SERVER_CONNECTIONS; i++)
+  {
+    fd = accept(fd_listen, NULL, NULL);
+    if (fd < 0)
+    {
+     return errors + 1;
+    }
+
+    errors += server_connection(fd, pipelining, &messages);
+    close(fd);
+  }
+
+  if (messages != SERVER_MESSAGES)
+  {
+    printf("server: %d messages received instead of %d\n", messages, SERVER_MESSAGES);
+    errors++;
+  }
+
+ return errors;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int send_message(int fd_socket, char *to, char *subject)
+{
+ char buf[256];
+
+  if (write_smtp_header(fd_socket, "sender@test.local", to))
+  {
+   return -1;
+  }
+
+  snprintf(buf, sizeof(buf), "Subject: %s\r\n\r\ntest\r\n", subject);
+  write_all(fd_socket, buf, strlen(buf));
+
+ return write_smtp_footer(fd_socket);
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+static int smtp_test(int pipelining)
+{
+ struct sockaddr_in sin;
+ socklen_t sin_len = sizeof(sin);
+ int fd_listen, fd_socket, status;
+ int errors = 0;
+ pid_t pid;
+
+  fd_listen = socket(AF_INET, SOCK_STREAM, 0);
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if ( (fd_listen < 0) || bind(fd_listen, (struct sockaddr *) &sin, sizeof(sin)) || listen(fd_listen, 1) ||
+       getsockname(fd_listen, (struct sockaddr *) &sin, &sin_len) )
+  {
+    printf("can not create server socket\n");
+   return 1;
+  }
+
+  fflush(stdout);
+  pid = fork();
+  if (pid == 0)
+  {
+    status = server(fd_listen, pipelining);
+    fflush(stdout);
+    _exit(status ? 1 : 0);
+  }
+  close(fd_listen);
+
+  fd_socket = smtp_open("127.0.0.1", ntohs(sin.sin_port), EMAIL_AUTH_NONE, "", "");
+
+  if ((fd_socket < 0) || send_message(fd_socket, "first@test.local, second@test.local", "first"))
+  {
+    printf("%s: first email not sent\n", pipelining ? "pipelining" : "no pipelining");
+    errors++;
+  }
+  else if ( (send_message(fd_socket, "first@test.local, bad@test.local", "rejected") != -1) ||
+            (!xsane.email_status) || (strcmp(xsane.email_status, TEXT_EMAIL_STATUS_SMTP_ERR_RCPT)) )
+  {
+    printf("%s: rejected receiver not reported\n", pipelining ? "pipelining" : "no pipelining");
+    errors++;
+  }
+
+  if (fd_socket >= 0)
+  {
+    close(fd_socket); /* the server may wait for data, so the connection is not reused */
+  }
+
+  fd_socket = smtp_open("127.0.0.1", ntohs(sin.sin_port), EMAIL_AUTH_NONE, "", "");
+
+  if ((fd_socket < 0) || send_message(fd_socket, "first@test.local", "reconnected"))
+  {
+    printf("%s: email after reconnect not sent\n", pipelining ? "pipelining" : "no pipelining");
+    errors++;
+  }
+
+  if (fd_socket >= 0)
+  {
+    smtp_close(fd_socket);
+  }
+
+  if ((waitpid(pid, &status, 0) != pid) || (!WIFEXITED(status)) || (WEXITSTATUS(status)))
+  {
+    printf("%s: server reported errors\n", pipelining ? "pipelining" : "no pipelining");
+    errors++;
+  }
+
+ return errors;
+}
+
+#endif
+
+/* ---------------------------------------------------------------------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+ int errors = 0;
+
+#ifdef XSANE_ACTIVATE_EMAIL
+  errors += smtp_test(TRUE);
+  errors += smtp_test(FALSE);
+
+  printf("xsane-smtp-test: %s\n", errors ? "FAILED" : "ok");
+#else
+  printf("xsane-smtp-test: email is not activated, skipped\n");
+#endif
+
+ return errors ? 1 : 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------------- */